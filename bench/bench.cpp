@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "diagnostic.h"
+#include "driver.h"
+#include "json.h"
+#include "lexer.h"
+#include "module.h"
+#include "parser.h"
+
+/*
+  Front end throughput over a corpus, written by gen_corpus.py or not. Each phase runs
+  `--iterations` times and keeps its fastest run, sources are served from overlays so
+  no phase pays for reading files or writing interfaces
+*/
+
+static void PrintUsage(const char *program)
+{
+  std::cerr << "Usage: " << program << " [options] <file.zr|dir>..." << std::endl;
+  std::cerr << "  --iterations=<n>  runs of each phase, the fastest is reported, defaults to 5" << std::endl;
+  std::cerr << "  -j <n>            threads of the checker, defaults to 1" << std::endl;
+  std::cerr << "Prints a JSON report to stdout and a summary to stderr" << std::endl;
+}
+
+// what every phase goes through
+class Corpus
+{
+public:
+  std::vector<std::string> m_Files;
+  std::vector<std::string> m_Contents;
+  size_t m_Bytes;
+
+  Corpus() : m_Files(), m_Contents(), m_Bytes(0) {};
+
+  // a table holding the corpus as overlays, nothing of it loaded yet
+  void Serve(ModuleManager &modManager) const
+  {
+    modManager.m_PreferInterfaces = false;
+    for (size_t i = 0; i < m_Files.size(); ++i)
+    {
+      modManager.m_Overlays[modManager.m_Resolver.Canonical(m_Files.at(i))] = m_Contents.at(i);
+    }
+  }
+};
+
+// the fastest of `iterations` runs of `phase`, in seconds
+template <typename Phase>
+static double Fastest(size_t iterations, Phase phase)
+{
+  double fastest = 0;
+  for (size_t i = 0; i < iterations; ++i)
+  {
+    auto start = std::chrono::steady_clock::now();
+    phase();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fastest = 0 == i ? seconds : std::min(fastest, seconds);
+  }
+  return fastest;
+}
+
+static size_t CountStatements(const std::vector<Ptr<Stmt>> &stmts)
+{
+  size_t count = stmts.size();
+  for (auto &stmt : stmts)
+  {
+    if (StmtT::Fun == stmt->GetType())
+    {
+      // functions the runtime provides have no body
+      if (auto body = CastPtr<FunStmt>(stmt)->GetBody())
+      {
+        count += CountStatements(body->GetStatements());
+      }
+    }
+    else if (StmtT::Block == stmt->GetType())
+    {
+      count += CountStatements(CastPtr<BlockStmt>(stmt)->GetStatements());
+    }
+  }
+  return count;
+}
+
+// loads every file of the corpus into `modManager`, parsed when `parse` says so
+static std::vector<Ptr<Module>> LoadAll(ModuleManager &modManager, const Corpus &corpus, bool parse)
+{
+  std::vector<Ptr<Module>> modules;
+  for (auto &file : corpus.m_Files)
+  {
+    auto module = modManager.Load(file).unwrap();
+    bool cycle = false;
+    if (parse && modManager.Claim(module, ModuleState::Loaded, cycle))
+    {
+      auto parseError = Parser(module, modManager).Parse();
+      modManager.Finish(module, parseError.has_value() ? ModuleState::Invalid : ModuleState::Parsed);
+    }
+    modules.push_back(module);
+  }
+  return modules;
+}
+
+static Json Phase(const std::string &name, double seconds, size_t bytes, size_t items, const std::string &itemsName)
+{
+  auto phase = Json::Object();
+  phase.Set("name", Json::String(name));
+  phase.Set("seconds", Json::Number(seconds));
+  phase.Set("bytes", Json::Number(static_cast<double>(bytes)));
+  phase.Set(itemsName, Json::Number(static_cast<double>(items)));
+  phase.Set("mb_per_s", Json::Number(static_cast<double>(bytes) / 1e6 / seconds));
+  phase.Set(itemsName + "_per_s", Json::Number(static_cast<double>(items) / seconds));
+  std::cerr << std::format("{:<10} {:>9.3f} ms {:>9.2f} MB/s {:>12.0f} {}/s", name, seconds * 1e3, static_cast<double>(bytes) / 1e6 / seconds, static_cast<double>(items) / seconds, itemsName) << std::endl;
+  return phase;
+}
+
+int main(int argc, char *argv[])
+{
+  size_t iterations = 5;
+  size_t jobs = 1;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg.starts_with("--iterations="))
+    {
+      iterations = std::strtoul(arg.c_str() + arg.find('=') + 1, nullptr, 10);
+    }
+    else if (arg == "-j" && i + 1 < argc)
+    {
+      jobs = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if (arg.starts_with("-"))
+    {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    else
+    {
+      inputs.push_back(arg);
+    }
+  }
+  if (inputs.empty() || 0 == iterations || 0 == jobs)
+  {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  Corpus corpus;
+  for (auto &input : inputs)
+  {
+    if (!std::filesystem::is_directory(input))
+    {
+      corpus.m_Files.push_back(input);
+      continue;
+    }
+    std::vector<std::string> found;
+    for (auto &entry : std::filesystem::recursive_directory_iterator(input))
+    {
+      if (entry.is_regular_file() && ".zr" == entry.path().extension())
+      {
+        found.push_back(entry.path().string());
+      }
+    }
+    std::sort(found.begin(), found.end());
+    corpus.m_Files.insert(corpus.m_Files.end(), found.begin(), found.end());
+  }
+  for (auto &file : corpus.m_Files)
+  {
+    std::ifstream stream(file);
+    if (!stream)
+    {
+      std::cerr << file << ": cannot be read" << std::endl;
+      return 1;
+    }
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    corpus.m_Contents.push_back(buffer.str());
+    corpus.m_Bytes += corpus.m_Contents.back().size();
+  }
+
+  ModuleManager modManager;
+  corpus.Serve(modManager);
+  auto modules = LoadAll(modManager, corpus, false);
+  size_t tokens = 0;
+  // an invalid character ends the module early, the parser then reports it
+  double lexSeconds = Fastest(iterations, [&]()
+                              {
+                                tokens = 0;
+                                for (auto &module : modules)
+                                {
+                                  Lexer lexer(module->m_ID, modManager);
+                                  for (auto token = lexer.Next(); token.is_ok() && TokenType::END != token.unwrap().m_Type; token = lexer.Next())
+                                  {
+                                    ++tokens;
+                                  }
+                                } });
+  bool parseFailed = false;
+  double parseSeconds = Fastest(iterations, [&]()
+                                {
+                                  for (auto &module : modules)
+                                  {
+                                    parseFailed = Parser(module, modManager).Parse().has_value() || parseFailed;
+                                  } });
+  if (parseFailed)
+  {
+    std::cerr << "the corpus has syntax errors, zeroc check tells which" << std::endl;
+    return 1;
+  }
+  size_t statements = 0;
+  for (auto &module : modules)
+  {
+    statements += CountStatements(module->m_AST->m_Program);
+  }
+
+  // checking settles a table for good, each run gets one of its own with the corpus parsed
+  std::unique_ptr<ModuleManager> checked;
+  std::vector<Diagnostic> diagnostics;
+  double checkSeconds = 0;
+  for (size_t i = 0; i < iterations; ++i)
+  {
+    checked = std::make_unique<ModuleManager>();
+    corpus.Serve(*checked);
+    LoadAll(*checked, corpus, true);
+    DiagnosticFilter filter;
+    auto start = std::chrono::steady_clock::now();
+    auto outcome = CheckEntries(*checked, corpus.m_Files, filter, jobs);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    checkSeconds = 0 == i ? seconds : std::min(checkSeconds, seconds);
+    diagnostics = std::move(outcome.m_Diagnostics);
+  }
+
+  size_t rendered = 0;
+  double renderSeconds = Fastest(iterations, [&]()
+                                 {
+                                   std::ostringstream out;
+                                   DiagnosticEngine diagnosticEngine(*checked, out);
+                                   for (auto &diagnostic : diagnostics)
+                                   {
+                                     diagnosticEngine.Report(diagnostic);
+                                   }
+                                   diagnosticEngine.Finish();
+                                   rendered = out.str().size(); });
+
+  auto report = Json::Object();
+  report.Set("files", Json::Number(static_cast<double>(corpus.m_Files.size())));
+  report.Set("bytes", Json::Number(static_cast<double>(corpus.m_Bytes)));
+  report.Set("tokens", Json::Number(static_cast<double>(tokens)));
+  report.Set("statements", Json::Number(static_cast<double>(statements)));
+  report.Set("diagnostics", Json::Number(static_cast<double>(diagnostics.size())));
+  report.Set("iterations", Json::Number(static_cast<double>(iterations)));
+  report.Set("jobs", Json::Number(static_cast<double>(jobs)));
+  auto phases = Json::Array();
+  phases.Push(Phase("lexer", lexSeconds, corpus.m_Bytes, statements, "statements"));
+  phases.Push(Phase("parser", parseSeconds, corpus.m_Bytes, statements, "statements"));
+  phases.Push(Phase("checker", checkSeconds, corpus.m_Bytes, statements, "statements"));
+  // output bytes, the sources it quotes are a fraction of the corpus
+  phases.Push(Phase("render", renderSeconds, rendered, diagnostics.size(), "diagnostics"));
+  report.Set("phases", std::move(phases));
+  std::cout << report.Dump() << std::endl;
+  return 0;
+}
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Writes a synthetic corpus for zeroc_bench.
+
+The corpus is a `main.zr` importing `--imports` library modules, each holding
+`--functions` functions that call each other down to `--depth` nested calls and
+a `--literal` character long string, plus a `large.zr` of `--large` functions on
+its own. Every tenth function declares an unused variable so rendering has
+warnings to work through. The output only depends on the arguments, keep them
+fixed to compare runs.
+"""
+
+import argparse
+import os
+
+
+def function(index, depth):
+    lines = [f"pub fun f{index}(x: i32): i32 {{"]
+    lines.append(f"  let y: i32 = x * {index % 7 + 1} + {index % 5};")
+    if index % 10 == 0:
+        lines.append(f"  let unused{index}: i32 = {index};")
+    if index == 0:
+        lines.append("  return y;")
+    else:
+        # f{i-1}(f{i-1}(...(y))), at most `depth` deep
+        nesting = min(depth, index)
+        callee = f"f{index - 1}"
+        lines.append("  return " + f"{callee}(" * nesting + "y" + ")" * nesting + ";")
+    lines.append("}")
+    return "\n".join(lines)
+
+
+def library(functions, depth, literal):
+    parts = [function(i, depth) for i in range(functions)]
+    parts.append(f'pub let banner: string = "{"x" * literal}";')
+    return "\n".join(parts) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("out", help="directory to write the corpus to")
+    parser.add_argument("--functions", type=int, default=200, help="functions per library module")
+    parser.add_argument("--imports", type=int, default=16, help="library modules imported by main.zr")
+    parser.add_argument("--depth", type=int, default=8, help="deepest call nesting")
+    parser.add_argument("--literal", type=int, default=4096, help="length of the string literal of each library")
+    parser.add_argument("--large", type=int, default=20000, help="functions of large.zr")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    for i in range(args.imports):
+        with open(os.path.join(args.out, f"lib{i}.zr"), "w") as out:
+            out.write(library(args.functions, args.depth, args.literal))
+    with open(os.path.join(args.out, "main.zr"), "w") as out:
+        for i in range(args.imports):
+            out.write(f"import lib{i} from lib{i};\n")
+        out.write("fun main(): i32 {\n  let total: i32 = 0;\n")
+        for i in range(args.imports):
+            out.write(f"  total = total + lib{i}.f{args.functions - 1}({i});\n")
+        out.write("  return total;\n}\n")
+    with open(os.path.join(args.out, "large.zr"), "w") as out:
+        out.write(library(args.large, args.depth, args.literal))
+
+
+if __name__ == "__main__":
+    main()
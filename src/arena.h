@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+  Bump allocator for objects sharing one lifetime, eg. the IR of a program.
+  Memory is released all at once when the arena goes away, destructors are
+  only recorded for types that need them
+*/
+class Arena
+{
+public:
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+  Arena() : m_Chunks(), m_Cursor(nullptr), m_Left(0), m_Dtors() {};
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena()
+  {
+    for (auto it = m_Dtors.rbegin(); it != m_Dtors.rend(); ++it)
+    {
+      it->second(it->first);
+    }
+  }
+
+  void *Allocate(size_t size, size_t align)
+  {
+    auto padding = (align - reinterpret_cast<uintptr_t>(m_Cursor) % align) % align;
+    if (!m_Cursor || padding + size > m_Left)
+    {
+      auto chunkSize = std::max(CHUNK_SIZE, size + align);
+      m_Chunks.push_back(std::make_unique<std::byte[]>(chunkSize));
+      m_Cursor = m_Chunks.back().get();
+      m_Left = chunkSize;
+      padding = (align - reinterpret_cast<uintptr_t>(m_Cursor) % align) % align;
+    }
+    auto ptr = m_Cursor + padding;
+    m_Cursor = ptr + size;
+    m_Left -= padding + size;
+    return ptr;
+  }
+
+  template <typename T, typename... Args>
+  T *Make(Args &&...args)
+  {
+    auto ptr = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+      m_Dtors.push_back({ptr, [](void *obj)
+                         { static_cast<T *>(obj)->~T(); }});
+    }
+    return ptr;
+  }
+
+  template <typename T>
+  T *MakeArray(size_t count)
+  {
+    static_assert(std::is_trivially_destructible_v<T>);
+    auto ptr = static_cast<T *>(Allocate(sizeof(T) * count, alignof(T)));
+    for (size_t i = 0; i < count; ++i)
+    {
+      new (ptr + i) T();
+    }
+    return ptr;
+  }
+
+private:
+  std::vector<std::unique_ptr<std::byte[]>> m_Chunks;
+  std::byte *m_Cursor;
+  size_t m_Left;
+  std::vector<std::pair<void *, void (*)(void *)>> m_Dtors;
+};
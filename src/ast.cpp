@@ -2,6 +2,7 @@
 #include <format>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "ast.h"
 #include "pointer.h"
@@ -36,6 +37,7 @@ private:
   void InspectExpressionCall(Ptr<CallExpr>);
   void InspectExpressionAssign(Ptr<AssignExpr>);
   void InspectExpressionFieldAccess(Ptr<FieldAccExpr>);
+  void InspectExpressionBinary(Ptr<BinaryExpr>);
   void InspectExpressionString(Ptr<StringExpr>);
   void InspectEpressionIdentifier(Ptr<IdentExpr>);
 };
@@ -183,6 +185,8 @@ void ASTInspector::InspectExpression(Ptr<Expr> expression)
     return InspectEpressionIdentifier(CastPtr<IdentExpr>(expression));
   case ExprT::FieldAcc:
     return InspectExpressionFieldAccess(CastPtr<FieldAccExpr>(expression));
+  case ExprT::Binary:
+    return InspectExpressionBinary(CastPtr<BinaryExpr>(expression));
   }
 }
 
@@ -234,6 +238,22 @@ void ASTInspector::InspectExpressionFieldAccess(Ptr<FieldAccExpr> fieldAccessExp
   UnTab();
 }
 
+void ASTInspector::InspectExpressionBinary(Ptr<BinaryExpr> binaryExpr)
+{
+  Position pos = binaryExpr->GetOpPos();
+  Writeln(std::format("Binary Expression: {} {}:{}:{}:{}", binaryExpr->GetOpLexeme(), pos.m_Line, pos.m_Column, pos.m_Start, pos.m_End));
+  Tab();
+  Writeln("Lhs:");
+  Tab();
+  InspectExpression(binaryExpr->GetLhs());
+  UnTab();
+  Writeln("Rhs:");
+  Tab();
+  InspectExpression(binaryExpr->GetRhs());
+  UnTab();
+  UnTab();
+}
+
 void ASTInspector::InspectExpressionString(Ptr<StringExpr> strExpr)
 {
   Writeln(std::format("string literal: {}", strExpr->GetValue()));
@@ -249,3 +269,20 @@ std::string Ast::Inspect()
   ASTInspector astInspector(*this);
   return astInspector.Inspect();
 }
+
+std::vector<std::string> StringExpr::SplitFormat() const
+{
+  auto value = GetValue();
+  std::vector<std::string> segments(1);
+  for (size_t i = 0; i < value.size(); ++i)
+  {
+    if ('{' == value[i] && i + 1 < value.size() && '}' == value[i + 1])
+    {
+      segments.emplace_back();
+      i++;
+      continue;
+    }
+    segments.back() += value[i];
+  }
+  return segments;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
@@ -9,10 +10,15 @@
 #include "token.h"
 #include "type.h"
 
+// dense per-module index of a node, assigned by the parser in creation order
+using NodeID = uint32_t;
+
 enum class Prec
 {
   Low = 1,
   Assign = 2,
+  Sum = 3,
+  Product = 4,
   Call = 10,
   FieldAcc = 11,
 };
@@ -35,21 +41,25 @@ enum class ExprT
   Number,
   Assign,
   FieldAcc,
+  Binary,
 };
 
 class Stmt
 {
 public:
   StmtT GetType() const { return m_Type; }
+  NodeID GetID() const { return m_ID; }
+  void SetID(NodeID id) { m_ID = id; }
   virtual Position GetPos() const = 0;
 
   virtual ~Stmt() = default;
 
 protected:
-  Stmt(StmtT type) : m_Type(type) {};
+  Stmt(StmtT type) : m_Type(type), m_ID(0) {};
 
 private:
   StmtT m_Type;
+  NodeID m_ID;
 };
 
 class Expr : public Stmt
@@ -148,13 +158,36 @@ private:
   Ptr<IdentExpr> m_FieldName;
 };
 
+/*
+  Binary arithmetic expression
+*/
+class BinaryExpr : public Expr
+{
+public:
+  BinaryExpr(Token op, Ptr<Expr> lhs, Ptr<Expr> rhs) : Expr(ExprT::Binary), m_Op(op), m_Lhs(lhs), m_Rhs(rhs) {};
+
+  Position GetPos() const override { return m_Lhs->GetPos().MergeWith(m_Rhs->GetPos()); }
+  Position GetOpPos() const { return m_Op.m_Position; }
+  TokenType GetOp() const { return m_Op.m_Type; }
+  std::string GetOpLexeme() const { return m_Op.m_Lexeme; }
+  Ptr<Expr> GetLhs() const { return m_Lhs; }
+  Ptr<Expr> GetRhs() const { return m_Rhs; }
+
+private:
+  Token m_Op;
+  Ptr<Expr> m_Lhs;
+  Ptr<Expr> m_Rhs;
+};
+
 class StringExpr : public Expr
 {
 public:
   StringExpr(Token token) : Expr(ExprT::String), m_Token(token) {};
 
-  std::string GetValue() const { return m_Token.m_Lexeme; }
+  const std::string &GetValue() const { return m_Token.m_Lexeme; }
   Position GetPos() const override { return m_Token.m_Position; }
+  // read as a println format, the literal pieces around each `{}`
+  std::vector<std::string> SplitFormat() const;
 
 private:
   Token m_Token;
@@ -179,8 +212,15 @@ public:
 
   Position GetPos() const override { return m_Pos; }
   bool IsFloat() const { return m_IsFloat; }
+  bool IsNegative() const { return m_Raw.starts_with('-'); }
   NumberBase GetBase() const { return m_Base; }
   std::string GetRaw() const { return m_Raw; }
+  // raw literal without sign nor base prefix, eg. `-0b101` gives `101`
+  std::string GetDigits() const
+  {
+    auto digits = m_Raw.starts_with('-') || m_Raw.starts_with('+') ? m_Raw.substr(1) : m_Raw;
+    return NumberBase::Dec != m_Base && digits.size() > 2 ? digits.substr(2) : digits;
+  }
 };
 
 class BlockStmt : public Stmt
@@ -231,6 +271,7 @@ public:
   FunParam(Ptr<IdentExpr> ident, Ptr<AstType> astType) : m_Ident(ident), m_AstType(astType) {};
 
   std::string GetName() const { return m_Ident->GetValue(); }
+  Ptr<IdentExpr> GetIdent() const { return m_Ident; }
   Ptr<AstType> GetAstType() const { return m_AstType; }
   Position GetNamePos() const { return m_Ident->GetPos(); }
   Position GetPos() const { return m_Ident->GetPos().MergeWith(m_AstType->GetPos()); }
@@ -343,8 +384,9 @@ class Ast
 {
 public:
   std::vector<Ptr<Stmt>> m_Program;
+  NodeID m_NodesCount;
 
-  Ast() : m_Program() {};
+  Ast() : m_Program(), m_NodesCount(0) {};
 
   std::string Inspect();
 };
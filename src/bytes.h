@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+  Binary encoding of interface files and daemon messages: integers are LEB128
+  varints, signed ones zigzag encoded, strings are length prefixed
+*/
+class ByteWriter
+{
+public:
+  std::string m_Buffer;
+
+  ByteWriter() : m_Buffer() {};
+
+  void Byte(uint8_t byte)
+  {
+    m_Buffer.push_back(static_cast<char>(byte));
+  }
+
+  void Varint(uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      Byte(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    Byte(static_cast<uint8_t>(value));
+  }
+
+  void Signed(int64_t value)
+  {
+    // zigzag so small negative values stay short
+    Varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+  }
+
+  void String(const std::string &str)
+  {
+    Varint(str.size());
+    m_Buffer.append(str);
+  }
+};
+
+class ByteReader
+{
+public:
+  ByteReader(const uint8_t *data, size_t size) : m_Cursor(data), m_End(data + size), m_Ok(true) {};
+
+  bool IsOk() const { return m_Ok; }
+  void Fail() { m_Ok = false; }
+
+  uint8_t Byte()
+  {
+    if (m_Cursor >= m_End)
+    {
+      m_Ok = false;
+      return 0;
+    }
+    return *m_Cursor++;
+  }
+
+  uint64_t Varint()
+  {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && m_Ok; shift += 7)
+    {
+      uint8_t byte = Byte();
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+      {
+        return value;
+      }
+    }
+    m_Ok = false;
+    return 0;
+  }
+
+  int64_t Signed()
+  {
+    uint64_t value = Varint();
+    return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+  }
+
+  std::string String()
+  {
+    uint64_t size = Varint();
+    if (!m_Ok || size > static_cast<uint64_t>(m_End - m_Cursor))
+    {
+      m_Ok = false;
+      return "";
+    }
+    std::string str(reinterpret_cast<const char *>(m_Cursor), size);
+    m_Cursor += size;
+    return str;
+  }
+
+private:
+  const uint8_t *m_Cursor;
+  const uint8_t *m_End;
+  bool m_Ok;
+};
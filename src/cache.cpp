@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "ast.h"
+#include "bytes.h"
+#include "cache.h"
+#include "context.h"
+#include "diagnostic.h"
+#include "interface.h"
+#include "module.h"
+#include "pointer.h"
+#include "sha256.h"
+
+#define CACHE_VERSION 1
+#define ENTRY_MAGIC "ZRC"
+#define MANIFEST_MAGIC "ZRM"
+
+static std::string Normalize(const std::string &path)
+{
+  return std::filesystem::path(path).lexically_normal().string();
+}
+
+// imports of top-level blocks are as good as any other, those of functions are errors
+static void CollectImports(const std::vector<Ptr<Stmt>> &stmts, std::vector<Ptr<ImportStmt>> &imports)
+{
+  for (auto &stmt : stmts)
+  {
+    if (StmtT::Import == stmt->GetType())
+    {
+      imports.push_back(CastPtr<ImportStmt>(stmt));
+    }
+    else if (StmtT::Block == stmt->GetType())
+    {
+      CollectImports(CastPtr<BlockStmt>(stmt)->GetStatements(), imports);
+    }
+  }
+}
+
+static void WriteArgs(ByteWriter &writer, const DiagnosticArgs &args)
+{
+  writer.Byte(args.m_Count);
+  for (size_t i = 0; i < args.m_Count; ++i)
+  {
+    auto &arg = args.m_Items.at(i);
+    writer.Byte(static_cast<uint8_t>(arg.index()));
+    if (auto span = std::get_if<SourceSpan>(&arg))
+    {
+      writer.Varint(span->m_Start);
+      writer.Varint(span->m_End);
+    }
+    else if (auto type = std::get_if<Ptr<type::Type>>(&arg))
+    {
+      ModuleInterface::WriteType(writer, *type);
+    }
+    else if (auto value = std::get_if<uint64_t>(&arg))
+    {
+      writer.Varint(*value);
+    }
+  }
+}
+
+// spans always point into the module the diagnostic is about
+static DiagnosticArgs ReadArgs(ByteReader &reader, ModuleID id)
+{
+  DiagnosticArgs args;
+  auto count = reader.Byte();
+  for (uint8_t i = 0; i < count && reader.IsOk(); ++i)
+  {
+    DiagnosticArg arg;
+    switch (reader.Byte())
+    {
+    case 0:
+      break;
+    case 1:
+    {
+      auto start = reader.Varint();
+      auto end = reader.Varint();
+      arg = SourceSpan(id, Position(0, 0, start, end));
+    }
+    break;
+    case 2:
+      arg = ModuleInterface::ReadType(reader);
+      break;
+    case 3:
+      arg = reader.Varint();
+      break;
+    default:
+      reader.Fail();
+      break;
+    }
+    if (args.m_Count < DiagnosticArgs::Capacity)
+    {
+      args.m_Items[args.m_Count++] = arg;
+    }
+    else
+    {
+      reader.Fail();
+    }
+  }
+  return args;
+}
+
+static bool IsWithin(const DiagnosticArgs &args, ModuleID id)
+{
+  for (size_t i = 0; i < args.m_Count; ++i)
+  {
+    auto span = std::get_if<SourceSpan>(&args.m_Items.at(i));
+    if (span && span->m_ModuleID != id)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void WriteDiagnostic(ByteWriter &writer, const Diagnostic &diagnostic)
+{
+  writer.Byte(static_cast<uint8_t>(diagnostic.m_Code));
+  ModuleInterface::WritePos(writer, diagnostic.m_Position);
+  WriteArgs(writer, diagnostic.m_Args);
+  writer.Byte(diagnostic.m_Reference.has_value());
+  if (diagnostic.m_Reference.has_value())
+  {
+    auto &reference = diagnostic.m_Reference.value();
+    writer.Byte(static_cast<uint8_t>(reference.m_Code));
+    ModuleInterface::WritePos(writer, reference.m_Position);
+    WriteArgs(writer, reference.m_Args);
+  }
+}
+
+static Diagnostic ReadDiagnostic(ByteReader &reader, ModuleID id)
+{
+  auto code = reader.Byte();
+  auto pos = ModuleInterface::ReadPos(reader);
+  auto args = ReadArgs(reader, id);
+  std::optional<DiagnosticReference> reference;
+  if (reader.Byte())
+  {
+    auto referenceCode = reader.Byte();
+    auto referencePos = ModuleInterface::ReadPos(reader);
+    auto referenceArgs = ReadArgs(reader, id);
+    if (referenceCode >= static_cast<uint8_t>(DiagCode::END))
+    {
+      reader.Fail();
+    }
+    reference = DiagnosticReference(static_cast<DiagCode>(referenceCode), id, referencePos, referenceArgs);
+  }
+  if (code >= static_cast<uint8_t>(DiagCode::END))
+  {
+    reader.Fail();
+  }
+  return Diagnostic(static_cast<DiagCode>(code), pos, id, args, reference);
+}
+
+BuildCache::BuildCache(const std::string &dir, const std::string &flags) : m_Dir((std::filesystem::path(dir) / std::format("v{}", CACHE_VERSION)).string()), m_Identity(), m_Mutex(), m_Entries(), m_Diagnostics()
+{
+  std::error_code errorCode;
+  for (auto sub : {"m", "i", "c", "x"})
+  {
+    std::filesystem::create_directories(std::filesystem::path(m_Dir) / sub, errorCode);
+  }
+  // the executable stands for the compiler version, its digest is kept by stamp as
+  // reading it whole for each run would cost more than a cache hit saves
+  auto exe = std::filesystem::read_symlink("/proc/self/exe", errorCode).string();
+  auto stamp = errorCode ? Result<SourceStamp, Error>(Error(Errno::FS_ERROR, errorCode.message())) : SourceStamp::Of(exe);
+  if (stamp.is_err())
+  {
+    // without a compiler digest entries of different builds would mix, the cache stays off
+    return;
+  }
+  auto stampName = "x/" + Sha256::Of(std::format("{}\n{}\n{}", exe, stamp.unwrap().m_Size, stamp.unwrap().m_MTime));
+  auto digest = Get(stampName);
+  if (!digest.has_value() || 64 != digest->size())
+  {
+    auto binary = ReadFile(exe);
+    if (!binary.has_value())
+    {
+      return;
+    }
+    digest = Sha256::Of(binary.value());
+    Put(stampName, digest.value());
+  }
+  Sha256 identity;
+  identity.Field(digest.value());
+  identity.Field(flags);
+  m_Identity = identity.Hex();
+}
+
+std::string BuildCache::SourceKey(const std::string &content) const
+{
+  Sha256 key;
+  key.Field(m_Identity);
+  key.Field(content);
+  return key.Hex();
+}
+
+std::optional<std::vector<BuildCache::ImportSpec>> BuildCache::ReadManifest(const std::string &sourceKey)
+{
+  auto data = Get("m/" + sourceKey);
+  if (!data.has_value())
+  {
+    return std::nullopt;
+  }
+  ByteReader reader(reinterpret_cast<const uint8_t *>(data->data()), data->size());
+  bool isValid = reader.String() == MANIFEST_MAGIC && CACHE_VERSION == reader.Varint();
+  auto importsCount = isValid ? reader.Varint() : 0;
+  std::vector<ImportSpec> imports;
+  for (uint64_t i = 0; i < importsCount && reader.IsOk(); ++i)
+  {
+    bool hasAtNotation = reader.Byte();
+    auto segmentsCount = reader.Varint();
+    std::vector<std::string> segments;
+    for (uint64_t j = 0; j < segmentsCount && reader.IsOk(); ++j)
+    {
+      segments.push_back(reader.String());
+    }
+    imports.push_back(ImportSpec(hasAtNotation, std::move(segments)));
+  }
+  if (!isValid || !reader.IsOk())
+  {
+    return std::nullopt;
+  }
+  return imports;
+}
+
+std::optional<BuildCache::Entry> BuildCache::Find(const std::string &path, const std::string *content, Resolver &resolver, std::vector<std::string> &visiting)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (auto found = m_Entries.find(path); found != m_Entries.end())
+    {
+      return found->second;
+    }
+  }
+  if (std::find(visiting.begin(), visiting.end(), path) != visiting.end())
+  {
+    return std::nullopt;
+  }
+  std::optional<std::string> read;
+  if (!content)
+  {
+    read = ReadFile(path);
+    if (!read.has_value())
+    {
+      return std::nullopt;
+    }
+    content = &read.value();
+  }
+  auto sourceKey = SourceKey(*content);
+  auto manifest = ReadManifest(sourceKey);
+  std::optional<Entry> entry;
+  if (manifest.has_value())
+  {
+    Entry found;
+    Sha256 key;
+    key.Field(sourceKey);
+    bool isComplete = true;
+    visiting.push_back(path);
+    for (auto &spec : manifest.value())
+    {
+      auto pathRes = resolver.Resolve(spec.m_HasAtNotation, spec.m_Segments);
+      auto importPath = pathRes.is_ok() ? Normalize(pathRes.unwrap()) : "";
+      auto imported = pathRes.is_ok() ? Find(importPath, nullptr, resolver, visiting) : std::nullopt;
+      if (!imported.has_value())
+      {
+        isComplete = false;
+        break;
+      }
+      key.Field(imported->m_InterfaceHash);
+      found.m_Imports.push_back(importPath);
+    }
+    visiting.pop_back();
+    auto data = isComplete ? Get("i/" + key.Hex()) : std::nullopt;
+    if (data.has_value())
+    {
+      ByteReader reader(reinterpret_cast<const uint8_t *>(data->data()), data->size());
+      bool isValid = reader.String() == ENTRY_MAGIC && CACHE_VERSION == reader.Varint();
+      found.m_InterfaceHash = isValid ? reader.String() : "";
+      if (reader.IsOk() && !found.m_InterfaceHash.empty())
+      {
+        found.m_Data = std::move(data.value());
+        entry = std::move(found);
+      }
+    }
+  }
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Entries.emplace(path, entry);
+  return entry;
+}
+
+Ptr<Module> BuildCache::Lookup(const std::string &path, const std::string &content, ModuleID id, ModuleManager &modManager)
+{
+  if (m_Identity.empty())
+  {
+    return nullptr;
+  }
+  std::vector<std::string> visiting;
+  auto entry = Find(path, &content, modManager.m_Resolver, visiting);
+  if (!entry.has_value())
+  {
+    return nullptr;
+  }
+  auto &data = entry->m_Data;
+  ByteReader reader(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+  auto module = MakePtr(Module(id, path, content));
+  // the header was checked by `Find`
+  (void)reader.String();
+  (void)reader.Varint();
+  (void)reader.String();
+  bool isValid = ModuleInterface::ReadExports(reader, module);
+  auto diagnosticsCount = isValid ? reader.Varint() : 0;
+  std::vector<Diagnostic> diagnostics;
+  for (uint64_t i = 0; i < diagnosticsCount && reader.IsOk(); ++i)
+  {
+    diagnostics.push_back(ReadDiagnostic(reader, id));
+  }
+  if (!isValid || !reader.IsOk())
+  {
+    return nullptr;
+  }
+  for (auto &importPath : entry->m_Imports)
+  {
+    auto loadRes = modManager.Load(importPath, modManager.m_PreferInterfaces);
+    if (loadRes.is_err())
+    {
+      return nullptr;
+    }
+    auto importID = loadRes.unwrap()->m_ID;
+    if (std::find(module->m_Imports.begin(), module->m_Imports.end(), importID) == module->m_Imports.end())
+    {
+      module->m_Imports.push_back(importID);
+    }
+  }
+  module->m_InterfaceHash = entry->m_InterfaceHash;
+  module->m_State = ModuleState::Checked;
+  modManager.CollectDepStamps(module);
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Diagnostics[id] = std::move(diagnostics);
+  return module;
+}
+
+void BuildCache::Store(Ptr<Module> module, const std::vector<Diagnostic> &diagnostics, ModuleManager &modManager)
+{
+  if (m_Identity.empty() || !module->m_AST || module->m_InterfaceHash.empty())
+  {
+    return;
+  }
+  for (auto &diagnostic : diagnostics)
+  {
+    bool isOwn = diagnostic.m_ModuleID == module->m_ID && IsWithin(diagnostic.m_Args, module->m_ID);
+    if (diagnostic.m_Reference.has_value())
+    {
+      auto &reference = diagnostic.m_Reference.value();
+      isOwn = isOwn && reference.m_ModuleID == module->m_ID && IsWithin(reference.m_Args, module->m_ID);
+    }
+    if (!isOwn)
+    {
+      return;
+    }
+  }
+  std::vector<Ptr<ImportStmt>> imports;
+  CollectImports(module->m_AST->m_Program, imports);
+  auto sourceKey = SourceKey(module->m_Content);
+  Sha256 key;
+  key.Field(sourceKey);
+  ByteWriter manifest;
+  manifest.String(MANIFEST_MAGIC);
+  manifest.Varint(CACHE_VERSION);
+  manifest.Varint(imports.size());
+  for (auto &importStmt : imports)
+  {
+    std::vector<std::string> segments;
+    for (auto &ident : importStmt->GetPath())
+    {
+      segments.push_back(ident->GetValue());
+    }
+    manifest.Byte(importStmt->hasAtNotation());
+    manifest.Varint(segments.size());
+    for (auto &segment : segments)
+    {
+      manifest.String(segment);
+    }
+    // loaded already by the checker, this only looks the module up
+    auto pathRes = modManager.m_Resolver.Resolve(importStmt->hasAtNotation(), segments);
+    auto loadRes = pathRes.is_ok() ? modManager.Load(pathRes.unwrap(), modManager.m_PreferInterfaces) : Result<Ptr<Module>, Error>(pathRes.unwrap_err());
+    if (loadRes.is_err() || loadRes.unwrap()->m_InterfaceHash.empty())
+    {
+      return;
+    }
+    key.Field(loadRes.unwrap()->m_InterfaceHash);
+  }
+  ByteWriter entry;
+  entry.String(ENTRY_MAGIC);
+  entry.Varint(CACHE_VERSION);
+  entry.String(module->m_InterfaceHash);
+  ModuleInterface::WriteExports(entry, module);
+  entry.Varint(diagnostics.size());
+  for (auto &diagnostic : diagnostics)
+  {
+    WriteDiagnostic(entry, diagnostic);
+  }
+  // an entry is only found through the manifest of its source, which goes first
+  Put("m/" + sourceKey, manifest.m_Buffer);
+  Put("i/" + key.Hex(), entry.m_Buffer);
+}
+
+std::vector<Diagnostic> BuildCache::TakeDiagnostics(ModuleID id)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto found = m_Diagnostics.find(id);
+  if (found == m_Diagnostics.end())
+  {
+    return {};
+  }
+  auto diagnostics = std::move(found->second);
+  m_Diagnostics.erase(found);
+  return diagnostics;
+}
+
+std::string BuildCache::ProgramKey(const std::string &path, const std::string &options, Resolver &resolver)
+{
+  if (m_Identity.empty())
+  {
+    return "";
+  }
+  Sha256 key;
+  key.Field(options);
+  // symbols are named after module paths, so the code depends on them as well
+  std::vector<std::string> pending = {Normalize(path)};
+  std::unordered_set<std::string> seen(pending.begin(), pending.end());
+  for (size_t i = 0; i < pending.size(); ++i)
+  {
+    auto content = ReadFile(pending.at(i));
+    auto sourceKey = content.has_value() ? SourceKey(content.value()) : "";
+    auto manifest = content.has_value() ? ReadManifest(sourceKey) : std::nullopt;
+    if (!manifest.has_value())
+    {
+      return "";
+    }
+    key.Field(pending.at(i));
+    key.Field(sourceKey);
+    for (auto &spec : manifest.value())
+    {
+      auto pathRes = resolver.Resolve(spec.m_HasAtNotation, spec.m_Segments);
+      if (pathRes.is_err())
+      {
+        return "";
+      }
+      auto importPath = Normalize(pathRes.unwrap());
+      if (seen.insert(importPath).second)
+      {
+        pending.push_back(importPath);
+      }
+    }
+  }
+  return key.Hex();
+}
+
+std::optional<std::string> BuildCache::LoadCode(const std::string &key)
+{
+  return key.empty() ? std::nullopt : Get("c/" + key);
+}
+
+void BuildCache::StoreCode(const std::string &key, const std::string &code)
+{
+  if (!key.empty())
+  {
+    Put("c/" + key, code);
+  }
+}
+
+std::string BuildCache::InterfaceHash(Ptr<Module> module)
+{
+  ByteWriter writer;
+  for (auto &pair : module->m_Exports->Store)
+  {
+    auto &decl = module->m_Sema->m_Decls.at(pair.second);
+    // uses get marked while bodies are checked and only matter within the module
+    auto flags = decl.m_Flags;
+    flags.m_Bits &= static_cast<uint8_t>(~static_cast<uint8_t>(Flag::Used));
+    writer.String(pair.first);
+    writer.Byte(static_cast<uint8_t>(decl.m_DeclT));
+    writer.Byte(flags.m_Bits);
+    ModuleInterface::WritePos(writer, decl.m_Pos);
+    ModuleInterface::WritePos(writer, decl.m_NamePos);
+    ModuleInterface::WritePos(writer, decl.m_ParamsPos);
+    ModuleInterface::WriteType(writer, decl.m_Type);
+  }
+  return Sha256::Of(writer.m_Buffer);
+}
+
+std::optional<std::string> BuildCache::Get(const std::string &name)
+{
+  return ReadFile(m_Dir + "/" + name);
+}
+
+void BuildCache::Put(const std::string &name, const std::string &data)
+{
+  // best effort, a cache that cannot be written only means the work gets done again
+  (void)WriteFile(m_Dir + "/" + name, data);
+}
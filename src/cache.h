@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "diagnostic.h"
+#include "module.h"
+#include "pointer.h"
+#include "resolver.h"
+
+/*
+  Content addressed store of checked modules and generated code, made to be shared
+  by every compiler process pointed at it, CI workers mounting one directory
+  included. Entries are named by the SHA-256 of everything that went into them and
+  written aside then renamed into place, so a visible entry never changes and
+  processes racing to write one leave the same bytes.
+
+    <dir>/v<N>/m/<source key>   imports of a source, in order
+    <dir>/v<N>/i/<module key>   exports, their digest and the diagnostics of a module
+                                checked without errors
+    <dir>/v<N>/c/<program key>  code generated for a program
+    <dir>/v<N>/x/<stamp>        digest of a compiler executable by path, size and mtime
+
+  A source key hashes the compiler, the flags and the content of a module, its module
+  key adds the export digest each import has in the cache. A module is so answered
+  only once everything it reaches is, the first check after an edit checks the
+  importers of the edited module again and finds their entries unchanged
+*/
+class BuildCache
+{
+public:
+  // `flags` holds whatever else changes what checking yields, eg. silenced warnings
+  BuildCache(const std::string &dir, const std::string &flags);
+
+  BuildCache(const BuildCache &) = delete;
+  BuildCache &operator=(const BuildCache &) = delete;
+
+  // The module at `path` holding `content` checked already under the ID `id`, or null.
+  // Its imports get loaded through `modManager`, its diagnostics wait in `TakeDiagnostics`
+  Ptr<Module> Lookup(const std::string &path, const std::string &content, ModuleID id, ModuleManager &modManager);
+  // `diagnostics` are the ones `module` reported itself, skipped if any points elsewhere
+  void Store(Ptr<Module> module, const std::vector<Diagnostic> &diagnostics, ModuleManager &modManager);
+  // once per module `Lookup` answered
+  std::vector<Diagnostic> TakeDiagnostics(ModuleID id);
+
+  // empty unless every module the program at `path` reaches is known to the cache;
+  // `options` holds what changes the code but not checking, eg. the optimization level
+  std::string ProgramKey(const std::string &path, const std::string &options, Resolver &resolver);
+  std::optional<std::string> LoadCode(const std::string &key);
+  void StoreCode(const std::string &key, const std::string &code);
+
+  // digest of the export table, the part of a module its importers depend on
+  static std::string InterfaceHash(Ptr<Module> module);
+
+private:
+  class ImportSpec
+  {
+  public:
+    bool m_HasAtNotation;
+    std::vector<std::string> m_Segments;
+
+    ImportSpec(bool hasAtNotation, std::vector<std::string> segments) : m_HasAtNotation(hasAtNotation), m_Segments(segments) {};
+  };
+
+  // a module the cache holds, found by its source and the digests of its imports
+  class Entry
+  {
+  public:
+    std::string m_Data;
+    std::string m_InterfaceHash;
+    std::vector<std::string> m_Imports; // resolved paths, in source order
+
+    Entry() : m_Data(), m_InterfaceHash(), m_Imports() {};
+  };
+
+  std::string m_Dir;
+  std::string m_Identity;
+  std::mutex m_Mutex;
+  // by normalized path, nothing when a module or one of its imports is not cached
+  std::unordered_map<std::string, std::optional<Entry>> m_Entries;
+  std::unordered_map<ModuleID, std::vector<Diagnostic>> m_Diagnostics;
+
+  std::string SourceKey(const std::string &content) const;
+  std::optional<std::vector<ImportSpec>> ReadManifest(const std::string &sourceKey);
+  // `visiting` holds the modules being looked up, importing one again is a cycle and a miss
+  std::optional<Entry> Find(const std::string &path, const std::string *content, Resolver &resolver, std::vector<std::string> &visiting);
+  std::optional<std::string> Get(const std::string &name);
+  void Put(const std::string &name, const std::string &data);
+};
@@ -0,0 +1,647 @@
+#include <cctype>
+#include <cstdint>
+#include <format>
+#include <string>
+#include <vector>
+
+#include "cgen.h"
+#include "ir.h"
+
+// the runtime every generated program carries, kept in sync with the natives of the VM
+static const char *PRELUDE = R"(#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct zr_str
+{
+  const char *ptr;
+  size_t len;
+} zr_str;
+
+typedef struct zr_arg zr_arg;
+typedef void (*zr_fn)(int argc, const zr_arg *args, zr_arg *ret);
+
+struct zr_arg
+{
+  int ty;
+  union
+  {
+    int64_t i;
+    uint64_t u;
+    double f;
+    zr_str s;
+    zr_fn fn;
+  } v;
+};
+
+/* stdout goes through one buffer, flushed when full and at exit */
+static char zr_out[1 << 16];
+static size_t zr_out_len;
+
+static void zr_flush(void)
+{
+  fwrite(zr_out, 1, zr_out_len, stdout);
+  fflush(stdout);
+  zr_out_len = 0;
+}
+
+static void zr_write(const char *ptr, size_t len)
+{
+  if (len > sizeof(zr_out) - zr_out_len)
+  {
+    zr_flush();
+    if (len > sizeof(zr_out))
+    {
+      fwrite(ptr, 1, len, stdout);
+      return;
+    }
+  }
+  memcpy(zr_out + zr_out_len, ptr, len);
+  zr_out_len += len;
+}
+
+static void zr_trap(const char *message)
+{
+  zr_flush();
+  fprintf(stderr, "runtime error: %s\n", message);
+  exit(1);
+}
+
+static void zr_write_str(zr_str value)
+{
+  if (value.len)
+  {
+    zr_write(value.ptr, value.len);
+  }
+}
+
+static void zr_write_i64(int64_t value)
+{
+  char buf[24];
+  int len = snprintf(buf, sizeof(buf), "%" PRId64, value);
+  zr_write(buf, (size_t)len);
+}
+
+static void zr_write_u64(uint64_t value)
+{
+  char buf[24];
+  int len = snprintf(buf, sizeof(buf), "%" PRIu64, value);
+  zr_write(buf, (size_t)len);
+}
+
+static void zr_write_f64(double value)
+{
+  char buf[32];
+  int precision;
+  int len = 0;
+  for (precision = 1; precision <= 17; ++precision)
+  {
+    len = snprintf(buf, sizeof(buf), "%.*g", precision, value);
+    if (strtod(buf, NULL) == value)
+    {
+      break;
+    }
+  }
+  zr_write(buf, (size_t)len);
+}
+
+static void zr_write_fn(zr_fn value)
+{
+  if (value)
+  {
+    zr_write("<fun>", 5);
+  }
+  else
+  {
+    zr_write("<null fun>", 10);
+  }
+}
+
+static void zr_put_arg(const zr_arg *arg)
+{
+  switch (arg->ty)
+  {
+  case ZR_VOID:
+    break;
+  case ZR_STR:
+    zr_write_str(arg->v.s);
+    break;
+  case ZR_F64:
+    zr_write_f64(arg->v.f);
+    break;
+  case ZR_FN:
+    zr_write_fn(arg->v.fn);
+    break;
+  case ZR_U8:
+  case ZR_U16:
+  case ZR_U32:
+  case ZR_U64:
+    zr_write_u64(arg->v.u);
+    break;
+  default:
+    zr_write_i64(arg->v.i);
+    break;
+  }
+}
+
+/* a leading string argument is a format, each `{}` in it takes the next argument */
+static void zr_println(int argc, const zr_arg *args, zr_arg *ret)
+{
+  int next = 0;
+  size_t i;
+  (void)ret;
+  if (argc > 0 && ZR_STR == args[0].ty)
+  {
+    next = 1;
+    for (i = 0; i < args[0].v.s.len; ++i)
+    {
+      const char *p = args[0].v.s.ptr;
+      if ('{' == p[i] && i + 1 < args[0].v.s.len && '}' == p[i + 1] && next < argc)
+      {
+        zr_put_arg(&args[next++]);
+        ++i;
+        continue;
+      }
+      zr_write(&p[i], 1);
+    }
+  }
+  for (; next < argc; ++next)
+  {
+    if (next > 0)
+    {
+      zr_write(" ", 1);
+    }
+    zr_put_arg(&args[next]);
+  }
+  zr_write("\n", 1);
+}
+)";
+
+// externs implemented by the prelude, with the thunk signature
+static const char *Native(const std::string &symbol)
+{
+  return "println" == symbol ? "zr_println" : nullptr;
+}
+
+// externs the prelude defines with their own C signature, called directly
+static bool IsWriter(const std::string &symbol)
+{
+  return symbol.starts_with("zr_write_");
+}
+
+static std::string CType(ir::Ty ty)
+{
+  switch (ty)
+  {
+  case ir::Ty::Void:
+    return "void";
+  case ir::Ty::F64:
+    return "double";
+  case ir::Ty::Str:
+    return "zr_str";
+  case ir::Ty::Fn:
+    return "zr_fn";
+  default:
+    return std::format("{}int{}_t", ir::IsSigned(ty) ? "" : "u", ir::BitWidth(ty));
+  }
+}
+
+static std::string TyTag(ir::Ty ty)
+{
+  auto name = ir::TyName(ty);
+  for (auto &c : name)
+  {
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  }
+  return "ZR_" + name;
+}
+
+// member of the zr_arg union holding a value of `ty`
+static std::string Field(ir::Ty ty)
+{
+  switch (ty)
+  {
+  case ir::Ty::F64:
+    return "f";
+  case ir::Ty::Str:
+    return "s";
+  case ir::Ty::Fn:
+    return "fn";
+  default:
+    return ir::IsSigned(ty) ? "i" : "u";
+  }
+}
+
+static std::string Literal(const std::string &str)
+{
+  std::string out = "\"";
+  for (auto ch : str)
+  {
+    auto c = static_cast<unsigned char>(ch);
+    switch (c)
+    {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      // octal escapes always take three digits so following characters can't extend them
+      out += std::isprint(c) && '?' != c ? std::string(1, static_cast<char>(c)) : std::format("\\{:03o}", c);
+      break;
+    }
+  }
+  return out + "\"";
+}
+
+static std::string IntLiteral(ir::Ty ty, uint64_t bits)
+{
+  if (ir::IsSigned(ty))
+  {
+    auto value = static_cast<int64_t>(bits);
+    if (INT64_MIN == value)
+    {
+      return "INT64_MIN";
+    }
+    return ir::Ty::I64 == ty ? std::format("INT64_C({})", value) : std::to_string(value);
+  }
+  return ir::Ty::U64 == ty ? std::format("UINT64_C({})", bits) : std::format("{}u", bits);
+}
+
+std::string CGenerator::Generate()
+{
+  m_Out << "/* generated by zeroc, do not edit */\n";
+  m_Out << "enum\n{\n";
+  for (auto ty = ir::Ty::Void; ty <= ir::Ty::Fn; ty = static_cast<ir::Ty>(static_cast<uint8_t>(ty) + 1))
+  {
+    m_Out << "  " << TyTag(ty) << ",\n";
+  }
+  m_Out << "};\n"
+        << PRELUDE << "\n";
+
+  // literals are views into a single pool, the C string literal adds one last NUL
+  auto pool = ir::StringPool::Build(m_Program.m_Strings);
+  m_Out << "static const char zr_pool[] =";
+  for (size_t at = 0; at < pool.m_Bytes.size(); at += 64)
+  {
+    m_Out << "\n  " << Literal(pool.m_Bytes.substr(at, 64));
+  }
+  m_Out << (pool.m_Bytes.empty() ? " \"\";\n" : ";\n");
+  for (size_t i = 0; i < m_Program.m_Strings.size(); ++i)
+  {
+    m_Out << std::format("static const zr_str zr_str_{} = {{zr_pool + {}, {}}};\n", i, pool.m_Offsets.at(i), m_Program.m_Strings.at(i).size());
+  }
+  for (auto function : m_Program.m_Functions)
+  {
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        if (ir::Op::FuncRef == instr->m_Op)
+        {
+          m_Thunks.insert(instr->m_Callee);
+        }
+      }
+    }
+  }
+
+  m_Out << "\n";
+  for (auto function : m_Program.m_Functions)
+  {
+    if (!function->IsExtern() || !(Native(function->m_Symbol) || IsWriter(function->m_Symbol)))
+    {
+      m_Out << Prototype(function) << ";\n";
+    }
+  }
+  for (auto function : m_Program.m_Functions)
+  {
+    if (m_Thunks.count(function) && !(function->IsExtern() && Native(function->m_Symbol)))
+    {
+      m_Out << std::format("static void {}(int argc, const zr_arg *args, zr_arg *ret);\n", Thunk(function));
+    }
+  }
+  m_Out << "\n";
+  for (auto global : m_Program.m_Globals)
+  {
+    m_Out << std::format("{}{} {};\n", global->m_IsPub ? "" : "static ", CType(global->m_Ty), global->m_Symbol);
+  }
+  for (auto function : m_Program.m_Functions)
+  {
+    if (!function->IsExtern())
+    {
+      GenFunction(function);
+    }
+  }
+  for (auto function : m_Program.m_Functions)
+  {
+    if (m_Thunks.count(function) && !(function->IsExtern() && Native(function->m_Symbol)))
+    {
+      GenThunk(function);
+    }
+  }
+
+  m_Out << "\nint main(void)\n{\n  atexit(zr_flush);\n";
+  for (auto init : m_Program.m_Inits)
+  {
+    m_Out << std::format("  {}();\n", init->m_Symbol);
+  }
+  if (m_Program.m_Main && ir::IsInt(m_Program.m_Main->m_RetTy))
+  {
+    m_Out << std::format("  return (int){}();\n", m_Program.m_Main->m_Symbol);
+  }
+  else
+  {
+    if (m_Program.m_Main)
+    {
+      m_Out << std::format("  {}();\n", m_Program.m_Main->m_Symbol);
+    }
+    m_Out << "  return 0;\n";
+  }
+  m_Out << "}\n";
+  return m_Out.str();
+}
+
+std::string CGenerator::Prototype(const ir::Function *function)
+{
+  std::string params;
+  for (size_t i = 0; i < function->m_Params.size(); ++i)
+  {
+    params += std::format("{}{} p{}", i ? ", " : "", CType(function->m_Params.at(i)), i);
+  }
+  if (function->IsExtern())
+  {
+    // variadic externs are left unprototyped
+    return std::format("extern {} {}({})", CType(function->m_RetTy), function->m_Symbol, function->m_IsVarArgs ? "" : (params.empty() ? "void" : params));
+  }
+  return std::format("{}{} {}({})", function->m_IsPub ? "" : "static ", CType(function->m_RetTy), function->m_Symbol, params.empty() ? "void" : params);
+}
+
+std::string CGenerator::Callee(const ir::Function *function)
+{
+  auto native = function->IsExtern() ? Native(function->m_Symbol) : nullptr;
+  return native ? native : function->m_Symbol;
+}
+
+std::string CGenerator::Thunk(const ir::Function *function)
+{
+  auto native = function->IsExtern() ? Native(function->m_Symbol) : nullptr;
+  return native ? native : "zr_thunk_" + function->m_Symbol;
+}
+
+std::string CGenerator::Value(const ir::Function *, const ir::Instr *instr)
+{
+  if (ir::Op::Param == instr->m_Op)
+  {
+    return std::format("p{}", instr->m_Imm);
+  }
+  return std::format("v{}", instr->m_ID);
+}
+
+// arguments from `first` on as a tagged array literal
+std::string CGenerator::Args(const ir::Function *function, const ir::Instr *instr, uint32_t first)
+{
+  if (instr->m_ArgsCount <= first)
+  {
+    return "0, NULL";
+  }
+  std::string args;
+  for (uint32_t i = first; i < instr->m_ArgsCount; ++i)
+  {
+    auto arg = instr->Arg(i);
+    args += std::format("{}{{{}, {{.{} = {}}}}}", i > first ? ", " : "", TyTag(arg->m_Ty), Field(arg->m_Ty), Value(function, arg));
+  }
+  return std::format("{}, (zr_arg[]){{{}}}", instr->m_ArgsCount - first, args);
+}
+
+void CGenerator::GenFunction(const ir::Function *function)
+{
+  m_Out << "\n"
+        << Prototype(function) << "\n{\n";
+  std::unordered_set<const ir::Block *> targets;
+  for (auto block : function->m_Blocks)
+  {
+    for (auto instr : block->m_Instrs)
+    {
+      if (ir::Op::Param != instr->m_Op && ir::Ty::Void != instr->m_Ty)
+      {
+        m_Out << std::format("  {} {};\n", CType(instr->m_Ty), Value(function, instr));
+      }
+      if (ir::Op::Jmp == instr->m_Op)
+      {
+        targets.insert(instr->m_Target);
+      }
+    }
+  }
+  for (auto block : function->m_Blocks)
+  {
+    if (targets.count(block))
+    {
+      m_Out << std::format("b{}:;\n", block->m_ID);
+    }
+    for (auto instr : block->m_Instrs)
+    {
+      GenInstr(function, instr);
+    }
+  }
+  m_Out << "}\n";
+}
+
+void CGenerator::GenInstr(const ir::Function *function, const ir::Instr *instr)
+{
+  auto dst = Value(function, instr);
+  auto arg = [&](size_t i)
+  { return Value(function, instr->Arg(i)); };
+  switch (instr->m_Op)
+  {
+  case ir::Op::Param:
+  case ir::Op::Phi:
+    break;
+  case ir::Op::Const:
+    switch (instr->m_Ty)
+    {
+    case ir::Ty::F64:
+    {
+      auto value = std::format("{}", instr->m_Float);
+      m_Out << std::format("  {} = {}{};\n", dst, value, value.find_first_of(".en") == std::string::npos ? ".0" : "");
+      break;
+    }
+    case ir::Ty::Str:
+      m_Out << std::format("  {} = zr_str_{};\n", dst, instr->m_Imm);
+      break;
+    case ir::Ty::Fn:
+      m_Out << std::format("  {} = NULL;\n", dst);
+      break;
+    default:
+      m_Out << std::format("  {} = {};\n", dst, IntLiteral(instr->m_Ty, instr->m_Imm));
+      break;
+    }
+    break;
+  case ir::Op::Copy:
+    m_Out << std::format("  {} = {};\n", dst, arg(0));
+    break;
+  case ir::Op::Cast:
+    m_Out << std::format("  {} = ({}){};\n", dst, CType(instr->m_Ty), arg(0));
+    break;
+  case ir::Op::FuncRef:
+    m_Out << std::format("  {} = &{};\n", dst, Thunk(instr->m_Callee));
+    break;
+  case ir::Op::Load:
+    m_Out << std::format("  {} = {};\n", dst, instr->m_Global->m_Symbol);
+    break;
+  case ir::Op::Store:
+    m_Out << std::format("  {} = {};\n", instr->m_Global->m_Symbol, arg(0));
+    break;
+  case ir::Op::Call:
+  {
+    auto callee = instr->m_Callee;
+    std::string call;
+    if (callee->IsExtern() && Native(callee->m_Symbol))
+    {
+      call = std::format("{}({}, NULL)", Callee(callee), Args(function, instr, 0));
+    }
+    else
+    {
+      std::string args;
+      for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+      {
+        args += (i ? ", " : "") + arg(i);
+      }
+      call = std::format("{}({})", Callee(callee), args);
+    }
+    m_Out << (ir::Ty::Void == instr->m_Ty ? std::format("  {};\n", call) : std::format("  {} = {};\n", dst, call));
+    break;
+  }
+  case ir::Op::CallIndirect:
+  {
+    m_Out << std::format("  if (!{})\n  {{\n    zr_trap({});\n  }}\n", arg(0), Literal(std::format("call of a null function in '{}'", function->m_Name)));
+    m_Out << std::format("  {{\n    zr_arg ret;\n    {}({}, &ret);\n", arg(0), Args(function, instr, 1));
+    if (ir::Ty::Void != instr->m_Ty)
+    {
+      m_Out << std::format("    {} = ({})ret.v.{};\n", dst, CType(instr->m_Ty), Field(instr->m_Ty));
+    }
+    m_Out << "  }\n";
+    break;
+  }
+  case ir::Op::Ret:
+    m_Out << (instr->m_ArgsCount ? std::format("  return {};\n", arg(0)) : "  return;\n");
+    break;
+  case ir::Op::Jmp:
+  {
+    // phis of the target read their operands all at once
+    std::vector<std::pair<const ir::Instr *, std::string>> moves;
+    for (auto phi : instr->m_Target->m_Instrs)
+    {
+      if (ir::Op::Phi != phi->m_Op)
+      {
+        break;
+      }
+      for (uint32_t i = 0; i < phi->m_ArgsCount; ++i)
+      {
+        if (phi->m_Incoming[i] == instr->m_Block)
+        {
+          moves.push_back({phi, Value(function, phi->Arg(i))});
+        }
+      }
+    }
+    if (!moves.empty())
+    {
+      m_Out << "  {\n";
+      for (size_t i = 0; i < moves.size(); ++i)
+      {
+        m_Out << std::format("    {} t{} = {};\n", CType(moves.at(i).first->m_Ty), i, moves.at(i).second);
+      }
+      for (size_t i = 0; i < moves.size(); ++i)
+      {
+        m_Out << std::format("    {} = t{};\n", Value(function, moves.at(i).first), i);
+      }
+      m_Out << "  }\n";
+    }
+    m_Out << std::format("  goto b{};\n", instr->m_Target->m_ID);
+    break;
+  }
+  case ir::Op::Add:
+  case ir::Op::Sub:
+  case ir::Op::Mul:
+  case ir::Op::Div:
+    GenArith(function, instr);
+    break;
+  case ir::Op::Unreachable:
+    m_Out << "  " << Trap(function, instr, "reached unreachable code") << "\n";
+    break;
+  }
+}
+
+std::string CGenerator::Trap(const ir::Function *function, const ir::Instr *instr, const std::string &what)
+{
+  return std::format("zr_trap({});", Literal(ir::TrapMessage(m_ModManager, function, instr, what)));
+}
+
+void CGenerator::GenArith(const ir::Function *function, const ir::Instr *instr)
+{
+  static const char *symbols[] = {"+", "-", "*", "/"};
+  static const char *builtins[] = {"add", "sub", "mul"};
+  auto op = static_cast<size_t>(instr->m_Op) - static_cast<size_t>(ir::Op::Add);
+  auto dst = Value(function, instr);
+  auto lhs = Value(function, instr->Arg(0));
+  auto rhs = Value(function, instr->Arg(1));
+  auto ty = CType(instr->m_Ty);
+  if (ir::Ty::F64 == instr->m_Ty)
+  {
+    m_Out << std::format("  {} = {} {} {};\n", dst, lhs, symbols[op], rhs);
+    return;
+  }
+  bool isChecked = instr->m_Checks & ir::CHECK_OVERFLOW;
+  if (ir::Op::Div != instr->m_Op)
+  {
+    if (isChecked)
+    {
+      // the builtin checks the result against the exact type of `dst`
+      m_Out << std::format("  if (__builtin_{}_overflow({}, {}, &{}))\n  {{\n    {}\n  }}\n", builtins[op], lhs, rhs, dst, Trap(function, instr, "integer overflow"));
+      return;
+    }
+    // wraps, signed overflow being undefined in C the operation is done unsigned
+    m_Out << std::format("  {} = ({})((uint64_t){} {} (uint64_t){});\n", dst, ty, lhs, symbols[op], rhs);
+    return;
+  }
+  m_Out << std::format("  if (!{})\n  {{\n    {}\n  }}\n", rhs, Trap(function, instr, "division by zero"));
+  if (!ir::IsSigned(instr->m_Ty))
+  {
+    m_Out << std::format("  {} = {} / {};\n", dst, lhs, rhs);
+    return;
+  }
+  auto min = IntLiteral(instr->m_Ty, ir::NormalizeBits(instr->m_Ty, uint64_t(1) << (ir::BitWidth(instr->m_Ty) - 1)));
+  if (isChecked)
+  {
+    m_Out << std::format("  if (-1 == {} && {} == {})\n  {{\n    {}\n  }}\n", rhs, lhs, min, Trap(function, instr, "integer overflow"));
+    m_Out << std::format("  {} = {} / {};\n", dst, lhs, rhs);
+    return;
+  }
+  m_Out << std::format("  {} = -1 == {} ? ({})(0 - (uint64_t){}) : {} / {};\n", dst, rhs, ty, lhs, lhs, rhs);
+}
+
+void CGenerator::GenThunk(const ir::Function *function)
+{
+  std::string args;
+  for (size_t i = 0; i < function->m_Params.size(); ++i)
+  {
+    auto ty = function->m_Params.at(i);
+    args += std::format("{}({})args[{}].v.{}", i ? ", " : "", CType(ty), i, Field(ty));
+  }
+  m_Out << std::format("\nstatic void {}(int argc, const zr_arg *args, zr_arg *ret)\n{{\n  (void)argc;\n  (void)args;\n", Thunk(function));
+  if (ir::Ty::Void == function->m_RetTy)
+  {
+    m_Out << std::format("  (void)ret;\n  {}({});\n}}\n", function->m_Symbol, args);
+    return;
+  }
+  m_Out << std::format("  ret->ty = {};\n  ret->v.{} = {}({});\n}}\n", TyTag(function->m_RetTy), Field(function->m_RetTy), function->m_Symbol, args);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <unordered_set>
+
+#include "ir.h"
+#include "module.h"
+
+/*
+  Translates IR to a single C99 translation unit. Values become locals, blocks
+  labels and phis copies on the incoming gotos. Function values point to
+  thunks taking tagged arguments so calls through them, natives included,
+  share one signature
+*/
+class CGenerator
+{
+public:
+  CGenerator(const ir::Program &program, const ModuleManager &modManager) : m_Program(program), m_ModManager(modManager), m_Out(), m_Thunks() {};
+
+  std::string Generate();
+
+private:
+  const ir::Program &m_Program;
+  const ModuleManager &m_ModManager;
+  std::ostringstream m_Out;
+  // functions whose address is taken
+  std::unordered_set<const ir::Function *> m_Thunks;
+
+  std::string Prototype(const ir::Function *function);
+  std::string Callee(const ir::Function *function);
+  std::string Thunk(const ir::Function *function);
+  std::string Value(const ir::Function *function, const ir::Instr *instr);
+  std::string Args(const ir::Function *function, const ir::Instr *instr, uint32_t first);
+  // the statement raising `what` at the position of `instr`
+  std::string Trap(const ir::Function *function, const ir::Instr *instr, const std::string &what);
+  void GenFunction(const ir::Function *function);
+  void GenInstr(const ir::Function *function, const ir::Instr *instr);
+  void GenArith(const ir::Function *function, const ir::Instr *instr);
+  void GenThunk(const ir::Function *function);
+};
@@ -1,39 +1,173 @@
+#include <algorithm>
 #include <bit>
 #include <cassert>
-#include <format>
 #include <optional>
-#include <sstream>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "ast.h"
+#include "cache.h"
 #include "checker.h"
 #include "context.h"
 #include "diagnostic.h"
 #include "error.h"
+#include "interface.h"
+#include "memstats.h"
 #include "module.h"
+#include "parallel.h"
 #include "parser.h"
 #include "pointer.h"
 #include "token.h"
 #include "type.h"
 
+Checked Checked::MakeError(Position pos)
+{
+  Checked checked(type::Type::Get(type::Base::UNKNOWN), pos);
+  checked.m_Flags.Set(Flag::Error);
+  return checked;
+}
+
 std::vector<Diagnostic> Checker::Check()
 {
+  auto diagnostics = CheckInterface();
+  auto bodiesDiagnostics = CheckBodies();
+  diagnostics.insert(diagnostics.end(), bodiesDiagnostics.begin(), bodiesDiagnostics.end());
+  return diagnostics;
+}
+
+std::vector<Diagnostic> Checker::CheckInterface()
+{
+  MemScope memScope("interface", m_Module->m_Path);
+  m_Sema = MakePtr(SemaInfo());
+  m_Sema->m_Nodes.resize(m_Module->m_AST->m_NodesCount);
+  m_Module->m_Sema = m_Sema;
   EnterScope(ScopeType::GLOBAL);
   for (auto statement : m_Module->m_AST->m_Program)
   {
-    auto bind = CheckStmt(statement);
-    if (bind && (!bind->m_IsUsed && bind->m_Type->IsSomething() && !bind->IsError()))
+    if (m_Filter.IsSaturated())
+    {
+      break;
+    }
+    if (StmtT::Fun != statement->GetType())
+    {
+      m_StmtStart = statement->GetPos().m_Start;
+    }
+    auto checked = CheckStmt(statement);
+    if (!checked.IsNothing() && !checked.m_Flags.Has(Flag::Used) && checked.m_Type->IsSomething() && !checked.IsError())
+    {
+      Report(Diagnostic(DiagCode::UnusedValue, checked.m_Pos, m_Module->m_ID));
+    }
+  }
+  BuildExports();
+  m_Sema->m_Globals = m_Sema->m_Decls;
+  if (m_ModManager.m_Cache)
+  {
+    // importers storing themselves read it, possibly from other threads once this step ends
+    m_Module->m_InterfaceHash = BuildCache::InterfaceHash(m_Module);
+  }
+  m_ModManager.CollectDepStamps(m_Module);
+  return std::move(m_Diagnostics);
+}
+
+std::vector<Diagnostic> Checker::CheckBodies()
+{
+  MemScope memScope("bodies", m_Module->m_Path);
+  // global scope is still open from `CheckInterface`
+  for (auto &funStmt : m_PendingBodies)
+  {
+    if (m_Filter.IsSaturated())
     {
-      m_Diagnostics.push_back(Diagnostic(Errno::UNUSED_VALUE, bind->m_Pos, bind->m_ModID, DiagnosticSeverity::WARN, "expression results to unused value"));
+      break;
     }
+    CheckFunBody(funStmt);
   }
+  m_PendingBodies.clear();
+  CheckInitOrder();
   LeaveScope();
+  // a saturated filter cut checking short, what it found is not the whole story
+  if (m_ModManager.m_Cache && !m_HasErrors && !m_Filter.IsSaturated())
+  {
+    m_ModManager.m_Cache->Store(m_Module, m_Reported, m_ModManager);
+  }
+  m_Reported.clear();
   return std::move(m_Diagnostics);
 }
 
-Ptr<Bind> Checker::CheckStmt(Ptr<Stmt> stmt)
+void Checker::WriteInterface()
+{
+  // interfaces carry no diagnostics, importers reading one would lose the warnings
+  if (!m_HasErrors && !m_HasDiagnostics && m_ModManager.m_Resolver.IsFresh(m_Module->m_Stamp))
+  {
+    // best effort, without a cache directory importers just check from source
+    (void)ModuleInterface::Write(m_Module);
+  }
+}
+
+bool Checker::CheckDeferred(ModuleManager &modManager, std::vector<Diagnostic> &diagnostics, size_t jobs)
+{
+  std::vector<Ptr<Module>> pending;
+  for (auto &module : modManager.Modules())
+  {
+    if (ModuleState::Deferred == module->m_State)
+    {
+      pending.push_back(module);
+    }
+  }
+  // bodies only read other modules and write their own tables, so modules are independent
+  std::vector<std::vector<Diagnostic>> results(pending.size());
+  std::vector<char> errors(pending.size(), false);
+  ParallelFor(pending.size(), jobs, [&](size_t i)
+              {
+                bool cycle = false;
+                if (!modManager.Claim(pending.at(i), ModuleState::Deferred, cycle))
+                {
+                  return;
+                }
+                auto checker = pending.at(i)->m_Checker;
+                results.at(i) = checker->CheckBodies();
+                checker->WriteInterface();
+                errors.at(i) = checker->HasErrors();
+                modManager.Finish(pending.at(i), ModuleState::Checked);
+              });
+  bool hasErrors = false;
+  for (size_t i = 0; i < pending.size(); ++i)
+  {
+    pending.at(i)->m_Checker = nullptr;
+    diagnostics.insert(diagnostics.end(), results.at(i).begin(), results.at(i).end());
+    hasErrors = hasErrors || errors.at(i);
+  }
+  return hasErrors;
+}
+
+void Checker::Report(Diagnostic diagnostic)
+{
+  m_HasDiagnostics = true;
+  if (DiagnosticSeverity::ERROR == diagnostic.GetSeverity())
+  {
+    m_HasErrors = true;
+  }
+  if (m_Filter.Admit(diagnostic.m_Code))
+  {
+    if (m_ModManager.m_Cache)
+    {
+      m_Reported.push_back(diagnostic);
+    }
+    m_Diagnostics.push_back(diagnostic);
+  }
+}
+
+Checked Checker::Record(Ptr<Stmt> stmt, Checked checked)
+{
+  auto &info = m_Sema->m_Nodes.at(stmt->GetID());
+  info.m_Type = checked.m_Type;
+  info.m_Decl = checked.m_Ref;
+  info.m_Flags = checked.m_Flags;
+  return checked;
+}
+
+Checked Checker::CheckStmt(Ptr<Stmt> stmt)
 {
   switch (stmt->GetType())
   {
@@ -50,28 +184,29 @@ Ptr<Bind> Checker::CheckStmt(Ptr<Stmt> stmt)
   case StmtT::Expr:
     return CheckExpr(CastPtr<Expr>(stmt));
   }
-  return nullptr;
+  return Checked();
 }
 
-Ptr<Bind> Checker::CheckStmtFun(Ptr<FunStmt> funStmt)
+Checked Checker::CheckStmtFun(Ptr<FunStmt> funStmt)
 {
   // 1. check name conflits
   FunSign sign = funStmt->GetSign();
-  auto bindWithSameName = m_Scopes.back().m_Context.Get(sign.GetName());
-  if (bindWithSameName)
+  auto declWithSameName = m_Scopes.back().m_Context.Get(sign.GetName());
+  if (NO_DECL != declWithSameName)
   {
-    DiagnosticReference reference(Errno::OK, bindWithSameName->m_ModID, bindWithSameName->m_Pos, "name used here");
-    m_Diagnostics.push_back(Diagnostic(Errno::NAME_ERROR, sign.GetNamePos(), m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("name '{}' is alredy used", sign.GetName()), reference));
-    return nullptr;
+    auto &other = m_Sema->m_Decls.at(declWithSameName);
+    DiagnosticReference reference(DiagCode::NoteNameUsedHere, m_Module->m_ID, other.m_Pos);
+    Report(Diagnostic(DiagCode::NameAlreadyUsed, sign.GetNamePos(), m_Module->m_ID, {SourceSpan(m_Module->m_ID, sign.GetNamePos())}, reference));
+    return Checked();
   }
 
   // 2. function not allowed inside another functions
   if (IsWithinScope(ScopeType::FUNCTION))
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::SYNTAX_ERROR, sign.GetNamePos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "cannot declare a function inside another function"));
-    // Save error bind with same name as placeholder to avoid ghost errors through error propagation
-    SaveBind(sign.GetName(), Bind::MakeError(m_Module->m_ID, sign.GetNamePos()));
-    return nullptr;
+    Report(Diagnostic(DiagCode::NestedFunction, sign.GetNamePos(), m_Module->m_ID));
+    // Save error decl with same name as placeholder to avoid ghost errors through error propagation
+    Declare(sign.GetName(), Decl(DeclT::Error, sign.GetName(), type::Type::Get(type::Base::UNKNOWN), sign.GetNamePos(), sign.GetNamePos(), funStmt->GetID()));
+    return Checked();
   }
 
   // 3. build function type
@@ -80,215 +215,288 @@ Ptr<Bind> Checker::CheckStmtFun(Ptr<FunStmt> funStmt)
   {
     funArgsTypes.push_back(param.GetAstType()->GetType());
   }
-  auto expectRetType = sign.GetRetType() ? sign.GetRetType()->GetType() : MakePtr(type::Type(type::Base::VOID));
+  auto expectRetType = sign.GetRetType() ? sign.GetRetType()->GetType() : type::Type::Get(type::Base::VOID);
   auto functionType = MakePtr(type::Function(sign.GetParams().size(), std::move(funArgsTypes), expectRetType, sign.IsVarArgs()));
-  auto functionBind = MakePtr(BindFun(sign.GetPos(), sign.GetNamePos(), sign.GetParamsPos(), functionType, m_Module->m_ID, false, sign.IsPub()));
-  SaveBind(sign.GetName(), functionBind);
+  Decl funDecl(DeclT::Fun, sign.GetName(), functionType, sign.GetPos(), sign.GetNamePos(), funStmt->GetID());
+  funDecl.m_ParamsPos = sign.GetParamsPos();
+  if (sign.IsPub())
+  {
+    funDecl.m_Flags.Set(Flag::Pub);
+  }
+  if (!funStmt->GetBody())
+  {
+    funDecl.m_Flags.Set(Flag::Extern);
+  }
+  auto funDeclID = Declare(sign.GetName(), funDecl);
+  Record(funStmt, Checked(functionType, sign.GetPos(), DeclRef(m_Module->m_ID, funDeclID)));
+
+  // 4. body is checked once every top-level declaration is known
+  if (funStmt->GetBody())
+  {
+    m_PendingBodies.push_back(funStmt);
+  }
+  else
+  {
+    CheckFunBody(funStmt);
+  }
+  return Checked();
+}
+
+void Checker::CheckFunBody(Ptr<FunStmt> funStmt)
+{
+  FunSign sign = funStmt->GetSign();
+  auto expectRetType = CastPtr<type::Function>(m_Sema->GetNode(funStmt->GetID()).m_Type)->m_RetType;
 
   EnterScope(ScopeType::FUNCTION);
+  m_Function = m_Sema->GetNode(funStmt->GetID()).m_Decl.m_ID;
 
-  // 4. save params binds inside of the new function scope
+  // 1. save params decls inside of the new function scope
   for (auto &param : sign.GetParams())
   {
-    if (m_Scopes.back().m_Context.Get(param.GetName()))
+    auto paramWithSameName = m_Scopes.back().m_Context.Get(param.GetName());
+    if (NO_DECL != paramWithSameName)
     {
-      DiagnosticReference reference(Errno::OK, m_Scopes.back().m_Context.Get(param.GetName())->m_ModID, m_Scopes.back().m_Context.Get(param.GetName())->m_Pos, "first used here");
-      m_Diagnostics.push_back(Diagnostic(Errno::NAME_ERROR, param.GetNamePos(), m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("duplicated param name '{}'", param.GetName()), reference));
+      DiagnosticReference reference(DiagCode::NoteFirstUsedHere, m_Module->m_ID, m_Sema->m_Decls.at(paramWithSameName).m_Pos);
+      Report(Diagnostic(DiagCode::DuplicatedParam, param.GetNamePos(), m_Module->m_ID, {SourceSpan(m_Module->m_ID, param.GetNamePos())}, reference));
       continue;
     }
     auto paramType = param.GetAstType()->GetType();
-    SaveBind(param.GetName(), MakePtr(Bind(BindT::Param, paramType, m_Module->m_ID, param.GetNamePos())));
+    auto paramDeclID = Declare(param.GetName(), Decl(DeclT::Param, param.GetName(), paramType, param.GetNamePos(), param.GetNamePos(), funStmt->GetID()));
+    Record(param.GetIdent(), Checked(paramType, param.GetNamePos(), DeclRef(m_Module->m_ID, paramDeclID)));
   }
 
-  // 5. check body if available
   auto body = funStmt->GetBody();
   if (!body)
   {
     // if is no body then is a simple declaration, eg. `pub fun println(...): void;`
     m_Scopes.pop_back();
-    return nullptr;
+    m_Function = NO_DECL;
+    return;
   }
 
-  // 6. ensure consistency between expected and returned type
-  auto blockRetBind = CheckStmtBlock(body);
-  if (blockRetBind)
+  // 2. ensure consistency between expected and returned type
+  auto blockRet = CheckStmtBlock(body);
+  if (!blockRet.IsNothing())
   {
-    auto foundRetType = blockRetBind->m_Type;
+    auto foundRetType = blockRet.m_Type;
     if (expectRetType->IsVoid() && !foundRetType->IsUnit())
     {
-      m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, blockRetBind->m_Pos, m_Module->m_ID, DiagnosticSeverity::ERROR, "void function does not accept return value"));
+      Report(Diagnostic(DiagCode::VoidFunctionRetValue, blockRet.m_Pos, m_Module->m_ID));
     }
     else if (foundRetType->Isknown() && !expectRetType->IsCompatWith(foundRetType))
     {
-      auto expected = expectRetType->Inspect();
-      auto provided = foundRetType->Inspect();
-      DiagnosticReference reference(Errno::OK, m_Module->m_ID, sign.GetRetType()->GetPos(), std::format("expect '{}' due to here", expected));
-      m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, blockRetBind->m_Pos, m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("return type mismatch, expect '{}' but got '{}'", expected, provided), reference));
+      DiagnosticReference reference(DiagCode::NoteExpectTypeDueTo, m_Module->m_ID, sign.GetRetType()->GetPos(), {expectRetType});
+      Report(Diagnostic(DiagCode::RetTypeMismatch, blockRet.m_Pos, m_Module->m_ID, {expectRetType, foundRetType}, reference));
     }
   }
   else if (!expectRetType->IsVoid())
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, sign.GetRetType()->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "missing return value for non-void function"));
+    Report(Diagnostic(DiagCode::MissingRetValue, sign.GetRetType()->GetPos(), m_Module->m_ID));
   }
 
   LeaveScope();
-  return nullptr;
+  m_Function = NO_DECL;
 }
 
-Ptr<Bind> Checker::CheckStmtRet(Ptr<RetStmt> retStmt)
+Checked Checker::CheckStmtRet(Ptr<RetStmt> retStmt)
 {
   if (!IsWithinScope(ScopeType::FUNCTION) && retStmt->IsExplicity())
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::SYNTAX_ERROR, retStmt->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "cannot return outside a function"));
-    return nullptr;
+    Report(Diagnostic(DiagCode::RetOutsideFunction, retStmt->GetPos(), m_Module->m_ID));
+    return Checked();
   }
-  auto returnBind = MakePtr(Bind(BindT::RetVal, MakePtr(type::Type(type::Base::UNIT)), m_Module->m_ID, retStmt->GetPos(), true));
+  Checked returned(type::Type::Get(type::Base::UNIT), retStmt->GetPos());
   auto val = retStmt->GetValue();
   if (val)
   {
-    auto valBind = CheckExpr(val);
-    returnBind->m_Type = valBind->m_Type;
-    returnBind->m_Ref = valBind->m_Ref;
+    auto valChecked = CheckExpr(val);
+    returned.m_Type = valChecked.m_Type;
+    returned.m_Ref = valChecked.m_Ref;
+    if (valChecked.IsError())
+    {
+      returned.m_Flags.Set(Flag::Error);
+    }
   }
-  return returnBind;
+  returned.m_Flags.Set(Flag::Used);
+  returned.m_Flags.Set(Flag::Ret);
+  return Record(retStmt, returned);
 }
 
-Ptr<Bind> Checker::CheckStmtBlock(Ptr<BlockStmt> blockStmt)
+Checked Checker::CheckStmtBlock(Ptr<BlockStmt> blockStmt)
 {
-  std::vector<Ptr<Bind>> statementsBinds = {};
+  Checked returned;
+  bool isDeadReported = false;
   auto statements = blockStmt->GetStatements();
   for (size_t i = 0; i < statements.size(); ++i)
   {
     auto statement = statements.at(i);
-    auto statementBind = CheckStmt(statement);
-    if (statementBind)
+    auto checked = CheckStmt(statement);
+    if (checked.m_Flags.Has(Flag::Ret) && returned.IsNothing())
     {
-      statementsBinds.push_back(statementBind);
+      returned = checked;
     }
-    if (StmtT::Ret == statement->GetType() && (i + 1 < statements.size()))
+    else if (!checked.IsNothing() && !checked.m_Flags.Has(Flag::Used) && checked.m_Type->IsSomething() && !checked.IsError())
     {
-      Position position = statements.at(i + 1)->GetPos();
-      position.m_End = blockStmt->GetPos().m_End - 1;
-      m_Diagnostics.push_back(Diagnostic(Errno::DEAD_CODE, position, m_Module->m_ID, DiagnosticSeverity::WARN, "unreachable code detected"));
-      break;
-    }
-  }
-
-  Ptr<Bind> returnBind = nullptr;
-  for (auto &bind : statementsBinds)
-  {
-    if (BindT::RetVal == bind->m_BindT)
-    {
-      returnBind = bind;
-      continue;
-    }
-    if (bind->m_Ref)
-    {
-      bind->m_Ref->m_IsUsed = true;
+      Report(Diagnostic(DiagCode::UnusedValue, checked.m_Pos, m_Module->m_ID));
     }
-    if (!bind->m_IsUsed && bind->m_Type->IsSomething() && !bind->IsError())
+    // unreachable code is still checked so every node gets its types recorded
+    if (StmtT::Ret == statement->GetType() && (i + 1 < statements.size()) && !isDeadReported)
     {
-      m_Diagnostics.push_back(Diagnostic(Errno::UNUSED_VALUE, bind->m_Pos, m_Module->m_ID, DiagnosticSeverity::WARN, "expression results to unused value"));
+      Position position = statements.at(i + 1)->GetPos();
+      position.m_End = blockStmt->GetPos().m_End - 1;
+      Report(Diagnostic(DiagCode::DeadCode, position, m_Module->m_ID));
+      isDeadReported = true;
     }
   }
-  return returnBind;
+  return returned;
 }
 
-Ptr<Bind> Checker::CheckStmtLet(Ptr<LetStmt> letStmt)
+Checked Checker::CheckStmtLet(Ptr<LetStmt> letStmt)
 {
   // 1. name should be new
-  auto bindWithSameName = m_Scopes.back().m_Context.Get(letStmt->GetName());
-  if (bindWithSameName)
+  auto declWithSameName = m_Scopes.back().m_Context.Get(letStmt->GetName());
+  if (NO_DECL != declWithSameName)
   {
-    DiagnosticReference reference(Errno::OK, bindWithSameName->m_ModID, bindWithSameName->m_Pos, "name used here");
-    m_Diagnostics.push_back(Diagnostic(Errno::NAME_ERROR, letStmt->GetNamePos(), m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("name '{}' already used", letStmt->GetName()), reference));
-    return nullptr;
+    DiagnosticReference reference(DiagCode::NoteNameUsedHere, m_Module->m_ID, m_Sema->m_Decls.at(declWithSameName).m_Pos);
+    Report(Diagnostic(DiagCode::NameAlreadyUsed, letStmt->GetNamePos(), m_Module->m_ID, {SourceSpan(m_Module->m_ID, letStmt->GetNamePos())}, reference));
+    return Checked();
   }
 
-  SaveBind(letStmt->GetName(), Bind::MakeError(m_Module->m_ID, letStmt->GetNamePos()));
+  // stays an error placeholder until the declaration is known to be valid
+  auto declID = Declare(letStmt->GetName(), Decl(DeclT::Error, letStmt->GetName(), type::Type::Get(type::Base::UNKNOWN), letStmt->GetNamePos(), letStmt->GetNamePos(), letStmt->GetID()));
 
   // 2. should have aither type annotation or an init value
   if (!letStmt->GetAstType() && !letStmt->GetInit())
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, letStmt->GetNamePos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "unable to infer variable type, initialize or annotate expected type"));
-    return nullptr;
+    Report(Diagnostic(DiagCode::UninferableType, letStmt->GetNamePos(), m_Module->m_ID));
+    return Checked();
   }
 
   // 3. ensure consistency between annotated type and type infered from init value if provided
-  Ptr<Bind> ref = nullptr;
+  DeclRef alias;
   Ptr<type::Type> letAnnotType = letStmt->GetAstType() ? letStmt->GetAstType()->GetType() : nullptr;
   if (letStmt->GetInit())
   {
-    auto initBind = CheckExpr(letStmt->GetInit());
-    if (initBind->IsError())
+    auto initChecked = CheckExpr(letStmt->GetInit());
+    if (initChecked.IsError())
     {
-      return nullptr;
+      return Checked();
     }
-    if (letAnnotType && !letAnnotType->IsCompatWith(initBind->m_Type))
+    if (letAnnotType && !letAnnotType->IsCompatWith(initChecked.m_Type))
     {
-      auto expected = letAnnotType->Inspect();
-      auto provided = initBind->m_Type->Inspect();
-      DiagnosticReference reference(Errno::OK, m_Module->m_ID, letStmt->GetAstType()->GetPos(), std::format("expect '{}' due to here", expected));
-      m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, initBind->m_Pos, m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("expect value of type '{}' but got '{}'", expected, provided), reference));
-      return nullptr;
+      DiagnosticReference reference(DiagCode::NoteExpectTypeDueTo, m_Module->m_ID, letStmt->GetAstType()->GetPos(), {letAnnotType});
+      Report(Diagnostic(DiagCode::ValueTypeMismatch, initChecked.m_Pos, m_Module->m_ID, {letAnnotType, initChecked.m_Type}, reference));
+      return Checked();
     }
-    ref = initBind->m_Ref;
-    letAnnotType = initBind->m_Type;
+    alias = initChecked.m_Ref;
+    if (!letAnnotType)
+    {
+      letAnnotType = initChecked.m_Type;
+    }
+  }
+  auto &decl = m_Sema->m_Decls.at(declID);
+  decl.m_DeclT = DeclT::Var;
+  decl.m_Type = letAnnotType;
+  decl.m_Alias = alias;
+  if (letStmt->IsPub())
+  {
+    decl.m_Flags.Set(Flag::Pub);
   }
-  SaveBind(letStmt->GetName(), MakePtr(Bind(BindT::Var, letAnnotType, m_Module->m_ID, letStmt->GetNamePos(), false, letStmt->IsPub(), ref)));
-  return nullptr;
+  Record(letStmt, Checked(letAnnotType, letStmt->GetNamePos(), DeclRef(m_Module->m_ID, declID)));
+  return Checked();
 }
 
-Ptr<Bind> Checker::CheckStmtImport(Ptr<ImportStmt> importStmt)
+Checked Checker::CheckStmtImport(Ptr<ImportStmt> importStmt)
 {
-  auto bindWithSameName = m_Scopes.back().m_Context.Get(importStmt->GetName());
-  if (bindWithSameName)
+  auto declWithSameName = m_Scopes.back().m_Context.Get(importStmt->GetName());
+  if (NO_DECL != declWithSameName)
   {
-    DiagnosticReference reference(Errno::OK, bindWithSameName->m_ModID, bindWithSameName->m_Pos, "name used here");
-    m_Diagnostics.push_back(Diagnostic(Errno::NAME_ERROR, importStmt->GetNamePos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "name already used", reference));
-    return nullptr;
+    DiagnosticReference reference(DiagCode::NoteNameUsedHere, m_Module->m_ID, m_Sema->m_Decls.at(declWithSameName).m_Pos);
+    Report(Diagnostic(DiagCode::NameAlreadyUsed, importStmt->GetNamePos(), m_Module->m_ID, {SourceSpan(m_Module->m_ID, importStmt->GetNamePos())}, reference));
+    return Checked();
   }
 
   // is just a placeholder to avoid ghost errors propagation in case of module load fail
-  SaveBind(importStmt->GetName(), Bind::MakeError(m_Module->m_ID, importStmt->GetNamePos()));
+  auto declID = Declare(importStmt->GetName(), Decl(DeclT::Error, importStmt->GetName(), type::Type::Get(type::Base::UNKNOWN), importStmt->GetPos(), importStmt->GetNamePos(), importStmt->GetID()));
+
+  // function bodies may be checked concurrently, they must not load modules
+  if (IsWithinScope(ScopeType::FUNCTION))
+  {
+    Report(Diagnostic(DiagCode::NestedImport, importStmt->GetPos(), m_Module->m_ID));
+    return Checked();
+  }
 
-  auto loadRes = m_ModManager.Load(NormalizeImportPath(importStmt->hasAtNotation(), importStmt->GetPath()));
+  std::vector<std::string> segments;
+  for (auto &ident : importStmt->GetPath())
+  {
+    segments.push_back(ident->GetValue());
+  }
+  auto pathRes = m_ModManager.m_Resolver.Resolve(importStmt->hasAtNotation(), segments);
+  auto loadRes = pathRes.is_ok() ? m_ModManager.Load(pathRes.unwrap(), m_ModManager.m_PreferInterfaces) : Result<Ptr<Module>, Error>(pathRes.unwrap_err());
   if (loadRes.is_err())
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::NAME_ERROR, importStmt->GetNamePos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "failed to import module"));
-    return nullptr;
+    Report(Diagnostic(DiagCode::ImportFailed, importStmt->GetNamePos(), m_Module->m_ID));
+    return Checked();
   }
   auto module = loadRes.unwrap();
-  if (ModuleStatus::INVALID == module->m_Status)
+  // another thread may be on the same module, each step runs once and the others wait for it
+  bool cycle = false;
+  if (m_ModManager.Claim(module, ModuleState::Loaded, cycle))
   {
-    return nullptr;
+    auto parseError = Parser(module, m_ModManager).Parse();
+    m_ModManager.Finish(module, parseError.has_value() ? ModuleState::Invalid : ModuleState::Parsed);
+    if (parseError.has_value())
+    {
+      Report(parseError.value());
+      return Checked();
+    }
   }
-  if (ModuleStatus::IDLE == module->m_Status)
+  if (!cycle && m_ModManager.Claim(module, ModuleState::Parsed, cycle))
   {
-    Parser parser(module, m_ModManager);
-    auto parseError = parser.Parse();
-    if (parseError.has_value())
+    auto checker = MakePtr(Checker(module, m_ModManager, m_Filter, m_ImportMode));
+    auto diagnostics = checker->CheckInterface();
+    if (CheckMode::Full == m_ImportMode)
     {
-      module->m_Status = ModuleStatus::INVALID;
-      m_Diagnostics.push_back(parseError.value());
-      return nullptr;
+      auto bodiesDiagnostics = checker->CheckBodies();
+      checker->WriteInterface();
+      diagnostics.insert(diagnostics.end(), bodiesDiagnostics.begin(), bodiesDiagnostics.end());
+      m_ModManager.Finish(module, ModuleState::Checked);
     }
-    Checker checker(module, m_ModManager);
-    auto diagnostics = checker.Check();
+    else
+    {
+      module->m_Checker = checker;
+      m_ModManager.Finish(module, ModuleState::Deferred);
+    }
+    m_HasErrors = m_HasErrors || checker->HasErrors();
     m_Diagnostics.insert(m_Diagnostics.end(), diagnostics.begin(), diagnostics.end());
-    module->m_Status = ModuleStatus::LOADED;
+  }
+  if (cycle)
+  {
+    Report(Diagnostic(DiagCode::ImportCycle, importStmt->GetNamePos(), m_Module->m_ID));
+    return Checked();
+  }
+  if (std::find(m_Module->m_Imports.begin(), m_Module->m_Imports.end(), module->m_ID) == m_Module->m_Imports.end())
+  {
+    m_Module->m_Imports.push_back(module->m_ID);
+  }
+  if (ModuleState::Invalid == module->m_State)
+  {
+    return Checked();
   }
   auto objectType = MakePtr(type::Object());
-  for (auto &bind : module->m_Exports->Store)
+  for (auto &pair : module->m_Exports->Store)
   {
-    objectType->m_Entries[bind.first] = bind.second->m_Type;
+    objectType->m_Entries[pair.first] = module->m_Sema->m_Globals.at(pair.second).m_Type;
   }
-  auto moduleBind = MakePtr(BindMod(importStmt->GetName(), importStmt->GetPos(), importStmt->GetNamePos(), m_Module->m_ID, module->m_Exports, objectType));
-  SaveBind(importStmt->GetName(), moduleBind);
-  return nullptr;
+  auto &decl = m_Sema->m_Decls.at(declID);
+  decl.m_DeclT = DeclT::Mod;
+  decl.m_Type = objectType;
+  decl.m_Target = module->m_ID;
+  Record(importStmt, Checked(objectType, importStmt->GetPos(), DeclRef(m_Module->m_ID, declID)));
+  return Checked();
 }
 
-Ptr<Bind> Checker::CheckExpr(Ptr<Expr> expr)
+Checked Checker::CheckExpr(Ptr<Expr> expr)
 {
   switch (expr->GetType())
   {
@@ -304,25 +512,26 @@ Ptr<Bind> Checker::CheckExpr(Ptr<Expr> expr)
     return CheckExprIdent(CastPtr<IdentExpr>(expr));
   case ExprT::FieldAcc:
     return CheckExprFieldAcc(CastPtr<FieldAccExpr>(expr));
+  case ExprT::Binary:
+    return CheckExprBinary(CastPtr<BinaryExpr>(expr));
   }
-  return nullptr;
+  return Checked();
 }
 
-Ptr<Bind> Checker::CheckExprCall(Ptr<CallExpr> callExpr)
+Checked Checker::CheckExprCall(Ptr<CallExpr> callExpr)
 {
   // callee
-  auto calleeBind = CheckExpr(callExpr->GetCallee());
-  if (calleeBind->IsError())
+  auto callee = CheckExpr(callExpr->GetCallee());
+  if (callee.IsError())
   {
-    calleeBind->m_Pos = calleeBind->m_Pos.MergeWith(callExpr->GetArgsPos());
-    return calleeBind;
+    return Record(callExpr, Checked::MakeError(callee.m_Pos.MergeWith(callExpr->GetArgsPos())));
   }
-  if (type::Base::FUNCTION != calleeBind->m_Type->m_Base)
+  if (type::Base::FUNCTION != callee.m_Type->m_Base)
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, callExpr->GetCalleePos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "call to non-callable object"));
-    return Bind::MakeError(m_Module->m_ID, callExpr->GetCalleePos());
+    Report(Diagnostic(DiagCode::NotCallable, callExpr->GetCalleePos(), m_Module->m_ID));
+    return Record(callExpr, Checked::MakeError(callExpr->GetCalleePos()));
   }
-  auto calleeFnType = CastPtr<type::Function>(calleeBind->m_Type);
+  auto calleeFnType = CastPtr<type::Function>(callee.m_Type);
   // arguments
   auto callExpressionArgs = callExpr->GetArgs();
   auto callExpressionArgsPosition = callExpr->GetArgsPos();
@@ -330,132 +539,213 @@ Ptr<Bind> Checker::CheckExprCall(Ptr<CallExpr> callExpr)
   {
     if (calleeFnType->m_ReqArgsCount > callExpressionArgs.size())
     {
-      m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, callExpressionArgsPosition, m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("expect '{}' required args but got '{}'", calleeFnType->m_ReqArgsCount, callExpressionArgs.size())));
-      return Bind::MakeError(m_Module->m_ID, callExpressionArgsPosition);
+      Report(Diagnostic(DiagCode::ArgsCountMismatch, callExpressionArgsPosition, m_Module->m_ID, {uint64_t(calleeFnType->m_ReqArgsCount), uint64_t(callExpressionArgs.size())}));
+      return Record(callExpr, Checked::MakeError(callExpressionArgsPosition));
     }
   }
   else if (calleeFnType->m_ReqArgsCount != callExpressionArgs.size())
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, callExpressionArgsPosition, m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("expect '{}' required args but got '{}'", calleeFnType->m_ReqArgsCount, callExpressionArgs.size())));
-    return Bind::MakeError(m_Module->m_ID, callExpressionArgsPosition);
+    Report(Diagnostic(DiagCode::ArgsCountMismatch, callExpressionArgsPosition, m_Module->m_ID, {uint64_t(calleeFnType->m_ReqArgsCount), uint64_t(callExpressionArgs.size())}));
+    return Record(callExpr, Checked::MakeError(callExpressionArgsPosition));
   }
   for (size_t i = 0; i < callExpressionArgs.size(); ++i)
   {
-    auto argumentBind = CheckExpr(callExpressionArgs.at(i));
-    if (argumentBind->IsError() || i >= calleeFnType->m_Args.size() || calleeFnType->m_Args.at(i)->IsCompatWith(argumentBind->m_Type))
+    auto argument = CheckExpr(callExpressionArgs.at(i));
+    if (argument.IsError() || i >= calleeFnType->m_Args.size() || calleeFnType->m_Args.at(i)->IsCompatWith(argument.m_Type))
     {
       continue;
     }
     auto expect = calleeFnType->m_Args.at(i);
-    auto found = argumentBind->m_Type;
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, argumentBind->m_Pos, m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("expect argument of type '{}' but got '{}'", expect->Inspect(), found->Inspect())));
+    Report(Diagnostic(DiagCode::ArgTypeMismatch, argument.m_Pos, m_Module->m_ID, {expect, argument.m_Type}));
+  }
+  // a literal format without placeholders only leads the line, the args follow it
+  if (IsPrintln(callee) && !callExpressionArgs.empty() && ExprT::String == callExpressionArgs.front()->GetType())
+  {
+    auto format = CastPtr<StringExpr>(callExpressionArgs.front());
+    auto slotsCount = format->SplitFormat().size() - 1;
+    if (slotsCount > 0 && slotsCount != callExpressionArgs.size() - 1)
+    {
+      Report(Diagnostic(DiagCode::FormatArgsMismatch, format->GetPos(), m_Module->m_ID, {uint64_t(slotsCount), uint64_t(callExpressionArgs.size() - 1)}));
+    }
   }
-  return MakePtr(Bind(BindT::Expr, calleeFnType->m_RetType, m_Module->m_ID, callExpr->GetPos()));
+  return Record(callExpr, Checked(calleeFnType->m_RetType, callExpr->GetPos()));
 }
 
-Ptr<Bind> Checker::CheckExprIdent(Ptr<IdentExpr> identExpr)
+Checked Checker::CheckExprIdent(Ptr<IdentExpr> identExpr, bool isUse)
 {
-  auto bind = LookupBind(identExpr->GetValue());
-  if (bind)
+  auto declID = LookupDecl(identExpr->GetValue());
+  if (NO_DECL == declID)
+  {
+    Report(Diagnostic(DiagCode::UndefinedName, identExpr->GetPos(), m_Module->m_ID, {SourceSpan(m_Module->m_ID, identExpr->GetPos())}));
+    return Record(identExpr, Checked::MakeError(identExpr->GetPos()));
+  }
+  auto &decl = m_Sema->m_Decls.at(declID);
+  if (isUse)
+  {
+    decl.m_Flags.Set(Flag::Used);
+  }
+  if (decl.m_Flags.Has(Flag::Global) && NO_DECL != m_Function)
+  {
+    m_BodyRefs[m_Function].emplace_back(declID, identExpr->GetPos());
+  }
+  else if (decl.m_Flags.Has(Flag::Global) && DeclT::Fun == decl.m_DeclT)
   {
-    return MakePtr(Bind(BindT::Expr, bind->m_Type, m_Module->m_ID, identExpr->GetPos(), false, false, bind->m_Ref ? bind->m_Ref : bind));
+    m_InitRefs.emplace_back(m_StmtStart, declID);
   }
-  m_Diagnostics.push_back(Diagnostic(Errno::NAME_ERROR, identExpr->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, std::format("undefined name '{}'", identExpr->GetValue())));
-  return Bind::MakeError(m_Module->m_ID, identExpr->GetPos());
+  Checked checked(decl.m_Type, identExpr->GetPos(), DeclRef(m_Module->m_ID, declID));
+  if (DeclT::Error == decl.m_DeclT)
+  {
+    checked.m_Flags.Set(Flag::Error);
+  }
+  return Record(identExpr, checked);
 }
 
-Ptr<Bind> Checker::CheckExprAssign(Ptr<AssignExpr> assignExpr)
+Checked Checker::CheckExprAssign(Ptr<AssignExpr> assignExpr)
 {
-  // dest
-  auto destBind = CheckExprIdent(assignExpr->GetDest());
-  if (destBind->IsError())
+  // dest, being assigned to does not count as a use
+  auto dest = CheckExprIdent(assignExpr->GetDest(), false);
+  if (dest.IsError())
   {
-    return destBind;
+    return Record(assignExpr, dest);
+  }
+  auto destDeclT = GetDecl(dest.m_Ref).m_DeclT;
+  if (DeclT::Var != destDeclT && DeclT::Param != destDeclT)
+  {
+    auto destPos = assignExpr->GetDest()->GetPos();
+    Report(Diagnostic(DiagCode::NotAssignable, destPos, m_Module->m_ID, {SourceSpan(m_Module->m_ID, destPos)}));
+    return Record(assignExpr, Checked::MakeError(destPos));
   }
   // value
-  auto valueBind = CheckExpr(assignExpr->GetValue());
-  if (valueBind->IsError())
+  auto value = CheckExpr(assignExpr->GetValue());
+  if (value.IsError())
   {
-    return valueBind;
+    return Record(assignExpr, value);
   }
   // match types
-  if (!destBind->m_Type->IsCompatWith(valueBind->m_Type))
+  if (!dest.m_Type->IsCompatWith(value.m_Type))
   {
-    auto expect = destBind->m_Type->Inspect();
-    auto found = valueBind->m_Type->Inspect();
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, valueBind->m_Pos, valueBind->m_ModID, DiagnosticSeverity::ERROR, std::format("expect value of type '{}' but got '{}'", expect, found)));
-    return Bind::MakeError(m_Module->m_ID, assignExpr->GetValue()->GetPos());
+    Report(Diagnostic(DiagCode::ValueTypeMismatch, value.m_Pos, m_Module->m_ID, {dest.m_Type, value.m_Type}));
+    return Record(assignExpr, Checked::MakeError(assignExpr->GetValue()->GetPos()));
   }
-  destBind->m_Ref = valueBind->m_Ref;
-  valueBind->m_IsUsed = true;
-  valueBind->m_Pos = assignExpr->GetPos();
-  return valueBind;
+  Checked assigned(dest.m_Type, assignExpr->GetPos(), dest.m_Ref);
+  assigned.m_Flags.Set(Flag::Used);
+  return Record(assignExpr, assigned);
 }
 
-Ptr<Bind> Checker::CheckExprFieldAcc(Ptr<FieldAccExpr> fieldAccExpr)
+Checked Checker::CheckExprFieldAcc(Ptr<FieldAccExpr> fieldAccExpr)
 {
-  auto valueBind = CheckExpr(fieldAccExpr->GetValue());
-  if (valueBind->IsError())
+  auto value = CheckExpr(fieldAccExpr->GetValue());
+  if (value.IsError())
+  {
+    return Record(fieldAccExpr, Checked::MakeError(value.m_Pos.MergeWith(fieldAccExpr->GetFieldName()->GetPos())));
+  }
+  if (type::Base::OBJECT != value.m_Type->m_Base)
   {
-    valueBind->m_Pos = valueBind->m_Pos.MergeWith(fieldAccExpr->GetFieldName()->GetPos());
-    return valueBind;
+    Report(Diagnostic(DiagCode::NotIndexable, fieldAccExpr->GetValue()->GetPos(), m_Module->m_ID));
+    return Record(fieldAccExpr, Checked::MakeError(fieldAccExpr->GetPos()));
   }
-  valueBind->m_Ref->m_IsUsed = true;
-  if (type::Base::OBJECT != valueBind->m_Type->m_Base)
+  // follow variables initialized from a module back to the import
+  DeclRef modRef = value.m_Ref;
+  while (modRef.IsValid() && DeclT::Var == GetDecl(modRef).m_DeclT && GetDecl(modRef).m_Alias.IsValid())
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, fieldAccExpr->GetValue()->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "object is not indexable"));
-    return Bind::MakeError(m_Module->m_ID, fieldAccExpr->GetPos());
+    modRef = GetDecl(modRef).m_Alias;
   }
-  auto bindObjType = CastPtr<type::Object>(valueBind->m_Type);
-  if (bindObjType->m_Entries.find(fieldAccExpr->GetFieldName()->GetValue()) == bindObjType->m_Entries.end())
+  bool isModule = modRef.IsValid() && DeclT::Mod == GetDecl(modRef).m_DeclT;
+  auto fieldName = fieldAccExpr->GetFieldName()->GetValue();
+  auto fieldNamePos = fieldAccExpr->GetFieldName()->GetPos();
+  auto bindObjType = CastPtr<type::Object>(value.m_Type);
+  if (bindObjType->m_Entries.find(fieldName) == bindObjType->m_Entries.end())
   {
-    std::string fieldNotFoundErrorMessage;
-    switch (valueBind->m_Ref->m_BindT)
+    if (isModule)
     {
-    case BindT::Mod:
-      fieldNotFoundErrorMessage = std::format("module '{}' has not field '{}'", (CastPtr<BindMod>(valueBind->m_Ref))->m_Name, fieldAccExpr->GetFieldName()->GetValue());
-      break;
-    default:
-      fieldNotFoundErrorMessage = std::format("object '{}' has no field '{}'", bindObjType->Inspect(), fieldAccExpr->GetFieldName()->GetValue());
+      auto &modDecl = GetDecl(modRef);
+      Report(Diagnostic(DiagCode::NoModuleField, fieldNamePos, m_Module->m_ID, {SourceSpan(modRef.m_ModID, modDecl.m_NamePos), SourceSpan(m_Module->m_ID, fieldNamePos)}));
+    }
+    else
+    {
+      Report(Diagnostic(DiagCode::NoObjectField, fieldNamePos, m_Module->m_ID, {value.m_Type, SourceSpan(m_Module->m_ID, fieldNamePos)}));
+    }
+    return Record(fieldAccExpr, Checked::MakeError(fieldNamePos));
+  }
+  DeclRef fieldRef;
+  if (isModule)
+  {
+    auto target = m_ModManager.Get(GetDecl(modRef).m_Target);
+    fieldRef = DeclRef(target->m_ID, target->m_Exports->Get(fieldName));
+  }
+  return Record(fieldAccExpr, Checked(bindObjType->m_Entries.at(fieldName), fieldAccExpr->GetPos(), fieldRef));
+}
+
+Checked Checker::CheckExprBinary(Ptr<BinaryExpr> binaryExpr)
+{
+  auto lhs = CheckExpr(binaryExpr->GetLhs());
+  auto rhs = CheckExpr(binaryExpr->GetRhs());
+  if (lhs.IsError() || rhs.IsError())
+  {
+    return Record(binaryExpr, Checked::MakeError(binaryExpr->GetPos()));
+  }
+  for (auto &operand : {lhs, rhs})
+  {
+    if (!operand.m_Type->IsInteger() && !operand.m_Type->IsIntRange() && type::Base::Float != operand.m_Type->m_Base)
+    {
+      Report(Diagnostic(DiagCode::InvalidOperand, operand.m_Pos, m_Module->m_ID, {operand.m_Type}));
+      return Record(binaryExpr, Checked::MakeError(binaryExpr->GetPos()));
     }
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, fieldAccExpr->GetFieldName()->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, fieldNotFoundErrorMessage));
-    return Bind::MakeError(m_Module->m_ID, fieldAccExpr->GetFieldName()->GetPos());
   }
-  return MakePtr(Bind(BindT::Expr, bindObjType->m_Entries.at(fieldAccExpr->GetFieldName()->GetValue()), m_Module->m_ID, fieldAccExpr->GetPos()));
+  // untyped literals take the type of the other side, both untyped stay a range
+  // that later fits its destination, overflow is left to the runtime checks
+  Ptr<type::Type> type;
+  if (lhs.m_Type->IsIntRange() && rhs.m_Type->IsIntRange())
+  {
+    auto lhsRange = CastPtr<type::IntRange>(lhs.m_Type);
+    auto rhsRange = CastPtr<type::IntRange>(rhs.m_Type);
+    bool isSigned = lhsRange->m_IsSigned || rhsRange->m_IsSigned || TokenType::Minus == binaryExpr->GetOp();
+    type = type::IntRange::Get(isSigned, std::max(lhsRange->m_BytesCout, rhsRange->m_BytesCout));
+  }
+  else if (rhs.m_Type->IsIntRange() ? lhs.m_Type->IsCompatWith(rhs.m_Type) : rhs.m_Type->IsCompatWith(lhs.m_Type))
+  {
+    type = rhs.m_Type->IsIntRange() ? lhs.m_Type : rhs.m_Type;
+  }
+  else
+  {
+    Report(Diagnostic(DiagCode::OperandsTypeMismatch, binaryExpr->GetOpPos(), m_Module->m_ID, {lhs.m_Type, rhs.m_Type}));
+    return Record(binaryExpr, Checked::MakeError(binaryExpr->GetPos()));
+  }
+  return Record(binaryExpr, Checked(type, binaryExpr->GetPos()));
 }
 
-Ptr<Bind> Checker::CheckExprString(Ptr<StringExpr> stringExpr)
+Checked Checker::CheckExprString(Ptr<StringExpr> stringExpr)
 {
-  return MakePtr(Bind(BindT::Expr, MakePtr(type::Type(type::Base::STRING)), m_Module->m_ID, stringExpr->GetPos()));
+  return Record(stringExpr, Checked(type::Type::Get(type::Base::STRING), stringExpr->GetPos()));
 }
 
-Ptr<Bind> Checker::CheckExprNumber(Ptr<NumberExpr> numExpr)
+Checked Checker::CheckExprNumber(Ptr<NumberExpr> numExpr)
 {
   if (numExpr->IsFloat())
   {
     return CheckExprNumberFloat(numExpr);
   }
   uint64_t value = 0;
-  bool isSigned = numExpr->m_Raw.at(0) == '-';
+  bool isSigned = numExpr->IsNegative();
   try
   {
-    value = std::stoull(isSigned ? numExpr->m_Raw.substr(1) : numExpr->m_Raw, nullptr, static_cast<int>(numExpr->m_Base));
+    value = std::stoull(numExpr->GetDigits(), nullptr, static_cast<int>(numExpr->m_Base));
   }
   catch (std::invalid_argument &)
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, numExpr->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "integer literal is invalid"));
-    return Bind::MakeError(m_Module->m_ID, numExpr->GetPos());
+    Report(Diagnostic(DiagCode::InvalidInt, numExpr->GetPos(), m_Module->m_ID));
+    return Record(numExpr, Checked::MakeError(numExpr->GetPos()));
   }
   catch (std::out_of_range &)
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, numExpr->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "integer literal exceeds storage limit of 8 bytes"));
-    return Bind::MakeError(m_Module->m_ID, numExpr->GetPos());
+    Report(Diagnostic(DiagCode::IntTooLarge, numExpr->GetPos(), m_Module->m_ID));
+    return Record(numExpr, Checked::MakeError(numExpr->GetPos()));
   }
   auto bytesCount = (std::bit_width(value) + 7) / 8;
-  return MakePtr(Bind(BindT::Expr, MakePtr(type::IntRange(isSigned, (unsigned long)bytesCount)), m_Module->m_ID, numExpr->m_Pos));
+  return Record(numExpr, Checked(type::IntRange::Get(isSigned, (unsigned long)bytesCount), numExpr->m_Pos));
 }
 
-Ptr<Bind> Checker::CheckExprNumberFloat(Ptr<NumberExpr> floatExpr)
+Checked Checker::CheckExprNumberFloat(Ptr<NumberExpr> floatExpr)
 {
   try
   {
@@ -463,15 +753,15 @@ Ptr<Bind> Checker::CheckExprNumberFloat(Ptr<NumberExpr> floatExpr)
   }
   catch (std::invalid_argument &)
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, floatExpr->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "invalid float number"));
-    return Bind::MakeError(m_Module->m_ID, floatExpr->GetPos());
+    Report(Diagnostic(DiagCode::InvalidFloat, floatExpr->GetPos(), m_Module->m_ID));
+    return Record(floatExpr, Checked::MakeError(floatExpr->GetPos()));
   }
   catch (std::out_of_range &)
   {
-    m_Diagnostics.push_back(Diagnostic(Errno::TYPE_ERROR, floatExpr->GetPos(), m_Module->m_ID, DiagnosticSeverity::ERROR, "float number out of range"));
-    return Bind::MakeError(m_Module->m_ID, floatExpr->GetPos());
+    Report(Diagnostic(DiagCode::FloatOutOfRange, floatExpr->GetPos(), m_Module->m_ID));
+    return Record(floatExpr, Checked::MakeError(floatExpr->GetPos()));
   }
-  return MakePtr(Bind(BindT::Expr, MakePtr(type::Type(type::Base::Float)), m_Module->m_ID, floatExpr->GetPos()));
+  return Record(floatExpr, Checked(type::Type::Get(type::Base::Float), floatExpr->GetPos()));
 }
 
 void Checker::EnterScope(ScopeType scopeType)
@@ -481,90 +771,131 @@ void Checker::EnterScope(ScopeType scopeType)
 
 void Checker::LeaveScope()
 {
-  for (auto &bind : m_Scopes.back().m_Context.Store)
+  for (auto &pair : m_Scopes.back().m_Context.Store)
   {
-    if (bind.second->m_IsUsed || bind.first.starts_with('_') || bind.second->m_IsPub || (ScopeType::GLOBAL == m_Scopes.back().m_Type && bind.first == "main"))
+    auto &decl = m_Sema->m_Decls.at(pair.second);
+    if (decl.m_Flags.Has(Flag::Used) || decl.m_Flags.Has(Flag::Pub) || pair.first.starts_with('_') || (ScopeType::GLOBAL == m_Scopes.back().m_Type && pair.first == "main"))
     {
       continue;
     }
-    switch (bind.second->m_BindT)
+    switch (decl.m_DeclT)
     {
-    case BindT::Error:
-    case BindT::Expr:
-    case BindT::RetVal:
+    case DeclT::Error:
       break;
-    case BindT::Mod:
-      m_Diagnostics.push_back(Diagnostic(Errno::UNUSED_VALUE, (CastPtr<BindMod>(bind.second))->m_NamePos, bind.second->m_ModID, DiagnosticSeverity::WARN, "unused import"));
+    case DeclT::Mod:
+      Report(Diagnostic(DiagCode::UnusedImport, decl.m_NamePos, m_Module->m_ID));
       break;
-    case BindT::Var:
-      m_Diagnostics.push_back(Diagnostic(Errno::UNUSED_VALUE, bind.second->m_Pos, bind.second->m_ModID, DiagnosticSeverity::WARN, std::format("unused variable '{}'", bind.first)));
+    case DeclT::Var:
+      Report(Diagnostic(DiagCode::UnusedVariable, decl.m_NamePos, m_Module->m_ID, {SourceSpan(m_Module->m_ID, decl.m_NamePos)}));
       break;
-    case BindT::Param:
-      m_Diagnostics.push_back(Diagnostic(Errno::UNUSED_VALUE, bind.second->m_Pos, bind.second->m_ModID, DiagnosticSeverity::WARN, std::format("unused parameter '{}'", bind.first)));
+    case DeclT::Param:
+      Report(Diagnostic(DiagCode::UnusedParam, decl.m_NamePos, m_Module->m_ID, {SourceSpan(m_Module->m_ID, decl.m_NamePos)}));
       break;
-    case BindT::Fun:
-      m_Diagnostics.push_back(Diagnostic(Errno::UNUSED_VALUE, (CastPtr<BindFun>(bind.second))->NamePosition, bind.second->m_ModID, DiagnosticSeverity::WARN, std::format("function '{}' never gets called", bind.first)));
+    case DeclT::Fun:
+      Report(Diagnostic(DiagCode::UnusedFunction, decl.m_NamePos, m_Module->m_ID, {SourceSpan(m_Module->m_ID, decl.m_NamePos)}));
       break;
     }
   }
-  if (ScopeType::GLOBAL == m_Scopes.back().m_Type)
+  m_Scopes.pop_back();
+}
+
+void Checker::BuildExports()
+{
+  m_Module->m_Exports = MakePtr(ModuleContext());
+  for (auto &pair : m_Scopes.front().m_Context.Store)
+  {
+    if (m_Sema->m_Decls.at(pair.second).m_Flags.Has(Flag::Pub))
+    {
+      m_Module->m_Exports->Save(pair.first, pair.second);
+    }
+  }
+}
+
+void Checker::CheckInitOrder()
+{
+  // bodies see every global, only the ones top-level code may run early are held to source order
+  std::set<size_t> reported;
+  for (auto &[stmtStart, function] : m_InitRefs)
   {
-    m_Module->m_Exports = MakePtr(ModuleContext());
-    for (auto &pair : m_Scopes.back().m_Context.Store)
+    std::vector<DeclID> pending = {function};
+    std::set<DeclID> visited;
+    while (!pending.empty())
     {
-      if (pair.second->m_IsPub)
+      auto current = pending.back();
+      pending.pop_back();
+      auto refs = m_BodyRefs.find(current);
+      if (!visited.insert(current).second || refs == m_BodyRefs.end())
+      {
+        continue;
+      }
+      for (auto &[declID, pos] : refs->second)
       {
-        m_Module->m_Exports->Store[pair.first] = pair.second;
+        auto &decl = m_Sema->m_Decls.at(declID);
+        if (DeclT::Fun == decl.m_DeclT)
+        {
+          pending.push_back(declID);
+        }
+        else if (DeclT::Var == decl.m_DeclT && decl.m_Pos.m_Start > stmtStart && reported.insert(pos.m_Start).second)
+        {
+          Report(Diagnostic(DiagCode::UndefinedName, pos, m_Module->m_ID, {SourceSpan(m_Module->m_ID, pos)}));
+        }
       }
     }
   }
-  m_Scopes.pop_back();
+  m_InitRefs.clear();
+  m_BodyRefs.clear();
 }
 
-Ptr<Bind> Checker::LookupBind(std::string name)
+DeclID Checker::LookupDecl(std::string name)
 {
   for (auto it = m_Scopes.rbegin(); it != m_Scopes.rend(); ++it)
   {
-    auto binding = it->m_Context.Get(name);
-    if (binding)
-      return binding;
+    auto declID = it->m_Context.Get(name);
+    if (NO_DECL != declID)
+      return declID;
   }
-  return nullptr;
+  return NO_DECL;
 }
 
-void Checker::SaveBind(std::string name, Ptr<Bind> bind)
+DeclID Checker::Declare(std::string name, Decl decl)
 {
-  m_Scopes.back().m_Context.Save(name, bind);
+  if (ScopeType::GLOBAL == m_Scopes.back().m_Type)
+  {
+    decl.m_Flags.Set(Flag::Global);
+  }
+  auto declID = m_Sema->Declare(decl);
+  m_Scopes.back().m_Context.Save(name, declID);
+  return declID;
 }
 
-bool Checker::IsWithinScope(ScopeType scopeType)
+const Decl &Checker::GetDecl(DeclRef ref)
 {
-  for (auto it = m_Scopes.rbegin(); it != m_Scopes.rend(); ++it)
+  if (ref.m_ModID == m_Module->m_ID)
   {
-    if (it->m_Type == scopeType)
-    {
-      return true;
-    }
+    return m_Sema->m_Decls.at(ref.m_ID);
   }
-  return false;
+  return m_ModManager.Get(ref.m_ModID)->m_Sema->m_Globals.at(ref.m_ID);
 }
 
-// utils
-std::string Checker::NormalizeImportPath(bool hasAtNotation, std::vector<Ptr<IdentExpr>> path)
+bool Checker::IsPrintln(const Checked &callee)
 {
-  std::ostringstream oss;
-  if (hasAtNotation)
+  if (!callee.m_Ref.IsValid())
   {
-    // TODO: prefix with ZEROLANG_HOME env variable
+    return false;
   }
-  for (size_t i = 0; i < path.size(); ++i)
+  auto &decl = GetDecl(callee.m_Ref);
+  return DeclT::Fun == decl.m_DeclT && decl.m_Flags.Has(Flag::Extern) && "println" == decl.m_Name && CastPtr<type::Function>(decl.m_Type)->m_IsVarArgs;
+}
+
+bool Checker::IsWithinScope(ScopeType scopeType)
+{
+  for (auto it = m_Scopes.rbegin(); it != m_Scopes.rend(); ++it)
   {
-    oss << path.at(i)->GetValue();
-    if ((i + 1) < path.size())
+    if (it->m_Type == scopeType)
     {
-      oss << "/";
+      return true;
     }
   }
-  oss << ".zr";
-  return oss.str();
+  return false;
 }
+
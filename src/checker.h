@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "ast.h"
@@ -23,40 +27,103 @@ public:
   Scope(ScopeType type) : m_Type(type), m_Context() {};
 };
 
+/*
+  Outcome of checking a statement or expression, passed by value between the
+  check methods and recorded in the module `SemaInfo`
+*/
+class Checked
+{
+public:
+  Ptr<type::Type> m_Type; // null when the statement produces nothing
+  Position m_Pos;
+  DeclRef m_Ref; // declaration the expression names, if any
+  Flags m_Flags;
+
+  Checked() : m_Type(nullptr), m_Pos(), m_Ref(), m_Flags() {};
+  Checked(Ptr<type::Type> type, Position pos, DeclRef ref = DeclRef()) : m_Type(type), m_Pos(pos), m_Ref(ref), m_Flags() {};
+
+  bool IsNothing() const { return !m_Type; }
+  bool IsError() const { return m_Flags.Has(Flag::Error); }
+
+  static Checked MakeError(Position pos);
+};
+
+enum class CheckMode
+{
+  Full,
+  Interface, // only top-level statements and signatures, function bodies are deferred
+};
+
 class Checker
 {
 public:
-  Checker(Ptr<Module> module, ModuleManager &modManager) : m_Module(module), m_ModManager(modManager), m_Scopes(), m_Diagnostics() {};
+  // `importMode` tells how modules brought in by imports get checked
+  Checker(Ptr<Module> module, ModuleManager &modManager, DiagnosticFilter &filter, CheckMode importMode = CheckMode::Full) : m_Module(module), m_ModManager(modManager), m_Filter(filter), m_ImportMode(importMode), m_Sema(nullptr), m_Scopes(), m_PendingBodies(), m_Function(NO_DECL), m_StmtStart(0), m_InitRefs(), m_BodyRefs(), m_Diagnostics(), m_Reported(), m_HasErrors(false), m_HasDiagnostics(false) {};
 
   std::vector<Diagnostic> Check();
+  // exports are available once this returns
+  std::vector<Diagnostic> CheckInterface();
+  std::vector<Diagnostic> CheckBodies();
+  // for imported modules once their bodies are checked, entry points are read from source anyway
+  void WriteInterface();
+  // true if any error was found, including the ones the filter dropped
+  bool HasErrors() const { return m_HasErrors; }
+
+  // checks bodies of every module imported in interface mode, spread across `jobs` threads
+  static bool CheckDeferred(ModuleManager &modManager, std::vector<Diagnostic> &diagnostics, size_t jobs);
 
 private:
   Ptr<Module> m_Module;
   ModuleManager &m_ModManager;
+  DiagnosticFilter &m_Filter;
+  CheckMode m_ImportMode;
+  Ptr<SemaInfo> m_Sema;
   std::vector<Scope> m_Scopes;
+  std::vector<Ptr<FunStmt>> m_PendingBodies;
+  // function whose body is being checked, NO_DECL at top level
+  DeclID m_Function;
+  // start of the top-level statement being checked
+  size_t m_StmtStart;
+  // functions named by top-level statements, by where the statement starts
+  std::vector<std::pair<size_t, DeclID>> m_InitRefs;
+  // functions and globals of the module each body names
+  std::unordered_map<DeclID, std::vector<std::pair<DeclID, Position>>> m_BodyRefs;
   std::vector<Diagnostic> m_Diagnostics;
+  // what the module itself reported, without the diagnostics of its imports, for the build cache
+  std::vector<Diagnostic> m_Reported;
+  bool m_HasErrors;
+  // the module itself reported anything, even filtered out, which its interface file could not replay
+  bool m_HasDiagnostics;
+
+  void Report(Diagnostic);
 
   void EnterScope(ScopeType);
   void LeaveScope();
-  Ptr<Bind> LookupBind(std::string name);
-  void SaveBind(std::string name, Ptr<Bind> bind);
+  DeclID LookupDecl(std::string name);
+  DeclID Declare(std::string name, Decl decl);
+  const Decl &GetDecl(DeclRef);
   bool IsWithinScope(ScopeType);
+  // the runtime `println`, its literal formats get split at compile time
+  bool IsPrintln(const Checked &callee);
+  Checked Record(Ptr<Stmt>, Checked);
+  void BuildExports();
+  // globals read by a body before their `let` ran, as a top-level statement calls it earlier
+  void CheckInitOrder();
 
-  // utils
-  std::string NormalizeImportPath(bool, std::vector<Ptr<IdentExpr>>);
-
-  Ptr<Bind> CheckStmt(Ptr<Stmt>);
-  Ptr<Bind> CheckStmtFun(Ptr<FunStmt>);
-  Ptr<Bind> CheckStmtRet(Ptr<RetStmt>);
-  Ptr<Bind> CheckStmtBlock(Ptr<BlockStmt>);
-  Ptr<Bind> CheckStmtLet(Ptr<LetStmt>);
-  Ptr<Bind> CheckStmtImport(Ptr<ImportStmt>);
-  Ptr<Bind> CheckExpr(Ptr<Expr>);
-  Ptr<Bind> CheckExprCall(Ptr<CallExpr>);
-  Ptr<Bind> CheckExprString(Ptr<StringExpr>);
-  Ptr<Bind> CheckExprNumber(Ptr<NumberExpr>);
-  Ptr<Bind> CheckExprNumberFloat(Ptr<NumberExpr>);
-  Ptr<Bind> CheckExprIdent(Ptr<IdentExpr>);
-  Ptr<Bind> CheckExprAssign(Ptr<AssignExpr>);
-  Ptr<Bind> CheckExprFieldAcc(Ptr<FieldAccExpr>);
+  Checked CheckStmt(Ptr<Stmt>);
+  Checked CheckStmtFun(Ptr<FunStmt>);
+  void CheckFunBody(Ptr<FunStmt>);
+  Checked CheckStmtRet(Ptr<RetStmt>);
+  Checked CheckStmtBlock(Ptr<BlockStmt>);
+  Checked CheckStmtLet(Ptr<LetStmt>);
+  Checked CheckStmtImport(Ptr<ImportStmt>);
+  Checked CheckExpr(Ptr<Expr>);
+  Checked CheckExprCall(Ptr<CallExpr>);
+  Checked CheckExprString(Ptr<StringExpr>);
+  Checked CheckExprNumber(Ptr<NumberExpr>);
+  Checked CheckExprNumberFloat(Ptr<NumberExpr>);
+  Checked CheckExprIdent(Ptr<IdentExpr>, bool isUse = true);
+  Checked CheckExprAssign(Ptr<AssignExpr>);
+  Checked CheckExprFieldAcc(Ptr<FieldAccExpr>);
+  Checked CheckExprBinary(Ptr<BinaryExpr>);
 };
@@ -1,15 +1,22 @@
 #include "context.h"
 
-void ModuleContext::Save(std::string name, Ptr<Bind> bind)
+DeclID SemaInfo::Declare(Decl decl)
 {
-  Store[name] = bind;
+  m_Decls.push_back(std::move(decl));
+  return static_cast<DeclID>(m_Decls.size() - 1);
 }
 
-Ptr<Bind> ModuleContext::Get(std::string key)
+void ModuleContext::Save(std::string name, DeclID decl)
 {
-  if (Store.find(key) == Store.end())
+  Store[name] = decl;
+}
+
+DeclID ModuleContext::Get(std::string key)
+{
+  auto it = Store.find(key);
+  if (it == Store.end())
   {
-    return nullptr;
+    return NO_DECL;
   }
-  return Store[key];
+  return it->second;
 }
@@ -1,68 +1,121 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <string>
 
+#include "ast.h"
 #include "module.h"
 #include "pointer.h"
 #include "token.h"
 #include "type.h"
 
-enum class BindT
+// dense per-module index of a declaration
+using DeclID = uint32_t;
+
+static constexpr DeclID NO_DECL = UINT32_MAX;
+
+enum class DeclT
 {
-  Expr,
   Fun,
   Var,
   Param,
-  RetVal,
   Mod,
   Error,
 };
 
-class Bind
+enum class Flag : uint8_t
+{
+  Used = 1 << 0,
+  Pub = 1 << 1,
+  Error = 1 << 2,
+  Ret = 1 << 3,
+  Extern = 1 << 4, // function declared without a body
+  Global = 1 << 5, // declared at module level
+};
+
+class Flags
+{
+public:
+  uint8_t m_Bits;
+
+  Flags() : m_Bits(0) {};
+
+  bool Has(Flag flag) const { return m_Bits & static_cast<uint8_t>(flag); }
+  void Set(Flag flag) { m_Bits |= static_cast<uint8_t>(flag); }
+  void Unset(Flag flag) { m_Bits &= static_cast<uint8_t>(~static_cast<uint8_t>(flag)); }
+};
+
+class DeclRef
 {
 public:
-  BindT m_BindT;
   ModuleID m_ModID;
-  Position m_Pos;
-  Ptr<type::Type> m_Type;
-  bool m_IsUsed;
-  bool m_IsPub;
-  Ptr<Bind> m_Ref;
+  DeclID m_ID;
+
+  DeclRef() : m_ModID(0), m_ID(NO_DECL) {};
+  DeclRef(ModuleID modID, DeclID id) : m_ModID(modID), m_ID(id) {};
 
-  Bind(BindT bindT, Ptr<type::Type> type, ModuleID modID, Position pos, bool isUsed = false, bool isPub = false, Ptr<Bind> ref = nullptr) : m_BindT(bindT), m_ModID(modID), m_Pos(pos), m_Type(type), m_IsUsed(isUsed), m_IsPub(isPub), m_Ref(ref) {}
+  bool IsValid() const { return NO_DECL != m_ID; }
+  bool operator==(const DeclRef &other) const { return m_ModID == other.m_ModID && m_ID == other.m_ID; }
+};
 
-  bool IsError() const { return BindT::Error == m_BindT || (m_Ref && m_Ref->IsError()); }
+class Decl
+{
+public:
+  DeclT m_DeclT;
+  std::string m_Name;
+  Ptr<type::Type> m_Type;
+  Position m_Pos;     // whole declaration
+  Position m_NamePos; // declared name
+  Position m_ParamsPos;
+  Flags m_Flags;
+  NodeID m_Node;      // declaring node, meaningless for declarations read from an interface
+  DeclRef m_Alias;    // variables initialized straight from another name
+  ModuleID m_Target;  // module brought in by an import
 
-  static inline Ptr<Bind> MakeError(ModuleID modID, Position pos) { return MakePtr(Bind(BindT::Error, MakePtr(type::Type(type::Base::UNKNOWN)), modID, pos)); }
+  Decl(DeclT declT, std::string name, Ptr<type::Type> type, Position pos, Position namePos, NodeID node) : m_DeclT(declT), m_Name(name), m_Type(type), m_Pos(pos), m_NamePos(namePos), m_ParamsPos(), m_Flags(), m_Node(node), m_Alias(), m_Target(0) {};
 };
 
-class BindFun : public Bind
+/*
+  What the checker learned about a node: its type, the declaration it names
+  or introduces and flags
+*/
+class NodeInfo
 {
 public:
-  Position NamePosition;
-  Position ParamsPosition;
+  Ptr<type::Type> m_Type;
+  DeclRef m_Decl;
+  Flags m_Flags;
 
-  BindFun(Position position, Position namePosition, Position paramsPosition, Ptr<type::Function> funType, ModuleID moduleID, bool used = false, bool isPublic = false) : Bind(BindT::Fun, funType, moduleID, position, used, isPublic), NamePosition(namePosition), ParamsPosition(paramsPosition) {};
+  NodeInfo() : m_Type(nullptr), m_Decl(), m_Flags() {};
 };
 
-class BindMod : public Bind
+/*
+  Checker results of a module kept in side tables, nodes are indexed by their
+  `NodeID` and declarations by their `DeclID`
+*/
+class SemaInfo
 {
 public:
-  std::string m_Name;
-  Position m_NamePos;
-  Ptr<class ModuleContext> m_Context;
+  std::vector<NodeInfo> m_Nodes;
+  std::vector<Decl> m_Decls;
+  // m_Decls as of the end of the top-level statements, what other modules read while
+  // function bodies keep declaring into m_Decls, possibly on another thread
+  std::vector<Decl> m_Globals;
+
+  SemaInfo() : m_Nodes(), m_Decls(), m_Globals() {};
 
-  BindMod(std::string name, Position position, Position aliasPosition, ModuleID moduleID, Ptr<class ModuleContext> context, Ptr<type::Object> objT) : Bind(BindT::Mod, objT, moduleID, position), m_Name(name), m_NamePos(aliasPosition), m_Context(context) {}
+  DeclID Declare(Decl decl);
+  const NodeInfo &GetNode(NodeID id) const { return m_Nodes.at(id); }
 };
 
 class ModuleContext
 {
 public:
-  std::map<std::string, Ptr<Bind>> Store;
+  std::map<std::string, DeclID> Store;
 
   ModuleContext() : Store() {};
 
-  void Save(std::string name, Ptr<Bind> bind);
-  Ptr<Bind> Get(std::string);
+  void Save(std::string name, DeclID decl);
+  DeclID Get(std::string);
 };
@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "daemon.h"
+#include "driver.h"
+
+// bumped whenever the encoding of requests or replies changes
+static const char *PROTOCOL = "zeroc-check-1";
+
+std::string DaemonRequest::Encode() const
+{
+  ByteWriter writer;
+  writer.String(PROTOCOL);
+  writer.String(m_Cwd);
+  writer.String(m_Home);
+  for (auto list : {&m_Roots, &m_Files, &m_Disabled})
+  {
+    writer.Varint(list->size());
+    for (auto &item : *list)
+    {
+      writer.String(item);
+    }
+  }
+  writer.Varint(m_MaxErrors);
+  writer.Varint(m_Jobs);
+  return writer.m_Buffer;
+}
+
+std::optional<DaemonRequest> DaemonRequest::Decode(const std::string &data)
+{
+  ByteReader reader(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+  if (reader.String() != PROTOCOL)
+  {
+    return std::nullopt;
+  }
+  DaemonRequest request;
+  request.m_Cwd = reader.String();
+  request.m_Home = reader.String();
+  for (auto list : {&request.m_Roots, &request.m_Files, &request.m_Disabled})
+  {
+    auto count = reader.Varint();
+    for (uint64_t i = 0; i < count && reader.IsOk(); ++i)
+    {
+      list->push_back(reader.String());
+    }
+  }
+  request.m_MaxErrors = reader.Varint();
+  request.m_Jobs = std::max<size_t>(1, reader.Varint());
+  if (!reader.IsOk())
+  {
+    return std::nullopt;
+  }
+  return request;
+}
+
+// a client has this long to send its request, others get served meanwhile
+static const int REQUEST_TIMEOUT_MS = 5000;
+// after this the client stops waiting for a stuck daemon and checks locally
+static const int REPLY_TIMEOUT_MS = 30000;
+
+// reads until the peer closes its end, false when it did not within `timeoutMs`
+static bool ReadAll(int fd, std::string &data, int timeoutMs)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  char buffer[4096];
+  for (;;)
+  {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    pollfd ready = {fd, POLLIN, 0};
+    int count = left > 0 ? poll(&ready, 1, static_cast<int>(left)) : 0;
+    if (count < 0 && EINTR == errno)
+    {
+      continue;
+    }
+    if (count <= 0)
+    {
+      return false;
+    }
+    auto size = read(fd, buffer, sizeof(buffer));
+    if (size < 0 && EINTR == errno)
+    {
+      continue;
+    }
+    if (size <= 0)
+    {
+      return 0 == size;
+    }
+    data.append(buffer, static_cast<size_t>(size));
+  }
+}
+
+// a peer that stops reading makes `WriteAll` fail after `timeoutMs` instead of blocking
+static void SetSendTimeout(int fd, int timeoutMs)
+{
+  timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+  (void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static bool WriteAll(int fd, const std::string &data)
+{
+  for (size_t sent = 0; sent < data.size();)
+  {
+    // a client gone early must not kill the daemon with SIGPIPE
+    auto count = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (count < 0 && EINTR == errno)
+    {
+      continue;
+    }
+    if (count < 0)
+    {
+      return false;
+    }
+    sent += static_cast<size_t>(count);
+  }
+  return true;
+}
+
+static bool AddressOf(const std::string &path, sockaddr_un &address)
+{
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+  {
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+// -1 when nothing listens at `path`
+static int Connect(const std::string &path)
+{
+  sockaddr_un address;
+  if (!AddressOf(path, address))
+  {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (0 != connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+std::string Daemon::DefaultSocketPath()
+{
+  auto runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+  if (runtimeDir && *runtimeDir)
+  {
+    return std::string(runtimeDir) + "/zeroc.sock";
+  }
+  return std::format("/tmp/zeroc-{}.sock", getuid());
+}
+
+std::optional<int> Daemon::Send(const std::string &socketPath, const DaemonRequest &request, std::ostream &out)
+{
+  int fd = Connect(socketPath);
+  if (fd < 0)
+  {
+    return std::nullopt;
+  }
+  // the daemon reads the request up to end of file
+  SetSendTimeout(fd, REQUEST_TIMEOUT_MS);
+  bool sent = WriteAll(fd, request.Encode()) && 0 == shutdown(fd, SHUT_WR);
+  std::string reply;
+  bool received = sent && ReadAll(fd, reply, REPLY_TIMEOUT_MS);
+  close(fd);
+  if (!received)
+  {
+    return std::nullopt;
+  }
+  ByteReader reader(reinterpret_cast<const uint8_t *>(reply.data()), reply.size());
+  auto exitCode = reader.Varint();
+  auto output = reader.String();
+  if (!reader.IsOk())
+  {
+    return std::nullopt;
+  }
+  out << output << std::flush;
+  return static_cast<int>(exitCode);
+}
+
+int Daemon::Serve()
+{
+  sockaddr_un address;
+  if (!AddressOf(m_SocketPath, address))
+  {
+    std::cerr << m_SocketPath << ": socket path too long" << std::endl;
+    return 1;
+  }
+  struct stat info;
+  if (0 == lstat(m_SocketPath.c_str(), &info))
+  {
+    int running = Connect(m_SocketPath);
+    if (running >= 0)
+    {
+      close(running);
+      std::cerr << m_SocketPath << ": a daemon is already listening" << std::endl;
+      return 1;
+    }
+    // left behind by a daemon that died, anything else is not ours to remove
+    if (!S_ISSOCK(info.st_mode) || 0 != unlink(m_SocketPath.c_str()))
+    {
+      std::cerr << m_SocketPath << ": " << std::strerror(EEXIST) << std::endl;
+      return 1;
+    }
+  }
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0 || 0 != bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) || 0 != chmod(m_SocketPath.c_str(), S_IRUSR | S_IWUSR) || 0 != listen(listener, 16))
+  {
+    std::cerr << m_SocketPath << ": " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  std::cerr << "listening on " << m_SocketPath << std::endl;
+  for (;;)
+  {
+    int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0)
+    {
+      if (EINTR == errno || ECONNABORTED == errno)
+      {
+        continue;
+      }
+      std::cerr << m_SocketPath << ": " << std::strerror(errno) << std::endl;
+      close(listener);
+      return 1;
+    }
+    // a slow or idle client only holds up its own thread
+    std::thread(&Daemon::Reply, this, client).detach();
+  }
+}
+
+void Daemon::Reply(int client)
+{
+  std::string data;
+  std::ostringstream out;
+  int exitCode = 1;
+  if (!ReadAll(client, data, REQUEST_TIMEOUT_MS))
+  {
+    out << "the request did not arrive in time" << std::endl;
+  }
+  else if (auto request = DaemonRequest::Decode(data))
+  {
+    // requests change the working directory and share workspaces, one runs at a time
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    exitCode = Handle(request.value(), out);
+  }
+  else
+  {
+    out << "malformed request, is the daemon from another version of zeroc?" << std::endl;
+  }
+  ByteWriter reply;
+  reply.Varint(static_cast<uint64_t>(exitCode));
+  reply.String(out.str());
+  SetSendTimeout(client, REQUEST_TIMEOUT_MS);
+  (void)WriteAll(client, reply.m_Buffer);
+  close(client);
+}
+
+int Daemon::Handle(const DaemonRequest &request, std::ostream &out)
+{
+  std::error_code errorCode;
+  std::filesystem::current_path(request.m_Cwd, errorCode);
+  if (errorCode)
+  {
+    out << request.m_Cwd << ": " << errorCode.message() << std::endl;
+    return 1;
+  }
+  auto key = request.m_Cwd + '\0' + request.m_Home;
+  for (auto &root : request.m_Roots)
+  {
+    key += '\0' + root;
+  }
+  auto &workspace = m_Workspaces[key];
+  if (!workspace)
+  {
+    workspace = std::make_unique<Workspace>();
+    workspace->m_ModManager.m_Resolver.m_Roots = request.m_Roots;
+    workspace->m_ModManager.m_Resolver.m_Home = request.m_Home;
+  }
+  auto outcome = workspace->Check(request.m_Files, request.m_Jobs);
+  DiagnosticFilter filter;
+  filter.m_MaxErrors = request.m_MaxErrors;
+  for (auto &name : request.m_Disabled)
+  {
+    if (auto code = Diagnostic::FromName(name))
+    {
+      filter.m_Disabled.insert(code.value());
+    }
+  }
+  for (auto &error : outcome.m_LoadErrors)
+  {
+    out << error << std::endl;
+  }
+  DiagnosticEngine diagnosticEngine(workspace->m_ModManager, out);
+  for (auto &diagnostic : outcome.m_Diagnostics)
+  {
+    if (filter.Admit(diagnostic.m_Code))
+    {
+      diagnosticEngine.Report(diagnostic);
+    }
+  }
+  diagnosticEngine.Finish();
+  return outcome.m_HasErrors ? 1 : 0;
+}
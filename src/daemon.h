@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "driver.h"
+
+// a `check` run on behalf of a client, paths are relative to `m_Cwd`
+class DaemonRequest
+{
+public:
+  std::string m_Cwd;
+  std::string m_Home;
+  std::vector<std::string> m_Roots;
+  std::vector<std::string> m_Files;
+  // names of the silenced warnings
+  std::vector<std::string> m_Disabled;
+  size_t m_MaxErrors;
+  size_t m_Jobs;
+
+  DaemonRequest() : m_Cwd(), m_Home(), m_Roots(), m_Files(), m_Disabled(), m_MaxErrors(0), m_Jobs(1) {};
+
+  std::string Encode() const;
+  static std::optional<DaemonRequest> Decode(const std::string &data);
+};
+
+/*
+  Answers `check` requests over a Unix domain socket from workspaces kept resident
+  between them, so only what changed and the modules importing it get checked again
+*/
+class Daemon
+{
+public:
+  std::string m_SocketPath;
+
+  Daemon(std::string socketPath) : m_SocketPath(socketPath), m_Workspaces(), m_Mutex() {};
+
+  // Serves each client on its own thread until killed, checks still run one at a
+  // time. Yields non zero when the socket can't be set up
+  int Serve();
+
+  // Runs `request` on the daemon listening at `socketPath` and copies its output to
+  // `out`. Yields the exit code of the check, nothing when no daemon answered in time
+  static std::optional<int> Send(const std::string &socketPath, const DaemonRequest &request, std::ostream &out);
+  // $XDG_RUNTIME_DIR/zeroc.sock, or a per user path under /tmp
+  static std::string DefaultSocketPath();
+
+private:
+  // modules resolve differently per working directory and search roots, each combination gets its own table
+  std::map<std::string, std::unique_ptr<Workspace>> m_Workspaces;
+  // held while a request is handled
+  std::mutex m_Mutex;
+
+  // reads the request of `client`, answers it and closes the connection
+  void Reply(int client);
+  int Handle(const DaemonRequest &request, std::ostream &out);
+};
@@ -1,10 +1,12 @@
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <format>
-#include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <variant>
 #include <vector>
 
 #include "diagnostic.h"
@@ -21,122 +23,304 @@
 #define BOLD_GREEN BOLD GREEN
 #define BOLD_WHITE BOLD WHITE
 
-std::string DiagnosticEngine::Paint(std::string text, std::string color)
+// the results of a SARIF log go in between
+#define SARIF_START "{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"version\":\"2.1.0\",\"runs\":[{\"tool\":{\"driver\":{\"name\":\"zeroc\"}},\"results\":["
+#define SARIF_END "]}]}\n"
+
+class DiagnosticInfo
+{
+public:
+  const char *m_Name;
+  Errno m_Errno;
+  DiagnosticSeverity m_Severity;
+  const char *m_Format;
+};
+
+static DiagnosticInfo GetInfo(DiagCode code)
 {
-  text.insert(0, color);
-  text.append(RESET);
-  return text;
+  switch (code)
+  {
+  case DiagCode::UnexpectedChar:
+    return {"unexpected-char", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "unexpected token: {}"};
+  case DiagCode::UnquotedString:
+    return {"unquoted-string", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "unquoted string"};
+  case DiagCode::UnexpectedPub:
+    return {"unexpected-pub", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "unexpected 'pub' modifier"};
+  case DiagCode::UnexpectedToken:
+    return {"unexpected-token", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "syntax error: unexpected '{}'"};
+  case DiagCode::MisplacedImplicitRet:
+    return {"misplaced-implicit-return", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "implicity return expression must be the last in a block, insert ';' at end"};
+  case DiagCode::InvalidExpr:
+    return {"invalid-expression", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "invalid left side expression"};
+  case DiagCode::ExpectIdent:
+    return {"expect-identifier", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "expect an identifier"};
+  case DiagCode::ExpectTypeAnn:
+    return {"expect-type", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "expect type annotation, try 'i32', 'string', ..."};
+  case DiagCode::NameAlreadyUsed:
+    return {"name-already-used", Errno::NAME_ERROR, DiagnosticSeverity::ERROR, "name '{}' is already used"};
+  case DiagCode::DuplicatedParam:
+    return {"duplicated-param", Errno::NAME_ERROR, DiagnosticSeverity::ERROR, "duplicated param name '{}'"};
+  case DiagCode::NestedFunction:
+    return {"nested-function", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "cannot declare a function inside another function"};
+  case DiagCode::NestedImport:
+    return {"nested-import", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "imports are only allowed at module level"};
+  case DiagCode::RetOutsideFunction:
+    return {"return-outside-function", Errno::SYNTAX_ERROR, DiagnosticSeverity::ERROR, "cannot return outside a function"};
+  case DiagCode::VoidFunctionRetValue:
+    return {"void-return-value", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "void function does not accept return value"};
+  case DiagCode::RetTypeMismatch:
+    return {"return-type-mismatch", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "return type mismatch, expect '{}' but got '{}'"};
+  case DiagCode::MissingRetValue:
+    return {"missing-return", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "missing return value for non-void function"};
+  case DiagCode::UninferableType:
+    return {"uninferable-type", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "unable to infer variable type, initialize or annotate expected type"};
+  case DiagCode::ValueTypeMismatch:
+    return {"type-mismatch", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "expect value of type '{}' but got '{}'"};
+  case DiagCode::ArgTypeMismatch:
+    return {"argument-type-mismatch", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "expect argument of type '{}' but got '{}'"};
+  case DiagCode::ArgsCountMismatch:
+    return {"arguments-count-mismatch", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "expect '{}' required args but got '{}'"};
+  case DiagCode::ImportFailed:
+    return {"import-failed", Errno::NAME_ERROR, DiagnosticSeverity::ERROR, "failed to import module"};
+  case DiagCode::ImportCycle:
+    return {"import-cycle", Errno::NAME_ERROR, DiagnosticSeverity::ERROR, "module imports itself, directly or through other modules"};
+  case DiagCode::UndefinedName:
+    return {"undefined-name", Errno::NAME_ERROR, DiagnosticSeverity::ERROR, "undefined name '{}'"};
+  case DiagCode::NotCallable:
+    return {"not-callable", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "call to non-callable object"};
+  case DiagCode::NotAssignable:
+    return {"not-assignable", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "cannot assign to '{}', only variables and params can be assigned"};
+  case DiagCode::NotIndexable:
+    return {"not-indexable", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "object is not indexable"};
+  case DiagCode::NoModuleField:
+    return {"no-module-field", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "module '{}' has no field '{}'"};
+  case DiagCode::NoObjectField:
+    return {"no-object-field", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "object '{}' has no field '{}'"};
+  case DiagCode::InvalidInt:
+    return {"invalid-integer", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "integer literal is invalid"};
+  case DiagCode::IntTooLarge:
+    return {"integer-too-large", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "integer literal exceeds storage limit of 8 bytes"};
+  case DiagCode::InvalidFloat:
+    return {"invalid-float", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "invalid float number"};
+  case DiagCode::FloatOutOfRange:
+    return {"float-out-of-range", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "float number out of range"};
+  case DiagCode::OperandsTypeMismatch:
+    return {"operands-type-mismatch", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "mismatched operand types '{}' and '{}'"};
+  case DiagCode::InvalidOperand:
+    return {"invalid-operand", Errno::TYPE_ERROR, DiagnosticSeverity::ERROR, "arithmetic is not defined on '{}'"};
+  case DiagCode::UnusedValue:
+    return {"unused-value", Errno::UNUSED_VALUE, DiagnosticSeverity::WARN, "expression results to unused value"};
+  case DiagCode::DeadCode:
+    return {"dead-code", Errno::DEAD_CODE, DiagnosticSeverity::WARN, "unreachable code detected"};
+  case DiagCode::UnusedImport:
+    return {"unused-import", Errno::UNUSED_VALUE, DiagnosticSeverity::WARN, "unused import"};
+  case DiagCode::UnusedVariable:
+    return {"unused-variable", Errno::UNUSED_VALUE, DiagnosticSeverity::WARN, "unused variable '{}'"};
+  case DiagCode::UnusedParam:
+    return {"unused-parameter", Errno::UNUSED_VALUE, DiagnosticSeverity::WARN, "unused parameter '{}'"};
+  case DiagCode::UnusedFunction:
+    return {"unused-function", Errno::UNUSED_VALUE, DiagnosticSeverity::WARN, "function '{}' never gets called"};
+  case DiagCode::FormatArgsMismatch:
+    return {"format-args", Errno::TYPE_ERROR, DiagnosticSeverity::WARN, "format expects '{}' args but got '{}'"};
+  case DiagCode::NoteNameUsedHere:
+    return {"note-name-used-here", Errno::OK, DiagnosticSeverity::INFO, "name used here"};
+  case DiagCode::NoteFirstUsedHere:
+    return {"note-first-used-here", Errno::OK, DiagnosticSeverity::INFO, "first used here"};
+  case DiagCode::NoteExpectTypeDueTo:
+    return {"note-expect-type", Errno::OK, DiagnosticSeverity::INFO, "expect '{}' due to here"};
+  case DiagCode::END:
+    break;
+  }
+  return {"unknown", Errno::OK, DiagnosticSeverity::INFO, "unknown diagnostic"};
 }
 
-struct LineInfo
+Errno Diagnostic::GetErrno() const
 {
-  size_t Start;
-  size_t End;
-};
+  return GetInfo(m_Code).m_Errno;
+}
 
-std::vector<LineInfo> split_lines(const std::string &code)
+DiagnosticSeverity Diagnostic::GetSeverity() const
 {
-  std::vector<LineInfo> lines;
-  size_t line_start = 0;
-  for (size_t i = 0; i < code.size(); ++i)
+  return GetInfo(m_Code).m_Severity;
+}
+
+std::string Diagnostic::GetName(DiagCode code)
+{
+  return GetInfo(code).m_Name;
+}
+
+std::optional<DiagCode> Diagnostic::FromName(std::string name)
+{
+  for (uint8_t i = 0; i < static_cast<uint8_t>(DiagCode::END); ++i)
   {
-    if (code[i] == '\n')
+    if (name == GetInfo(static_cast<DiagCode>(i)).m_Name)
     {
-      lines.push_back({line_start, i});
-      line_start = i + 1;
+      return static_cast<DiagCode>(i);
     }
   }
-  if (line_start < code.size())
+  return std::nullopt;
+}
+
+bool DiagnosticFilter::Admit(DiagCode code)
+{
+  auto severity = GetInfo(code).m_Severity;
+  if (DiagnosticSeverity::ERROR != severity)
   {
-    lines.push_back({line_start, code.size()});
+    return m_Disabled.find(code) == m_Disabled.end() && !IsSaturated();
   }
-  return lines;
+  return m_MaxErrors == 0 || m_ErrorsCount++ < m_MaxErrors;
 }
 
-size_t find_line_index(const std::vector<LineInfo> &lines, size_t pos)
+bool DiagnosticFilter::IsSaturated() const
 {
-  for (size_t i = 0; i < lines.size(); ++i)
+  return m_MaxErrors > 0 && m_ErrorsCount >= m_MaxErrors;
+}
+
+std::string DiagnosticEngine::RenderArg(const DiagnosticArg &arg)
+{
+  if (auto span = std::get_if<SourceSpan>(&arg))
   {
-    if (pos >= lines[i].Start && pos < lines[i].End)
+    auto &content = m_ModManager.Get(span->m_ModuleID)->m_Content;
+    if (span->m_Start >= content.size() || span->m_End < span->m_Start)
     {
-      return i;
+      return "";
     }
+    return content.substr(span->m_Start, span->m_End - span->m_Start + 1);
+  }
+  if (auto type = std::get_if<Ptr<type::Type>>(&arg))
+  {
+    return (*type)->Inspect();
   }
-  return lines.size(); // Not found
+  if (auto number = std::get_if<uint64_t>(&arg))
+  {
+    return std::to_string(*number);
+  }
+  return "";
 }
 
-std::string DiagnosticEngine::Highlight(std::string code, size_t start, size_t end, std::string colr)
+std::string DiagnosticEngine::RenderMessage(DiagCode code, const DiagnosticArgs &args)
 {
-  end++;
-  // Clamp start and end to valid range
-  start = std::min(start, code.size());
-  end = std::min(end, code.size());
-  start = std::max(start, static_cast<size_t>(0));
-  end = std::max(end, start);
-
-  auto lines = split_lines(code);
-  if (lines.empty())
+  std::string format = GetInfo(code).m_Format;
+  std::string message;
+  size_t argIndex = 0;
+  for (size_t i = 0; i < format.size(); ++i)
   {
-    return "";
+    if ('{' == format[i] && i + 1 < format.size() && '}' == format[i + 1])
+    {
+      if (argIndex < args.m_Count)
+      {
+        message.append(RenderArg(args.m_Items[argIndex++]));
+      }
+      i++;
+      continue;
+    }
+    message.push_back(format[i]);
   }
+  return message;
+}
 
-  // Find start_line and end_line
-  size_t startLine = find_line_index(lines, start);
-  if (startLine >= lines.size())
+DiagnosticEngine::DiagnosticEngine(ModuleManager &modManager, std::ostream &out, DiagnosticFormat format) : m_ModManager(modManager), m_Out(out), m_Format(format), m_Buffer(), m_Reported(0), m_Finished(false), m_Lines() {};
+
+DiagnosticEngine::~DiagnosticEngine()
+{
+  Finish();
+}
+
+std::optional<DiagnosticFormat> DiagnosticEngine::FormatFromName(const std::string &name)
+{
+  if ("text" == name)
+  {
+    return DiagnosticFormat::Text;
+  }
+  if ("json" == name)
   {
-    startLine = lines.size() - 1;
+    return DiagnosticFormat::Json;
   }
+  if ("sarif" == name)
+  {
+    return DiagnosticFormat::Sarif;
+  }
+  return std::nullopt;
+}
 
-  size_t endLine;
-  if (end == 0)
+const std::vector<DiagnosticEngine::Line> &DiagnosticEngine::GetLines(ModuleID id)
+{
+  auto found = m_Lines.find(id);
+  if (found != m_Lines.end())
   {
-    endLine = startLine;
+    return found->second;
   }
-  else
+  auto &content = m_ModManager.Get(id)->m_Content;
+  std::vector<Line> lines;
+  size_t lineStart = 0;
+  for (size_t i = content.find('\n'); i != std::string::npos; i = content.find('\n', i + 1))
   {
-    endLine = find_line_index(lines, end - 1);
-    if (endLine >= lines.size())
-    {
-      endLine = lines.size() - 1;
-    }
+    lines.emplace_back(lineStart, i);
+    lineStart = i + 1;
+  }
+  if (lineStart < content.size())
+  {
+    lines.emplace_back(lineStart, content.size());
   }
+  return m_Lines.emplace(id, std::move(lines)).first->second;
+}
 
-  // Calculate context lines
-  size_t contextStart = (startLine >= 2) ? startLine - 2 : 0;
-  size_t contextEnd = std::min(endLine + 2, lines.size() - 1);
+size_t DiagnosticEngine::FindLine(const std::vector<Line> &lines, size_t pos)
+{
+  // the last line starting at or before `pos`, past the end is the last line
+  auto after = std::upper_bound(lines.begin(), lines.end(), pos, [](size_t offset, const Line &line)
+                                { return offset < line.m_Start; });
+  return after == lines.begin() ? 0 : static_cast<size_t>(after - lines.begin()) - 1;
+}
 
-  // Collect context lines
-  std::vector<size_t> contextLines;
-  for (size_t i = contextStart; i <= contextEnd; ++i)
+void DiagnosticEngine::Paint(std::string_view text, std::string_view color)
+{
+  m_Buffer.append(color);
+  m_Buffer.append(text);
+  m_Buffer.append(RESET);
+}
+
+void DiagnosticEngine::Highlight(ModuleID id, size_t start, size_t end, std::string_view color, std::string_view indent)
+{
+  auto &code = m_ModManager.Get(id)->m_Content;
+  auto &lines = GetLines(id);
+  end++;
+  // Clamp start and end to valid range
+  start = std::min(start, code.size());
+  end = std::min(end, code.size());
+  end = std::max(end, start);
+
+  if (lines.empty())
   {
-    contextLines.push_back(i);
+    return;
   }
 
-  // Prepare output
-  std::stringstream output;
-  size_t max_line_number = contextEnd + 1;
-  size_t line_number_width = std::to_string(max_line_number).size();
+  size_t startLine = FindLine(lines, start);
+  size_t endLine = 0 == end ? startLine : FindLine(lines, end - 1);
+
+  // Calculate context lines
+  size_t contextStart = (startLine >= 2) ? startLine - 2 : 0;
+  size_t contextEnd = std::min(endLine + 2, lines.size() - 1);
 
-  for (size_t lineIndex : contextLines)
+  size_t lineNumberWidth = std::to_string(contextEnd + 1).size();
+  auto out = std::back_inserter(m_Buffer);
+  for (size_t lineIndex = contextStart; lineIndex <= contextEnd; ++lineIndex)
   {
-    const auto &line = lines[lineIndex];
-    std::string lineCode = code.substr(line.Start, line.End - line.Start);
-    size_t lineNumber = lineIndex + 1;
+    auto &line = lines[lineIndex];
+    std::string_view lineCode(code.data() + line.m_Start, line.m_End - line.m_Start);
 
     // Output code line
-    output << std::setw(static_cast<int>(line_number_width)) << lineNumber << " | " << lineCode << "\n";
+    std::format_to(out, "{}{:>{}} | {}\n", indent, lineIndex + 1, lineNumberWidth, lineCode);
 
     // Check if line is part of the highlighted region
-    if (line.End <= start || line.Start >= end)
+    if (line.m_End <= start || line.m_Start >= end)
     {
       continue;
     }
 
     // Calculate columns to highlight
-    size_t highlightStart = std::max(start, line.Start);
-    size_t highlightEnd = std::min(end, line.End);
-    size_t startColumn = highlightStart - line.Start;
-    size_t endColumn = highlightEnd - line.Start;
+    size_t startColumn = std::max(start, line.m_Start) - line.m_Start;
+    size_t endColumn = std::min(end, line.m_End) - line.m_Start;
 
     // Handle zero-length (caret at a position)
     if (startColumn == endColumn)
@@ -151,46 +335,180 @@ std::string DiagnosticEngine::Highlight(std::string code, size_t start, size_t e
       }
     }
 
-    // Generate caret line
-    std::string caretLine(lineCode.size(), ' ');
-    for (size_t i = startColumn; i < endColumn && i < caretLine.size(); ++i)
-    {
-      caretLine[i] = '^';
-    }
-
     // Output caret line
-    output << std::setw(static_cast<int>(line_number_width)) << "" << " | " << colr << caretLine << RESET << "\n";
+    std::format_to(out, "{}{:>{}} | {}", indent, "", lineNumberWidth, color);
+    m_Buffer.append(startColumn, ' ');
+    m_Buffer.append(std::min(endColumn, lineCode.size()) - startColumn, '^');
+    m_Buffer.append(lineCode.size() - std::min(endColumn, lineCode.size()), ' ');
+    m_Buffer.append(RESET "\n");
+  }
+}
+
+void DiagnosticEngine::ReportText(const Diagnostic &diagnostic)
+{
+  auto severity = diagnostic.GetSeverity();
+  auto message = RenderMessage(diagnostic.m_Code, diagnostic.m_Args);
+  if (DiagnosticSeverity::WARN == severity)
+  {
+    message.append(std::format(" [-W{}]", Diagnostic::GetName(diagnostic.m_Code)));
   }
+  Paint(std::format("{}:{}:{} ", m_ModManager.Get(diagnostic.m_ModuleID)->m_Path, diagnostic.m_Position.m_Line, diagnostic.m_Position.m_Column), BOLD_WHITE);
+  Paint(std::format("{}: {}", MatchSevevirtyString(severity), message), MatchSeverityColor(severity));
+  m_Buffer.append("\n\n");
+  Highlight(diagnostic.m_ModuleID, diagnostic.m_Position.m_Start, diagnostic.m_Position.m_End, MatchSeverityColor(severity), "");
+  m_Buffer.push_back('\n');
 
-  return output.str();
+  if (diagnostic.m_Reference.has_value())
+  {
+    auto &ref = diagnostic.m_Reference.value();
+    Paint(std::format("\t{}:{}:{} {}", m_ModManager.Get(ref.m_ModuleID)->m_Path, ref.m_Position.m_Line, ref.m_Position.m_Column, RenderMessage(ref.m_Code, ref.m_Args)), BOLD_WHITE);
+    m_Buffer.append("\n\n");
+    Highlight(ref.m_ModuleID, ref.m_Position.m_Start, ref.m_Position.m_End, MatchSeverityColor(DiagnosticSeverity::INFO), "\t");
+    m_Buffer.append("\t\n");
+  }
 }
 
-std::string insertTabAfterNewline(const std::string &input)
+void DiagnosticEngine::RenderRegion(Json &object, ModuleID id, Position position, const char *line, const char *column, const char *endLine, const char *endColumn)
 {
-  std::string result = input;
-  size_t pos = 0;
-  while ((pos = result.find("\n", pos)) != std::string::npos)
+  // columns are 1-based, the end one is the column past the last character. Taken from
+  // the offsets as the highlight is, the line of a position may be the next token's
+  auto &lines = GetLines(id);
+  size_t firstLine = position.m_Line;
+  size_t firstColumn = position.m_Column;
+  size_t lastLine = firstLine;
+  size_t lastColumn = firstColumn + 1;
+  if (!lines.empty())
   {
-    result.insert(pos + 1, "\t");
-    pos += 2;
+    size_t end = std::max(position.m_End + 1, position.m_Start + 1);
+    size_t index = FindLine(lines, position.m_Start);
+    firstLine = index + 1;
+    firstColumn = position.m_Start - lines[index].m_Start + 1;
+    index = FindLine(lines, end - 1);
+    lastLine = index + 1;
+    lastColumn = end - lines[index].m_Start + 1;
   }
-  return result;
+  object.Set(line, Json::Number(static_cast<double>(firstLine)));
+  object.Set(column, Json::Number(static_cast<double>(firstColumn)));
+  object.Set(endLine, Json::Number(static_cast<double>(lastLine)));
+  object.Set(endColumn, Json::Number(static_cast<double>(lastColumn)));
 }
 
-void DiagnosticEngine::Report(Diagnostic diagnostic)
+Json DiagnosticEngine::RenderJson(const Diagnostic &diagnostic)
 {
-  std::cerr << Paint(std::format("{}:{}:{} ", m_ModManager.m_Modules[diagnostic.m_ModuleID]->m_Path, diagnostic.m_Position.m_Line, diagnostic.m_Position.m_Column), BOLD_WHITE);
-  std::cerr << Paint(std::format("{}: {}", MatchSevevirtyString(diagnostic.m_Severity), diagnostic.m_Message), MatchSeverityColor(diagnostic.m_Severity)) << std::endl;
-  std::cerr << std::endl;
-  std::cerr << Highlight(m_ModManager.m_Modules[diagnostic.m_ModuleID]->m_Content, diagnostic.m_Position.m_Start, diagnostic.m_Position.m_End, MatchSeverityColor(diagnostic.m_Severity)) << std::endl;
+  static constexpr const char *SEVERITIES[] = {"", "info", "warning", "error"};
+  auto item = Json::Object();
+  item.Set("file", Json::String(m_ModManager.Get(diagnostic.m_ModuleID)->m_Path));
+  RenderRegion(item, diagnostic.m_ModuleID, diagnostic.m_Position, "line", "column", "end_line", "end_column");
+  item.Set("severity", Json::String(SEVERITIES[static_cast<size_t>(diagnostic.GetSeverity())]));
+  item.Set("code", Json::String(Diagnostic::GetName(diagnostic.m_Code)));
+  item.Set("message", Json::String(RenderMessage(diagnostic.m_Code, diagnostic.m_Args)));
+  if (diagnostic.m_Reference.has_value())
+  {
+    auto &ref = diagnostic.m_Reference.value();
+    auto related = Json::Object();
+    related.Set("file", Json::String(m_ModManager.Get(ref.m_ModuleID)->m_Path));
+    RenderRegion(related, ref.m_ModuleID, ref.m_Position, "line", "column", "end_line", "end_column");
+    related.Set("message", Json::String(RenderMessage(ref.m_Code, ref.m_Args)));
+    item.Set("related", std::move(related));
+  }
+  return item;
+}
 
+Json DiagnosticEngine::RenderSarif(const Diagnostic &diagnostic)
+{
+  static constexpr const char *LEVELS[] = {"", "note", "warning", "error"};
+  auto location = [this](ModuleID id, Position position)
+  {
+    auto artifact = Json::Object();
+    artifact.Set("uri", Json::String(m_ModManager.Get(id)->m_Path));
+    auto physical = Json::Object();
+    physical.Set("artifactLocation", std::move(artifact));
+    auto region = Json::Object();
+    RenderRegion(region, id, position, "startLine", "startColumn", "endLine", "endColumn");
+    physical.Set("region", std::move(region));
+    auto result = Json::Object();
+    result.Set("physicalLocation", std::move(physical));
+    return result;
+  };
+  auto text = [](std::string message)
+  {
+    auto object = Json::Object();
+    object.Set("text", Json::String(std::move(message)));
+    return object;
+  };
+
+  auto result = Json::Object();
+  result.Set("ruleId", Json::String(Diagnostic::GetName(diagnostic.m_Code)));
+  result.Set("level", Json::String(LEVELS[static_cast<size_t>(diagnostic.GetSeverity())]));
+  result.Set("message", text(RenderMessage(diagnostic.m_Code, diagnostic.m_Args)));
+  result.Set("locations", Json::Array().Push(location(diagnostic.m_ModuleID, diagnostic.m_Position)));
   if (diagnostic.m_Reference.has_value())
   {
-    auto ref = diagnostic.m_Reference.value();
-    std::cerr << Paint(std::format("\t{}:{}:{} {}", m_ModManager.m_Modules[ref.m_ModuleID]->m_Path, ref.m_Position.m_Line, ref.m_Position.m_Column, ref.m_Message), BOLD_WHITE) << std::endl;
-    std::cerr << std::endl;
-    std::cerr << "\t" << insertTabAfterNewline(Highlight(m_ModManager.m_Modules[ref.m_ModuleID]->m_Content, ref.m_Position.m_Start, ref.m_Position.m_End, MatchSeverityColor(DiagnosticSeverity::INFO))) << std::endl;
+    auto &ref = diagnostic.m_Reference.value();
+    auto related = location(ref.m_ModuleID, ref.m_Position);
+    related.Set("message", text(RenderMessage(ref.m_Code, ref.m_Args)));
+    result.Set("relatedLocations", Json::Array().Push(std::move(related)));
+  }
+  return result;
+}
+
+void DiagnosticEngine::Report(const Diagnostic &diagnostic)
+{
+  if (m_Finished)
+  {
+    return;
+  }
+  switch (m_Format)
+  {
+  case DiagnosticFormat::Text:
+    ReportText(diagnostic);
+    break;
+  case DiagnosticFormat::Json:
+    m_Buffer.append(0 == m_Reported ? "[\n" : ",\n");
+    m_Buffer.append(RenderJson(diagnostic).Dump());
+    break;
+  case DiagnosticFormat::Sarif:
+    m_Buffer.append(0 == m_Reported ? SARIF_START "\n" : ",\n");
+    m_Buffer.append(RenderSarif(diagnostic).Dump());
+    break;
+  }
+  m_Reported++;
+  if (m_Buffer.size() >= FLUSH_SIZE)
+  {
+    Flush();
+  }
+}
+
+void DiagnosticEngine::Flush()
+{
+  if (m_Buffer.empty())
+  {
+    return;
+  }
+  m_Out.write(m_Buffer.data(), static_cast<std::streamsize>(m_Buffer.size()));
+  m_Out.flush();
+  m_Buffer.clear();
+}
+
+void DiagnosticEngine::Finish()
+{
+  if (m_Finished)
+  {
+    return;
+  }
+  m_Finished = true;
+  switch (m_Format)
+  {
+  case DiagnosticFormat::Text:
+    break;
+  case DiagnosticFormat::Json:
+    m_Buffer.append(0 == m_Reported ? "[]\n" : "\n]\n");
+    break;
+  case DiagnosticFormat::Sarif:
+    m_Buffer.append(0 == m_Reported ? SARIF_START SARIF_END : "\n" SARIF_END);
+    break;
   }
+  Flush();
 }
 
 std::string DiagnosticEngine::MatchSevevirtyString(DiagnosticSeverity severity)
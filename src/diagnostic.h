@@ -1,12 +1,25 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
 #include <optional>
+#include <set>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 #include "error.h"
+#include "json.h"
 #include "module.h"
+#include "pointer.h"
 #include "token.h"
+#include "type.h"
 
 enum class DiagnosticSeverity
 {
@@ -15,42 +28,207 @@ enum class DiagnosticSeverity
   ERROR = 3,
 };
 
+enum class DiagCode : uint8_t
+{
+  // syntax errors
+  UnexpectedChar,
+  UnquotedString,
+  UnexpectedPub,
+  UnexpectedToken,
+  MisplacedImplicitRet,
+  InvalidExpr,
+  ExpectIdent,
+  ExpectTypeAnn,
+  // semantic errors
+  NameAlreadyUsed,
+  DuplicatedParam,
+  NestedFunction,
+  NestedImport,
+  RetOutsideFunction,
+  VoidFunctionRetValue,
+  RetTypeMismatch,
+  MissingRetValue,
+  UninferableType,
+  ValueTypeMismatch,
+  ArgTypeMismatch,
+  ArgsCountMismatch,
+  ImportFailed,
+  ImportCycle,
+  UndefinedName,
+  NotCallable,
+  NotAssignable,
+  NotIndexable,
+  NoModuleField,
+  NoObjectField,
+  InvalidInt,
+  IntTooLarge,
+  InvalidFloat,
+  FloatOutOfRange,
+  OperandsTypeMismatch,
+  InvalidOperand,
+  // warnings, can be silenced with `-Wno-<name>`
+  UnusedValue,
+  DeadCode,
+  UnusedImport,
+  UnusedVariable,
+  UnusedParam,
+  UnusedFunction,
+  FormatArgsMismatch,
+  // references
+  NoteNameUsedHere,
+  NoteFirstUsedHere,
+  NoteExpectTypeDueTo,
+
+  END,
+};
+
+/*
+  Slice of a module content, names are recorded this way and only copied out
+  of the source when the diagnostic gets rendered
+*/
+class SourceSpan
+{
+public:
+  ModuleID m_ModuleID;
+  size_t m_Start;
+  size_t m_End;
+
+  SourceSpan(ModuleID moduleID, Position pos) : m_ModuleID(moduleID), m_Start(pos.m_Start), m_End(pos.m_End) {};
+};
+
+using DiagnosticArg = std::variant<std::monostate, SourceSpan, Ptr<type::Type>, uint64_t>;
+
+class DiagnosticArgs
+{
+public:
+  static constexpr size_t Capacity = 2;
+
+  std::array<DiagnosticArg, Capacity> m_Items;
+  uint8_t m_Count;
+
+  DiagnosticArgs() : m_Items(), m_Count(0) {};
+  DiagnosticArgs(std::initializer_list<DiagnosticArg> args) : m_Items(), m_Count(0)
+  {
+    for (auto &arg : args)
+    {
+      if (m_Count < Capacity)
+      {
+        m_Items[m_Count++] = arg;
+      }
+    }
+  }
+};
+
 class DiagnosticReference
 {
 public:
-  Errno m_Errno;
+  DiagCode m_Code;
   ModuleID m_ModuleID;
   Position m_Position;
-  std::string m_Message;
+  DiagnosticArgs m_Args;
 
-  DiagnosticReference(Errno errn, ModuleID moduleID, Position position, std::string message) : m_Errno(errn), m_ModuleID(moduleID), m_Position(position), m_Message(message) {};
+  DiagnosticReference(DiagCode code, ModuleID moduleID, Position position, DiagnosticArgs args = {}) : m_Code(code), m_ModuleID(moduleID), m_Position(position), m_Args(args) {};
 };
 
 class Diagnostic
 {
 public:
-  Errno m_Errno;
+  DiagCode m_Code;
   Position m_Position;
   ModuleID m_ModuleID;
-  DiagnosticSeverity m_Severity;
-  std::string m_Message;
+  DiagnosticArgs m_Args;
   std::optional<DiagnosticReference> m_Reference;
 
-  Diagnostic(Errno errn, Position pos, ModuleID moduleID, DiagnosticSeverity severity, std::string message, std::optional<DiagnosticReference> reference = std::nullopt) : m_Errno(errn), m_Position(pos), m_ModuleID(moduleID), m_Severity(severity), m_Message(message), m_Reference(reference) {};
+  Diagnostic(DiagCode code, Position pos, ModuleID moduleID, DiagnosticArgs args = {}, std::optional<DiagnosticReference> reference = std::nullopt) : m_Code(code), m_Position(pos), m_ModuleID(moduleID), m_Args(args), m_Reference(reference) {};
+
+  Errno GetErrno() const;
+  DiagnosticSeverity GetSeverity() const;
+
+  static std::string GetName(DiagCode);
+  static std::optional<DiagCode> FromName(std::string);
 };
 
+/*
+  Decides which diagnostics are worth keeping, consulted before they are stored
+  so dropped ones never reach rendering
+*/
+class DiagnosticFilter
+{
+public:
+  size_t m_MaxErrors; // 0 means no limit
+  std::set<DiagCode> m_Disabled;
+  // shared by checkers running on different threads
+  std::atomic<size_t> m_ErrorsCount;
+
+  DiagnosticFilter() : m_MaxErrors(0), m_Disabled(), m_ErrorsCount(0) {};
+
+  bool Admit(DiagCode);
+  bool IsSaturated() const;
+};
+
+enum class DiagnosticFormat
+{
+  Text,
+  Json,  // an array of diagnostics
+  Sarif, // a SARIF 2.1.0 log holding one run
+};
+
+/*
+  Renders diagnostics into a buffer written out in large pieces, the line table of
+  a module gets built the first time one of its diagnostics is rendered. The
+  machine formats make a single document, closed by `Finish` or the destructor
+*/
 class DiagnosticEngine
 {
 public:
-  DiagnosticEngine(ModuleManager &modManager) : m_ModManager(modManager) {}
+  DiagnosticEngine(ModuleManager &modManager, std::ostream &out = std::cerr, DiagnosticFormat format = DiagnosticFormat::Text);
+  ~DiagnosticEngine();
+
+  DiagnosticEngine(const DiagnosticEngine &) = delete;
+  DiagnosticEngine &operator=(const DiagnosticEngine &) = delete;
 
-  void Report(Diagnostic diagnostic);
+  void Report(const Diagnostic &diagnostic);
+  std::string RenderMessage(DiagCode code, const DiagnosticArgs &args);
+  // writes out what got rendered so far
+  void Flush();
+  // closes the document and flushes, nothing gets reported afterwards
+  void Finish();
+
+  static std::optional<DiagnosticFormat> FormatFromName(const std::string &name);
 
 private:
+  // offsets into the content, `m_End` is the newline ending the line
+  class Line
+  {
+  public:
+    size_t m_Start;
+    size_t m_End;
+
+    Line(size_t start, size_t end) : m_Start(start), m_End(end) {};
+  };
+
+  static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
   ModuleManager &m_ModManager;
+  std::ostream &m_Out;
+  DiagnosticFormat m_Format;
+  std::string m_Buffer;
+  size_t m_Reported;
+  bool m_Finished;
+  std::unordered_map<ModuleID, std::vector<Line>> m_Lines;
+
+  const std::vector<Line> &GetLines(ModuleID id);
+  size_t FindLine(const std::vector<Line> &lines, size_t pos);
+
+  void ReportText(const Diagnostic &diagnostic);
+  Json RenderJson(const Diagnostic &diagnostic);
+  Json RenderSarif(const Diagnostic &diagnostic);
+  // sets the start and the end of `position` under the given keys
+  void RenderRegion(Json &object, ModuleID id, Position position, const char *line, const char *column, const char *endLine, const char *endColumn);
 
-  std::string Paint(std::string code, std::string color);
-  std::string Highlight(std::string code, size_t start, size_t end, std::string color);
+  std::string RenderArg(const DiagnosticArg &arg);
+  void Paint(std::string_view text, std::string_view color);
+  void Highlight(ModuleID id, size_t start, size_t end, std::string_view color, std::string_view indent);
 
   std::string MatchSeverityColor(DiagnosticSeverity severity);
   std::string MatchSevevirtyString(DiagnosticSeverity severity);
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+#include "cache.h"
+#include "checker.h"
+#include "diagnostic.h"
+#include "driver.h"
+#include "module.h"
+#include "parallel.h"
+#include "parser.h"
+#include "pointer.h"
+
+CheckOutcome CheckEntries(ModuleManager &modManager, const std::vector<std::string> &inputFiles, DiagnosticFilter &filter, size_t jobs)
+{
+  CheckOutcome outcome;
+  for (auto &inputFile : inputFiles)
+  {
+    auto loadRes = modManager.Load(inputFile);
+    if (loadRes.is_err())
+    {
+      outcome.m_LoadErrors.push_back(inputFile + ": " + loadRes.unwrap_err().Message);
+      outcome.m_HasErrors = true;
+      continue;
+    }
+    // the same module may be named twice
+    if (std::find(outcome.m_Entries.begin(), outcome.m_Entries.end(), loadRes.unwrap()) == outcome.m_Entries.end())
+    {
+      outcome.m_Entries.push_back(loadRes.unwrap());
+    }
+  }
+  auto &entries = outcome.m_Entries;
+  std::vector<std::vector<Diagnostic>> found(entries.size());
+  std::vector<char> parseErrors(entries.size(), false);
+  ParallelFor(entries.size(), jobs, [&](size_t i)
+              {
+                auto entry = entries.at(i);
+                bool cycle = false;
+                if (modManager.Claim(entry, ModuleState::Loaded, cycle))
+                {
+                  auto parseError = Parser(entry, modManager).Parse();
+                  modManager.Finish(entry, parseError.has_value() ? ModuleState::Invalid : ModuleState::Parsed);
+                  if (parseError.has_value())
+                  {
+                    found.at(i).push_back(parseError.value());
+                    parseErrors.at(i) = true;
+                    return;
+                  }
+                }
+                // reached first as the import of another entry, its diagnostics went there
+                if (!modManager.Claim(entry, ModuleState::Parsed, cycle))
+                {
+                  return;
+                }
+                auto checker = MakePtr(Checker(entry, modManager, filter, CheckMode::Interface));
+                found.at(i) = checker->CheckInterface();
+                entry->m_Checker = checker;
+                modManager.Finish(entry, ModuleState::Deferred);
+              });
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    outcome.m_Diagnostics.insert(outcome.m_Diagnostics.end(), found.at(i).begin(), found.at(i).end());
+    outcome.m_HasErrors = outcome.m_HasErrors || parseErrors.at(i);
+  }
+  // interface errors stick to their checker, so they surface here too
+  outcome.m_HasErrors = Checker::CheckDeferred(modManager, outcome.m_Diagnostics, jobs) || outcome.m_HasErrors;
+  ReplayCached(modManager, entries, filter, outcome.m_Diagnostics);
+  SortDiagnostics(modManager, outcome.m_Diagnostics);
+  return outcome;
+}
+
+void SortDiagnostics(ModuleManager &modManager, std::vector<Diagnostic> &diagnostics)
+{
+  std::stable_sort(diagnostics.begin(), diagnostics.end(), [&](const Diagnostic &a, const Diagnostic &b)
+                   { return std::tie(modManager.Get(a.m_ModuleID)->m_Path, a.m_Position.m_Start) < std::tie(modManager.Get(b.m_ModuleID)->m_Path, b.m_Position.m_Start); });
+}
+
+std::vector<Ptr<Module>> Reachable(ModuleManager &modManager, const std::vector<Ptr<Module>> &entries)
+{
+  std::vector<Ptr<Module>> reached;
+  std::unordered_set<ModuleID> seen;
+  for (auto &entry : entries)
+  {
+    if (seen.insert(entry->m_ID).second)
+    {
+      reached.push_back(entry);
+    }
+  }
+  for (size_t i = 0; i < reached.size(); ++i)
+  {
+    for (auto importID : reached.at(i)->m_Imports)
+    {
+      auto imported = modManager.Get(importID);
+      if (imported && seen.insert(importID).second)
+      {
+        reached.push_back(imported);
+      }
+    }
+  }
+  return reached;
+}
+
+void ReplayCached(ModuleManager &modManager, const std::vector<Ptr<Module>> &entries, DiagnosticFilter &filter, std::vector<Diagnostic> &diagnostics)
+{
+  if (!modManager.m_Cache)
+  {
+    return;
+  }
+  for (auto &module : Reachable(modManager, entries))
+  {
+    for (auto &diagnostic : modManager.m_Cache->TakeDiagnostics(module->m_ID))
+    {
+      if (filter.Admit(diagnostic.m_Code))
+      {
+        diagnostics.push_back(diagnostic);
+      }
+    }
+  }
+}
+
+CheckOutcome Workspace::Check(const std::vector<std::string> &inputFiles, size_t jobs)
+{
+  // an import that failed may resolve now that files were added, nothing tells but trying again
+  std::unordered_set<ModuleID> forced;
+  for (auto &[id, diagnostics] : m_Diagnostics)
+  {
+    if (std::any_of(diagnostics.begin(), diagnostics.end(), [](const Diagnostic &diagnostic)
+                    { return DiagCode::ImportFailed == diagnostic.m_Code || DiagCode::ImportCycle == diagnostic.m_Code; }))
+    {
+      forced.insert(id);
+    }
+  }
+  for (auto id : m_ModManager.Refresh(forced))
+  {
+    m_Diagnostics.erase(id);
+  }
+  std::unordered_set<ModuleID> settled;
+  for (auto &module : m_ModManager.Modules())
+  {
+    if (ModuleState::Checked == module->m_State || ModuleState::Invalid == module->m_State)
+    {
+      settled.insert(module->m_ID);
+    }
+  }
+  DiagnosticFilter everything;
+  auto outcome = CheckEntries(m_ModManager, inputFiles, everything, jobs);
+  for (auto &module : m_ModManager.Modules())
+  {
+    if (!settled.contains(module->m_ID))
+    {
+      m_Diagnostics[module->m_ID].clear();
+    }
+  }
+  for (auto &diagnostic : outcome.m_Diagnostics)
+  {
+    if (!settled.contains(diagnostic.m_ModuleID))
+    {
+      m_Diagnostics[diagnostic.m_ModuleID].push_back(diagnostic);
+    }
+  }
+  outcome.m_Diagnostics.clear();
+  outcome.m_HasErrors = !outcome.m_LoadErrors.empty();
+  for (auto &module : Reachable(m_ModManager, outcome.m_Entries))
+  {
+    if (auto found = m_Diagnostics.find(module->m_ID); found != m_Diagnostics.end())
+    {
+      outcome.m_Diagnostics.insert(outcome.m_Diagnostics.end(), found->second.begin(), found->second.end());
+    }
+  }
+  for (auto &diagnostic : outcome.m_Diagnostics)
+  {
+    outcome.m_HasErrors = outcome.m_HasErrors || DiagnosticSeverity::ERROR == diagnostic.GetSeverity();
+  }
+  SortDiagnostics(m_ModManager, outcome.m_Diagnostics);
+  return outcome;
+}
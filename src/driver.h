@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "diagnostic.h"
+#include "module.h"
+#include "pointer.h"
+
+// what checking a set of entry points found
+class CheckOutcome
+{
+public:
+  std::vector<Ptr<Module>> m_Entries;
+  // sorted by path and position
+  std::vector<Diagnostic> m_Diagnostics;
+  // "<path>: <message>" for each entry point that failed to load
+  std::vector<std::string> m_LoadErrors;
+  bool m_HasErrors;
+
+  CheckOutcome() : m_Entries(), m_Diagnostics(), m_LoadErrors(), m_HasErrors(false) {};
+};
+
+// Checks every entry point against one module table: entries get parsed and their
+// interfaces checked in parallel, then every deferred function body. Modules the
+// table holds checked already are skipped along with their diagnostics, so a table
+// kept between checks only pays for what was loaded or refreshed since
+CheckOutcome CheckEntries(ModuleManager &modManager, const std::vector<std::string> &inputFiles, DiagnosticFilter &filter, size_t jobs);
+// module IDs depend on which thread loaded a module first, paths do not
+void SortDiagnostics(ModuleManager &modManager, std::vector<Diagnostic> &diagnostics);
+// `entries` and every module they import, directly or not
+std::vector<Ptr<Module>> Reachable(ModuleManager &modManager, const std::vector<Ptr<Module>> &entries);
+// Appends what the build cache kept for the modules it answered among `entries` and
+// their imports, as far as `filter` admits it. Each module hands its diagnostics out once
+void ReplayCached(ModuleManager &modManager, const std::vector<Ptr<Module>> &entries, DiagnosticFilter &filter, std::vector<Diagnostic> &diagnostics);
+
+/*
+  A module table kept between checks, with the diagnostics of every module in it.
+  Each check first refreshes the table against the disk and the overlays, so it
+  only pays for the modules that changed and the ones importing them
+*/
+class Workspace
+{
+public:
+  ModuleManager m_ModManager;
+
+  Workspace() : m_ModManager(), m_Diagnostics() {};
+
+  // Like `CheckEntries`, except the outcome holds the diagnostics of every module the
+  // entries reach, whether checked now or by an earlier call, and none is filtered
+  CheckOutcome Check(const std::vector<std::string> &inputFiles, size_t jobs);
+
+private:
+  std::unordered_map<ModuleID, std::vector<Diagnostic>> m_Diagnostics;
+};
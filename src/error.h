@@ -9,6 +9,7 @@ enum class Errno
   NAME_ERROR,
   TYPE_ERROR,
   SYNTAX_ERROR,
+  RUNTIME_ERROR,
 
   UNUSED_VALUE,
   DEAD_CODE,
@@ -0,0 +1,297 @@
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bytes.h"
+#include "context.h"
+#include "error.h"
+#include "interface.h"
+#include "module.h"
+#include "pointer.h"
+#include "result.h"
+#include "sha256.h"
+#include "token.h"
+#include "type.h"
+
+#define ZRI_MAGIC "ZRI"
+#define ZRI_VERSION 2
+
+static void WriteStamp(ByteWriter &writer, const SourceStamp &stamp)
+{
+  writer.String(stamp.m_Path);
+  writer.Varint(stamp.m_Size);
+  writer.Signed(stamp.m_MTime);
+}
+
+static SourceStamp ReadStamp(ByteReader &reader)
+{
+  auto path = reader.String();
+  auto size = reader.Varint();
+  auto mtime = reader.Signed();
+  return SourceStamp(path, size, mtime);
+}
+
+void ModuleInterface::WritePos(ByteWriter &writer, const Position &pos)
+{
+  writer.Varint(pos.m_Line);
+  writer.Varint(pos.m_Column);
+  writer.Varint(pos.m_Start);
+  writer.Varint(pos.m_End);
+}
+
+Position ModuleInterface::ReadPos(ByteReader &reader)
+{
+  auto line = reader.Varint();
+  auto column = reader.Varint();
+  auto start = reader.Varint();
+  auto end = reader.Varint();
+  return Position(line, column, start, end);
+}
+
+void ModuleInterface::WriteType(ByteWriter &writer, Ptr<type::Type> type)
+{
+  writer.Byte(static_cast<uint8_t>(type->m_Base));
+  switch (type->m_Base)
+  {
+  case type::Base::IntRange:
+  {
+    auto intRange = CastPtr<type::IntRange>(type);
+    writer.Byte(intRange->m_IsSigned);
+    writer.Varint(intRange->m_BytesCout);
+  }
+  break;
+  case type::Base::FUNCTION:
+  {
+    auto funType = CastPtr<type::Function>(type);
+    writer.Varint(funType->m_ReqArgsCount);
+    writer.Varint(funType->m_Args.size());
+    for (auto &arg : funType->m_Args)
+    {
+      WriteType(writer, arg);
+    }
+    WriteType(writer, funType->m_RetType);
+    writer.Byte(funType->m_IsVarArgs);
+  }
+  break;
+  case type::Base::OBJECT:
+  {
+    auto objType = CastPtr<type::Object>(type);
+    writer.Varint(objType->m_Entries.size());
+    for (auto &entry : objType->m_Entries)
+    {
+      writer.String(entry.first);
+      WriteType(writer, entry.second);
+    }
+  }
+  break;
+  default:
+    break;
+  }
+}
+
+Ptr<type::Type> ModuleInterface::ReadType(ByteReader &reader)
+{
+  auto base = static_cast<type::Base>(reader.Byte());
+  switch (base)
+  {
+  case type::Base::IntRange:
+  {
+    bool isSigned = reader.Byte();
+    auto bytesCount = reader.Varint();
+    return type::IntRange::Get(isSigned, bytesCount);
+  }
+  case type::Base::FUNCTION:
+  {
+    auto reqArgsCount = reader.Varint();
+    auto argsCount = reader.Varint();
+    std::vector<Ptr<type::Type>> args;
+    for (uint64_t i = 0; i < argsCount && reader.IsOk(); ++i)
+    {
+      args.push_back(ReadType(reader));
+    }
+    auto retType = ReadType(reader);
+    bool isVarArgs = reader.Byte();
+    return MakePtr(type::Function(reqArgsCount, std::move(args), retType, isVarArgs));
+  }
+  case type::Base::OBJECT:
+  {
+    auto objType = MakePtr(type::Object());
+    auto entriesCount = reader.Varint();
+    for (uint64_t i = 0; i < entriesCount && reader.IsOk(); ++i)
+    {
+      auto name = reader.String();
+      objType->m_Entries[name] = ReadType(reader);
+    }
+    return objType;
+  }
+  case type::Base::VOID:
+  case type::Base::STRING:
+  case type::Base::I8:
+  case type::Base::I16:
+  case type::Base::I32:
+  case type::Base::I64:
+  case type::Base::U8:
+  case type::Base::U16:
+  case type::Base::U32:
+  case type::Base::U64:
+  case type::Base::Float:
+  case type::Base::UNIT:
+    return type::Type::Get(base);
+  default:
+    reader.Fail();
+    return type::Type::Get(type::Base::UNKNOWN);
+  }
+}
+
+void ModuleInterface::WriteExports(ByteWriter &writer, Ptr<Module> module)
+{
+  writer.Varint(module->m_Exports->Store.size());
+  for (auto &pair : module->m_Exports->Store)
+  {
+    auto &decl = module->m_Sema->m_Decls.at(pair.second);
+    writer.String(pair.first);
+    writer.Byte(static_cast<uint8_t>(decl.m_DeclT));
+    writer.Byte(decl.m_Flags.m_Bits);
+    WritePos(writer, decl.m_Pos);
+    WritePos(writer, decl.m_NamePos);
+    WritePos(writer, decl.m_ParamsPos);
+    WriteType(writer, decl.m_Type);
+  }
+}
+
+bool ModuleInterface::ReadExports(ByteReader &reader, Ptr<Module> module)
+{
+  module->m_Exports = MakePtr(ModuleContext());
+  module->m_Sema = MakePtr(SemaInfo());
+  auto exportsCount = reader.Varint();
+  bool isValid = reader.IsOk();
+  for (uint64_t i = 0; i < exportsCount && isValid; ++i)
+  {
+    auto name = reader.String();
+    auto declT = static_cast<DeclT>(reader.Byte());
+    Flags flags;
+    flags.m_Bits = reader.Byte();
+    auto pos = ReadPos(reader);
+    auto namePos = ReadPos(reader);
+    auto paramsPos = ReadPos(reader);
+    auto type = ReadType(reader);
+    isValid = reader.IsOk() && (DeclT::Fun == declT || DeclT::Var == declT) && (DeclT::Fun != declT || type::Base::FUNCTION == type->m_Base);
+    Decl decl(declT, name, type, pos, namePos, 0);
+    decl.m_ParamsPos = paramsPos;
+    decl.m_Flags = flags;
+    module->m_Exports->Save(name, module->m_Sema->Declare(decl));
+  }
+  module->m_Sema->m_Globals = module->m_Sema->m_Decls;
+  return isValid;
+}
+
+std::string ModuleInterface::Dir()
+{
+  static const std::string dir = []() -> std::string
+  {
+    auto cacheHome = std::getenv("XDG_CACHE_HOME");
+    if (cacheHome && *cacheHome)
+    {
+      return std::string(cacheHome) + "/zeroc/interfaces";
+    }
+    auto home = std::getenv("HOME");
+    if (home && *home)
+    {
+      return std::string(home) + "/.cache/zeroc/interfaces";
+    }
+    return "";
+  }();
+  return dir;
+}
+
+std::string ModuleInterface::PathFor(std::string sourcePath)
+{
+  if (Dir().empty())
+  {
+    return "";
+  }
+  // the stamp inside tells which source a file is for, the name only has to spread them
+  std::error_code errorCode;
+  auto absolute = std::filesystem::absolute(sourcePath, errorCode).lexically_normal().string();
+  return Dir() + "/" + Sha256::Of(errorCode ? sourcePath : absolute) + ".zri";
+}
+
+Result<Ptr<Module>, Error> ModuleInterface::Read(std::string interfacePath, std::string sourcePath, ModuleID id, Resolver &resolver)
+{
+  int fd = open(interfacePath.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return Error(Errno::FS_ERROR, "no interface file");
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0)
+  {
+    close(fd);
+    return Error(Errno::FS_ERROR, "empty interface file");
+  }
+  size_t size = static_cast<size_t>(info.st_size);
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == data)
+  {
+    return Error(Errno::FS_ERROR, "failed to map interface file");
+  }
+
+  ByteReader reader(static_cast<const uint8_t *>(data), size);
+  auto module = MakePtr(Module(id, sourcePath, ""));
+  bool isValid = reader.String() == ZRI_MAGIC && ZRI_VERSION == reader.Varint();
+  if (isValid)
+  {
+    module->m_Stamp = ReadStamp(reader);
+    isValid = reader.IsOk() && module->m_Stamp.m_Path == sourcePath && resolver.IsFresh(module->m_Stamp);
+  }
+  auto depsCount = isValid ? reader.Varint() : 0;
+  for (uint64_t i = 0; i < depsCount && isValid; ++i)
+  {
+    auto stamp = ReadStamp(reader);
+    isValid = reader.IsOk() && resolver.IsFresh(stamp);
+    module->m_DepStamps.push_back(stamp);
+  }
+  isValid = isValid && ReadExports(reader, module);
+  munmap(data, size);
+
+  if (!isValid)
+  {
+    return Error(Errno::FS_ERROR, "stale or malformed interface file");
+  }
+  module->m_State = ModuleState::Checked;
+  return module;
+}
+
+std::optional<Error> ModuleInterface::Write(Ptr<Module> module)
+{
+  ByteWriter writer;
+  writer.String(ZRI_MAGIC);
+  writer.Varint(ZRI_VERSION);
+  WriteStamp(writer, module->m_Stamp);
+  writer.Varint(module->m_DepStamps.size());
+  for (auto &stamp : module->m_DepStamps)
+  {
+    WriteStamp(writer, stamp);
+  }
+  WriteExports(writer, module);
+  auto path = PathFor(module->m_Path);
+  if (path.empty())
+  {
+    return Error(Errno::FS_ERROR, "no directory to keep interface files in");
+  }
+  // a directory that cannot be created makes the write fail below
+  std::error_code errorCode;
+  std::filesystem::create_directories(Dir(), errorCode);
+  if (!WriteFile(path, writer.m_Buffer))
+  {
+    return Error(Errno::FS_ERROR, "failed to write interface file");
+  }
+  return std::nullopt;
+}
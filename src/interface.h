@@ -0,0 +1,45 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "bytes.h"
+#include "error.h"
+#include "module.h"
+#include "pointer.h"
+#include "resolver.h"
+#include "result.h"
+#include "token.h"
+#include "type.h"
+
+/*
+  Compiled module interface (`.zri`), the export table of a checked module kept
+  in the user's cache directory so importers can skip reading, parsing and
+  checking it. Only imported modules get one.
+
+  Integers are LEB128 varints and strings are length prefixed:
+    "ZRI" magic, format version
+    source stamp, dependency stamps
+    exports: name, bind kind, positions, type tree
+*/
+class ModuleInterface
+{
+public:
+  // $XDG_CACHE_HOME/zeroc/interfaces or ~/.cache/zeroc/interfaces, empty when neither is set
+  static std::string Dir();
+  // empty when there is no directory to keep interfaces in
+  static std::string PathFor(std::string sourcePath);
+
+  // fails if the file is malformed or any stamp it records went stale
+  static Result<Ptr<Module>, Error> Read(std::string interfacePath, std::string sourcePath, ModuleID id, Resolver &resolver);
+  static std::optional<Error> Write(Ptr<Module> module);
+
+  // the export table alone, shared with the build cache
+  static void WriteExports(ByteWriter &writer, Ptr<Module> module);
+  // gives `module` fresh exports and sema, false if the table is malformed
+  static bool ReadExports(ByteReader &reader, Ptr<Module> module);
+  static void WritePos(ByteWriter &writer, const Position &pos);
+  static Position ReadPos(ByteReader &reader);
+  static void WriteType(ByteWriter &writer, Ptr<type::Type> type);
+  static Ptr<type::Type> ReadType(ByteReader &reader);
+};
@@ -1 +1,942 @@
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include "ir.h"
+
+namespace ir
+{
+std::string TyName(Ty ty)
+{
+  switch (ty)
+  {
+  case Ty::Void:
+    return "void";
+  case Ty::I8:
+    return "i8";
+  case Ty::I16:
+    return "i16";
+  case Ty::I32:
+    return "i32";
+  case Ty::I64:
+    return "i64";
+  case Ty::U8:
+    return "u8";
+  case Ty::U16:
+    return "u16";
+  case Ty::U32:
+    return "u32";
+  case Ty::U64:
+    return "u64";
+  case Ty::F64:
+    return "f64";
+  case Ty::Str:
+    return "str";
+  case Ty::Fn:
+    return "fn";
+  }
+  return "?";
+}
+
+bool IsInt(Ty ty)
+{
+  return BitWidth(ty) > 0;
+}
+
+bool IsSigned(Ty ty)
+{
+  switch (ty)
+  {
+  case Ty::I8:
+  case Ty::I16:
+  case Ty::I32:
+  case Ty::I64:
+    return true;
+  default:
+    return false;
+  }
+}
+
+unsigned BitWidth(Ty ty)
+{
+  switch (ty)
+  {
+  case Ty::I8:
+  case Ty::U8:
+    return 8;
+  case Ty::I16:
+  case Ty::U16:
+    return 16;
+  case Ty::I32:
+  case Ty::U32:
+    return 32;
+  case Ty::I64:
+  case Ty::U64:
+    return 64;
+  default:
+    return 0;
+  }
+}
+
+uint64_t NormalizeBits(Ty ty, uint64_t bits)
+{
+  auto width = BitWidth(ty);
+  if (0 == width || 64 == width)
+  {
+    return bits;
+  }
+  auto mask = (uint64_t(1) << width) - 1;
+  bits &= mask;
+  if (IsSigned(ty) && ((bits >> (width - 1)) & 1))
+  {
+    bits |= ~mask;
+  }
+  return bits;
+}
+
+std::string OpName(Op op)
+{
+  switch (op)
+  {
+  case Op::Const:
+    return "const";
+  case Op::Param:
+    return "param";
+  case Op::Copy:
+    return "copy";
+  case Op::Cast:
+    return "cast";
+  case Op::FuncRef:
+    return "funcref";
+  case Op::Load:
+    return "load";
+  case Op::Store:
+    return "store";
+  case Op::Call:
+    return "call";
+  case Op::CallIndirect:
+    return "call.indirect";
+  case Op::Phi:
+    return "phi";
+  case Op::Add:
+    return "add";
+  case Op::Sub:
+    return "sub";
+  case Op::Mul:
+    return "mul";
+  case Op::Div:
+    return "div";
+  case Op::Ret:
+    return "ret";
+  case Op::Jmp:
+    return "jmp";
+  case Op::Unreachable:
+    return "unreachable";
+  }
+  return "?";
+}
+
+bool IsTerminator(Op op)
+{
+  return Op::Ret == op || Op::Jmp == op || Op::Unreachable == op;
+}
+
+bool IsArith(Op op)
+{
+  return Op::Add == op || Op::Sub == op || Op::Mul == op || Op::Div == op;
+}
+
+std::vector<Block *> Block::Successors() const
+{
+  auto terminator = Terminator();
+  if (terminator && Op::Jmp == terminator->m_Op)
+  {
+    return {terminator->m_Target};
+  }
+  return {};
+}
+
+size_t Function::Size() const
+{
+  size_t size = 0;
+  for (auto block : m_Blocks)
+  {
+    size += block->m_Instrs.size();
+  }
+  return size;
+}
+
+std::unordered_map<Block *, std::vector<Block *>> Function::Predecessors() const
+{
+  std::unordered_map<Block *, std::vector<Block *>> preds;
+  for (auto block : m_Blocks)
+  {
+    for (auto succ : block->Successors())
+    {
+      preds[succ].push_back(block);
+    }
+  }
+  return preds;
+}
+
+void Function::ReplaceAllUses(Instr *from, Instr *to)
+{
+  for (auto block : m_Blocks)
+  {
+    for (auto instr : block->m_Instrs)
+    {
+      for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+      {
+        if (instr->m_Args[i] == from)
+        {
+          instr->m_Args[i] = to;
+        }
+      }
+    }
+  }
+}
+
+void Function::Renumber()
+{
+  m_BlocksCount = 0;
+  m_ValuesCount = 0;
+  for (auto block : m_Blocks)
+  {
+    block->m_ID = m_BlocksCount++;
+    for (auto instr : block->m_Instrs)
+    {
+      instr->m_ID = m_ValuesCount++;
+    }
+  }
+}
+
+Function *Program::NewFunction(std::string name, std::string symbol, ModuleID modID, std::vector<Ty> params, Ty retTy)
+{
+  auto function = m_Arena.Make<Function>(name, symbol, modID, std::move(params), retTy);
+  m_Functions.push_back(function);
+  return function;
+}
+
+Global *Program::NewGlobal(std::string name, std::string symbol, Ty ty, ModuleID modID, bool isPub)
+{
+  auto global = m_Arena.Make<Global>(name, symbol, ty, modID, isPub);
+  m_Globals.push_back(global);
+  return global;
+}
+
+Block *Program::NewBlock(Function *function)
+{
+  auto block = m_Arena.Make<Block>(function->m_BlocksCount++, function);
+  function->m_Blocks.push_back(block);
+  return block;
+}
+
+Instr *Program::NewInstr(Op op, Ty ty, std::initializer_list<Instr *> args)
+{
+  return NewInstr(op, ty, std::vector<Instr *>(args));
+}
+
+Instr *Program::NewInstr(Op op, Ty ty, const std::vector<Instr *> &args)
+{
+  auto instr = m_Arena.Make<Instr>(op, ty);
+  instr->m_ArgsCount = static_cast<uint32_t>(args.size());
+  instr->m_Args = m_Arena.MakeArray<Instr *>(args.size());
+  for (size_t i = 0; i < args.size(); ++i)
+  {
+    instr->m_Args[i] = args.at(i);
+  }
+  return instr;
+}
+
+uint64_t Program::Intern(const std::string &str)
+{
+  auto found = m_StringIDs.find(str);
+  if (found != m_StringIDs.end())
+  {
+    return found->second;
+  }
+  m_Strings.push_back(str);
+  m_StringIDs.emplace(str, m_Strings.size() - 1);
+  return m_Strings.size() - 1;
+}
+
+StringPool StringPool::Build(const std::vector<std::string> &strings)
+{
+  // sorted by their reversed bytes, a literal comes right before the ones it is a suffix of
+  std::vector<size_t> order(strings.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+            { return std::lexicographical_compare(strings.at(a).rbegin(), strings.at(a).rend(), strings.at(b).rbegin(), strings.at(b).rend()); });
+  StringPool pool;
+  pool.m_Offsets.assign(strings.size(), 0);
+  const std::string *last = nullptr;
+  uint64_t lastOffset = 0;
+  for (auto it = order.rbegin(); it != order.rend(); ++it)
+  {
+    auto &str = strings.at(*it);
+    if (last && last->ends_with(str))
+    {
+      pool.m_Offsets.at(*it) = lastOffset + last->size() - str.size();
+      continue;
+    }
+    last = &str;
+    lastOffset = pool.m_Bytes.size();
+    pool.m_Offsets.at(*it) = lastOffset;
+    pool.m_Bytes += str;
+    pool.m_Bytes += '\0';
+  }
+  return pool;
+}
+
+std::string TrapMessage(const ModuleManager &modManager, const Function *function, const Instr *instr, const std::string &what)
+{
+  auto where = [&](const Function *in, const Position &pos)
+  { return std::format("{}:{}:{}", modManager.Get(in->m_ModID)->m_Path, pos.m_Line, pos.m_Column); };
+  auto origin = instr->Origin(function);
+  auto message = std::format("{}: {} in '{}'", where(origin, instr->m_Pos), what, origin->m_Name);
+  for (auto site = instr->m_Inlined; site; site = site->m_Parent)
+  {
+    auto caller = site->m_Parent ? site->m_Parent->m_Function : function;
+    message += std::format(", inlined at {} in '{}'", where(caller, site->m_CallPos), caller->m_Name);
+  }
+  return message;
+}
+
+Instr *Builder::Insert(Instr *instr)
+{
+  instr->m_Block = m_Block;
+  instr->m_ID = m_Block->m_Parent->m_ValuesCount++;
+  instr->m_Pos = m_Pos;
+  m_Block->m_Instrs.push_back(instr);
+  return instr;
+}
+
+Instr *Builder::Emit(Op op, Ty ty, std::initializer_list<Instr *> args)
+{
+  return Insert(m_Program.NewInstr(op, ty, args));
+}
+
+Instr *Builder::Emit(Op op, Ty ty, const std::vector<Instr *> &args)
+{
+  return Insert(m_Program.NewInstr(op, ty, args));
+}
+
+Instr *Builder::Int(Ty ty, uint64_t bits)
+{
+  auto instr = Emit(Op::Const, ty);
+  instr->m_Imm = bits;
+  return instr;
+}
+
+Instr *Builder::Float(double value)
+{
+  auto instr = Emit(Op::Const, Ty::F64);
+  instr->m_Float = value;
+  return instr;
+}
+
+Instr *Builder::Str(const std::string &str)
+{
+  auto instr = Emit(Op::Const, Ty::Str);
+  instr->m_Imm = m_Program.Intern(str);
+  return instr;
+}
+
+Instr *Builder::Zero(Ty ty)
+{
+  switch (ty)
+  {
+  case Ty::F64:
+    return Float(0);
+  case Ty::Str:
+    return Str("");
+  default:
+    return Int(ty, 0);
+  }
+}
+
+Instr *Builder::Call(Function *callee, const std::vector<Instr *> &args)
+{
+  auto instr = Emit(Op::Call, callee->m_RetTy, args);
+  instr->m_Callee = callee;
+  return instr;
+}
+
+Instr *Builder::Jmp(Block *target)
+{
+  auto instr = Emit(Op::Jmp, Ty::Void);
+  instr->m_Target = target;
+  return instr;
+}
+
+Instr *Builder::Coerce(Instr *value, Ty ty)
+{
+  if (!value || value->m_Ty == ty || !IsInt(value->m_Ty) || !IsInt(ty))
+  {
+    return value;
+  }
+  return Emit(Op::Cast, ty, {value});
+}
+
+static std::string Escape(const std::string &str)
+{
+  std::string escaped;
+  for (auto ch : str)
+  {
+    switch (ch)
+    {
+    case '"':
+      escaped += "\\\"";
+      break;
+    case '\\':
+      escaped += "\\\\";
+      break;
+    case '\n':
+      escaped += "\\n";
+      break;
+    case '\t':
+      escaped += "\\t";
+      break;
+    default:
+      escaped += ch;
+    }
+  }
+  return escaped;
+}
+
+static std::string DumpInstr(const Program &program, const Instr *instr)
+{
+  std::ostringstream oss;
+  if (Ty::Void != instr->m_Ty)
+  {
+    oss << "%" << instr->m_ID << " = ";
+  }
+  oss << OpName(instr->m_Op);
+  if (Ty::Void != instr->m_Ty)
+  {
+    oss << "." << TyName(instr->m_Ty);
+  }
+  if (instr->m_Checks & CHECK_OVERFLOW)
+  {
+    oss << ".ov";
+  }
+  if (instr->m_Checks & CHECK_ZERO)
+  {
+    oss << ".nz";
+  }
+  switch (instr->m_Op)
+  {
+  case Op::Const:
+    if (Ty::Str == instr->m_Ty)
+    {
+      oss << " \"" << Escape(program.m_Strings.at(instr->m_Imm)) << "\"";
+    }
+    else if (Ty::F64 == instr->m_Ty)
+    {
+      oss << " " << std::format("{}", instr->m_Float);
+    }
+    else if (IsSigned(instr->m_Ty))
+    {
+      oss << " " << static_cast<int64_t>(instr->m_Imm);
+    }
+    else
+    {
+      oss << " " << instr->m_Imm;
+    }
+    return oss.str();
+  case Op::Param:
+    oss << " " << instr->m_Imm;
+    return oss.str();
+  case Op::FuncRef:
+    oss << " @" << instr->m_Callee->m_Symbol;
+    return oss.str();
+  case Op::Load:
+  case Op::Store:
+    oss << " @" << instr->m_Global->m_Symbol;
+    break;
+  case Op::Call:
+    oss << " @" << instr->m_Callee->m_Symbol;
+    break;
+  case Op::Jmp:
+    oss << " b" << instr->m_Target->m_ID;
+    return oss.str();
+  case Op::Phi:
+    for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+    {
+      oss << (i ? ", " : " ") << "[b" << instr->m_Incoming[i]->m_ID << ": %" << instr->Arg(i)->m_ID << "]";
+    }
+    return oss.str();
+  default:
+    break;
+  }
+  uint32_t first = 0;
+  if (Op::CallIndirect == instr->m_Op)
+  {
+    oss << " %" << instr->Arg(0)->m_ID;
+    first = 1;
+  }
+  bool isCall = Op::Call == instr->m_Op || Op::CallIndirect == instr->m_Op;
+  oss << (isCall ? "(" : "");
+  for (uint32_t i = first; i < instr->m_ArgsCount; ++i)
+  {
+    oss << (i > first ? ", " : (isCall ? "" : " ")) << "%" << instr->Arg(i)->m_ID;
+  }
+  oss << (isCall ? ")" : "");
+  return oss.str();
+}
+
+std::string Program::Dump() const
+{
+  std::ostringstream oss;
+  for (auto global : m_Globals)
+  {
+    oss << (global->m_IsPub ? "pub " : "") << "global @" << global->m_Symbol << ": " << TyName(global->m_Ty) << "\n";
+  }
+  for (auto function : m_Functions)
+  {
+    oss << (m_Globals.empty() && function == m_Functions.front() ? "" : "\n");
+    oss << (function->IsExtern() ? "extern " : "") << (function->m_IsPub ? "pub " : "") << "fun @" << function->m_Symbol << "(";
+    for (size_t i = 0; i < function->m_Params.size(); ++i)
+    {
+      oss << (i ? ", " : "") << TyName(function->m_Params.at(i));
+    }
+    if (function->m_IsVarArgs)
+    {
+      oss << (function->m_Params.empty() ? "..." : ", ...");
+    }
+    oss << ") -> " << TyName(function->m_RetTy);
+    if (function->IsExtern())
+    {
+      oss << "\n";
+      continue;
+    }
+    oss << " {\n";
+    for (auto block : function->m_Blocks)
+    {
+      oss << "b" << block->m_ID << ":\n";
+      for (auto instr : block->m_Instrs)
+      {
+        oss << "  " << DumpInstr(*this, instr) << "\n";
+      }
+    }
+    oss << "}\n";
+  }
+  return oss.str();
+}
+
+/*
+  Verifier
+*/
+class Verifier
+{
+public:
+  Verifier(const Program &program) : m_Program(program), m_Function(nullptr), m_Errors(), m_Order(), m_Idom() {};
+
+  std::vector<std::string> Verify();
+
+private:
+  const Program &m_Program;
+  const Function *m_Function;
+  std::vector<std::string> m_Errors;
+  // reverse post order index of every reachable block
+  std::unordered_map<const Block *, size_t> m_Order;
+  std::unordered_map<const Block *, const Block *> m_Idom;
+
+  void Fail(const Block *block, const Instr *instr, std::string message);
+  void VerifyFunction(const Function *function);
+  void VerifyInstr(const Block *block, const Instr *instr, const std::unordered_map<const Block *, std::vector<const Block *>> &preds);
+  void ComputeDominators(const std::unordered_map<const Block *, std::vector<const Block *>> &preds);
+  bool Dominates(const Block *a, const Block *b) const;
+  bool IsAvailable(const Instr *value, const Block *block, size_t index) const;
+};
+
+std::vector<std::string> Program::Verify() const
+{
+  return Verifier(*this).Verify();
+}
+
+std::vector<std::string> Verifier::Verify()
+{
+  std::unordered_set<const Global *> globals(m_Program.m_Globals.begin(), m_Program.m_Globals.end());
+  std::unordered_set<const Function *> functions(m_Program.m_Functions.begin(), m_Program.m_Functions.end());
+  for (auto function : m_Program.m_Functions)
+  {
+    m_Function = function;
+    VerifyFunction(function);
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        if (instr->m_Global && globals.count(instr->m_Global) == 0)
+        {
+          Fail(block, instr, "global is not part of the program");
+        }
+        if (instr->m_Callee && functions.count(instr->m_Callee) == 0)
+        {
+          Fail(block, instr, "callee is not part of the program");
+        }
+      }
+    }
+  }
+  for (auto init : m_Program.m_Inits)
+  {
+    if (functions.count(init) == 0 || !init->m_Params.empty() || Ty::Void != init->m_RetTy)
+    {
+      m_Errors.push_back(std::format("@{}: invalid module initializer", init->m_Symbol));
+    }
+  }
+  return m_Errors;
+}
+
+void Verifier::Fail(const Block *block, const Instr *instr, std::string message)
+{
+  auto where = std::format("@{}", m_Function->m_Symbol);
+  if (block)
+  {
+    where += std::format(" b{}", block->m_ID);
+  }
+  if (instr)
+  {
+    where += std::format(" `{}`", DumpInstr(m_Program, instr));
+  }
+  m_Errors.push_back(where + ": " + message);
+}
+
+void Verifier::VerifyFunction(const Function *function)
+{
+  if (function->IsExtern())
+  {
+    return;
+  }
+  std::unordered_set<const Block *> blocks(function->m_Blocks.begin(), function->m_Blocks.end());
+  std::unordered_map<const Block *, std::vector<const Block *>> preds;
+  for (auto block : function->m_Blocks)
+  {
+    if (block->m_Parent != function)
+    {
+      Fail(block, nullptr, "block belongs to another function");
+    }
+    if (!block->Terminator())
+    {
+      Fail(block, nullptr, "block does not end with a terminator");
+      continue;
+    }
+    for (auto succ : block->Successors())
+    {
+      if (blocks.count(succ) == 0)
+      {
+        Fail(block, block->Terminator(), "jump target is not part of the function");
+        continue;
+      }
+      preds[succ].push_back(block);
+    }
+  }
+  if (!m_Errors.empty())
+  {
+    return;
+  }
+  ComputeDominators(preds);
+
+  std::unordered_set<const Instr *> seen;
+  for (auto block : function->m_Blocks)
+  {
+    bool isPhiAllowed = true;
+    for (size_t i = 0; i < block->m_Instrs.size(); ++i)
+    {
+      auto instr = block->m_Instrs.at(i);
+      if (!seen.insert(instr).second)
+      {
+        Fail(block, instr, "instruction appears twice");
+      }
+      if (instr->m_Block != block)
+      {
+        Fail(block, instr, "instruction has a stale parent block");
+      }
+      if (instr->IsTerminator() && i + 1 != block->m_Instrs.size())
+      {
+        Fail(block, instr, "terminator in the middle of a block");
+      }
+      if (Op::Phi == instr->m_Op && !isPhiAllowed)
+      {
+        Fail(block, instr, "phi after a non-phi instruction");
+      }
+      isPhiAllowed = isPhiAllowed && Op::Phi == instr->m_Op;
+      VerifyInstr(block, instr, preds);
+    }
+  }
+}
+
+void Verifier::VerifyInstr(const Block *block, const Instr *instr, const std::unordered_map<const Block *, std::vector<const Block *>> &preds)
+{
+  // operands must be defined in this function before being used
+  for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+  {
+    auto arg = instr->Arg(i);
+    if (!arg || !arg->m_Block || arg->m_Block->m_Parent != m_Function)
+    {
+      Fail(block, instr, std::format("operand {} is not defined in this function", i));
+      return;
+    }
+    if (Ty::Void == arg->m_Ty)
+    {
+      Fail(block, instr, std::format("operand {} has no value", i));
+    }
+    if (Op::Phi == instr->m_Op)
+    {
+      auto incoming = instr->m_Incoming[i];
+      if (m_Order.count(incoming) && !IsAvailable(arg, incoming, incoming->m_Instrs.size()))
+      {
+        Fail(block, instr, std::format("operand {} does not dominate b{}", i, incoming->m_ID));
+      }
+      continue;
+    }
+    size_t index = static_cast<size_t>(std::find(block->m_Instrs.begin(), block->m_Instrs.end(), instr) - block->m_Instrs.begin());
+    if (m_Order.count(block) && !IsAvailable(arg, block, index))
+    {
+      Fail(block, instr, std::format("operand {} does not dominate its use", i));
+    }
+  }
+
+  auto argTy = [&](uint32_t i)
+  { return instr->Arg(i)->m_Ty; };
+  switch (instr->m_Op)
+  {
+  case Op::Const:
+    // the only function constant is the null function, addresses come from FuncRef
+    if (Ty::Void == instr->m_Ty || (Ty::Fn == instr->m_Ty && 0 != instr->m_Imm) || (Ty::Str == instr->m_Ty && instr->m_Imm >= m_Program.m_Strings.size()))
+    {
+      Fail(block, instr, "invalid constant");
+    }
+    break;
+  case Op::Param:
+    if (instr->m_Imm >= m_Function->m_Params.size() || m_Function->m_Params.at(instr->m_Imm) != instr->m_Ty)
+    {
+      Fail(block, instr, "parameter index or type mismatch");
+    }
+    break;
+  case Op::Copy:
+    if (instr->m_ArgsCount != 1 || argTy(0) != instr->m_Ty)
+    {
+      Fail(block, instr, "copy type mismatch");
+    }
+    break;
+  case Op::Cast:
+    if (instr->m_ArgsCount != 1 || !IsInt(argTy(0)) || !IsInt(instr->m_Ty))
+    {
+      Fail(block, instr, "cast between non integer types");
+    }
+    break;
+  case Op::FuncRef:
+    if (!instr->m_Callee || Ty::Fn != instr->m_Ty)
+    {
+      Fail(block, instr, "function reference without function");
+    }
+    break;
+  case Op::Load:
+    if (!instr->m_Global || instr->m_Global->m_Ty != instr->m_Ty)
+    {
+      Fail(block, instr, "load type mismatch");
+    }
+    break;
+  case Op::Store:
+    if (!instr->m_Global || instr->m_ArgsCount != 1 || argTy(0) != instr->m_Global->m_Ty || Ty::Void != instr->m_Ty)
+    {
+      Fail(block, instr, "store type mismatch");
+    }
+    break;
+  case Op::Call:
+  {
+    auto callee = instr->m_Callee;
+    if (!callee || callee->m_RetTy != instr->m_Ty)
+    {
+      Fail(block, instr, "call result type mismatch");
+      break;
+    }
+    if (instr->m_ArgsCount < callee->m_Params.size() || (!callee->m_IsVarArgs && instr->m_ArgsCount != callee->m_Params.size()))
+    {
+      Fail(block, instr, "call arguments count mismatch");
+      break;
+    }
+    for (uint32_t i = 0; i < callee->m_Params.size(); ++i)
+    {
+      if (argTy(i) != callee->m_Params.at(i))
+      {
+        Fail(block, instr, std::format("call argument {} type mismatch", i));
+      }
+    }
+    break;
+  }
+  case Op::CallIndirect:
+    if (instr->m_ArgsCount < 1 || Ty::Fn != argTy(0))
+    {
+      Fail(block, instr, "indirect call through a non function value");
+    }
+    break;
+  case Op::Phi:
+  {
+    auto found = preds.find(block);
+    auto blockPreds = found == preds.end() ? std::vector<const Block *>() : found->second;
+    if (blockPreds.size() != instr->m_ArgsCount)
+    {
+      Fail(block, instr, "phi operands do not match predecessors");
+      break;
+    }
+    for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+    {
+      if (std::find(blockPreds.begin(), blockPreds.end(), instr->m_Incoming[i]) == blockPreds.end() || argTy(i) != instr->m_Ty)
+      {
+        Fail(block, instr, std::format("phi operand {} mismatch", i));
+      }
+    }
+    break;
+  }
+  case Op::Add:
+  case Op::Sub:
+  case Op::Mul:
+  case Op::Div:
+    if (instr->m_ArgsCount != 2 || argTy(0) != instr->m_Ty || argTy(1) != instr->m_Ty || !(IsInt(instr->m_Ty) || Ty::F64 == instr->m_Ty))
+    {
+      Fail(block, instr, "arithmetic operands type mismatch");
+    }
+    else if (Ty::F64 == instr->m_Ty && instr->m_Checks)
+    {
+      Fail(block, instr, "checked float arithmetic");
+    }
+    break;
+  case Op::Ret:
+    if (Ty::Void == m_Function->m_RetTy ? instr->m_ArgsCount != 0 : (instr->m_ArgsCount != 1 || argTy(0) != m_Function->m_RetTy))
+    {
+      Fail(block, instr, "return type mismatch");
+    }
+    break;
+  case Op::Jmp:
+    if (!instr->m_Target)
+    {
+      Fail(block, instr, "jump without target");
+    }
+    break;
+  case Op::Unreachable:
+    break;
+  }
+}
+
+void Verifier::ComputeDominators(const std::unordered_map<const Block *, std::vector<const Block *>> &preds)
+{
+  // reverse post order of the blocks reachable from the entry
+  std::vector<const Block *> postOrder;
+  std::unordered_set<const Block *> visited;
+  std::vector<std::pair<const Block *, size_t>> stack = {{m_Function->Entry(), 0}};
+  visited.insert(m_Function->Entry());
+  while (!stack.empty())
+  {
+    auto &[block, next] = stack.back();
+    auto succs = block->Successors();
+    if (next < succs.size())
+    {
+      auto succ = succs.at(next++);
+      if (visited.insert(succ).second)
+      {
+        stack.push_back({succ, 0});
+      }
+      continue;
+    }
+    postOrder.push_back(block);
+    stack.pop_back();
+  }
+  m_Order.clear();
+  m_Idom.clear();
+  for (size_t i = 0; i < postOrder.size(); ++i)
+  {
+    m_Order[postOrder.at(postOrder.size() - 1 - i)] = i;
+  }
+
+  // Cooper, Harvey and Kennedy iterative algorithm
+  m_Idom[m_Function->Entry()] = m_Function->Entry();
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto it = postOrder.rbegin(); it != postOrder.rend(); ++it)
+    {
+      auto block = *it;
+      if (block == m_Function->Entry())
+      {
+        continue;
+      }
+      const Block *idom = nullptr;
+      auto found = preds.find(block);
+      for (auto pred : found == preds.end() ? std::vector<const Block *>() : found->second)
+      {
+        if (m_Idom.count(pred) == 0)
+        {
+          continue;
+        }
+        if (!idom)
+        {
+          idom = pred;
+          continue;
+        }
+        auto a = pred;
+        auto b = idom;
+        while (a != b)
+        {
+          while (m_Order.at(a) > m_Order.at(b))
+          {
+            a = m_Idom.at(a);
+          }
+          while (m_Order.at(b) > m_Order.at(a))
+          {
+            b = m_Idom.at(b);
+          }
+        }
+        idom = a;
+      }
+      if (idom && (m_Idom.count(block) == 0 || m_Idom.at(block) != idom))
+      {
+        m_Idom[block] = idom;
+        changed = true;
+      }
+    }
+  }
+}
+
+bool Verifier::Dominates(const Block *a, const Block *b) const
+{
+  while (true)
+  {
+    if (a == b)
+    {
+      return true;
+    }
+    auto idom = m_Idom.at(b);
+    if (idom == b)
+    {
+      return false;
+    }
+    b = idom;
+  }
+}
+
+bool Verifier::IsAvailable(const Instr *value, const Block *block, size_t index) const
+{
+  auto def = value->m_Block;
+  if (def == block)
+  {
+    for (size_t i = 0; i < index && i < block->m_Instrs.size(); ++i)
+    {
+      if (block->m_Instrs.at(i) == value)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+  return m_Order.count(def) && Dominates(def, block);
+}
+} // namespace ir
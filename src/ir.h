@@ -1,7 +1,248 @@
 #pragma once
 
-class IRGenerator
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "module.h"
+#include "token.h"
+
+/*
+  SSA intermediate representation. Every value is the instruction defining it,
+  instructions live in basic blocks ended by exactly one terminator and the
+  whole program is allocated from a single arena
+*/
+namespace ir
+{
+enum class Ty : uint8_t
+{
+  Void,
+  I8,
+  I16,
+  I32,
+  I64,
+  U8,
+  U16,
+  U32,
+  U64,
+  F64,
+  Str,
+  Fn, // address of a function
+};
+
+std::string TyName(Ty);
+bool IsInt(Ty);
+bool IsSigned(Ty);
+unsigned BitWidth(Ty);
+// truncates to the width of `ty` and extends back to 64 bits following its sign
+uint64_t NormalizeBits(Ty ty, uint64_t bits);
+
+enum class Op : uint8_t
+{
+  Const,        // m_Imm holds integer bits extended to 64 bits, or a string index, m_Float a float
+  Param,        // m_Imm-th parameter of the function
+  Copy,         // args[0]
+  Cast,         // args[0] converted to another integer type, truncating or extending
+  FuncRef,      // address of m_Callee
+  Load,         // m_Global
+  Store,        // m_Global = args[0]
+  Call,         // m_Callee(args...)
+  CallIndirect, // args[0](args[1]...)
+  Phi,          // args[i] when coming from m_Incoming[i]
+  Add,          // args[0] + args[1], integers wrap at the width of the type unless checked
+  Sub,
+  Mul,
+  Div, // truncating for integers
+  // terminators
+  Ret,
+  Jmp, // m_Target
+  Unreachable,
+};
+
+std::string OpName(Op);
+bool IsTerminator(Op);
+bool IsArith(Op);
+
+// traps an arithmetic instruction may raise, an unchecked integer op wraps
+enum Check : uint8_t
+{
+  CHECK_OVERFLOW = 1,
+  CHECK_ZERO = 2,
+};
+
+class Block;
+class Function;
+class Global;
+
+/*
+  Where an inlined instruction comes from: its position is in `m_Function`, whose
+  call at `m_CallPos` got inlined. That call is in the function of `m_Parent`, or in
+  the one holding the instruction now when there is no parent
+*/
+class InlineSite
+{
+public:
+  const Function *m_Function;
+  Position m_CallPos;
+  const InlineSite *m_Parent;
+
+  InlineSite(const Function *function, Position callPos, const InlineSite *parent) : m_Function(function), m_CallPos(callPos), m_Parent(parent) {};
+};
+
+class Instr
+{
+public:
+  Op m_Op;
+  Ty m_Ty; // Void when the instruction yields no value
+  uint8_t m_Checks;
+  uint32_t m_ID;
+  Block *m_Block;
+  Instr **m_Args;
+  uint32_t m_ArgsCount;
+  uint64_t m_Imm;
+  double m_Float;
+  Function *m_Callee;
+  Global *m_Global;
+  Block *m_Target;
+  Block **m_Incoming;
+  Position m_Pos;
+  // null unless inlining moved the instruction out of the function it was written in
+  const InlineSite *m_Inlined;
+
+  Instr(Op op, Ty ty) : m_Op(op), m_Ty(ty), m_Checks(0), m_ID(0), m_Block(nullptr), m_Args(nullptr), m_ArgsCount(0), m_Imm(0), m_Float(0), m_Callee(nullptr), m_Global(nullptr), m_Target(nullptr), m_Incoming(nullptr), m_Pos(0, 0, 0, 0), m_Inlined(nullptr) {};
+
+  Instr *Arg(size_t i) const { return m_Args[i]; }
+  bool IsTerminator() const { return ir::IsTerminator(m_Op); }
+  // function whose source `m_Pos` points into, `holder` being the one the instruction is in
+  const Function *Origin(const Function *holder) const { return m_Inlined ? m_Inlined->m_Function : holder; }
+};
+
+class Block
+{
+public:
+  uint32_t m_ID;
+  Function *m_Parent;
+  std::vector<Instr *> m_Instrs;
+
+  Block(uint32_t id, Function *parent) : m_ID(id), m_Parent(parent), m_Instrs() {};
+
+  Instr *Terminator() const { return m_Instrs.empty() || !m_Instrs.back()->IsTerminator() ? nullptr : m_Instrs.back(); }
+  std::vector<Block *> Successors() const;
+};
+
+class Global
+{
+public:
+  std::string m_Name;
+  std::string m_Symbol;
+  Ty m_Ty;
+  ModuleID m_ModID;
+  bool m_IsPub;
+
+  Global(std::string name, std::string symbol, Ty ty, ModuleID modID, bool isPub) : m_Name(name), m_Symbol(symbol), m_Ty(ty), m_ModID(modID), m_IsPub(isPub) {};
+};
+
+class Function
 {
 public:
+  std::string m_Name;
+  std::string m_Symbol;
+  ModuleID m_ModID;
+  std::vector<Ty> m_Params;
+  Ty m_RetTy;
+  bool m_IsPub;
+  bool m_IsVarArgs;
+  // blocks in layout order, the first one is the entry, empty for external functions
+  std::vector<Block *> m_Blocks;
+  uint32_t m_ValuesCount;
+  uint32_t m_BlocksCount;
+  Position m_Pos;
+
+  Function(std::string name, std::string symbol, ModuleID modID, std::vector<Ty> params, Ty retTy) : m_Name(name), m_Symbol(symbol), m_ModID(modID), m_Params(std::move(params)), m_RetTy(retTy), m_IsPub(false), m_IsVarArgs(false), m_Blocks(), m_ValuesCount(0), m_BlocksCount(0), m_Pos(0, 0, 0, 0) {};
+
+  bool IsExtern() const { return m_Blocks.empty(); }
+  Block *Entry() const { return m_Blocks.front(); }
+  size_t Size() const;
+  std::unordered_map<Block *, std::vector<Block *>> Predecessors() const;
+  void ReplaceAllUses(Instr *from, Instr *to);
+  // dense ids again, in layout order, after passes removed blocks and values
+  void Renumber();
+};
+
+class Program
+{
+public:
+  Arena m_Arena;
+  std::vector<Function *> m_Functions;
+  std::vector<Global *> m_Globals;
+  std::vector<std::string> m_Strings;
+  // module initializers, dependencies first
+  std::vector<Function *> m_Inits;
+  Function *m_Main;
+
+  Program() : m_Arena(), m_Functions(), m_Globals(), m_Strings(), m_Inits(), m_Main(nullptr), m_StringIDs() {};
+
+  Function *NewFunction(std::string name, std::string symbol, ModuleID modID, std::vector<Ty> params, Ty retTy);
+  Global *NewGlobal(std::string name, std::string symbol, Ty ty, ModuleID modID, bool isPub);
+  Block *NewBlock(Function *function);
+  Instr *NewInstr(Op op, Ty ty, std::initializer_list<Instr *> args = {});
+  Instr *NewInstr(Op op, Ty ty, const std::vector<Instr *> &args);
+  uint64_t Intern(const std::string &str);
+
+  std::string Dump() const;
+  // empty when the program is well formed
+  std::vector<std::string> Verify() const;
+
 private:
+  std::unordered_map<std::string, uint64_t> m_StringIDs;
+};
+
+/*
+  Every string literal of a program in one read-only buffer, NUL terminated
+  for C callers. A literal ending another one shares its bytes, so values are
+  views: an offset in here and the length of the literal
+*/
+class StringPool
+{
+public:
+  std::string m_Bytes;
+  std::vector<uint64_t> m_Offsets; // by string index
+
+  StringPool() : m_Bytes(), m_Offsets() {};
+
+  static StringPool Build(const std::vector<std::string> &strings);
+};
+
+// `path:line:col: what in 'function'` for a trap raised by `instr`, followed by the calls it was inlined at
+std::string TrapMessage(const ModuleManager &modManager, const Function *function, const Instr *instr, const std::string &what);
+
+/*
+  Appends instructions at the end of the current block
+*/
+class Builder
+{
+public:
+  Program &m_Program;
+  Block *m_Block;
+  Position m_Pos; // attached to every new instruction
+
+  Builder(Program &program) : m_Program(program), m_Block(nullptr), m_Pos(0, 0, 0, 0) {};
+
+  Instr *Insert(Instr *instr);
+  Instr *Emit(Op op, Ty ty, std::initializer_list<Instr *> args = {});
+  Instr *Emit(Op op, Ty ty, const std::vector<Instr *> &args);
+  Instr *Int(Ty ty, uint64_t bits);
+  Instr *Float(double value);
+  Instr *Str(const std::string &str);
+  Instr *Zero(Ty ty);
+  Instr *Call(Function *callee, const std::vector<Instr *> &args);
+  Instr *Jmp(Block *target);
+  // converts integers between widths, other values are returned as is
+  Instr *Coerce(Instr *value, Ty ty);
+  bool IsTerminated() const { return m_Block->Terminator() != nullptr; }
 };
+} // namespace ir
@@ -0,0 +1,733 @@
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "ir.h"
+#include "irgen.h"
+#include "module.h"
+#include "pointer.h"
+#include "type.h"
+
+static ir::Ty TyOf(Ptr<type::Type> type)
+{
+  if (!type)
+  {
+    return ir::Ty::Void;
+  }
+  switch (type->m_Base)
+  {
+  case type::Base::I8:
+    return ir::Ty::I8;
+  case type::Base::I16:
+    return ir::Ty::I16;
+  case type::Base::I32:
+    return ir::Ty::I32;
+  case type::Base::I64:
+    return ir::Ty::I64;
+  case type::Base::U8:
+    return ir::Ty::U8;
+  case type::Base::U16:
+    return ir::Ty::U16;
+  case type::Base::U32:
+    return ir::Ty::U32;
+  case type::Base::U64:
+    return ir::Ty::U64;
+  case type::Base::Float:
+    return ir::Ty::F64;
+  case type::Base::STRING:
+    return ir::Ty::Str;
+  case type::Base::FUNCTION:
+    return ir::Ty::Fn;
+  case type::Base::IntRange:
+    return TyOf(CastPtr<type::IntRange>(type)->GetDefault());
+  default:
+    // modules, unit and unknown have no runtime representation
+    return ir::Ty::Void;
+  }
+}
+
+// alphanumerics stay, `_` doubles and anything else, or a leading digit, becomes `_` and two hex digits
+static std::string MangleComponent(const std::string &component)
+{
+  std::string mangled;
+  for (auto ch : component)
+  {
+    auto byte = static_cast<unsigned char>(ch);
+    if ('_' == ch)
+    {
+      mangled += "__";
+    }
+    else if (std::isalpha(byte) || (std::isdigit(byte) && !mangled.empty()))
+    {
+      mangled += ch;
+    }
+    else
+    {
+      mangled += std::format("_{:02x}", byte);
+    }
+  }
+  return std::to_string(mangled.size()) + mangled;
+}
+
+// Modules are named by the import path they were resolved from, so symbols are the
+// same on every machine: `@std/io.zr` gives `H3std2io` and `a/b.zr` from a search
+// root `R1a1b`. The entry, which nothing imports, goes by its path from the working
+// directory, `examples/hello.zr` gives `E8examples5hello`. Components are length
+// prefixed and never start with a digit, so different paths never give one name
+static std::string MangleModule(Resolver &resolver, const std::string &path)
+{
+  auto name = resolver.ImportName(path);
+  char kind = name.starts_with('@') ? 'H' : 'R';
+  if (name.empty())
+  {
+    kind = 'E';
+    std::error_code errorCode;
+    auto cwd = std::filesystem::current_path(errorCode);
+    auto fsPath = std::filesystem::path(path).lexically_normal();
+    name = fsPath.is_absolute() && !errorCode ? fsPath.lexically_relative(cwd).string() : fsPath.string();
+  }
+  else if ('@' == name.front())
+  {
+    name = name.substr(1);
+  }
+  if (name.ends_with(".zr"))
+  {
+    name = name.substr(0, name.size() - 3);
+  }
+  std::string mangled(1, kind);
+  for (auto &component : std::filesystem::path(name))
+  {
+    mangled += MangleComponent(component.string());
+  }
+  return mangled;
+}
+
+Ptr<ir::Program> IRGenerator::Generate(Ptr<Module> entry)
+{
+  m_Program = std::make_shared<ir::Program>();
+  m_Builder = std::make_shared<ir::Builder>(*m_Program);
+  std::vector<Ptr<Module>> order;
+  CollectModules(entry, order);
+  CollectReachable(entry, order);
+
+  // declare everything first so references across modules resolve in any order
+  for (auto &module : order)
+  {
+    for (DeclID id = 0; id < module->m_Sema->m_Decls.size(); ++id)
+    {
+      auto &decl = module->m_Sema->m_Decls.at(id);
+      if (!decl.m_Flags.Has(Flag::Global))
+      {
+        continue;
+      }
+      if (DeclT::Fun == decl.m_DeclT && IsReachable(DeclRef(module->m_ID, id)))
+      {
+        FunctionFor(DeclRef(module->m_ID, id));
+      }
+      else if (DeclT::Var == decl.m_DeclT && ir::Ty::Void != TyOf(decl.m_Type))
+      {
+        GlobalFor(DeclRef(module->m_ID, id));
+      }
+    }
+  }
+  for (auto &module : order)
+  {
+    m_Module = module;
+    LowerModule();
+  }
+
+  for (DeclID id = 0; entry->m_Sema && id < entry->m_Sema->m_Decls.size(); ++id)
+  {
+    auto &decl = entry->m_Sema->m_Decls.at(id);
+    if (DeclT::Fun == decl.m_DeclT && decl.m_Flags.Has(Flag::Global) && "main" == decl.m_Name)
+    {
+      m_Program->m_Main = FunctionFor(DeclRef(entry->m_ID, id));
+    }
+  }
+  return m_Program;
+}
+
+void IRGenerator::CollectModules(Ptr<Module> module, std::vector<Ptr<Module>> &order)
+{
+  if (std::find(order.begin(), order.end(), module) != order.end() || !module->m_AST || !module->m_Sema)
+  {
+    return;
+  }
+  // imports are acyclic, a module is added once all its dependencies are
+  for (auto importID : module->m_Imports)
+  {
+    CollectModules(m_ModManager.Get(importID), order);
+  }
+  order.push_back(module);
+}
+
+void IRGenerator::CollectReachable(Ptr<Module> entry, const std::vector<Ptr<Module>> &order)
+{
+  std::map<std::pair<ModuleID, DeclID>, Ptr<FunStmt>> funStmts;
+  std::vector<DeclRef> pending;
+  for (auto &module : order)
+  {
+    for (auto &stmt : module->m_AST->m_Program)
+    {
+      if (StmtT::Fun != stmt->GetType())
+      {
+        // initializers always run
+        MarkReachable(module, stmt, pending);
+        continue;
+      }
+      auto ref = module->m_Sema->GetNode(stmt->GetID()).m_Decl;
+      if (!ref.IsValid())
+      {
+        continue;
+      }
+      funStmts.emplace(std::make_pair(ref.m_ModID, ref.m_ID), CastPtr<FunStmt>(stmt));
+      auto &decl = GetDecl(ref);
+      if (module == entry && ("main" == decl.m_Name || decl.m_Flags.Has(Flag::Pub)))
+      {
+        pending.push_back(ref);
+      }
+    }
+  }
+  while (!pending.empty())
+  {
+    auto ref = pending.back();
+    pending.pop_back();
+    auto key = std::make_pair(ref.m_ModID, ref.m_ID);
+    if (!m_Reachable.insert(key).second)
+    {
+      continue;
+    }
+    auto found = funStmts.find(key);
+    if (found != funStmts.end() && found->second->GetBody())
+    {
+      MarkReachable(m_ModManager.Get(ref.m_ModID), found->second->GetBody(), pending);
+    }
+  }
+  for (auto &module : order)
+  {
+    for (auto &stmt : module->m_AST->m_Program)
+    {
+      if (StmtT::Fun != stmt->GetType() || !CastPtr<FunStmt>(stmt)->GetBody())
+      {
+        continue;
+      }
+      auto ref = module->m_Sema->GetNode(stmt->GetID()).m_Decl;
+      if (ref.IsValid() && !IsReachable(ref))
+      {
+        m_Unreachable.push_back(ref);
+      }
+    }
+  }
+}
+
+void IRGenerator::MarkReachable(Ptr<Module> module, Ptr<Stmt> stmt, std::vector<DeclRef> &pending)
+{
+  if (!stmt)
+  {
+    return;
+  }
+  switch (stmt->GetType())
+  {
+  case StmtT::Block:
+    for (auto &inner : CastPtr<BlockStmt>(stmt)->GetStatements())
+    {
+      MarkReachable(module, inner, pending);
+    }
+    return;
+  case StmtT::Let:
+    MarkReachable(module, CastPtr<LetStmt>(stmt)->GetInit(), pending);
+    return;
+  case StmtT::Ret:
+    MarkReachable(module, CastPtr<RetStmt>(stmt)->GetValue(), pending);
+    return;
+  case StmtT::Fun:
+  case StmtT::Import:
+    return;
+  case StmtT::Expr:
+    break;
+  }
+  auto expr = CastPtr<Expr>(stmt);
+  switch (expr->GetType())
+  {
+  case ExprT::Call:
+    MarkReachable(module, CastPtr<CallExpr>(expr)->GetCallee(), pending);
+    for (auto &arg : CastPtr<CallExpr>(expr)->GetArgs())
+    {
+      MarkReachable(module, arg, pending);
+    }
+    break;
+  case ExprT::Assign:
+    MarkReachable(module, CastPtr<AssignExpr>(expr)->GetValue(), pending);
+    break;
+  case ExprT::Binary:
+    MarkReachable(module, CastPtr<BinaryExpr>(expr)->GetLhs(), pending);
+    MarkReachable(module, CastPtr<BinaryExpr>(expr)->GetRhs(), pending);
+    break;
+  case ExprT::Ident:
+  case ExprT::FieldAcc:
+  {
+    // a field access names a declaration of the module it reaches into
+    auto ref = module->m_Sema->GetNode(expr->GetID()).m_Decl;
+    if (ref.IsValid() && DeclT::Fun == GetDecl(ref).m_DeclT)
+    {
+      pending.push_back(ref);
+    }
+    break;
+  }
+  case ExprT::Number:
+  case ExprT::String:
+    break;
+  }
+}
+
+const Decl &IRGenerator::GetDecl(DeclRef ref)
+{
+  return m_ModManager.Get(ref.m_ModID)->m_Sema->m_Decls.at(ref.m_ID);
+}
+
+const NodeInfo &IRGenerator::GetInfo(Ptr<Stmt> node)
+{
+  return m_Module->m_Sema->GetNode(node->GetID());
+}
+
+ir::Function *IRGenerator::FunctionFor(DeclRef ref)
+{
+  auto key = std::make_pair(ref.m_ModID, ref.m_ID);
+  if (auto found = m_Functions.find(key); found != m_Functions.end())
+  {
+    return found->second;
+  }
+  auto &decl = GetDecl(ref);
+  auto fnType = CastPtr<type::Function>(decl.m_Type);
+  std::vector<ir::Ty> params;
+  for (auto &arg : fnType->m_Args)
+  {
+    params.push_back(TyOf(arg));
+  }
+  // functions without a body are provided by the runtime or the linker under their own name
+  auto symbol = decl.m_Flags.Has(Flag::Extern) ? decl.m_Name : MangleModule(m_ModManager.m_Resolver, m_ModManager.Get(ref.m_ModID)->m_Path) + "__" + decl.m_Name;
+  auto function = m_Program->NewFunction(decl.m_Name, symbol, ref.m_ModID, params, TyOf(fnType->m_RetType));
+  function->m_IsPub = decl.m_Flags.Has(Flag::Pub);
+  function->m_IsVarArgs = fnType->m_IsVarArgs;
+  function->m_Pos = decl.m_Pos;
+  m_Functions.emplace(key, function);
+  return function;
+}
+
+ir::Global *IRGenerator::GlobalFor(DeclRef ref)
+{
+  auto key = std::make_pair(ref.m_ModID, ref.m_ID);
+  if (auto found = m_Globals.find(key); found != m_Globals.end())
+  {
+    return found->second;
+  }
+  auto &decl = GetDecl(ref);
+  auto symbol = MangleModule(m_ModManager.m_Resolver, m_ModManager.Get(ref.m_ModID)->m_Path) + "__" + decl.m_Name;
+  auto global = m_Program->NewGlobal(decl.m_Name, symbol, TyOf(decl.m_Type), ref.m_ModID, decl.m_Flags.Has(Flag::Pub));
+  m_Globals.emplace(key, global);
+  return global;
+}
+
+void IRGenerator::LowerModule()
+{
+  for (auto &stmt : m_Module->m_AST->m_Program)
+  {
+    if (StmtT::Fun == stmt->GetType())
+    {
+      LowerFunction(CastPtr<FunStmt>(stmt));
+    }
+  }
+
+  // everything else runs once, when the module gets initialized
+  m_Function = m_Program->NewFunction("__init", "zr_init_" + MangleModule(m_ModManager.m_Resolver, m_Module->m_Path), m_Module->m_ID, {}, ir::Ty::Void);
+  m_RetType = type::Type::Get(type::Base::VOID);
+  m_Values.clear();
+  m_Builder->m_Block = m_Program->NewBlock(m_Function);
+  for (auto &stmt : m_Module->m_AST->m_Program)
+  {
+    if (StmtT::Fun != stmt->GetType() && StmtT::Import != stmt->GetType())
+    {
+      LowerStmt(stmt);
+    }
+  }
+  if (!m_Builder->IsTerminated())
+  {
+    m_Builder->Emit(ir::Op::Ret, ir::Ty::Void);
+  }
+  m_Program->m_Inits.push_back(m_Function);
+}
+
+void IRGenerator::LowerFunction(Ptr<FunStmt> funStmt)
+{
+  auto ref = GetInfo(funStmt).m_Decl;
+  if (!funStmt->GetBody() || !ref.IsValid() || !IsReachable(ref))
+  {
+    return;
+  }
+  m_Function = FunctionFor(ref);
+  m_RetType = CastPtr<type::Function>(GetDecl(ref).m_Type)->m_RetType;
+  m_Values.clear();
+  m_Builder->m_Block = m_Program->NewBlock(m_Function);
+  m_Builder->m_Pos = funStmt->GetSign().GetPos();
+
+  auto params = funStmt->GetSign().GetParams();
+  for (size_t i = 0; i < params.size(); ++i)
+  {
+    auto param = m_Builder->Emit(ir::Op::Param, m_Function->m_Params.at(i));
+    param->m_Imm = i;
+    m_Values[GetInfo(params.at(i).GetIdent()).m_Decl.m_ID] = param;
+  }
+  LowerStmtBlock(funStmt->GetBody());
+  if (!m_Builder->IsTerminated())
+  {
+    // the checker rejects non void functions without a return value
+    m_Builder->Emit(ir::Ty::Void == m_Function->m_RetTy ? ir::Op::Ret : ir::Op::Unreachable, ir::Ty::Void);
+  }
+}
+
+void IRGenerator::LowerStmt(Ptr<Stmt> stmt)
+{
+  // code after a terminator is unreachable, it still gets a block of its own
+  if (m_Builder->IsTerminated())
+  {
+    m_Builder->m_Block = m_Program->NewBlock(m_Function);
+  }
+  m_Builder->m_Pos = stmt->GetPos();
+  switch (stmt->GetType())
+  {
+  case StmtT::Block:
+    LowerStmtBlock(CastPtr<BlockStmt>(stmt));
+    break;
+  case StmtT::Let:
+    LowerStmtLet(CastPtr<LetStmt>(stmt));
+    break;
+  case StmtT::Ret:
+    LowerStmtRet(CastPtr<RetStmt>(stmt));
+    break;
+  case StmtT::Expr:
+    LowerExpr(CastPtr<Expr>(stmt));
+    break;
+  case StmtT::Fun:
+  case StmtT::Import:
+    // only valid at module level, handled by `LowerModule`
+    break;
+  }
+}
+
+void IRGenerator::LowerStmtBlock(Ptr<BlockStmt> blockStmt)
+{
+  for (auto &stmt : blockStmt->GetStatements())
+  {
+    LowerStmt(stmt);
+  }
+}
+
+void IRGenerator::LowerStmtLet(Ptr<LetStmt> letStmt)
+{
+  auto ref = GetInfo(letStmt).m_Decl;
+  auto &decl = GetDecl(ref);
+  auto ty = TyOf(decl.m_Type);
+  auto init = letStmt->GetInit() ? LowerExpr(letStmt->GetInit(), decl.m_Type) : nullptr;
+  if (ir::Ty::Void == ty)
+  {
+    return;
+  }
+  m_Builder->m_Pos = letStmt->GetPos();
+  if (decl.m_Flags.Has(Flag::Global))
+  {
+    // globals start zeroed
+    if (init)
+    {
+      auto store = m_Builder->Emit(ir::Op::Store, ir::Ty::Void, {m_Builder->Coerce(init, ty)});
+      store->m_Global = GlobalFor(ref);
+    }
+    return;
+  }
+  m_Values[ref.m_ID] = init ? m_Builder->Emit(ir::Op::Copy, ty, {m_Builder->Coerce(init, ty)}) : m_Builder->Zero(ty);
+}
+
+void IRGenerator::LowerStmtRet(Ptr<RetStmt> retStmt)
+{
+  auto value = retStmt->GetValue() ? LowerExpr(retStmt->GetValue(), m_RetType) : nullptr;
+  m_Builder->m_Pos = retStmt->GetPos();
+  if (ir::Ty::Void == m_Function->m_RetTy || !value)
+  {
+    m_Builder->Emit(ir::Op::Ret, ir::Ty::Void);
+    return;
+  }
+  m_Builder->Emit(ir::Op::Ret, ir::Ty::Void, {m_Builder->Coerce(value, m_Function->m_RetTy)});
+}
+
+ir::Instr *IRGenerator::LowerExpr(Ptr<Expr> expr, Ptr<type::Type> expected)
+{
+  m_Builder->m_Pos = expr->GetPos();
+  switch (expr->GetType())
+  {
+  case ExprT::Call:
+    return LowerExprCall(CastPtr<CallExpr>(expr));
+  case ExprT::Assign:
+    return LowerExprAssign(CastPtr<AssignExpr>(expr));
+  case ExprT::Number:
+    return LowerExprNumber(CastPtr<NumberExpr>(expr), expected);
+  case ExprT::Binary:
+    return LowerExprBinary(CastPtr<BinaryExpr>(expr), expected);
+  case ExprT::String:
+    return m_Builder->Str(CastPtr<StringExpr>(expr)->GetValue());
+  case ExprT::Ident:
+  case ExprT::FieldAcc:
+    // field accesses only reach into modules, the checker resolved them already
+    return LowerRef(GetInfo(expr).m_Decl);
+  }
+  return nullptr;
+}
+
+ir::Instr *IRGenerator::LowerExprCall(Ptr<CallExpr> callExpr)
+{
+  auto callee = callExpr->GetCallee();
+  auto calleeRef = GetInfo(callee).m_Decl;
+  auto calleeType = CastPtr<type::Function>(GetInfo(callee).m_Type);
+  bool isDirect = (ExprT::Ident == callee->GetType() || ExprT::FieldAcc == callee->GetType()) && calleeRef.IsValid() && DeclT::Fun == GetDecl(calleeRef).m_DeclT;
+
+  if (isDirect && IsPrintln(FunctionFor(calleeRef), callExpr))
+  {
+    LowerPrintln(callExpr);
+    return nullptr;
+  }
+
+  std::vector<ir::Instr *> args;
+  if (!isDirect)
+  {
+    args.push_back(LowerExpr(callee));
+  }
+  auto argExprs = callExpr->GetArgs();
+  for (size_t i = 0; i < argExprs.size(); ++i)
+  {
+    auto expected = i < calleeType->m_Args.size() ? calleeType->m_Args.at(i) : nullptr;
+    auto arg = LowerExpr(argExprs.at(i), expected);
+    if (arg)
+    {
+      args.push_back(expected ? m_Builder->Coerce(arg, TyOf(expected)) : arg);
+    }
+  }
+  m_Builder->m_Pos = callExpr->GetPos();
+  if (isDirect)
+  {
+    return m_Builder->Call(FunctionFor(calleeRef), args);
+  }
+  return m_Builder->Emit(ir::Op::CallIndirect, TyOf(calleeType->m_RetType), args);
+}
+
+// lines whose format is known at compile time, a string computed at runtime could still hold `{}`
+bool IRGenerator::IsPrintln(const ir::Function *function, Ptr<CallExpr> callExpr)
+{
+  if (!function->IsExtern() || !function->m_IsVarArgs || "println" != function->m_Symbol)
+  {
+    return false;
+  }
+  auto args = callExpr->GetArgs();
+  return args.empty() || ExprT::String == args.front()->GetType() || type::Base::STRING != GetInfo(args.front()).m_Type->m_Base;
+}
+
+// same output as the runtime `println`: placeholders take the args in order, the rest follow separated by spaces
+void IRGenerator::LowerPrintln(Ptr<CallExpr> callExpr)
+{
+  auto argExprs = callExpr->GetArgs();
+  std::vector<std::string> segments;
+  size_t next = 0;
+  if (!argExprs.empty() && ExprT::String == argExprs.front()->GetType())
+  {
+    segments = CastPtr<StringExpr>(argExprs.front())->SplitFormat();
+    next = 1;
+  }
+  std::vector<ir::Instr *> args;
+  for (size_t i = next; i < argExprs.size(); ++i)
+  {
+    args.push_back(LowerExpr(argExprs.at(i)));
+  }
+  m_Builder->m_Pos = callExpr->GetPos();
+
+  // adjacent literal text is merged into a single write
+  std::string text;
+  auto flush = [&]()
+  {
+    if (!text.empty())
+    {
+      Write(m_Builder->Str(text));
+      text.clear();
+    }
+  };
+  auto arg = args.begin();
+  for (size_t i = 0; i < segments.size(); ++i)
+  {
+    text += segments.at(i);
+    if (i + 1 == segments.size())
+    {
+      break;
+    }
+    if (arg == args.end())
+    {
+      // a placeholder without an argument is printed as written
+      text += "{}";
+      continue;
+    }
+    flush();
+    Write(*arg++);
+  }
+  for (; arg != args.end(); ++arg)
+  {
+    if (next++ > 0)
+    {
+      text += ' ';
+    }
+    flush();
+    Write(*arg);
+  }
+  text += '\n';
+  flush();
+}
+
+// one call to the runtime function printing values of this type
+void IRGenerator::Write(ir::Instr *value)
+{
+  if (!value || ir::Ty::Void == value->m_Ty)
+  {
+    return;
+  }
+  std::string symbol;
+  auto ty = value->m_Ty;
+  switch (ty)
+  {
+  case ir::Ty::Str:
+    symbol = "zr_write_str";
+    break;
+  case ir::Ty::F64:
+    symbol = "zr_write_f64";
+    break;
+  case ir::Ty::Fn:
+    symbol = "zr_write_fn";
+    break;
+  default:
+    ty = ir::IsSigned(ty) ? ir::Ty::I64 : ir::Ty::U64;
+    symbol = ir::IsSigned(ty) ? "zr_write_i64" : "zr_write_u64";
+    break;
+  }
+  auto &function = m_Runtime[symbol];
+  if (!function)
+  {
+    function = m_Program->NewFunction(symbol, symbol, m_Module->m_ID, {ty}, ir::Ty::Void);
+  }
+  m_Builder->Call(function, {m_Builder->Coerce(value, ty)});
+}
+
+ir::Instr *IRGenerator::LowerExprAssign(Ptr<AssignExpr> assignExpr)
+{
+  auto ref = GetInfo(assignExpr).m_Decl;
+  auto &decl = GetDecl(ref);
+  auto ty = TyOf(decl.m_Type);
+  auto value = m_Builder->Coerce(LowerExpr(assignExpr->GetValue(), decl.m_Type), ty);
+  m_Builder->m_Pos = assignExpr->GetPos();
+  if (!value || ir::Ty::Void == ty)
+  {
+    return value;
+  }
+  if (decl.m_Flags.Has(Flag::Global))
+  {
+    auto store = m_Builder->Emit(ir::Op::Store, ir::Ty::Void, {value});
+    store->m_Global = GlobalFor(ref);
+    return value;
+  }
+  auto copy = m_Builder->Emit(ir::Op::Copy, ty, {value});
+  m_Values[ref.m_ID] = copy;
+  return copy;
+}
+
+ir::Instr *IRGenerator::LowerExprBinary(Ptr<BinaryExpr> binaryExpr, Ptr<type::Type> expected)
+{
+  // operands are lowered at the width of the result so literals need no cast
+  auto type = GetInfo(binaryExpr).m_Type;
+  if (type->IsIntRange())
+  {
+    type = expected && expected->IsInteger() ? expected : CastPtr<type::IntRange>(type)->GetDefault();
+  }
+  auto ty = TyOf(type);
+  auto lhs = m_Builder->Coerce(LowerExpr(binaryExpr->GetLhs(), type), ty);
+  auto rhs = m_Builder->Coerce(LowerExpr(binaryExpr->GetRhs(), type), ty);
+  ir::Op op = ir::Op::Add;
+  switch (binaryExpr->GetOp())
+  {
+  case TokenType::Minus:
+    op = ir::Op::Sub;
+    break;
+  case TokenType::Asterisk:
+    op = ir::Op::Mul;
+    break;
+  case TokenType::Slash:
+    op = ir::Op::Div;
+    break;
+  default:
+    break;
+  }
+  m_Builder->m_Pos = binaryExpr->GetOpPos();
+  auto instr = m_Builder->Emit(op, ty, {lhs, rhs});
+  if (ir::IsInt(ty))
+  {
+    instr->m_Checks = static_cast<uint8_t>((m_CheckedArith ? ir::CHECK_OVERFLOW : 0) | (ir::Op::Div == op ? ir::CHECK_ZERO : 0));
+  }
+  return instr;
+}
+
+ir::Instr *IRGenerator::LowerExprNumber(Ptr<NumberExpr> numExpr, Ptr<type::Type> expected)
+{
+  if (numExpr->IsFloat())
+  {
+    return m_Builder->Float(std::stod(numExpr->GetRaw()));
+  }
+  // literals take the type the context expects
+  auto ty = expected && expected->IsInteger() ? TyOf(expected) : TyOf(GetInfo(numExpr).m_Type);
+  auto value = std::stoull(numExpr->GetDigits(), nullptr, static_cast<int>(numExpr->GetBase()));
+  return m_Builder->Int(ty, numExpr->IsNegative() ? ~value + 1 : value);
+}
+
+ir::Instr *IRGenerator::LowerRef(DeclRef ref)
+{
+  if (!ref.IsValid())
+  {
+    return nullptr;
+  }
+  auto &decl = GetDecl(ref);
+  switch (decl.m_DeclT)
+  {
+  case DeclT::Fun:
+  {
+    auto funcRef = m_Builder->Emit(ir::Op::FuncRef, ir::Ty::Fn);
+    funcRef->m_Callee = FunctionFor(ref);
+    return funcRef;
+  }
+  case DeclT::Var:
+    if (decl.m_Flags.Has(Flag::Global))
+    {
+      if (ir::Ty::Void == TyOf(decl.m_Type))
+      {
+        return nullptr;
+      }
+      auto load = m_Builder->Emit(ir::Op::Load, TyOf(decl.m_Type));
+      load->m_Global = GlobalFor(ref);
+      return load;
+    }
+    [[fallthrough]];
+  case DeclT::Param:
+  {
+    auto found = m_Values.find(ref.m_ID);
+    return found == m_Values.end() ? nullptr : found->second;
+  }
+  case DeclT::Mod:
+  case DeclT::Error:
+    return nullptr;
+  }
+  return nullptr;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "ir.h"
+#include "module.h"
+#include "pointer.h"
+#include "type.h"
+
+/*
+  Lowers checked modules to IR, types and names come from the checker side
+  tables so no resolution happens here. Top-level statements of a module end
+  up in its initializer, top-level lets become globals. Only the functions
+  reachable from `main`, the public functions of the entry and the initializers
+  get lowered
+*/
+class IRGenerator
+{
+public:
+  // integer arithmetic traps on overflow, otherwise it wraps; division by zero always traps
+  bool m_CheckedArith;
+  // functions with a body left out of the program, in source order
+  std::vector<DeclRef> m_Unreachable;
+
+  IRGenerator(ModuleManager &modManager) : m_CheckedArith(true), m_Unreachable(), m_ModManager(modManager), m_Program(nullptr), m_Builder(nullptr), m_Module(nullptr), m_Function(nullptr), m_RetType(nullptr), m_Functions(), m_Globals(), m_Reachable(), m_Values(), m_Runtime() {};
+
+  // `entry` and everything it imports must be checked without errors
+  Ptr<ir::Program> Generate(Ptr<Module> entry);
+
+private:
+  ModuleManager &m_ModManager;
+  Ptr<ir::Program> m_Program;
+  Ptr<ir::Builder> m_Builder;
+  Ptr<Module> m_Module;
+  ir::Function *m_Function;
+  Ptr<type::Type> m_RetType;
+  std::map<std::pair<ModuleID, DeclID>, ir::Function *> m_Functions;
+  std::map<std::pair<ModuleID, DeclID>, ir::Global *> m_Globals;
+  std::set<std::pair<ModuleID, DeclID>> m_Reachable;
+  // current SSA value of each local and param of `m_Function`
+  std::unordered_map<DeclID, ir::Instr *> m_Values;
+  // output functions each backend provides, by symbol
+  std::unordered_map<std::string, ir::Function *> m_Runtime;
+
+  void CollectModules(Ptr<Module> module, std::vector<Ptr<Module>> &order);
+  void CollectReachable(Ptr<Module> entry, const std::vector<Ptr<Module>> &order);
+  // queues the functions `stmt` refers to, called or passed around as values
+  void MarkReachable(Ptr<Module> module, Ptr<Stmt> stmt, std::vector<DeclRef> &pending);
+  bool IsReachable(DeclRef ref) const { return m_Reachable.count(std::make_pair(ref.m_ModID, ref.m_ID)) > 0; }
+  const Decl &GetDecl(DeclRef ref);
+  const NodeInfo &GetInfo(Ptr<Stmt> node);
+  ir::Function *FunctionFor(DeclRef ref);
+  ir::Global *GlobalFor(DeclRef ref);
+
+  void LowerModule();
+  void LowerFunction(Ptr<FunStmt> funStmt);
+  void LowerStmt(Ptr<Stmt> stmt);
+  void LowerStmtBlock(Ptr<BlockStmt> blockStmt);
+  void LowerStmtLet(Ptr<LetStmt> letStmt);
+  void LowerStmtRet(Ptr<RetStmt> retStmt);
+  ir::Instr *LowerExpr(Ptr<Expr> expr, Ptr<type::Type> expected = nullptr);
+  ir::Instr *LowerExprCall(Ptr<CallExpr> callExpr);
+  bool IsPrintln(const ir::Function *function, Ptr<CallExpr> callExpr);
+  void LowerPrintln(Ptr<CallExpr> callExpr);
+  void Write(ir::Instr *value);
+  ir::Instr *LowerExprAssign(Ptr<AssignExpr> assignExpr);
+  ir::Instr *LowerExprBinary(Ptr<BinaryExpr> binaryExpr, Ptr<type::Type> expected);
+  ir::Instr *LowerExprNumber(Ptr<NumberExpr> numExpr, Ptr<type::Type> expected);
+  ir::Instr *LowerRef(DeclRef ref);
+};
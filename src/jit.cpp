@@ -0,0 +1,306 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X86_64
+#endif
+
+#include "jit.h"
+#include "vm.h"
+
+namespace vm
+{
+#ifdef JIT_X86_64
+/*
+  Templates. rbx holds the register file, r12 the VM and r13 where the
+  result goes. Zeroed bytes are the holes patched for each instruction
+*/
+// push rbx; push r12; push r13; mov rbx, rdi; mov r12, rsi; mov r13, rdx
+static const uint8_t PROLOGUE[] = {0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x49, 0x89, 0xD5};
+// pop r13; pop r12; pop rbx; ret
+static const uint8_t EPILOGUE[] = {0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3};
+// mov rax, [rbx + src]
+static const uint8_t LOAD_REG[] = {0x48, 0x8B, 0x83, 0, 0, 0, 0};
+// mov [rbx + dst], rax
+static const uint8_t STORE_REG[] = {0x48, 0x89, 0x83, 0, 0, 0, 0};
+// mov rax, imm
+static const uint8_t LOAD_IMM[] = {0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0};
+// shl rax, shift; sar rax, shift
+static const uint8_t SEXT[] = {0x48, 0xC1, 0xE0, 0, 0x48, 0xC1, 0xF8, 0};
+// shl rax, shift; shr rax, shift
+static const uint8_t ZEXT[] = {0x48, 0xC1, 0xE0, 0, 0x48, 0xC1, 0xE8, 0};
+// add rax, [rbx + src]
+static const uint8_t ADD_REG[] = {0x48, 0x03, 0x83, 0, 0, 0, 0};
+// sub rax, [rbx + src]
+static const uint8_t SUB_REG[] = {0x48, 0x2B, 0x83, 0, 0, 0, 0};
+// imul rax, [rbx + src]
+static const uint8_t IMUL_REG[] = {0x48, 0x0F, 0xAF, 0x83, 0, 0, 0, 0};
+// mul qword [rbx + src], clobbers rdx
+static const uint8_t MUL_REG[] = {0x48, 0xF7, 0xA3, 0, 0, 0, 0};
+// jo slow
+static const uint8_t JO[] = {0x0F, 0x80, 0, 0, 0, 0};
+// jc slow
+static const uint8_t JC[] = {0x0F, 0x82, 0, 0, 0, 0};
+// mov rcx, rax; shl rcx, shift; sar rcx, shift; cmp rcx, rax; jne slow
+static const uint8_t FITS_SIGNED[] = {0x48, 0x89, 0xC1, 0x48, 0xC1, 0xE1, 0, 0x48, 0xC1, 0xF9, 0, 0x48, 0x39, 0xC1, 0x0F, 0x85, 0, 0, 0, 0};
+// mov rcx, rax; shl rcx, shift; shr rcx, shift; cmp rcx, rax; jne slow
+static const uint8_t FITS_UNSIGNED[] = {0x48, 0x89, 0xC1, 0x48, 0xC1, 0xE1, 0, 0x48, 0xC1, 0xE9, 0, 0x48, 0x39, 0xC1, 0x0F, 0x85, 0, 0, 0, 0};
+// movsd xmm0, [rbx + src]
+static const uint8_t LOAD_FLOAT[] = {0xF2, 0x0F, 0x10, 0x83, 0, 0, 0, 0};
+// {add,sub,mul,div}sd xmm0, [rbx + src], the opcode byte is patched
+static const uint8_t FLOAT_OP[] = {0xF2, 0x0F, 0, 0x83, 0, 0, 0, 0};
+// movsd [rbx + dst], xmm0
+static const uint8_t STORE_FLOAT[] = {0xF2, 0x0F, 0x11, 0x83, 0, 0, 0, 0};
+// mov rax, [rax]
+static const uint8_t LOAD_INDIRECT[] = {0x48, 0x8B, 0x00};
+// mov rcx, addr; mov [rcx], rax
+static const uint8_t STORE_INDIRECT[] = {0x48, 0xB9, 0, 0, 0, 0, 0, 0, 0, 0, 0x48, 0x89, 0x01};
+// mov [r13], rax
+static const uint8_t STORE_RESULT[] = {0x49, 0x89, 0x45, 0x00};
+// xor eax, eax
+static const uint8_t ZERO_STATUS[] = {0x31, 0xC0};
+// jmp target
+static const uint8_t JMP[] = {0xE9, 0, 0, 0, 0};
+// mov rdi, r12; mov rsi, rbx; mov rdx, pc; mov rcx, function; mov rax, helper; call rax; test eax, eax; jnz exit
+static const uint8_t CALL_HELPER[] = {0x4C, 0x89, 0xE7, 0x48, 0x89, 0xDE, 0x48, 0xBA, 0, 0, 0, 0, 0, 0, 0, 0, 0x48, 0xB9, 0, 0, 0, 0, 0, 0, 0, 0, 0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xD0, 0x85, 0xC0, 0x0F, 0x85, 0, 0, 0, 0};
+
+class Assembler
+{
+public:
+  std::vector<uint8_t> m_Code;
+
+  Assembler() : m_Code() {};
+
+  // copies `bytes` and returns the offset they start at
+  template <size_t N>
+  size_t Put(const uint8_t (&bytes)[N])
+  {
+    auto at = m_Code.size();
+    m_Code.insert(m_Code.end(), bytes, bytes + N);
+    return at;
+  }
+
+  template <typename T>
+  void Patch(size_t at, T value)
+  {
+    std::memcpy(m_Code.data() + at, &value, sizeof(T));
+  }
+
+  void LoadReg(uint32_t reg) { Patch(Put(LOAD_REG) + 3, static_cast<int32_t>(reg * sizeof(Value))); }
+  void StoreReg(uint32_t reg) { Patch(Put(STORE_REG) + 3, static_cast<int32_t>(reg * sizeof(Value))); }
+  void LoadImm(uint64_t imm) { Patch(Put(LOAD_IMM) + 2, imm); }
+  // `bytes` ends with the 32 bit displacement of a register
+  template <size_t N>
+  void PutReg(const uint8_t (&bytes)[N], uint32_t reg) { Patch(Put(bytes) + N - 4, static_cast<int32_t>(reg * sizeof(Value))); }
+  void CallHelper(const uint32_t *pc, const Function &function, JitHelper helper, std::vector<size_t> &exits)
+  {
+    auto at = Put(CALL_HELPER);
+    Patch(at + 8, reinterpret_cast<uint64_t>(pc));
+    Patch(at + 18, reinterpret_cast<uint64_t>(&function));
+    Patch(at + 28, reinterpret_cast<uint64_t>(helper));
+    exits.push_back(at + 42);
+  }
+};
+
+bool Jit::IsSupported()
+{
+  return true;
+}
+
+JitFn Jit::Compile(const Function &function, Value *globals, JitHelper helper)
+{
+  Assembler as;
+  auto &code = function.m_Code;
+  // native offset of each bytecode instruction, jumps are patched once all are known
+  std::vector<size_t> offsets(code.size() + 1, 0);
+  std::vector<std::pair<size_t, uint32_t>> jumps;
+  std::vector<size_t> exits;
+  as.Put(PROLOGUE);
+  for (size_t pc = 0; pc < code.size(); pc += OpLength(&code[pc]))
+  {
+    offsets[pc] = as.m_Code.size();
+    auto op = &code[pc];
+    switch (static_cast<Opcode>(op[0]))
+    {
+    case Opcode::LoadK:
+      as.LoadImm(function.m_Consts[op[2]].u);
+      as.StoreReg(op[1]);
+      break;
+    case Opcode::Mov:
+      as.LoadReg(op[2]);
+      as.StoreReg(op[1]);
+      break;
+    case Opcode::SExt:
+    case Opcode::ZExt:
+    {
+      as.LoadReg(op[2]);
+      auto at = Opcode::SExt == static_cast<Opcode>(op[0]) ? as.Put(SEXT) : as.Put(ZEXT);
+      as.Patch(at + 3, static_cast<uint8_t>(op[3]));
+      as.Patch(at + 7, static_cast<uint8_t>(op[3]));
+      as.StoreReg(op[1]);
+      break;
+    }
+    case Opcode::LoadG:
+      as.LoadImm(reinterpret_cast<uint64_t>(globals + op[2]));
+      as.Put(LOAD_INDIRECT);
+      as.StoreReg(op[1]);
+      break;
+    case Opcode::StoreG:
+      as.LoadReg(op[2]);
+      as.Patch(as.Put(STORE_INDIRECT) + 2, reinterpret_cast<uint64_t>(globals + op[1]));
+      break;
+    case Opcode::Ret:
+      as.LoadReg(op[1]);
+      as.Put(STORE_RESULT);
+      as.Put(ZERO_STATUS);
+      as.Put(EPILOGUE);
+      break;
+    case Opcode::RetVoid:
+      as.Put(ZERO_STATUS);
+      as.Put(EPILOGUE);
+      break;
+    case Opcode::Jmp:
+      jumps.push_back({as.Put(JMP) + 1, op[1]});
+      break;
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    {
+      auto opcode = static_cast<Opcode>(op[0]);
+      as.LoadReg(op[2]);
+      if (Opcode::Add == opcode)
+      {
+        as.PutReg(ADD_REG, op[3]);
+      }
+      else if (Opcode::Sub == opcode)
+      {
+        as.PutReg(SUB_REG, op[3]);
+      }
+      else
+      {
+        as.PutReg(IMUL_REG, op[3]);
+      }
+      as.StoreReg(op[1]);
+      break;
+    }
+    case Opcode::AddS:
+    case Opcode::AddU:
+    case Opcode::SubS:
+    case Opcode::SubU:
+    case Opcode::MulS:
+    case Opcode::MulU:
+    {
+      // the fast path stays inline, overflow goes to the helper that raises the trap
+      auto opcode = static_cast<Opcode>(op[0]);
+      bool isSigned = Opcode::AddS == opcode || Opcode::SubS == opcode || Opcode::MulS == opcode;
+      as.LoadReg(op[2]);
+      switch (opcode)
+      {
+      case Opcode::AddS:
+      case Opcode::AddU:
+        as.PutReg(ADD_REG, op[3]);
+        break;
+      case Opcode::SubS:
+      case Opcode::SubU:
+        as.PutReg(SUB_REG, op[3]);
+        break;
+      case Opcode::MulS:
+        as.PutReg(IMUL_REG, op[3]);
+        break;
+      default:
+        as.PutReg(MUL_REG, op[3]);
+        break;
+      }
+      std::vector<size_t> slows = {(isSigned ? as.Put(JO) : as.Put(JC)) + 2};
+      if (0 != op[4])
+      {
+        auto at = isSigned ? as.Put(FITS_SIGNED) : as.Put(FITS_UNSIGNED);
+        as.Patch(at + 6, static_cast<uint8_t>(op[4]));
+        as.Patch(at + 10, static_cast<uint8_t>(op[4]));
+        slows.push_back(at + 16);
+      }
+      as.StoreReg(op[1]);
+      auto done = as.Put(JMP) + 1;
+      for (auto at : slows)
+      {
+        as.Patch(at, static_cast<int32_t>(as.m_Code.size()) - static_cast<int32_t>(at + 4));
+      }
+      as.CallHelper(op, function, helper, exits);
+      as.Patch(done, static_cast<int32_t>(as.m_Code.size()) - static_cast<int32_t>(done + 4));
+      break;
+    }
+    case Opcode::FAdd:
+    case Opcode::FSub:
+    case Opcode::FMul:
+    case Opcode::FDiv:
+    {
+      static const uint8_t opcodes[] = {0x58, 0x5C, 0x59, 0x5E};
+      as.PutReg(LOAD_FLOAT, op[2]);
+      auto at = as.m_Code.size();
+      as.PutReg(FLOAT_OP, op[3]);
+      as.Patch(at + 2, opcodes[op[0] - static_cast<uint32_t>(Opcode::FAdd)]);
+      as.PutReg(STORE_FLOAT, op[1]);
+      break;
+    }
+    case Opcode::DivS:
+    case Opcode::DivU:
+    case Opcode::Call:
+    case Opcode::CallNative:
+    case Opcode::CallInd:
+    case Opcode::Trap:
+      as.CallHelper(op, function, helper, exits);
+      break;
+    }
+  }
+  // the helper failed, its non zero status is returned as is
+  auto exit = as.Put(EPILOGUE);
+  for (auto &[at, target] : jumps)
+  {
+    as.Patch(at, static_cast<int32_t>(offsets[target]) - static_cast<int32_t>(at + 4));
+  }
+  for (auto at : exits)
+  {
+    as.Patch(at, static_cast<int32_t>(exit) - static_cast<int32_t>(at + 4));
+  }
+
+  auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  auto size = (as.m_Code.size() + pageSize - 1) / pageSize * pageSize;
+  auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == memory)
+  {
+    return nullptr;
+  }
+  std::memcpy(memory, as.m_Code.data(), as.m_Code.size());
+  if (0 != mprotect(memory, size, PROT_READ | PROT_EXEC))
+  {
+    munmap(memory, size);
+    return nullptr;
+  }
+  m_Pages.push_back({memory, size});
+  return reinterpret_cast<JitFn>(memory);
+}
+
+Jit::~Jit()
+{
+  for (auto &[memory, size] : m_Pages)
+  {
+    munmap(memory, size);
+  }
+}
+#else
+bool Jit::IsSupported()
+{
+  return false;
+}
+
+JitFn Jit::Compile(const Function &, Value *, JitHelper)
+{
+  return nullptr;
+}
+
+Jit::~Jit() {}
+#endif
+} // namespace vm
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "vm.h"
+
+/*
+  Baseline JIT: the bytecode of a function is translated by copying a fixed
+  machine code template per opcode and patching register offsets, constants
+  and jump targets into it. Calls and traps go through a helper back into the
+  VM. Only x86-64 Linux is supported, elsewhere Compile yields null and the
+  function stays interpreted
+*/
+namespace vm
+{
+// returns zero when `function` returned normally, the VM holds the error otherwise
+using JitHelper = int (*)(VM *vm, Value *regs, const uint32_t *pc, const Function *function);
+
+class Jit
+{
+public:
+  Jit() : m_Pages() {};
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+  ~Jit();
+
+  static bool IsSupported();
+
+  // null when unsupported or when executable memory can't be mapped
+  JitFn Compile(const Function &function, Value *globals, JitHelper helper);
+
+private:
+  std::vector<std::pair<void *, size_t>> m_Pages;
+};
+} // namespace vm
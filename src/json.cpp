@@ -0,0 +1,469 @@
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <optional>
+#include <string>
+
+#include "json.h"
+
+static const Json NONE;
+
+Json Json::Bool(bool value)
+{
+  Json json;
+  json.m_Type = JsonT::Bool;
+  json.m_Bool = value;
+  return json;
+}
+
+Json Json::Number(double value)
+{
+  Json json;
+  json.m_Type = JsonT::Number;
+  json.m_Number = value;
+  return json;
+}
+
+Json Json::String(std::string value)
+{
+  Json json;
+  json.m_Type = JsonT::String;
+  json.m_String = std::move(value);
+  return json;
+}
+
+Json Json::Array()
+{
+  Json json;
+  json.m_Type = JsonT::Array;
+  return json;
+}
+
+Json Json::Object()
+{
+  Json json;
+  json.m_Type = JsonT::Object;
+  return json;
+}
+
+const Json &Json::Get(const std::string &key) const
+{
+  for (auto &member : m_Members)
+  {
+    if (member.first == key)
+    {
+      return member.second;
+    }
+  }
+  return NONE;
+}
+
+const Json &Json::At(size_t index) const
+{
+  return index < m_Items.size() ? m_Items.at(index) : NONE;
+}
+
+int64_t Json::AsInt() const
+{
+  return JsonT::Number == m_Type ? static_cast<int64_t>(m_Number) : 0;
+}
+
+const std::string &Json::AsString() const
+{
+  return m_String;
+}
+
+Json &Json::Set(const std::string &key, Json value)
+{
+  m_Type = JsonT::Object;
+  for (auto &member : m_Members)
+  {
+    if (member.first == key)
+    {
+      member.second = std::move(value);
+      return *this;
+    }
+  }
+  m_Members.emplace_back(key, std::move(value));
+  return *this;
+}
+
+Json &Json::Push(Json value)
+{
+  m_Type = JsonT::Array;
+  m_Items.push_back(std::move(value));
+  return *this;
+}
+
+std::string Json::Dump() const
+{
+  std::string out;
+  DumpTo(out);
+  return out;
+}
+
+static void DumpString(const std::string &str, std::string &out)
+{
+  out.push_back('"');
+  for (char c : str)
+  {
+    switch (c)
+    {
+    case '"':
+      out.append("\\\"");
+      break;
+    case '\\':
+      out.append("\\\\");
+      break;
+    case '\n':
+      out.append("\\n");
+      break;
+    case '\r':
+      out.append("\\r");
+      break;
+    case '\t':
+      out.append("\\t");
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+      {
+        out.append(std::format("\\u{:04x}", static_cast<unsigned>(c)));
+      }
+      else
+      {
+        out.push_back(c);
+      }
+    }
+  }
+  out.push_back('"');
+}
+
+void Json::DumpTo(std::string &out) const
+{
+  switch (m_Type)
+  {
+  case JsonT::Null:
+    out.append("null");
+    break;
+  case JsonT::Bool:
+    out.append(m_Bool ? "true" : "false");
+    break;
+  case JsonT::Number:
+    // ids, lines and columns are integers, print them as such
+    if (std::trunc(m_Number) == m_Number && std::fabs(m_Number) < 9007199254740992.0)
+    {
+      out.append(std::to_string(static_cast<int64_t>(m_Number)));
+    }
+    else if (std::isfinite(m_Number))
+    {
+      out.append(std::format("{}", m_Number));
+    }
+    else
+    {
+      out.append("null");
+    }
+    break;
+  case JsonT::String:
+    DumpString(m_String, out);
+    break;
+  case JsonT::Array:
+    out.push_back('[');
+    for (size_t i = 0; i < m_Items.size(); ++i)
+    {
+      if (i > 0)
+      {
+        out.push_back(',');
+      }
+      m_Items.at(i).DumpTo(out);
+    }
+    out.push_back(']');
+    break;
+  case JsonT::Object:
+    out.push_back('{');
+    for (size_t i = 0; i < m_Members.size(); ++i)
+    {
+      if (i > 0)
+      {
+        out.push_back(',');
+      }
+      DumpString(m_Members.at(i).first, out);
+      out.push_back(':');
+      m_Members.at(i).second.DumpTo(out);
+    }
+    out.push_back('}');
+    break;
+  }
+}
+
+/*
+  Recursive descent over the text, any error fails the whole parse
+*/
+class JsonParser
+{
+public:
+  JsonParser(const std::string &text) : m_Text(text), m_Cursor(0), m_Depth(0) {};
+
+  std::optional<Json> ParseDocument()
+  {
+    auto value = ParseValue();
+    SkipSpaces();
+    if (!value.has_value() || m_Cursor != m_Text.size())
+    {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+private:
+  // deeper nesting than any message needs, keeps the stack bounded on hostile input
+  static constexpr size_t MAX_DEPTH = 256;
+
+  const std::string &m_Text;
+  size_t m_Cursor;
+  size_t m_Depth;
+
+  void SkipSpaces()
+  {
+    while (m_Cursor < m_Text.size() && (' ' == m_Text[m_Cursor] || '\t' == m_Text[m_Cursor] || '\n' == m_Text[m_Cursor] || '\r' == m_Text[m_Cursor]))
+    {
+      ++m_Cursor;
+    }
+  }
+
+  bool Eat(char c)
+  {
+    SkipSpaces();
+    if (m_Cursor < m_Text.size() && c == m_Text[m_Cursor])
+    {
+      ++m_Cursor;
+      return true;
+    }
+    return false;
+  }
+
+  bool EatWord(const char *word)
+  {
+    std::string expected(word);
+    if (0 != m_Text.compare(m_Cursor, expected.size(), expected))
+    {
+      return false;
+    }
+    m_Cursor += expected.size();
+    return true;
+  }
+
+  std::optional<Json> ParseValue()
+  {
+    SkipSpaces();
+    if (m_Cursor >= m_Text.size() || m_Depth > MAX_DEPTH)
+    {
+      return std::nullopt;
+    }
+    char c = m_Text[m_Cursor];
+    if ('{' == c || '[' == c)
+    {
+      ++m_Depth;
+      auto value = '{' == c ? ParseObject() : ParseArray();
+      --m_Depth;
+      return value;
+    }
+    if ('"' == c)
+    {
+      auto str = ParseString();
+      return str.has_value() ? std::optional<Json>(Json::String(str.value())) : std::nullopt;
+    }
+    if (EatWord("true") || EatWord("false"))
+    {
+      return Json::Bool('t' == c);
+    }
+    if (EatWord("null"))
+    {
+      return Json();
+    }
+    return ParseNumber();
+  }
+
+  std::optional<Json> ParseObject()
+  {
+    ++m_Cursor;
+    auto object = Json::Object();
+    if (Eat('}'))
+    {
+      return object;
+    }
+    do
+    {
+      SkipSpaces();
+      auto key = ParseString();
+      if (!key.has_value() || !Eat(':'))
+      {
+        return std::nullopt;
+      }
+      auto value = ParseValue();
+      if (!value.has_value())
+      {
+        return std::nullopt;
+      }
+      object.m_Members.emplace_back(key.value(), std::move(value.value()));
+    } while (Eat(','));
+    return Eat('}') ? std::optional<Json>(std::move(object)) : std::nullopt;
+  }
+
+  std::optional<Json> ParseArray()
+  {
+    ++m_Cursor;
+    auto array = Json::Array();
+    if (Eat(']'))
+    {
+      return array;
+    }
+    do
+    {
+      auto value = ParseValue();
+      if (!value.has_value())
+      {
+        return std::nullopt;
+      }
+      array.m_Items.push_back(std::move(value.value()));
+    } while (Eat(','));
+    return Eat(']') ? std::optional<Json>(std::move(array)) : std::nullopt;
+  }
+
+  std::optional<Json> ParseNumber()
+  {
+    const char *begin = m_Text.c_str() + m_Cursor;
+    char *end = nullptr;
+    double value = std::strtod(begin, &end);
+    if (end == begin)
+    {
+      return std::nullopt;
+    }
+    m_Cursor += static_cast<size_t>(end - begin);
+    return Json::Number(value);
+  }
+
+  std::optional<uint32_t> ParseHex4()
+  {
+    if (m_Cursor + 4 > m_Text.size())
+    {
+      return std::nullopt;
+    }
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+      char c = m_Text[m_Cursor++];
+      int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 16;
+      if (digit > 15)
+      {
+        return std::nullopt;
+      }
+      value = value * 16 + static_cast<uint32_t>(digit);
+    }
+    return value;
+  }
+
+  static void AppendUtf8(uint32_t code, std::string &out)
+  {
+    if (code < 0x80)
+    {
+      out.push_back(static_cast<char>(code));
+    }
+    else if (code < 0x800)
+    {
+      out.push_back(static_cast<char>(0xc0 | (code >> 6)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    }
+    else if (code < 0x10000)
+    {
+      out.push_back(static_cast<char>(0xe0 | (code >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    }
+    else
+    {
+      out.push_back(static_cast<char>(0xf0 | (code >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    }
+  }
+
+  std::optional<std::string> ParseString()
+  {
+    if (m_Cursor >= m_Text.size() || '"' != m_Text[m_Cursor])
+    {
+      return std::nullopt;
+    }
+    ++m_Cursor;
+    std::string str;
+    while (m_Cursor < m_Text.size())
+    {
+      char c = m_Text[m_Cursor++];
+      if ('"' == c)
+      {
+        return str;
+      }
+      if ('\\' != c)
+      {
+        str.push_back(c);
+        continue;
+      }
+      if (m_Cursor >= m_Text.size())
+      {
+        return std::nullopt;
+      }
+      char escaped = m_Text[m_Cursor++];
+      switch (escaped)
+      {
+      case '"':
+      case '\\':
+      case '/':
+        str.push_back(escaped);
+        break;
+      case 'b':
+        str.push_back('\b');
+        break;
+      case 'f':
+        str.push_back('\f');
+        break;
+      case 'n':
+        str.push_back('\n');
+        break;
+      case 'r':
+        str.push_back('\r');
+        break;
+      case 't':
+        str.push_back('\t');
+        break;
+      case 'u':
+      {
+        auto code = ParseHex4();
+        if (!code.has_value())
+        {
+          return std::nullopt;
+        }
+        // characters past the BMP come as a surrogate pair
+        if (code.value() >= 0xd800 && code.value() < 0xdc00 && EatWord("\\u"))
+        {
+          auto low = ParseHex4();
+          if (!low.has_value() || low.value() < 0xdc00 || low.value() >= 0xe000)
+          {
+            return std::nullopt;
+          }
+          code = 0x10000 + ((code.value() - 0xd800) << 10) + (low.value() - 0xdc00);
+        }
+        AppendUtf8(code.value(), str);
+        break;
+      }
+      default:
+        return std::nullopt;
+      }
+    }
+    return std::nullopt;
+  }
+};
+
+std::optional<Json> Json::Parse(const std::string &text)
+{
+  return JsonParser(text).ParseDocument();
+}
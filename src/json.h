@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class JsonT
+{
+  Null,
+  Bool,
+  Number,
+  String,
+  Array,
+  Object,
+};
+
+/*
+  JSON value as exchanged by the language server, object members keep the order
+  they were set in. Looking up what is absent yields null rather than failing,
+  messages are read by walking the fields they may hold
+*/
+class Json
+{
+public:
+  JsonT m_Type;
+  bool m_Bool;
+  double m_Number;
+  std::string m_String;
+  std::vector<Json> m_Items;
+  std::vector<std::pair<std::string, Json>> m_Members;
+
+  Json() : m_Type(JsonT::Null), m_Bool(false), m_Number(0), m_String(), m_Items(), m_Members() {};
+
+  static Json Bool(bool value);
+  static Json Number(double value);
+  static Json String(std::string value);
+  static Json Array();
+  static Json Object();
+
+  bool IsNull() const { return JsonT::Null == m_Type; }
+  // null for anything but an object holding `key`
+  const Json &Get(const std::string &key) const;
+  const Json &At(size_t index) const;
+  size_t Size() const { return m_Items.size(); }
+  // zero and empty for values of another type
+  int64_t AsInt() const;
+  const std::string &AsString() const;
+
+  Json &Set(const std::string &key, Json value);
+  Json &Push(Json value);
+
+  std::string Dump() const;
+  // nothing on malformed text
+  static std::optional<Json> Parse(const std::string &text);
+
+private:
+  void DumpTo(std::string &out) const;
+};
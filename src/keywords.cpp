@@ -1,10 +1,11 @@
 #include "keywords.h"
 
-std::optional<TokenType> Keyword::match(std::string identifier)
+std::optional<TokenType> Keyword::match(const std::string &identifier)
 {
-  if (KEYWORDS.contains(identifier))
+  auto it = KEYWORDS.find(identifier);
+  if (KEYWORDS.end() != it)
   {
-    return KEYWORDS.at(identifier);
+    return it->second;
   }
   return std::nullopt;
 }
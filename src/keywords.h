@@ -33,5 +33,5 @@ const std::unordered_map<std::string, TokenType> KEYWORDS = {
 class Keyword
 {
 public:
-  static std::optional<TokenType> match(std::string);
+  static std::optional<TokenType> match(const std::string &);
 };
@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <cstdlib>
 #include <string>
+#include <utility>
 
 #include "diagnostic.h"
 #include "error.h"
@@ -15,6 +16,30 @@
 #define EOF_CHAR '\0'
 
 Result<Token, Diagnostic> Lexer::Next()
+{
+  auto res = Scan();
+  if (res.is_ok())
+  {
+    switch (res.unwrap().m_Type)
+    {
+    case TokenType::Ident:
+    case TokenType::StrLit:
+    case TokenType::BinLit:
+    case TokenType::HexLit:
+    case TokenType::DecLit:
+    case TokenType::FloatLit:
+    case TokenType::Rparen:
+      m_AfterOperand = true;
+      break;
+    default:
+      m_AfterOperand = false;
+      break;
+    }
+  }
+  return res;
+}
+
+Result<Token, Diagnostic> Lexer::Scan()
 {
   AdvanceWhile([](char c)
                { return std::isspace(c); });
@@ -24,7 +49,7 @@ Result<Token, Diagnostic> Lexer::Next()
   }
   char current = PeekOne();
   // {+-}[0-9]
-  if (std::isdigit(current) || ((current == '-' || current == '+') && std::isdigit(PeekNext())))
+  if (std::isdigit(current) || ((current == '-' || current == '+') && std::isdigit(PeekNext()) && !m_AfterOperand))
   {
     return MakeTokenNumber();
   }
@@ -38,9 +63,9 @@ Result<Token, Diagnostic> Lexer::Next()
     std::optional<TokenType> keyword = Keyword::match(label);
     if (keyword.has_value())
     {
-      return Token(Position(m_Line, atColumn, at, m_Cursor - 1), keyword.value(), label);
+      return Token(Position(m_Line, atColumn, at, m_Cursor - 1), keyword.value(), std::move(label));
     }
-    return Token(Position(m_Line, atColumn, at, m_Cursor - 1), TokenType::Ident, label);
+    return Token(Position(m_Line, atColumn, at, m_Cursor - 1), TokenType::Ident, std::move(label));
   }
   switch (current)
   {
@@ -66,12 +91,17 @@ Result<Token, Diagnostic> Lexer::Next()
     return MakeIfNextOr("..", TokenType::Ellipsis, TokenType::Dot);
   case '-':
     return MakeIfNextOr(">", TokenType::Arrow, TokenType::Minus);
+  case '+':
+    return MakeTokenSimple(TokenType::Plus);
+  case '*':
+    return MakeTokenSimple(TokenType::Asterisk);
+  case '/':
+    return MakeTokenSimple(TokenType::Slash);
   case '"':
     return MakeTokenString();
   }
-  std::string message = "Unexpected token: ";
-  message.push_back(current);
-  return Diagnostic(Errno::SYNTAX_ERROR, Position(m_Line, m_Column, m_Cursor, m_Cursor), m_ModuleID, DiagnosticSeverity::ERROR, message);
+  Position pos(m_Line, m_Column, m_Cursor, m_Cursor);
+  return Diagnostic(DiagCode::UnexpectedChar, pos, m_ModuleID, {SourceSpan(m_ModuleID, pos)});
 }
 
 Result<Token, Diagnostic> Lexer::MakeTokenSimple(TokenType tt)
@@ -108,7 +138,7 @@ Result<Token, Diagnostic> Lexer::MakeTokenString()
     char current = PeekOne();
     if (IsEof() || '\n' == current)
     {
-      return Diagnostic(Errno::SYNTAX_ERROR, Position(m_Line, m_Column, at, m_Cursor - 1), m_ModuleID, DiagnosticSeverity::ERROR, "unquoted string");
+      return Diagnostic(DiagCode::UnquotedString, Position(m_Line, m_Column, at, m_Cursor - 1), m_ModuleID);
     }
     if ('"' == current)
     {
@@ -170,7 +200,7 @@ char Lexer::PeekOne()
   {
     return EOF_CHAR;
   }
-  return m_ModuleContent.at(m_Cursor);
+  return m_ModuleContent[m_Cursor];
 }
 
 char Lexer::PeekNext()
@@ -179,7 +209,7 @@ char Lexer::PeekNext()
   {
     return EOF_CHAR;
   }
-  return m_ModuleContent.at(m_Cursor + 1);
+  return m_ModuleContent[m_Cursor + 1];
 }
 
 void Lexer::Advance()
@@ -208,17 +238,7 @@ void Lexer::Advance(size_t steps)
   }
 }
 
-size_t Lexer::AdvanceWhile(std::function<bool(char)> predicate)
-{
-  size_t at = m_Cursor;
-  while (!IsEof() && predicate(PeekOne()))
-  {
-    Advance();
-  }
-  return m_Cursor - at;
-}
-
-bool Lexer::StartsWith(std::string xs)
+bool Lexer::StartsWith(const std::string &xs)
 {
-  return xs == m_ModuleContent.substr(m_Cursor, xs.length());
+  return 0 == m_ModuleContent.compare(m_Cursor, xs.length(), xs);
 }
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <cstddef>
-#include <functional>
 #include <string>
 
 #include "diagnostic.h"
@@ -12,7 +11,7 @@
 class Lexer
 {
 public:
-  Lexer(ModuleID moduleID, ModuleManager &moduleManager) : m_ModuleID(moduleID), m_ModManager(moduleManager), m_ModuleContent(m_ModManager.m_Modules[moduleID]->m_Content), m_Line(1), m_Column(1), m_Cursor(0) {};
+  Lexer(ModuleID moduleID, ModuleManager &moduleManager) : m_ModuleID(moduleID), m_ModManager(moduleManager), m_ModuleContent(m_ModManager.Get(moduleID)->m_Content), m_Line(1), m_Column(1), m_Cursor(0), m_AfterOperand(false) {};
 
   Result<Token, Diagnostic> Next();
 
@@ -24,15 +23,29 @@ private:
   size_t m_Line;
   size_t m_Column;
   size_t m_Cursor;
+  // a sign right after an operand is an operator, `a -1` subtracts
+  bool m_AfterOperand;
 
   bool IsEof();
   char PeekOne();
   char PeekNext();
   void Advance();
   void Advance(size_t);
-  size_t AdvanceWhile(std::function<bool(char)>);
-  bool StartsWith(std::string);
-
+  bool StartsWith(const std::string &);
+
+  // a template rather than a `std::function`, it runs once per character
+  template <typename Predicate>
+  size_t AdvanceWhile(Predicate predicate)
+  {
+    size_t at = m_Cursor;
+    while (!IsEof() && predicate(PeekOne()))
+    {
+      Advance();
+    }
+    return m_Cursor - at;
+  }
+
+  Result<Token, Diagnostic> Scan();
   Result<Token, Diagnostic> MakeTokenNumber();
   Result<Token, Diagnostic> MakeTokenString();
   Result<Token, Diagnostic> MakeTokenSimple(TokenType);
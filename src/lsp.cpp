@@ -0,0 +1,686 @@
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "context.h"
+#include "diagnostic.h"
+#include "driver.h"
+#include "json.h"
+#include "lsp.h"
+#include "module.h"
+
+// JSON-RPC error codes
+static constexpr int PARSE_ERROR = -32700;
+static constexpr int INVALID_REQUEST = -32600;
+static constexpr int METHOD_NOT_FOUND = -32601;
+
+// larger bodies are skipped and answered with a parse error rather than allocated
+static constexpr size_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+static std::string PathOfUri(const std::string &uri)
+{
+  if (!uri.starts_with("file://"))
+  {
+    return "";
+  }
+  std::string path;
+  for (size_t i = 7; i < uri.size(); ++i)
+  {
+    if ('%' == uri[i] && i + 2 < uri.size() && std::isxdigit(uri[i + 1]) && std::isxdigit(uri[i + 2]))
+    {
+      path.push_back(static_cast<char>(std::stoi(uri.substr(i + 1, 2), nullptr, 16)));
+      i += 2;
+    }
+    else
+    {
+      path.push_back(uri[i]);
+    }
+  }
+  return path;
+}
+
+static std::string UriOfPath(const std::string &path)
+{
+  std::string uri = "file://";
+  for (char c : path)
+  {
+    if (std::isalnum(static_cast<unsigned char>(c)) || std::string("/-._~").find(c) != std::string::npos)
+    {
+      uri.push_back(c);
+    }
+    else
+    {
+      uri.append(std::format("%{:02X}", static_cast<unsigned char>(c)));
+    }
+  }
+  return uri;
+}
+
+/*
+  Converts between byte offsets and LSP positions, lines from zero and characters
+  counted in UTF-16 code units
+*/
+class LineIndex
+{
+public:
+  std::string m_Text;
+  std::vector<size_t> m_Starts;
+
+  LineIndex(std::string text) : m_Text(std::move(text)), m_Starts({0})
+  {
+    for (size_t i = 0; i < m_Text.size(); ++i)
+    {
+      if ('\n' == m_Text[i])
+      {
+        m_Starts.push_back(i + 1);
+      }
+    }
+  }
+
+  // positions past the end of a line or of the text are clamped to it
+  size_t OffsetOf(const Json &position) const
+  {
+    auto line = static_cast<size_t>(std::max<int64_t>(0, position.Get("line").AsInt()));
+    if (line >= m_Starts.size())
+    {
+      return m_Text.size();
+    }
+    auto character = std::max<int64_t>(0, position.Get("character").AsInt());
+    size_t offset = m_Starts.at(line);
+    while (offset < m_Text.size() && '\n' != m_Text[offset] && character > 0)
+    {
+      character -= Units(static_cast<unsigned char>(m_Text[offset]));
+      offset += Length(static_cast<unsigned char>(m_Text[offset]));
+    }
+    return std::min(offset, m_Text.size());
+  }
+
+  Json PositionOf(size_t offset) const
+  {
+    offset = std::min(offset, m_Text.size());
+    auto line = static_cast<size_t>(std::upper_bound(m_Starts.begin(), m_Starts.end(), offset) - m_Starts.begin() - 1);
+    int64_t character = 0;
+    for (size_t i = m_Starts.at(line); i < offset; i += Length(static_cast<unsigned char>(m_Text[i])))
+    {
+      character += Units(static_cast<unsigned char>(m_Text[i]));
+    }
+    auto position = Json::Object();
+    position.Set("line", Json::Number(static_cast<double>(line)));
+    position.Set("character", Json::Number(static_cast<double>(character)));
+    return position;
+  }
+
+  // `pos` ends on its last byte
+  Json RangeOf(const Position &pos) const
+  {
+    auto range = Json::Object();
+    range.Set("start", PositionOf(pos.m_Start));
+    range.Set("end", PositionOf(pos.m_End + 1));
+    return range;
+  }
+
+private:
+  // bytes of the UTF-8 sequence `lead` starts
+  static size_t Length(unsigned char lead)
+  {
+    return lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 1;
+  }
+
+  // code points past the BMP take a surrogate pair
+  static int64_t Units(unsigned char lead)
+  {
+    return lead >= 0xf0 ? 2 : 1;
+  }
+};
+
+// modules read from an interface carry no content, their source is still on disk
+static LineIndex LinesOf(Ptr<Module> module)
+{
+  if (!module->IsFromInterface())
+  {
+    return LineIndex(module->m_Content);
+  }
+  return LineIndex(ReadFile(module->m_Path).value_or(""));
+}
+
+static bool Contains(const Position &pos, size_t offset)
+{
+  // a cursor right after a name is still on it
+  return pos.m_Start <= offset && offset <= pos.m_End + 1;
+}
+
+/*
+  Innermost node under a cursor the checker recorded a type or a declaration
+  for. Declarations are only hit on their name, not on their whole extent
+*/
+class NodeFinder
+{
+public:
+  Ptr<Stmt> m_Node;
+  Position m_Pos;
+
+  NodeFinder(const SemaInfo &sema, size_t offset) : m_Node(nullptr), m_Pos(), m_Sema(sema), m_Offset(offset) {};
+
+  void Visit(Ptr<Stmt> stmt)
+  {
+    if (!stmt)
+    {
+      return;
+    }
+    switch (stmt->GetType())
+    {
+    case StmtT::Block:
+      for (auto &inner : CastPtr<BlockStmt>(stmt)->GetStatements())
+      {
+        Visit(inner);
+      }
+      break;
+    case StmtT::Fun:
+    {
+      auto funStmt = CastPtr<FunStmt>(stmt);
+      Consider(stmt, funStmt->GetSign().GetNamePos());
+      for (auto &param : funStmt->GetSign().GetParams())
+      {
+        Visit(param.GetIdent());
+      }
+      Visit(funStmt->GetBody());
+      break;
+    }
+    case StmtT::Ret:
+      Visit(CastPtr<RetStmt>(stmt)->GetValue());
+      break;
+    case StmtT::Let:
+    {
+      auto letStmt = CastPtr<LetStmt>(stmt);
+      Consider(stmt, letStmt->GetNamePos());
+      Visit(letStmt->GetInit());
+      break;
+    }
+    case StmtT::Import:
+      Consider(stmt, CastPtr<ImportStmt>(stmt)->GetNamePos());
+      break;
+    case StmtT::Expr:
+      VisitExpr(CastPtr<Expr>(stmt));
+      break;
+    }
+  }
+
+private:
+  const SemaInfo &m_Sema;
+  size_t m_Offset;
+
+  void VisitExpr(Ptr<Expr> expr)
+  {
+    switch (expr->GetType())
+    {
+    case ExprT::Call:
+    {
+      auto callExpr = CastPtr<CallExpr>(expr);
+      Consider(expr, expr->GetPos());
+      VisitExpr(callExpr->GetCallee());
+      for (auto &arg : callExpr->GetArgs())
+      {
+        VisitExpr(arg);
+      }
+      break;
+    }
+    case ExprT::Assign:
+      Consider(expr, expr->GetPos());
+      VisitExpr(CastPtr<AssignExpr>(expr)->GetDest());
+      VisitExpr(CastPtr<AssignExpr>(expr)->GetValue());
+      break;
+    case ExprT::FieldAcc:
+      // the value is visited on its own, the access answers for the field name
+      Consider(expr, CastPtr<FieldAccExpr>(expr)->GetFieldName()->GetPos());
+      VisitExpr(CastPtr<FieldAccExpr>(expr)->GetValue());
+      break;
+    case ExprT::Binary:
+      Consider(expr, CastPtr<BinaryExpr>(expr)->GetOpPos());
+      VisitExpr(CastPtr<BinaryExpr>(expr)->GetLhs());
+      VisitExpr(CastPtr<BinaryExpr>(expr)->GetRhs());
+      break;
+    case ExprT::Ident:
+    case ExprT::String:
+    case ExprT::Number:
+      Consider(expr, expr->GetPos());
+      break;
+    }
+  }
+
+  void Consider(Ptr<Stmt> node, Position pos)
+  {
+    if (!Contains(pos, m_Offset) || node->GetID() >= m_Sema.m_Nodes.size())
+    {
+      return;
+    }
+    auto &info = m_Sema.GetNode(node->GetID());
+    if (!info.m_Type && !info.m_Decl.IsValid())
+    {
+      return;
+    }
+    if (!m_Node || pos.m_End - pos.m_Start <= m_Pos.m_End - m_Pos.m_Start)
+    {
+      m_Node = node;
+      m_Pos = pos;
+    }
+  }
+};
+
+int LanguageServer::Run()
+{
+  for (;;)
+  {
+    auto message = Receive();
+    if (!message.has_value())
+    {
+      // the client went away without saying `exit`
+      return 1;
+    }
+    if (!Dispatch(message.value()))
+    {
+      return m_ShutDown ? 0 : 1;
+    }
+  }
+}
+
+std::optional<Json> LanguageServer::Receive()
+{
+  size_t length = 0;
+  bool hasLength = false;
+  std::string line;
+  while (std::getline(m_In, line))
+  {
+    if (!line.empty() && '\r' == line.back())
+    {
+      line.pop_back();
+    }
+    if (line.empty())
+    {
+      if (!hasLength)
+      {
+        continue;
+      }
+      if (length > MAX_MESSAGE_SIZE)
+      {
+        auto skip = static_cast<std::streamsize>(std::min<size_t>(length, std::numeric_limits<std::streamsize>::max()));
+        if (m_In.ignore(skip).gcount() != skip)
+        {
+          return std::nullopt;
+        }
+        return Json();
+      }
+      std::string body(length, '\0');
+      if (!m_In.read(body.data(), static_cast<std::streamsize>(length)))
+      {
+        return std::nullopt;
+      }
+      // malformed bodies come out as null, answered with a parse error
+      return Json::Parse(body).value_or(Json());
+    }
+    if (line.starts_with("Content-Length:"))
+    {
+      try
+      {
+        length = std::stoul(line.substr(15));
+        hasLength = true;
+      }
+      catch (std::exception &)
+      {
+        hasLength = false;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+void LanguageServer::Send(const Json &message)
+{
+  auto body = message.Dump();
+  m_Out << "Content-Length: " << body.size() << "\r\n\r\n"
+        << body << std::flush;
+}
+
+void LanguageServer::Reply(const Json &id, Json result)
+{
+  auto message = Json::Object();
+  message.Set("jsonrpc", Json::String("2.0"));
+  message.Set("id", id);
+  message.Set("result", std::move(result));
+  Send(message);
+}
+
+void LanguageServer::ReplyError(const Json &id, int code, const std::string &text)
+{
+  auto error = Json::Object();
+  error.Set("code", Json::Number(code));
+  error.Set("message", Json::String(text));
+  auto message = Json::Object();
+  message.Set("jsonrpc", Json::String("2.0"));
+  message.Set("id", id);
+  message.Set("error", std::move(error));
+  Send(message);
+}
+
+void LanguageServer::Notify(const std::string &method, Json params)
+{
+  auto message = Json::Object();
+  message.Set("jsonrpc", Json::String("2.0"));
+  message.Set("method", Json::String(method));
+  message.Set("params", std::move(params));
+  Send(message);
+}
+
+bool LanguageServer::Dispatch(const Json &message)
+{
+  if (JsonT::Object != message.m_Type)
+  {
+    ReplyError(Json(), PARSE_ERROR, "malformed message");
+    return true;
+  }
+  auto &method = message.Get("method").AsString();
+  auto &id = message.Get("id");
+  auto &params = message.Get("params");
+  if ("initialize" == method)
+  {
+    // imports resolve from the working directory
+    auto root = PathOfUri(params.Get("rootUri").AsString());
+    std::error_code errorCode;
+    std::filesystem::current_path(root.empty() ? params.Get("rootPath").AsString() : root, errorCode);
+    auto sync = Json::Object();
+    sync.Set("openClose", Json::Bool(true));
+    sync.Set("change", Json::Number(2)); // incremental
+    sync.Set("save", Json::Object());
+    auto capabilities = Json::Object();
+    capabilities.Set("textDocumentSync", std::move(sync));
+    capabilities.Set("definitionProvider", Json::Bool(true));
+    capabilities.Set("hoverProvider", Json::Bool(true));
+    auto serverInfo = Json::Object();
+    serverInfo.Set("name", Json::String("zeroc"));
+    auto result = Json::Object();
+    result.Set("capabilities", std::move(capabilities));
+    result.Set("serverInfo", std::move(serverInfo));
+    Reply(id, std::move(result));
+  }
+  else if ("shutdown" == method)
+  {
+    m_ShutDown = true;
+    Reply(id, Json());
+  }
+  else if ("exit" == method)
+  {
+    return false;
+  }
+  else if ("textDocument/didOpen" == method)
+  {
+    Open(params);
+  }
+  else if ("textDocument/didChange" == method)
+  {
+    Change(params);
+  }
+  else if ("textDocument/didClose" == method)
+  {
+    Close(params);
+  }
+  else if ("textDocument/didSave" == method)
+  {
+    // other files may have been saved along
+    Recheck();
+  }
+  else if ("textDocument/definition" == method)
+  {
+    Reply(id, Definition(params));
+  }
+  else if ("textDocument/hover" == method)
+  {
+    Reply(id, Hover(params));
+  }
+  else if (method.empty() && id.IsNull())
+  {
+    ReplyError(id, INVALID_REQUEST, "message without a method");
+  }
+  // notifications the server has no use for, eg. `initialized`, go unanswered
+  else if (!id.IsNull() && !method.empty())
+  {
+    ReplyError(id, METHOD_NOT_FOUND, "unsupported method: " + method);
+  }
+  return true;
+}
+
+void LanguageServer::Open(const Json &params)
+{
+  auto &document = params.Get("textDocument");
+  auto path = PathOfUri(document.Get("uri").AsString());
+  if (path.empty())
+  {
+    return;
+  }
+  m_Documents[document.Get("uri").AsString()] = path;
+  auto &modManager = m_Workspace.m_ModManager;
+  modManager.m_Overlays[modManager.m_Resolver.Canonical(path)] = document.Get("text").AsString();
+  Recheck();
+}
+
+void LanguageServer::Change(const Json &params)
+{
+  auto &uri = params.Get("textDocument").Get("uri").AsString();
+  auto found = m_Documents.find(uri);
+  if (found == m_Documents.end())
+  {
+    return;
+  }
+  auto &modManager = m_Workspace.m_ModManager;
+  auto &text = modManager.m_Overlays[modManager.m_Resolver.Canonical(found->second)];
+  auto &changes = params.Get("contentChanges");
+  for (size_t i = 0; i < changes.Size(); ++i)
+  {
+    auto &change = changes.At(i);
+    auto &range = change.Get("range");
+    if (range.IsNull())
+    {
+      text = change.Get("text").AsString();
+      continue;
+    }
+    // each change applies to the text the previous ones left
+    LineIndex lines(text);
+    auto start = lines.OffsetOf(range.Get("start"));
+    auto end = std::max(start, lines.OffsetOf(range.Get("end")));
+    text.replace(start, end - start, change.Get("text").AsString());
+  }
+  Recheck();
+}
+
+void LanguageServer::Close(const Json &params)
+{
+  auto &uri = params.Get("textDocument").Get("uri").AsString();
+  auto found = m_Documents.find(uri);
+  if (found == m_Documents.end())
+  {
+    return;
+  }
+  auto &modManager = m_Workspace.m_ModManager;
+  modManager.m_Overlays.erase(modManager.m_Resolver.Canonical(found->second));
+  m_Documents.erase(found);
+  Recheck();
+}
+
+std::string LanguageServer::UriOf(Ptr<Module> module)
+{
+  auto canonical = m_Workspace.m_ModManager.m_Resolver.Canonical(module->m_Path);
+  return UriOfPath(std::filesystem::absolute(canonical).lexically_normal().string());
+}
+
+void LanguageServer::Recheck()
+{
+  std::vector<std::string> inputFiles;
+  for (auto &[uri, path] : m_Documents)
+  {
+    inputFiles.push_back(path);
+  }
+  auto outcome = m_Workspace.Check(inputFiles, m_Jobs);
+  auto &modManager = m_Workspace.m_ModManager;
+  DiagnosticEngine diagnosticEngine(modManager);
+  // every open document gets an answer, even an empty one
+  std::map<std::string, Json> published;
+  for (auto &[uri, path] : m_Documents)
+  {
+    published[uri] = Json::Array();
+  }
+  std::map<ModuleID, LineIndex> lines;
+  auto linesOf = [&](ModuleID id) -> const LineIndex &
+  {
+    auto found = lines.find(id);
+    if (found == lines.end())
+    {
+      found = lines.emplace(id, LinesOf(modManager.Get(id))).first;
+    }
+    return found->second;
+  };
+  for (auto &diagnostic : outcome.m_Diagnostics)
+  {
+    auto item = Json::Object();
+    item.Set("range", linesOf(diagnostic.m_ModuleID).RangeOf(diagnostic.m_Position));
+    auto severity = diagnostic.GetSeverity();
+    item.Set("severity", Json::Number(DiagnosticSeverity::ERROR == severity ? 1 : DiagnosticSeverity::WARN == severity ? 2 : 3));
+    item.Set("code", Json::String(Diagnostic::GetName(diagnostic.m_Code)));
+    item.Set("source", Json::String("zeroc"));
+    item.Set("message", Json::String(diagnosticEngine.RenderMessage(diagnostic.m_Code, diagnostic.m_Args)));
+    if (diagnostic.m_Reference.has_value())
+    {
+      auto &reference = diagnostic.m_Reference.value();
+      auto location = Json::Object();
+      location.Set("uri", Json::String(UriOf(modManager.Get(reference.m_ModuleID))));
+      location.Set("range", linesOf(reference.m_ModuleID).RangeOf(reference.m_Position));
+      auto related = Json::Object();
+      related.Set("location", std::move(location));
+      related.Set("message", Json::String(diagnosticEngine.RenderMessage(reference.m_Code, reference.m_Args)));
+      item.Set("relatedInformation", Json::Array().Push(std::move(related)));
+    }
+    auto uri = UriOf(modManager.Get(diagnostic.m_ModuleID));
+    published.try_emplace(uri, Json::Array()).first->second.Push(std::move(item));
+  }
+  for (auto &uri : m_Published)
+  {
+    published.try_emplace(uri, Json::Array());
+  }
+  m_Published.clear();
+  for (auto &[uri, diagnostics] : published)
+  {
+    if (diagnostics.Size() > 0)
+    {
+      m_Published.insert(uri);
+    }
+    auto params = Json::Object();
+    params.Set("uri", Json::String(uri));
+    params.Set("diagnostics", std::move(diagnostics));
+    Notify("textDocument/publishDiagnostics", std::move(params));
+  }
+  for (auto &error : outcome.m_LoadErrors)
+  {
+    auto params = Json::Object();
+    params.Set("type", Json::Number(1));
+    params.Set("message", Json::String(error));
+    Notify("window/logMessage", std::move(params));
+  }
+}
+
+// the module an open document is checked as, null until it parses
+static Ptr<Module> ModuleOf(ModuleManager &modManager, const std::string &path)
+{
+  auto canonical = modManager.m_Resolver.Canonical(path);
+  for (auto &module : modManager.Modules())
+  {
+    if (modManager.m_Resolver.Canonical(module->m_Path) == canonical)
+    {
+      return module->m_AST && module->m_Sema ? module : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+Json LanguageServer::Definition(const Json &params)
+{
+  auto found = m_Documents.find(params.Get("textDocument").Get("uri").AsString());
+  auto &modManager = m_Workspace.m_ModManager;
+  auto module = found != m_Documents.end() ? ModuleOf(modManager, found->second) : nullptr;
+  if (!module)
+  {
+    return Json();
+  }
+  NodeFinder finder(*module->m_Sema, LinesOf(module).OffsetOf(params.Get("position")));
+  for (auto &stmt : module->m_AST->m_Program)
+  {
+    finder.Visit(stmt);
+  }
+  if (!finder.m_Node)
+  {
+    return Json();
+  }
+  auto ref = module->m_Sema->GetNode(finder.m_Node->GetID()).m_Decl;
+  auto owner = ref.IsValid() ? modManager.Get(ref.m_ModID) : nullptr;
+  if (!owner || !owner->m_Sema || ref.m_ID >= owner->m_Sema->m_Decls.size())
+  {
+    return Json();
+  }
+  auto &decl = owner->m_Sema->m_Decls.at(ref.m_ID);
+  auto location = Json::Object();
+  // on the name an import binds, go to the module it brings in
+  if (DeclT::Mod == decl.m_DeclT && StmtT::Import == finder.m_Node->GetType() && modManager.Get(decl.m_Target))
+  {
+    location.Set("uri", Json::String(UriOf(modManager.Get(decl.m_Target))));
+    location.Set("range", LineIndex("").RangeOf(Position(1, 1, 0, 0)));
+    return location;
+  }
+  location.Set("uri", Json::String(UriOf(owner)));
+  location.Set("range", LinesOf(owner).RangeOf(decl.m_NamePos));
+  return location;
+}
+
+Json LanguageServer::Hover(const Json &params)
+{
+  auto found = m_Documents.find(params.Get("textDocument").Get("uri").AsString());
+  auto &modManager = m_Workspace.m_ModManager;
+  auto module = found != m_Documents.end() ? ModuleOf(modManager, found->second) : nullptr;
+  if (!module)
+  {
+    return Json();
+  }
+  auto lines = LinesOf(module);
+  NodeFinder finder(*module->m_Sema, lines.OffsetOf(params.Get("position")));
+  for (auto &stmt : module->m_AST->m_Program)
+  {
+    finder.Visit(stmt);
+  }
+  if (!finder.m_Node)
+  {
+    return Json();
+  }
+  auto &info = module->m_Sema->GetNode(finder.m_Node->GetID());
+  auto type = info.m_Type;
+  std::string name;
+  if (auto owner = info.m_Decl.IsValid() ? modManager.Get(info.m_Decl.m_ModID) : nullptr; owner && owner->m_Sema && info.m_Decl.m_ID < owner->m_Sema->m_Decls.size())
+  {
+    auto &decl = owner->m_Sema->m_Decls.at(info.m_Decl.m_ID);
+    name = decl.m_Name;
+    type = type ? type : decl.m_Type;
+  }
+  if (!type)
+  {
+    return Json();
+  }
+  auto contents = Json::Object();
+  contents.Set("kind", Json::String("plaintext"));
+  contents.Set("value", Json::String(name.empty() ? type->Inspect() : name + ": " + type->Inspect()));
+  auto hover = Json::Object();
+  hover.Set("contents", std::move(contents));
+  hover.Set("range", lines.RangeOf(finder.m_Pos));
+  return hover;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "driver.h"
+#include "json.h"
+
+/*
+  Language server over a pair of streams, `Content-Length` framed JSON-RPC. Open
+  documents are overlays of a single workspace checked again after each edit,
+  which only re-parses the edited module and rechecks the ones importing it
+*/
+class LanguageServer
+{
+public:
+  LanguageServer(std::istream &in, std::ostream &out, const std::vector<std::string> &searchRoots, size_t jobs) : m_In(in), m_Out(out), m_Jobs(jobs), m_Workspace(), m_Documents(), m_Published(), m_ShutDown(false)
+  {
+    m_Workspace.m_ModManager.m_Resolver.m_Roots = searchRoots;
+  };
+
+  // serves until the client says `exit`, yields the exit code it asks for
+  int Run();
+
+private:
+  std::istream &m_In;
+  std::ostream &m_Out;
+  size_t m_Jobs;
+  Workspace m_Workspace;
+  // open documents, URI to path
+  std::map<std::string, std::string> m_Documents;
+  // URIs given diagnostics by the last check, cleared when they have none left
+  std::set<std::string> m_Published;
+  bool m_ShutDown;
+
+  std::optional<Json> Receive();
+  void Send(const Json &message);
+  void Reply(const Json &id, Json result);
+  void ReplyError(const Json &id, int code, const std::string &message);
+  void Notify(const std::string &method, Json params);
+
+  // false once the client said `exit`
+  bool Dispatch(const Json &message);
+  void Open(const Json &params);
+  void Change(const Json &params);
+  void Close(const Json &params);
+  void Recheck();
+  Json Definition(const Json &params);
+  Json Hover(const Json &params);
+
+  std::string UriOf(Ptr<Module> module);
+};
@@ -1,49 +1,639 @@
+#include <algorithm>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <tuple>
+#include <vector>
 
+#include "cache.h"
+#include "cgen.h"
 #include "checker.h"
+#include "daemon.h"
 #include "diagnostic.h"
+#include "driver.h"
+#include "irgen.h"
+#include "lsp.h"
+#include "memstats.h"
 #include "module.h"
+#include "parallel.h"
 #include "parser.h"
+#include "passes.h"
+#include "vm.h"
+#include "watch.h"
+#include "x64.h"
+
+static void PrintUsage(const char *program)
+{
+  std::cerr << "Usage: " << program << " [run|build] [options] <input_file>" << std::endl;
+  std::cerr << "       " << program << " check [options] <input_file>... [--all <dir>]" << std::endl;
+  std::cerr << "       " << program << " --daemon [--socket=<path>]" << std::endl;
+  std::cerr << "       " << program << " lsp [-I <dir>]..." << std::endl;
+  std::cerr << "  run               execute the program: module initializers, then main" << std::endl;
+  std::cerr << "  build             compile the program to an executable through the C backend and $CC (cc)" << std::endl;
+  std::cerr << "  check             check many entry points at once, sharing the modules they import" << std::endl;
+  std::cerr << "  lsp               serve the Language Server Protocol over stdin and stdout" << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  --max-errors=<n>  stop after <n> errors, 0 means no limit" << std::endl;
+  std::cerr << "  -Wno-<name>       silence the warning <name>, eg. -Wno-unused-variable" << std::endl;
+  std::cerr << "  --emit=<ir|c|obj> print the IR or the C translation of the program once it checks," << std::endl;
+  std::cerr << "                    or write a native x86-64 ELF object" << std::endl;
+  std::cerr << "  -o <file>         build: path of the executable, defaults to the input without extension" << std::endl;
+  std::cerr << "                    --emit=obj: path of the object, defaults to the input with a .o extension" << std::endl;
+  std::cerr << "  -O<level>         optimize the IR, level 0, 1 or 2, defaults to 0 and to 1 for run and build" << std::endl;
+  std::cerr << "  --print-after=<pass>  print the IR to stderr after each run of <pass>" << std::endl;
+  std::cerr << "  --print-reachability  report the functions left out of the program, no entry point reaches them" << std::endl;
+  std::cerr << "  --time-passes     report the time spent in each IR pass" << std::endl;
+  std::cerr << "  --cache-dir=<dir> reuse and store checked modules and generated code in <dir>, which may be" << std::endl;
+  std::cerr << "                    shared between machines, defaults to $ZEROC_CACHE_DIR" << std::endl;
+  std::cerr << "  --diagnostics-format=<text|json|sarif>  print the diagnostics as text to stderr (default)," << std::endl;
+  std::cerr << "                    or as one JSON array or SARIF 2.1.0 log to stdout" << std::endl;
+  std::cerr << "  --mem-stats       report allocations and peak memory by phase and module, and AST nodes by kind" << std::endl;
+  std::cerr << "  --remarks         report the optimizations applied to the IR, eg. the arithmetic checks removed" << std::endl;
+  std::cerr << "  --jit-threshold=<n>  run: compile a function to machine code after <n> calls, 0 disables the JIT" << std::endl;
+  std::cerr << "  --unchecked-arith let integer arithmetic wrap on overflow instead of trapping" << std::endl;
+  std::cerr << "  -I <dir>          search <dir> for imports before the working directory" << std::endl;
+  std::cerr << "  --imports=<mode>  'full' (default) checks imported function bodies in parallel," << std::endl;
+  std::cerr << "                    'interface' only checks their signatures" << std::endl;
+  std::cerr << "  --all <dir>       check: add every .zr file under <dir> as an entry point" << std::endl;
+  std::cerr << "  -j <n>            check: use <n> threads, defaults to one per hardware thread" << std::endl;
+  std::cerr << "  --connect         check: let the daemon check, or check locally when none answers in time" << std::endl;
+  std::cerr << "  --watch           check: check again whenever a loaded module changes, until interrupted" << std::endl;
+  std::cerr << "  --daemon          serve checks from memory, reloading only the modules that changed" << std::endl;
+  std::cerr << "  --socket=<path>   socket of the daemon, defaults to $XDG_RUNTIME_DIR/zeroc.sock" << std::endl;
+}
+
+static std::string ShellQuote(const std::string &str)
+{
+  std::string quoted = "'";
+  for (auto c : str)
+  {
+    quoted += '\'' == c ? std::string("'\\''") : std::string(1, c);
+  }
+  return quoted + "'";
+}
+
+// feeds `source` to the system C compiler, yields the exit code for the driver
+static int CompileC(const std::string &source, const std::string &outputFile)
+{
+  auto cc = std::getenv("CC");
+  auto command = std::format("{} -std=c99 -O2 -x c - -o {}", cc && *cc ? cc : "cc", ShellQuote(outputFile));
+  auto pipe = popen(command.c_str(), "w");
+  if (!pipe)
+  {
+    std::cerr << "failed to run the C compiler: " << command << std::endl;
+    return 1;
+  }
+  std::fwrite(source.data(), 1, source.size(), pipe);
+  auto status = pclose(pipe);
+  if (0 != status)
+  {
+    std::cerr << "C compiler failed: " << command << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// hands out what `--emit` or `build` produced, generated now or found in the build cache
+static int Deliver(const std::string &emit, bool build, const std::string &code, std::string outputFile, const std::string &inputFile)
+{
+  if ("ir" == emit || ("c" == emit && !build))
+  {
+    std::cout << code;
+    return 0;
+  }
+  if ("obj" == emit)
+  {
+    if (outputFile.empty())
+    {
+      outputFile = std::filesystem::path(inputFile).replace_extension(".o").string();
+    }
+    std::ofstream out(outputFile, std::ios::binary);
+    out.write(code.data(), static_cast<std::streamsize>(code.size()));
+    if (!out)
+    {
+      std::cerr << "failed to write " << outputFile << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+  if (outputFile.empty())
+  {
+    outputFile = std::filesystem::path(inputFile).replace_extension().string();
+  }
+  return CompileC(code, outputFile);
+}
+
+// text is for people, the machine formats are documents of their own
+static std::ostream &DiagnosticsStream(DiagnosticFormat format)
+{
+  return DiagnosticFormat::Text == format ? std::cerr : std::cout;
+}
+
+// `check`: every entry point against one module table
+static int Check(const std::vector<std::string> &inputFiles, const std::vector<std::string> &searchRoots, DiagnosticFilter &filter, size_t jobs, Ptr<BuildCache> cache, DiagnosticFormat format)
+{
+  ModuleManager moduleManager;
+  moduleManager.m_Resolver.m_Roots = searchRoots;
+  moduleManager.m_Cache = cache;
+  DiagnosticEngine diagnosticEngine(moduleManager, DiagnosticsStream(format), format);
+  MemStats::BeginPhase("check");
+  auto outcome = CheckEntries(moduleManager, inputFiles, filter, jobs);
+  MemStats::BeginPhase("report");
+  for (auto &error : outcome.m_LoadErrors)
+  {
+    std::cerr << error << std::endl;
+  }
+  for (auto &diagnostic : outcome.m_Diagnostics)
+  {
+    diagnosticEngine.Report(diagnostic);
+  }
+  return outcome.m_HasErrors ? 1 : 0;
+}
+
+// `check --connect`: the same through the daemon, nothing when none answered
+static std::optional<int> CheckRemote(const std::string &socketPath, const std::vector<std::string> &inputFiles, const std::vector<std::string> &searchRoots, DiagnosticFilter &filter, size_t jobs)
+{
+  std::error_code errorCode;
+  auto cwd = std::filesystem::current_path(errorCode);
+  if (errorCode)
+  {
+    return std::nullopt;
+  }
+  DaemonRequest request;
+  request.m_Cwd = cwd.string();
+  auto home = std::getenv("ZEROLANG_HOME");
+  request.m_Home = home ? home : "";
+  request.m_Roots = searchRoots;
+  request.m_Files = inputFiles;
+  for (auto code : filter.m_Disabled)
+  {
+    request.m_Disabled.push_back(Diagnostic::GetName(code));
+  }
+  request.m_MaxErrors = filter.m_MaxErrors;
+  request.m_Jobs = jobs;
+  return Daemon::Send(socketPath, request, std::cerr);
+}
+
+// `check --watch`: a workspace checked again after each batch of changes, until killed
+static int CheckWatch(const std::vector<std::string> &inputFiles, const std::vector<std::string> &searchRoots, DiagnosticFilter &filter, size_t jobs, DiagnosticFormat format)
+{
+  // long enough to take in an editor saving several files at once
+  constexpr int SETTLE_MS = 50;
+  FileWatcher watcher;
+  if (!watcher.Open())
+  {
+    std::cerr << "failed to watch files: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  Workspace workspace;
+  workspace.m_ModManager.m_Resolver.m_Roots = searchRoots;
+  do
+  {
+    auto outcome = workspace.Check(inputFiles, jobs);
+    // modules changed since the last round, their line tables with them
+    DiagnosticEngine diagnosticEngine(workspace.m_ModManager, DiagnosticsStream(format), format);
+    for (auto &error : outcome.m_LoadErrors)
+    {
+      std::cerr << error << std::endl;
+    }
+    filter.m_ErrorsCount = 0;
+    size_t errors = 0;
+    size_t warnings = 0;
+    for (auto &diagnostic : outcome.m_Diagnostics)
+    {
+      if (filter.Admit(diagnostic.m_Code))
+      {
+        diagnosticEngine.Report(diagnostic);
+        if (DiagnosticSeverity::ERROR == diagnostic.GetSeverity())
+        {
+          ++errors;
+        }
+        else
+        {
+          ++warnings;
+        }
+      }
+    }
+    // an entry that failed to load is watched too, it may get created
+    for (auto &inputFile : inputFiles)
+    {
+      watcher.Watch(inputFile);
+    }
+    for (auto &module : workspace.m_ModManager.Modules())
+    {
+      watcher.Watch(module->m_Path);
+    }
+    diagnosticEngine.Finish();
+    std::cerr << std::format("-- {} error(s), {} warning(s), watching {} file(s)", errors + outcome.m_LoadErrors.size(), warnings, watcher.Size()) << std::endl;
+  } while (watcher.Wait(SETTLE_MS));
+  std::cerr << "failed to watch files: " << std::strerror(errno) << std::endl;
+  return 1;
+}
 
 int main(int argc, char *argv[])
 {
-  if (argc < 2)
+  DiagnosticFilter filter;
+  std::vector<std::string> searchRoots;
+  bool checkImportBodies = true;
+  // "ir" or "c"
+  std::string emit;
+  std::string command = argc > 1 ? argv[1] : "";
+  bool run = command == "run";
+  bool build = command == "build";
+  bool check = command == "check";
+  bool lsp = command == "lsp";
+  std::string outputFile;
+  std::optional<unsigned> optLevel;
+  std::string printAfter;
+  bool timePasses = false;
+  bool remarks = false;
+  bool printReachability = false;
+  bool checkedArith = true;
+  std::optional<uint32_t> jitThreshold;
+  size_t jobs = DefaultJobs();
+  bool daemon = false;
+  bool connect = false;
+  bool watch = false;
+  auto diagnosticsFormat = DiagnosticFormat::Text;
+  std::string socketPath = Daemon::DefaultSocketPath();
+  auto cacheDirEnv = std::getenv("ZEROC_CACHE_DIR");
+  std::string cacheDir = cacheDirEnv ? cacheDirEnv : "";
+  std::vector<std::string> inputFiles;
+  for (int i = run || build || check || lsp ? 2 : 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg.starts_with("--max-errors="))
+    {
+      try
+      {
+        filter.m_MaxErrors = std::stoul(arg.substr(arg.find('=') + 1));
+      }
+      catch (std::exception &)
+      {
+        std::cerr << "invalid value for --max-errors: " << arg << std::endl;
+        return 1;
+      }
+    }
+    else if (arg == "--emit=ir" || arg == "--emit=c" || arg == "--emit=obj")
+    {
+      emit = arg.substr(arg.find('=') + 1);
+    }
+    else if (arg == "-o" && i + 1 < argc)
+    {
+      outputFile = argv[++i];
+    }
+    else if (arg == "-O0" || arg == "-O1" || arg == "-O2")
+    {
+      optLevel = static_cast<unsigned>(arg.back() - '0');
+    }
+    else if (arg.starts_with("--print-after="))
+    {
+      printAfter = arg.substr(arg.find('=') + 1);
+      if (!ir::PassManager::IsPassName(printAfter))
+      {
+        std::cerr << "unknown pass: " << printAfter << std::endl;
+        return 1;
+      }
+    }
+    else if (arg.starts_with("--jit-threshold="))
+    {
+      try
+      {
+        jitThreshold = static_cast<uint32_t>(std::stoul(arg.substr(arg.find('=') + 1)));
+      }
+      catch (std::exception &)
+      {
+        std::cerr << "invalid value for --jit-threshold: " << arg << std::endl;
+        return 1;
+      }
+    }
+    else if (arg == "--time-passes")
+    {
+      timePasses = true;
+    }
+    else if (arg == "--remarks")
+    {
+      remarks = true;
+    }
+    else if (arg == "--print-reachability")
+    {
+      printReachability = true;
+    }
+    else if (arg.starts_with("--cache-dir="))
+    {
+      cacheDir = arg.substr(arg.find('=') + 1);
+    }
+    else if (arg.starts_with("--diagnostics-format="))
+    {
+      auto format = DiagnosticEngine::FormatFromName(arg.substr(arg.find('=') + 1));
+      if (!format.has_value())
+      {
+        std::cerr << "unknown diagnostics format: " << arg.substr(arg.find('=') + 1) << std::endl;
+        return 1;
+      }
+      diagnosticsFormat = format.value();
+    }
+    else if (arg == "--mem-stats")
+    {
+      MemStats::Enable();
+    }
+    else if (arg == "--unchecked-arith")
+    {
+      checkedArith = false;
+    }
+    else if (arg.starts_with("-I"))
+    {
+      if (arg.size() == 2 && i + 1 >= argc)
+      {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      searchRoots.push_back(arg.size() > 2 ? arg.substr(2) : argv[++i]);
+    }
+    else if (arg == "--imports=full" || arg == "--imports=interface")
+    {
+      checkImportBodies = arg == "--imports=full";
+    }
+    else if (arg.starts_with("-Wno-"))
+    {
+      auto code = Diagnostic::FromName(arg.substr(5));
+      if (!code.has_value() || DiagnosticSeverity::WARN != Diagnostic(code.value(), Position(), 0).GetSeverity())
+      {
+        std::cerr << "unknown warning: " << arg.substr(5) << std::endl;
+        return 1;
+      }
+      filter.m_Disabled.insert(code.value());
+    }
+    else if (check && arg == "--all" && i + 1 < argc)
+    {
+      std::string dir = argv[++i];
+      std::error_code errorCode;
+      std::vector<std::string> found;
+      for (auto it = std::filesystem::recursive_directory_iterator(dir, errorCode); !errorCode && it != std::filesystem::recursive_directory_iterator(); it.increment(errorCode))
+      {
+        if (it->is_regular_file() && ".zr" == it->path().extension())
+        {
+          found.push_back(it->path().string());
+        }
+      }
+      if (errorCode)
+      {
+        std::cerr << dir << ": " << errorCode.message() << std::endl;
+        return 1;
+      }
+      // directory order is unspecified, module IDs and so diagnostics follow the entry order
+      std::sort(found.begin(), found.end());
+      inputFiles.insert(inputFiles.end(), found.begin(), found.end());
+    }
+    else if (check && arg.starts_with("-j"))
+    {
+      if (arg.size() == 2 && i + 1 >= argc)
+      {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      try
+      {
+        jobs = std::stoul(arg.size() > 2 ? arg.substr(2) : argv[++i]);
+      }
+      catch (std::exception &)
+      {
+        std::cerr << "invalid value for -j: " << arg << std::endl;
+        return 1;
+      }
+      if (0 == jobs)
+      {
+        std::cerr << "invalid value for -j: " << arg << std::endl;
+        return 1;
+      }
+    }
+    else if (check && arg == "--connect")
+    {
+      connect = true;
+    }
+    else if (check && arg == "--watch")
+    {
+      watch = true;
+    }
+    else if (!run && !build && !check && arg == "--daemon")
+    {
+      daemon = true;
+    }
+    else if (arg.starts_with("--socket="))
+    {
+      socketPath = arg.substr(arg.find('=') + 1);
+    }
+    else if (arg.starts_with("-") || (!inputFiles.empty() && !check) || lsp)
+    {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    else
+    {
+      inputFiles.push_back(arg);
+    }
+  }
+  if (lsp)
   {
-    std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
+    // the protocol owns stdout, stray diagnostics go to stderr
+    return LanguageServer(std::cin, std::cout, searchRoots, DefaultJobs()).Run();
+  }
+  if (daemon && inputFiles.empty())
+  {
+    return Daemon(socketPath).Serve();
+  }
+  if (inputFiles.empty() || daemon || (watch && connect))
+  {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  if (DiagnosticFormat::Text != diagnosticsFormat && (run || "ir" == emit || ("c" == emit && !build)))
+  {
+    std::cerr << "--diagnostics-format: only text can share stdout with run and --emit=ir|c" << std::endl;
     return 1;
   }
+  if (watch)
+  {
+    return CheckWatch(inputFiles, searchRoots, filter, jobs, diagnosticsFormat);
+  }
+  // the daemon renders text
+  if (check && connect && DiagnosticFormat::Text == diagnosticsFormat)
+  {
+    if (auto exitCode = CheckRemote(socketPath, inputFiles, searchRoots, filter, jobs))
+    {
+      return exitCode.value();
+    }
+  }
+  // the daemon, the language server and watching keep their modules in memory instead
+  Ptr<BuildCache> cache;
+  if (!cacheDir.empty())
+  {
+    // checking depends on nothing else the command line says
+    std::string flags;
+    for (auto code : filter.m_Disabled)
+    {
+      flags += "-Wno-" + Diagnostic::GetName(code) + " ";
+    }
+    cache = std::make_shared<BuildCache>(cacheDir, flags);
+  }
+  if (check)
+  {
+    return Check(inputFiles, searchRoots, filter, jobs, cache, diagnosticsFormat);
+  }
+  auto inputFile = inputFiles.front();
   ModuleManager moduleManager;
-  DiagnosticEngine diagnosticEngine(moduleManager);
-  auto loadRes = moduleManager.Load(argv[1]);
-  if (loadRes.is_err())
+  moduleManager.m_Resolver.m_Roots = searchRoots;
+  moduleManager.m_Cache = cache;
+  // lowering needs the AST of every module
+  bool lower = !emit.empty() || run || build;
+  moduleManager.m_PreferInterfaces = !lower;
+  // `run` needs the IR itself, and the reports of the passes would go missing on a hit
+  bool cacheCode = cache && (!emit.empty() || build) && printAfter.empty() && !timePasses && !remarks && !printReachability;
+  auto level = optLevel.value_or(run || build ? 1 : 0);
+  auto codeOptions = std::format("emit={} build={} O{} checked-arith={}", emit, build, level, checkedArith);
+  DiagnosticEngine diagnosticEngine(moduleManager, DiagnosticsStream(diagnosticsFormat), diagnosticsFormat);
+  if (cacheCode)
   {
-    std::cerr << loadRes.unwrap_err().Message << std::endl;
+    if (auto code = cache->LoadCode(cache->ProgramKey(inputFile, codeOptions, moduleManager.m_Resolver)))
+    {
+      diagnosticEngine.Finish();
+      return Deliver(emit, build, code.value(), outputFile, inputFile);
+    }
   }
-  auto mainModule = loadRes.unwrap();
-  Parser parser(mainModule, moduleManager);
-  auto parseError = parser.Parse();
-  if (parseError.has_value())
+  MemStats::BeginPhase("frontend");
+  auto loadRes = moduleManager.Load(inputFile);
+  if (loadRes.is_err())
   {
-    diagnosticEngine.Report(parseError.value());
+    std::cerr << inputFile << ": " << loadRes.unwrap_err().Message << std::endl;
     return 1;
   }
-  // std::cout << mainModule->m_AST->Inspect() << std::endl;
-  Checker checker(mainModule, moduleManager);
-  auto diagnostics = checker.Check();
-  bool hasErrorDiagnostic = false;
-  for (auto &diagnostic : diagnostics)
+  auto mainModule = loadRes.unwrap();
+  std::vector<Diagnostic> diagnostics;
+  bool hasErrors = false;
+  // a build cache hit comes checked, without errors
+  if (!mainModule->IsFromInterface())
   {
-    if (DiagnosticSeverity::ERROR == diagnostic.m_Severity)
+    // the main module steps through its states like any import, so importing it back is a cycle
+    bool cycle = false;
+    (void)moduleManager.Claim(mainModule, ModuleState::Loaded, cycle);
+    Parser parser(mainModule, moduleManager);
+    auto parseError = parser.Parse();
+    moduleManager.Finish(mainModule, parseError.has_value() ? ModuleState::Invalid : ModuleState::Parsed);
+    if (parseError.has_value())
     {
-      hasErrorDiagnostic = true;
+      diagnosticEngine.Report(parseError.value());
+      return 1;
     }
+    // std::cout << mainModule->m_AST->Inspect() << std::endl;
+    (void)moduleManager.Claim(mainModule, ModuleState::Parsed, cycle);
+    Checker checker(mainModule, moduleManager, filter, CheckMode::Interface);
+    diagnostics = checker.Check();
+    moduleManager.Finish(mainModule, ModuleState::Checked);
+    hasErrors = checker.HasErrors();
+  }
+  if (checkImportBodies || lower)
+  {
+    hasErrors = Checker::CheckDeferred(moduleManager, diagnostics, DefaultJobs()) || hasErrors;
+  }
+  ReplayCached(moduleManager, {mainModule}, filter, diagnostics);
+  // bodies are checked after signatures, restore source order within each module
+  std::stable_sort(diagnostics.begin(), diagnostics.end(), [](const Diagnostic &a, const Diagnostic &b)
+                   { return std::tie(a.m_ModuleID, a.m_Position.m_Start) < std::tie(b.m_ModuleID, b.m_Position.m_Start); });
+  for (auto &diagnostic : diagnostics)
+  {
     diagnosticEngine.Report(diagnostic);
   }
-  if (hasErrorDiagnostic)
+  // ahead of whatever else goes to stderr, the program output included
+  diagnosticEngine.Finish();
+  if (hasErrors)
   {
     return 1;
   }
+  if (lower)
+  {
+    MemStats::BeginPhase("lower");
+    IRGenerator generator(moduleManager);
+    generator.m_CheckedArith = checkedArith;
+    auto program = generator.Generate(mainModule);
+    if (printReachability)
+    {
+      for (auto &ref : generator.m_Unreachable)
+      {
+        auto module = moduleManager.Get(ref.m_ModID);
+        auto &decl = module->m_Sema->m_Decls.at(ref.m_ID);
+        std::cerr << std::format("{}:{}:{}: dropped unreachable function '{}'", module->m_Path, decl.m_NamePos.m_Line, decl.m_NamePos.m_Column, decl.m_Name) << std::endl;
+      }
+    }
+    auto passes = ir::PassManager::ForLevel(level);
+    passes.m_PrintAfter = printAfter;
+    MemStats::BeginPhase("optimize");
+    passes.Run(*program, std::cerr);
+    if (timePasses)
+    {
+      passes.ReportTimings(std::cerr);
+    }
+    if (remarks)
+    {
+      for (auto &remark : passes.Remarks())
+      {
+        auto &path = moduleManager.Get(remark.m_ModID)->m_Path;
+        std::cerr << std::format("{}:{}:{}: remark: {} in '{}' [{}]", path, remark.m_Pos.m_Line, remark.m_Pos.m_Column, remark.m_Message, remark.m_Function, remark.m_Pass) << std::endl;
+      }
+    }
+    auto problems = program->Verify();
+    for (auto &problem : problems)
+    {
+      std::cerr << "invalid IR: " << problem << std::endl;
+    }
+    if (!problems.empty())
+    {
+      return 1;
+    }
+    if (emit.empty() && !build)
+    {
+      auto bytecode = vm::Program::Compile(*program, moduleManager);
+      MemStats::BeginPhase("run");
+      vm::VM machine(*bytecode);
+      machine.m_JitThreshold = jitThreshold.value_or(machine.m_JitThreshold);
+      auto runRes = machine.Run();
+      if (runRes.is_err())
+      {
+        std::cerr << "runtime error: " << runRes.unwrap_err().Message << std::endl;
+        return 1;
+      }
+      return runRes.unwrap();
+    }
+    std::string code;
+    if ("ir" == emit)
+    {
+      code = program->Dump();
+    }
+    else
+    {
+      MemStats::BeginPhase("codegen");
+      if ("obj" == emit)
+      {
+        auto object = X64Generator(*program).Generate();
+        code.assign(object.begin(), object.end());
+      }
+      else
+      {
+        code = CGenerator(*program, moduleManager).Generate();
+      }
+    }
+    // a hit prints nothing else, warnings included
+    if (cacheCode && diagnostics.empty())
+    {
+      cache->StoreCode(cache->ProgramKey(inputFile, codeOptions, moduleManager.m_Resolver), code);
+    }
+    return Deliver(emit, build, code, outputFile, inputFile);
+  }
   return 0;
 }
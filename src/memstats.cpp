@@ -0,0 +1,423 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+#include "ast.h"
+#include "memstats.h"
+
+static std::atomic<bool> g_Enabled(false);
+// live bytes reach the globals in batches, the peaks are off by this much per thread
+static constexpr int64_t PUBLISH_BYTES = 64 * 1024;
+static std::atomic<int64_t> g_Live(0);
+static std::atomic<int64_t> g_Peak(0);
+static thread_local MemCounters t_Counters;
+static thread_local int64_t t_Unpublished = 0;
+static thread_local MemScope *t_Scope = nullptr;
+
+static void Publish()
+{
+  auto live = g_Live.fetch_add(t_Unpublished, std::memory_order_relaxed) + t_Unpublished;
+  t_Unpublished = 0;
+  auto peak = g_Peak.load(std::memory_order_relaxed);
+  while (live > peak && !g_Peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+  {
+  }
+}
+
+static void Track(int64_t delta)
+{
+  ++t_Counters.m_Allocs;
+  t_Counters.m_Bytes += static_cast<uint64_t>(delta);
+  t_Counters.m_Live += delta;
+  t_Unpublished += delta;
+  if (t_Unpublished >= PUBLISH_BYTES)
+  {
+    Publish();
+  }
+}
+
+static void Untrack(int64_t size)
+{
+  t_Counters.m_Live -= size;
+  t_Unpublished -= size;
+  if (t_Unpublished <= -PUBLISH_BYTES)
+  {
+    g_Live.fetch_add(t_Unpublished, std::memory_order_relaxed);
+    t_Unpublished = 0;
+  }
+}
+
+// the array and sized forms of the standard library forward to these two
+void *operator new(std::size_t size)
+{
+  void *ptr = std::malloc(size ? size : 1);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  if (g_Enabled.load(std::memory_order_relaxed))
+  {
+    Track(static_cast<int64_t>(malloc_usable_size(ptr)));
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+  if (ptr && g_Enabled.load(std::memory_order_relaxed))
+  {
+    Untrack(static_cast<int64_t>(malloc_usable_size(ptr)));
+  }
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+  operator delete(ptr);
+}
+
+// not left to the library, a sanitizer replacing them would pair its own allocation with our delete
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+    return operator new(size);
+  }
+  catch (const std::bad_alloc &)
+  {
+    return nullptr;
+  }
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+  operator delete(ptr);
+}
+
+class NodeCounts
+{
+public:
+  // indexed by `StmtT` and `ExprT`, both start at one
+  std::array<uint64_t, 7> m_Stmts;
+  std::array<uint64_t, 8> m_Exprs;
+
+  NodeCounts() : m_Stmts(), m_Exprs() {};
+};
+
+class PhaseRecord
+{
+public:
+  std::string m_Name;
+  int64_t m_Peak;
+  int64_t m_Resident;
+
+  PhaseRecord(std::string name) : m_Name(name), m_Peak(0), m_Resident(0) {};
+};
+
+static std::mutex g_Mutex;
+static std::vector<PhaseRecord> g_Phases;
+static std::atomic<size_t> g_Phase(SIZE_MAX);
+// phase, step, path
+static std::map<std::tuple<size_t, std::string, std::string>, MemCounters> g_Charges;
+static std::map<std::string, NodeCounts> g_Nodes;
+static std::optional<MemScope> g_PhaseScope;
+
+MemScope::MemScope(const char *step, const std::string &path) : m_Step(step), m_Path(), m_Parent(nullptr), m_Start(), m_Active(MemStats::IsEnabled())
+{
+  if (!m_Active)
+  {
+    return;
+  }
+  m_Path = path;
+  m_Parent = t_Scope;
+  if (m_Parent)
+  {
+    m_Parent->Charge();
+  }
+  t_Scope = this;
+  m_Start = t_Counters;
+}
+
+MemScope::~MemScope()
+{
+  if (!m_Active)
+  {
+    return;
+  }
+  Charge();
+  t_Scope = m_Parent;
+  if (m_Parent)
+  {
+    m_Parent->m_Start = t_Counters;
+  }
+}
+
+void MemScope::Charge()
+{
+  auto now = t_Counters;
+  if (now.m_Allocs != m_Start.m_Allocs || now.m_Live != m_Start.m_Live)
+  {
+    std::lock_guard<std::mutex> lock(g_Mutex);
+    auto &charged = g_Charges[{g_Phase.load(), m_Step, m_Path}];
+    charged.m_Allocs += now.m_Allocs - m_Start.m_Allocs;
+    charged.m_Bytes += now.m_Bytes - m_Start.m_Bytes;
+    charged.m_Live += now.m_Live - m_Start.m_Live;
+  }
+  // the entry made above is nobody's
+  m_Start = t_Counters;
+}
+
+static int64_t ResidentBytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  int64_t size = 0;
+  int64_t resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static int64_t PeakResidentBytes()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.starts_with("VmHWM:"))
+    {
+      return std::strtoll(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+  }
+  return 0;
+}
+
+static std::string Size(int64_t bytes)
+{
+  auto value = static_cast<double>(bytes);
+  if (bytes < 0)
+  {
+    return std::format("-{}", Size(-bytes));
+  }
+  if (bytes < 1024)
+  {
+    return std::format("{} B", bytes);
+  }
+  if (bytes < 1024 * 1024)
+  {
+    return std::format("{:.1f} KiB", value / 1024);
+  }
+  return std::format("{:.1f} MiB", value / 1024 / 1024);
+}
+
+static void EndPhase()
+{
+  if (!g_PhaseScope.has_value())
+  {
+    return;
+  }
+  g_PhaseScope.reset();
+  // phases run from the main thread, whatever it holds back belongs to this one
+  Publish();
+  std::lock_guard<std::mutex> lock(g_Mutex);
+  auto &phase = g_Phases.at(g_Phase.load());
+  phase.m_Peak = g_Peak.load();
+  phase.m_Resident = ResidentBytes();
+}
+
+void MemStats::Enable()
+{
+  g_Enabled = true;
+  // the tables outlive the handler, they were constructed before it got registered
+  std::atexit([]()
+              { Report(std::cerr); });
+}
+
+bool MemStats::IsEnabled()
+{
+  return g_Enabled.load(std::memory_order_relaxed);
+}
+
+void MemStats::BeginPhase(const char *phase)
+{
+  if (!IsEnabled())
+  {
+    return;
+  }
+  EndPhase();
+  Publish();
+  {
+    std::lock_guard<std::mutex> lock(g_Mutex);
+    g_Phases.emplace_back(phase);
+    g_Phase = g_Phases.size() - 1;
+  }
+  g_Peak = g_Live.load();
+  g_PhaseScope.emplace(phase, "");
+}
+
+static void CountExpr(const Ptr<Expr> &expr, NodeCounts &counts);
+
+static void CountStmt(const Ptr<Stmt> &stmt, NodeCounts &counts)
+{
+  if (!stmt)
+  {
+    return;
+  }
+  if (StmtT::Expr == stmt->GetType())
+  {
+    return CountExpr(CastPtr<Expr>(stmt), counts);
+  }
+  ++counts.m_Stmts.at(static_cast<size_t>(stmt->GetType()));
+  switch (stmt->GetType())
+  {
+  case StmtT::Block:
+    for (auto &inner : CastPtr<BlockStmt>(stmt)->GetStatements())
+    {
+      CountStmt(inner, counts);
+    }
+    break;
+  case StmtT::Fun:
+    CountStmt(CastPtr<FunStmt>(stmt)->GetBody(), counts);
+    break;
+  case StmtT::Ret:
+    CountExpr(CastPtr<RetStmt>(stmt)->GetValue(), counts);
+    break;
+  case StmtT::Let:
+    CountExpr(CastPtr<LetStmt>(stmt)->GetInit(), counts);
+    break;
+  case StmtT::Expr:
+  case StmtT::Import:
+    break;
+  }
+}
+
+static void CountExpr(const Ptr<Expr> &expr, NodeCounts &counts)
+{
+  if (!expr)
+  {
+    return;
+  }
+  ++counts.m_Exprs.at(static_cast<size_t>(expr->GetType()));
+  switch (expr->GetType())
+  {
+  case ExprT::Call:
+  {
+    auto call = CastPtr<CallExpr>(expr);
+    CountExpr(call->GetCallee(), counts);
+    for (auto &arg : call->GetArgs())
+    {
+      CountExpr(arg, counts);
+    }
+    break;
+  }
+  case ExprT::Assign:
+    CountExpr(CastPtr<AssignExpr>(expr)->GetDest(), counts);
+    CountExpr(CastPtr<AssignExpr>(expr)->GetValue(), counts);
+    break;
+  case ExprT::FieldAcc:
+    CountExpr(CastPtr<FieldAccExpr>(expr)->GetValue(), counts);
+    CountExpr(CastPtr<FieldAccExpr>(expr)->GetFieldName(), counts);
+    break;
+  case ExprT::Binary:
+    CountExpr(CastPtr<BinaryExpr>(expr)->GetLhs(), counts);
+    CountExpr(CastPtr<BinaryExpr>(expr)->GetRhs(), counts);
+    break;
+  case ExprT::Ident:
+  case ExprT::String:
+  case ExprT::Number:
+    break;
+  }
+}
+
+void MemStats::CountNodes(const std::string &path, const Ast &ast)
+{
+  NodeCounts counts;
+  for (auto &stmt : ast.m_Program)
+  {
+    CountStmt(stmt, counts);
+  }
+  std::lock_guard<std::mutex> lock(g_Mutex);
+  g_Nodes[path] = counts;
+}
+
+void MemStats::Report(std::ostream &out)
+{
+  static const std::array<const char *, 7> STMT_NAMES = {"", "Block", "Fun", "Ret", "Expr", "Let", "Import"};
+  static const std::array<const char *, 8> EXPR_NAMES = {"", "Call", "Ident", "String", "Number", "Assign", "FieldAcc", "Binary"};
+  if (!IsEnabled())
+  {
+    return;
+  }
+  EndPhase();
+  g_Enabled = false;
+  std::lock_guard<std::mutex> lock(g_Mutex);
+  auto phaseName = [](size_t phase) -> std::string
+  {
+    return phase < g_Phases.size() ? g_Phases.at(phase).m_Name : "-";
+  };
+
+  out << std::format("{:<24} {:>12} {:>12} {:>12} {:>12}", "phase", "allocations", "allocated", "peak live", "resident") << std::endl;
+  for (size_t i = 0; i < g_Phases.size(); ++i)
+  {
+    MemCounters total;
+    for (auto &[key, charged] : g_Charges)
+    {
+      if (std::get<0>(key) == i)
+      {
+        total.m_Allocs += charged.m_Allocs;
+        total.m_Bytes += charged.m_Bytes;
+      }
+    }
+    auto &phase = g_Phases.at(i);
+    out << std::format("{:<24} {:>12} {:>12} {:>12} {:>12}", phase.m_Name, total.m_Allocs, Size(static_cast<int64_t>(total.m_Bytes)), Size(phase.m_Peak), Size(phase.m_Resident)) << std::endl;
+  }
+  out << std::format("peak resident {}", Size(PeakResidentBytes())) << std::endl;
+
+  // retained is what the step left allocated, the AST for parsing, the tables for checking
+  out << std::endl
+      << std::format("{:<40} {:<20} {:>12} {:>12} {:>12}", "module", "phase/step", "allocations", "allocated", "retained") << std::endl;
+  std::map<std::tuple<std::string, size_t, std::string>, MemCounters> byModule;
+  for (auto &[key, charged] : g_Charges)
+  {
+    byModule[{std::get<2>(key), std::get<0>(key), std::get<1>(key)}] = charged;
+  }
+  for (auto &[key, charged] : byModule)
+  {
+    auto &[path, phase, step] = key;
+    auto name = phaseName(phase);
+    out << std::format("{:<40} {:<20} {:>12} {:>12} {:>12}", path.empty() ? "(none)" : path, step == name ? name : name + "/" + step, charged.m_Allocs, Size(static_cast<int64_t>(charged.m_Bytes)), Size(charged.m_Live)) << std::endl;
+  }
+
+  out << std::endl
+      << "AST nodes" << std::endl;
+  for (auto &[path, counts] : g_Nodes)
+  {
+    std::string line;
+    for (size_t i = 1; i < counts.m_Stmts.size(); ++i)
+    {
+      if (counts.m_Stmts.at(i) > 0)
+      {
+        line += std::format("{}{} {}", line.empty() ? "" : ", ", STMT_NAMES.at(i), counts.m_Stmts.at(i));
+      }
+    }
+    for (size_t i = 1; i < counts.m_Exprs.size(); ++i)
+    {
+      if (counts.m_Exprs.at(i) > 0)
+      {
+        line += std::format("{}{} {}", line.empty() ? "" : ", ", EXPR_NAMES.at(i), counts.m_Exprs.at(i));
+      }
+    }
+    out << std::format("{:<40} {}", path, line) << std::endl;
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "ast.h"
+#include "pointer.h"
+
+// what a thread allocated, monotonic except for the live bytes
+class MemCounters
+{
+public:
+  uint64_t m_Allocs;
+  uint64_t m_Bytes;
+  int64_t m_Live;
+
+  constexpr MemCounters() : m_Allocs(0), m_Bytes(0), m_Live(0) {};
+};
+
+/*
+  Charges the allocations of its thread to a step of the current phase on behalf of
+  one module, until it ends or a nested scope takes over. Loading an import from the
+  middle of checking its importer is charged to the import that way
+*/
+class MemScope
+{
+public:
+  MemScope(const char *step, const std::string &path);
+  ~MemScope();
+
+  MemScope(const MemScope &) = delete;
+  MemScope &operator=(const MemScope &) = delete;
+
+private:
+  const char *m_Step;
+  std::string m_Path;
+  MemScope *m_Parent;
+  MemCounters m_Start;
+  bool m_Active;
+
+  // adds what the thread allocated since the last charge
+  void Charge();
+};
+
+/*
+  Allocation accounting behind `--mem-stats`. Once enabled, the replaced global
+  `operator new` and `operator delete` count into thread local counters which scopes
+  charge to their step, the live bytes are published every few dozen KiB to track the
+  peak of each phase
+*/
+class MemStats
+{
+public:
+  static void Enable();
+  static bool IsEnabled();
+
+  // ends the current phase on the main thread, samples the resident set, begins `phase`
+  static void BeginPhase(const char *phase);
+  // AST nodes of `path` by kind, counted once it parsed
+  static void CountNodes(const std::string &path, const Ast &ast);
+  // ends the current phase and prints every table
+  static void Report(std::ostream &out);
+};
@@ -1,27 +1,384 @@
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "cache.h"
 #include "error.h"
+#include "interface.h"
+#include "memstats.h"
 #include "module.h"
 #include "pointer.h"
 #include "result.h"
 
-Result<Ptr<Module>, Error> ModuleManager::Load(std::string path)
+ModuleTable::~ModuleTable()
 {
-  if (m_PathToID.find(path) != m_PathToID.end())
+  for (auto &segment : m_Segments)
   {
-    return m_Modules.at(m_PathToID.at(path));
+    delete[] segment.load();
   }
-  std::ifstream file(path);
+}
+
+// segment k starts at FIRST_SEGMENT * (2^k - 1) and holds FIRST_SEGMENT * 2^k entries
+size_t ModuleTable::SegmentOf(ModuleID id, size_t &offset)
+{
+  auto segment = static_cast<size_t>(std::bit_width(id / FIRST_SEGMENT + 1) - 1);
+  offset = id - FIRST_SEGMENT * ((size_t(1) << segment) - 1);
+  return segment;
+}
+
+ModuleID ModuleTable::Reserve()
+{
+  ModuleID id = m_Size++;
+  size_t offset;
+  auto segment = SegmentOf(id, offset);
+  if (!m_Segments.at(segment).load())
+  {
+    std::lock_guard<std::mutex> lock(m_GrowMutex);
+    if (!m_Segments.at(segment).load())
+    {
+      m_Segments.at(segment).store(new Ptr<Module>[FIRST_SEGMENT << segment]);
+    }
+  }
+  return id;
+}
+
+void ModuleTable::Set(ModuleID id, Ptr<Module> module)
+{
+  size_t offset;
+  auto segment = SegmentOf(id, offset);
+  m_Segments.at(segment).load()[offset] = module;
+}
+
+Ptr<Module> ModuleTable::At(ModuleID id) const
+{
+  size_t offset;
+  auto segment = SegmentOf(id, offset);
+  auto entries = segment < SEGMENTS_COUNT && id < m_Size ? m_Segments.at(segment).load() : nullptr;
+  return entries ? entries[offset] : nullptr;
+}
+
+std::optional<std::string> ReadFile(const std::string &path)
+{
+  std::ifstream file(path, std::ios::binary);
   if (!file.is_open())
+  {
+    return std::nullopt;
+  }
+  std::ostringstream content;
+  content << file.rdbuf();
+  if (file.bad())
+  {
+    return std::nullopt;
+  }
+  return content.str();
+}
+
+bool WriteFile(const std::string &path, const std::string &data)
+{
+  std::string tmpPath = path + ".XXXXXX";
+  int fd = mkstemp(tmpPath.data());
+  if (fd < 0)
+  {
+    return false;
+  }
+  // mkstemp leaves the file readable by its owner alone
+  bool isOk = 0 == fchmod(fd, 0644);
+  for (size_t written = 0; isOk && written < data.size();)
+  {
+    auto count = write(fd, data.data() + written, data.size() - written);
+    isOk = count > 0 || (count < 0 && EINTR == errno);
+    written += count > 0 ? static_cast<size_t>(count) : 0;
+  }
+  isOk = 0 == close(fd) && isOk;
+  if (!isOk || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+Result<Ptr<Module>, Error> ModuleManager::Load(std::string path, bool preferInterface)
+{
+  auto canonical = m_Resolver.Canonical(path);
+  auto &shard = m_Shards.at(std::hash<std::string>()(canonical) % SHARDS_COUNT);
+  Ptr<LoadSlot> slot;
+  {
+    std::lock_guard<std::mutex> lock(shard.m_Mutex);
+    auto &found = shard.m_Slots[canonical];
+    if (!found)
+    {
+      found = std::make_shared<LoadSlot>();
+    }
+    slot = found;
+  }
+  // the shard stays free while the file is read, other loads of the path wait here
+  std::call_once(slot->m_Once, [&]()
+                 { slot->m_Result = Read(path, preferInterface); });
+  return slot->m_Result.value();
+}
+
+Result<Ptr<Module>, Error> ModuleManager::Read(const std::string &source, bool preferInterface)
+{
+  auto path = std::filesystem::path(source).lexically_normal().string();
+  MemScope memScope("load", path);
+  auto overlay = OverlayOf(path);
+  if (overlay)
+  {
+    ModuleID id = m_Table.Reserve();
+    auto module = MakePtr(Module(id, path, *overlay));
+    module->m_Stamp = SourceStamp(path, 0, 0);
+    m_Table.Set(id, module);
+    return module;
+  }
+  auto stampRes = m_Resolver.Stamp(path);
+  if (stampRes.is_err())
+  {
+    return stampRes.unwrap_err();
+  }
+  ModuleID id = m_Table.Reserve();
+  if (preferInterface && m_Resolver.Exists(ModuleInterface::PathFor(path)))
+  {
+    auto interfaceRes = ModuleInterface::Read(ModuleInterface::PathFor(path), path, id, m_Resolver);
+    if (interfaceRes.is_ok())
+    {
+      if (m_Cache)
+      {
+        interfaceRes.unwrap()->m_InterfaceHash = BuildCache::InterfaceHash(interfaceRes.unwrap());
+      }
+      m_Table.Set(id, interfaceRes.unwrap());
+      return interfaceRes.unwrap();
+    }
+  }
+  auto read = ReadFile(path);
+  if (!read)
   {
     std::error_code errorCode;
     (void)std::filesystem::status(path, errorCode);
     return Error(Errno::FS_ERROR, errorCode.message());
   }
-  std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-  ModuleID id = m_Modules.size();
-  auto module = MakePtr(Module(id, path, content));
-  m_Modules[id] = module;
+  auto content = std::move(read.value());
+  // lowering needs an AST, so it goes without hits
+  auto module = m_Cache && m_PreferInterfaces ? m_Cache->Lookup(path, content, id, *this) : nullptr;
+  if (!module)
+  {
+    module = MakePtr(Module(id, path, content));
+  }
+  module->m_Stamp = stampRes.unwrap();
+  m_Table.Set(id, module);
   return module;
 }
+
+const std::string *ModuleManager::OverlayOf(const std::string &path)
+{
+  if (m_Overlays.empty())
+  {
+    return nullptr;
+  }
+  auto found = m_Overlays.find(m_Resolver.Canonical(path));
+  return found != m_Overlays.end() ? &found->second : nullptr;
+}
+
+std::vector<Ptr<Module>> ModuleManager::Modules() const
+{
+  std::vector<Ptr<Module>> modules;
+  for (ModuleID id = 0; id < m_Table.Size(); ++id)
+  {
+    if (auto module = m_Table.At(id))
+    {
+      modules.push_back(module);
+    }
+  }
+  return modules;
+}
+
+void ModuleManager::CollectDepStamps(Ptr<Module> module)
+{
+  std::set<std::string> seen;
+  module->m_DepStamps.clear();
+  for (auto importID : module->m_Imports)
+  {
+    auto imported = Get(importID);
+    if (seen.insert(imported->m_Stamp.m_Path).second)
+    {
+      module->m_DepStamps.push_back(imported->m_Stamp);
+    }
+    for (auto &stamp : imported->m_DepStamps)
+    {
+      if (seen.insert(stamp.m_Path).second)
+      {
+        module->m_DepStamps.push_back(stamp);
+      }
+    }
+  }
+}
+
+std::vector<ModuleID> ModuleManager::Refresh(const std::unordered_set<ModuleID> &forced)
+{
+  m_Resolver.Forget();
+  auto modules = Modules();
+  std::unordered_set<ModuleID> stale(forced);
+  std::unordered_set<ModuleID> gone;
+  std::unordered_map<ModuleID, std::string> contents;
+  std::unordered_map<ModuleID, std::vector<ModuleID>> importers;
+  for (auto &module : modules)
+  {
+    for (auto importID : module->m_Imports)
+    {
+      importers[importID].push_back(module->m_ID);
+    }
+    if (auto overlay = OverlayOf(module->m_Path))
+    {
+      if (*overlay != module->m_Content || module->IsFromInterface())
+      {
+        contents[module->m_ID] = *overlay;
+      }
+      module->m_Stamp = SourceStamp(module->m_Stamp.m_Path, 0, 0);
+      continue;
+    }
+    auto stampRes = m_Resolver.Stamp(module->m_Stamp.m_Path);
+    if (stampRes.is_err())
+    {
+      gone.insert(module->m_ID);
+      continue;
+    }
+    auto stamp = stampRes.unwrap();
+    bool touched = stamp.m_Size != module->m_Stamp.m_Size || stamp.m_MTime != module->m_Stamp.m_MTime;
+    // interfaces record no imports, only the stamps of what they were checked against
+    bool depsChanged = module->IsFromInterface() && std::any_of(module->m_DepStamps.begin(), module->m_DepStamps.end(), [&](const SourceStamp &dep)
+                                                                { return !m_Resolver.IsFresh(dep); });
+    if (!touched && !depsChanged)
+    {
+      continue;
+    }
+    auto read = ReadFile(module->m_Stamp.m_Path);
+    if (!read)
+    {
+      gone.insert(module->m_ID);
+      continue;
+    }
+    auto content = std::move(read.value());
+    module->m_Stamp = stamp;
+    // touched but not edited, eg. a checkout or a buffer saved, keeps everything
+    if (content != module->m_Content || module->IsFromInterface())
+    {
+      contents[module->m_ID] = std::move(content);
+    }
+  }
+  // the canonical path of a file that is gone may not be the one it was loaded under
+  for (auto &shard : m_Shards)
+  {
+    std::erase_if(shard.m_Slots, [&](const auto &pair)
+                  {
+                    auto &result = pair.second->m_Result;
+                    return result.has_value() && (result.value().is_err() || gone.contains(result.value().unwrap()->m_ID)); });
+  }
+  std::vector<ModuleID> worklist;
+  for (auto &module : modules)
+  {
+    if (forced.contains(module->m_ID) || gone.contains(module->m_ID) || contents.contains(module->m_ID))
+    {
+      stale.insert(module->m_ID);
+      worklist.push_back(module->m_ID);
+    }
+  }
+  while (!worklist.empty())
+  {
+    auto id = worklist.back();
+    worklist.pop_back();
+    for (auto importer : importers[id])
+    {
+      if (stale.insert(importer).second)
+      {
+        worklist.push_back(importer);
+      }
+    }
+  }
+  for (auto id : stale)
+  {
+    auto module = Get(id);
+    if (!module)
+    {
+      continue;
+    }
+    if (gone.contains(id))
+    {
+      m_Table.Set(id, nullptr);
+      continue;
+    }
+    if (auto content = contents.find(id); content != contents.end())
+    {
+      module->m_Content = std::move(content->second);
+      module->m_AST = nullptr;
+    }
+    module->m_State = module->m_AST ? ModuleState::Parsed : ModuleState::Loaded;
+    module->m_Exports = nullptr;
+    module->m_Sema = nullptr;
+    module->m_Imports.clear();
+    module->m_DepStamps.clear();
+    module->m_Checker = nullptr;
+  }
+  return std::vector<ModuleID>(stale.begin(), stale.end());
+}
+
+bool ModuleManager::Claim(Ptr<Module> module, ModuleState from, bool &cycle)
+{
+  auto self = std::this_thread::get_id();
+  std::unique_lock<std::mutex> lock(m_StateMutex);
+  while (module->m_Busy)
+  {
+    // follow who waits for whom starting at the module's owner
+    auto owner = module->m_Owner;
+    for (;;)
+    {
+      if (owner == self)
+      {
+        cycle = true;
+        return false;
+      }
+      auto waiting = m_WaitingOn.find(owner);
+      if (waiting == m_WaitingOn.end())
+      {
+        break;
+      }
+      // reserved by a failed load or dropped by `Refresh`, nobody owns it
+      auto awaited = Get(waiting->second);
+      if (!awaited)
+      {
+        break;
+      }
+      owner = awaited->m_Owner;
+    }
+    m_WaitingOn[self] = module->m_ID;
+    m_StateChanged.wait(lock);
+    m_WaitingOn.erase(self);
+  }
+  if (from != module->m_State)
+  {
+    return false;
+  }
+  module->m_Busy = true;
+  module->m_Owner = self;
+  return true;
+}
+
+void ModuleManager::Finish(Ptr<Module> module, ModuleState to)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_StateMutex);
+    module->m_State = to;
+    module->m_Busy = false;
+    module->m_Owner = std::thread::id();
+  }
+  m_StateChanged.notify_all();
+}
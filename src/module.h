@@ -1,44 +1,173 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
-#include <map>
+#include <cstdint>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "ast.h"
 #include "error.h"
+#include "resolver.h"
 #include "result.h"
 
 using ModuleID = size_t;
 
-enum class ModuleStatus
+/*
+  Steps a module goes through. Each step out of a state runs once, on the thread
+  that claims it, see `ModuleManager::Claim`
+*/
+enum class ModuleState : uint8_t
 {
-  IDLE = 1,
-  LOADED,
-  INVALID,
+  Loaded, // content read, nothing else done
+  Parsed,
+  Deferred, // exports are known, function bodies are not checked yet
+  Checked,  // also the state of modules read from an interface file
+  Invalid,  // failed to parse
 };
 
 class Module
 {
 public:
   ModuleID m_ID;
-  ModuleStatus m_Status;
+  ModuleState m_State;
+  // a thread is running the step out of `m_State`
+  bool m_Busy;
+  std::thread::id m_Owner;
   std::string m_Path;
   std::string m_Content;
   Ptr<Ast> m_AST;
   Ptr<class ModuleContext> m_Exports;
+  Ptr<class SemaInfo> m_Sema;
   std::vector<ModuleID> m_Imports;
+  SourceStamp m_Stamp;
+  // stamps of every module this one depends on, directly or transitively
+  std::vector<SourceStamp> m_DepStamps;
+  // keeps the scopes of a `Deferred` module alive until its bodies are checked
+  Ptr<class Checker> m_Checker;
+  // digest of the exports once they are known, only kept with a build cache
+  std::string m_InterfaceHash;
 
-  Module(ModuleID id, std::string path, std::string content) : m_ID(id), m_Status(ModuleStatus::IDLE), m_Path(path), m_Content(content), m_AST(nullptr), m_Exports(nullptr), m_Imports() {};
+  Module(ModuleID id, std::string path, std::string content) : m_ID(id), m_State(ModuleState::Loaded), m_Busy(false), m_Owner(), m_Path(path), m_Content(content), m_AST(nullptr), m_Exports(nullptr), m_Sema(nullptr), m_Imports(), m_Stamp(), m_DepStamps(), m_Checker(nullptr), m_InterfaceHash() {};
+
+  bool IsFromInterface() const { return ModuleState::Checked == m_State && !m_AST; }
+};
+
+/*
+  Dense ID to module table. It grows by segments twice the size of the previous
+  one and never moves an entry, so lookups take no lock while modules get added
+*/
+class ModuleTable
+{
+public:
+  ModuleTable() : m_Segments(), m_Size(0), m_GrowMutex() {};
+  ~ModuleTable();
+  ModuleTable(const ModuleTable &) = delete;
+  ModuleTable &operator=(const ModuleTable &) = delete;
+
+  ModuleID Reserve();
+  // `id` comes from `Reserve`, the module is visible to whoever learns the ID afterwards
+  void Set(ModuleID id, Ptr<Module> module);
+  // null for IDs reserved by failed loads
+  Ptr<Module> At(ModuleID id) const;
+  size_t Size() const { return m_Size; }
+
+private:
+  static constexpr size_t FIRST_SEGMENT = 64;
+  static constexpr size_t SEGMENTS_COUNT = 32;
+
+  std::array<std::atomic<Ptr<Module> *>, SEGMENTS_COUNT> m_Segments;
+  std::atomic<size_t> m_Size;
+  std::mutex m_GrowMutex;
+
+  static size_t SegmentOf(ModuleID id, size_t &offset);
 };
 
+// whole content of a file, none when it cannot be opened or read
+std::optional<std::string> ReadFile(const std::string &path);
+// Publishes `data` at `path` at once: it is written to a file of a unique name in
+// the same directory, then renamed over, so concurrent writers and readers of the
+// path, on this machine or sharing the directory from others, never see a partial file
+bool WriteFile(const std::string &path, const std::string &data);
+
 class ModuleManager
 {
 public:
-  std::map<ModuleID, Ptr<Module>> m_Modules;
-  std::map<std::string, ModuleID> m_PathToID;
+  Resolver m_Resolver;
+  // code generation needs every module from source, interfaces only carry exports
+  bool m_PreferInterfaces;
+  // Unsaved editor buffers by canonical path, read in place of the file. Modules
+  // read from one get a stamp that is never fresh, so interfaces are not written
+  // for them and those written for their importers go stale. Only change while no
+  // thread loads
+  std::unordered_map<std::string, std::string> m_Overlays;
+  // Consulted for modules read from disk while interfaces are preferred, a hit is
+  // created checked with its content and without AST. Checkers store what they
+  // finish without errors
+  Ptr<class BuildCache> m_Cache;
+
+  ModuleManager() : m_Resolver(), m_PreferInterfaces(true), m_Overlays(), m_Cache(nullptr), m_Table(), m_Shards(), m_StateMutex(), m_StateChanged(), m_WaitingOn() {};
+
+  // When `preferInterface` is set and an up to date `.zri` of the source exists,
+  // the module is created from it already checked and without content.
+  // Safe to call from any thread, concurrent loads of one path share a single read
+  Result<Ptr<Module>, Error> Load(std::string, bool preferInterface = false);
+  Ptr<Module> Get(ModuleID id) const { return m_Table.At(id); }
+  // every module loaded so far, by ID; only call while no thread is loading
+  std::vector<Ptr<Module>> Modules() const;
+  void CollectDepStamps(Ptr<Module>);
+
+  // True when the caller gets to run the step out of `from`, it then calls
+  // `Finish`. Otherwise waits for the thread running a step on the module and
+  // yields false; `cycle` is set instead of waiting when that thread is, maybe
+  // through others, waiting for the caller, ie. the modules import each other
+  bool Claim(Ptr<Module> module, ModuleState from, bool &cycle);
+  void Finish(Ptr<Module> module, ModuleState to);
+
+  // For processes outliving a single check: forgets the resolver caches and failed
+  // loads, then sends modules whose source or overlay changed, those in `forced` and all their
+  // importers back to be checked again. Importers keep their AST, modules whose file
+  // is gone leave the table. Yields the IDs of every module sent back or dropped.
+  // Only call while no thread uses the table
+  std::vector<ModuleID> Refresh(const std::unordered_set<ModuleID> &forced);
+
+private:
+  static constexpr size_t SHARDS_COUNT = 16;
+
+  // one per canonical path, the first thread to get there loads the module
+  class LoadSlot
+  {
+  public:
+    std::once_flag m_Once;
+    std::optional<Result<Ptr<Module>, Error>> m_Result;
+
+    LoadSlot() : m_Once(), m_Result() {};
+  };
+
+  class PathShard
+  {
+  public:
+    std::mutex m_Mutex;
+    // keyed by canonical path, so different spellings of a path share a module
+    std::unordered_map<std::string, Ptr<LoadSlot>> m_Slots;
+
+    PathShard() : m_Mutex(), m_Slots() {};
+  };
 
-  ModuleManager() : m_Modules() {};
+  ModuleTable m_Table;
+  std::array<PathShard, SHARDS_COUNT> m_Shards;
+  // guards the state of every module, steps are few and coarse so one lock does
+  std::mutex m_StateMutex;
+  std::condition_variable m_StateChanged;
+  std::unordered_map<std::thread::id, ModuleID> m_WaitingOn;
 
-  Result<Ptr<Module>, Error> Load(std::string);
+  Result<Ptr<Module>, Error> Read(const std::string &path, bool preferInterface);
+  const std::string *OverlayOf(const std::string &path);
 };
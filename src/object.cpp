@@ -0,0 +1,192 @@
+#include <cstdint>
+#include <cstring>
+#include <elf.h>
+#include <string>
+#include <vector>
+
+#include "object.h"
+
+size_t ElfWriter::AddSymbol(std::string name, Section section, uint64_t value, uint64_t size, bool isGlobal, bool isFunction)
+{
+  m_Symbols.push_back(Symbol(name, section, value, size, isGlobal, isFunction));
+  return m_Symbols.size() - 1;
+}
+
+size_t ElfWriter::SectionSymbol(Section section)
+{
+  for (size_t i = 0; i < m_Symbols.size(); ++i)
+  {
+    if (m_Symbols.at(i).m_Name.empty() && m_Symbols.at(i).m_Section == section)
+    {
+      return i;
+    }
+  }
+  return AddSymbol("", section, 0, 0, false, false);
+}
+
+void ElfWriter::AddReloc(uint64_t offset, size_t symbol, uint32_t type, int64_t addend)
+{
+  m_Relocs.push_back(Reloc(offset, symbol, type, addend));
+}
+
+template <typename T>
+static void Append(std::vector<uint8_t> &out, const T &value)
+{
+  auto bytes = reinterpret_cast<const uint8_t *>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void Align(std::vector<uint8_t> &out, size_t alignment)
+{
+  while (out.size() % alignment)
+  {
+    out.push_back(0);
+  }
+}
+
+static uint32_t AddString(std::vector<uint8_t> &table, const std::string &str)
+{
+  auto at = static_cast<uint32_t>(table.size());
+  table.insert(table.end(), str.begin(), str.end());
+  table.push_back(0);
+  return at;
+}
+
+std::vector<uint8_t> ElfWriter::Write() const
+{
+  enum : uint16_t
+  {
+    NUL,
+    TEXT,
+    RODATA,
+    BSS,
+    RELA_TEXT,
+    SYMTAB,
+    STRTAB,
+    NOTE_STACK,
+    SHSTRTAB,
+    COUNT,
+  };
+  auto sectionIndex = [](Section section) -> uint16_t
+  {
+    switch (section)
+    {
+    case Section::Text:
+      return TEXT;
+    case Section::Rodata:
+      return RODATA;
+    case Section::Bss:
+      return BSS;
+    default:
+      return SHN_UNDEF;
+    }
+  };
+
+  // locals must precede globals in the symbol table
+  std::vector<size_t> order;
+  std::vector<uint32_t> indexOf(m_Symbols.size(), 0);
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    for (size_t i = 0; i < m_Symbols.size(); ++i)
+    {
+      if (m_Symbols.at(i).m_IsGlobal == (1 == pass))
+      {
+        indexOf[i] = static_cast<uint32_t>(order.size() + 1);
+        order.push_back(i);
+      }
+    }
+  }
+  uint32_t firstGlobal = 1;
+  std::vector<uint8_t> strtab = {0};
+  std::vector<uint8_t> symtab(sizeof(Elf64_Sym), 0);
+  for (auto i : order)
+  {
+    auto &symbol = m_Symbols.at(i);
+    Elf64_Sym sym;
+    std::memset(&sym, 0, sizeof(sym));
+    sym.st_name = symbol.m_Name.empty() ? 0 : AddString(strtab, symbol.m_Name);
+    auto type = symbol.m_Name.empty() ? STT_SECTION : (symbol.m_IsFunction ? STT_FUNC : (Section::Undef == symbol.m_Section ? STT_NOTYPE : STT_OBJECT));
+    sym.st_info = static_cast<unsigned char>(ELF64_ST_INFO(symbol.m_IsGlobal ? STB_GLOBAL : STB_LOCAL, type));
+    // undefined functions get no type, the linker learns it from the definition
+    if (Section::Undef == symbol.m_Section)
+    {
+      sym.st_info = static_cast<unsigned char>(ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE));
+    }
+    sym.st_shndx = sectionIndex(symbol.m_Section);
+    sym.st_value = symbol.m_Value;
+    sym.st_size = symbol.m_Size;
+    Append(symtab, sym);
+    firstGlobal += symbol.m_IsGlobal ? 0 : 1;
+  }
+  std::vector<uint8_t> rela;
+  for (auto &reloc : m_Relocs)
+  {
+    Elf64_Rela entry;
+    entry.r_offset = reloc.m_Offset;
+    entry.r_info = ELF64_R_INFO(static_cast<uint64_t>(indexOf.at(reloc.m_Symbol)), static_cast<uint64_t>(reloc.m_Type));
+    entry.r_addend = reloc.m_Addend;
+    Append(rela, entry);
+  }
+  std::vector<uint8_t> shstrtab = {0};
+  std::vector<uint32_t> names(COUNT, 0);
+  const char *sectionNames[COUNT] = {"", ".text", ".rodata", ".bss", ".rela.text", ".symtab", ".strtab", ".note.GNU-stack", ".shstrtab"};
+  for (uint16_t i = 1; i < COUNT; ++i)
+  {
+    names[i] = AddString(shstrtab, sectionNames[i]);
+  }
+
+  std::vector<Elf64_Shdr> headers(COUNT);
+  std::memset(headers.data(), 0, sizeof(Elf64_Shdr) * COUNT);
+  std::vector<uint8_t> out(sizeof(Elf64_Ehdr), 0);
+  auto place = [&](uint16_t index, const std::vector<uint8_t> &data, uint32_t type, uint64_t flags, uint64_t alignment)
+  {
+    Align(out, alignment);
+    auto &header = headers[index];
+    header.sh_name = names[index];
+    header.sh_type = type;
+    header.sh_flags = flags;
+    header.sh_offset = out.size();
+    header.sh_size = data.size();
+    header.sh_addralign = alignment;
+    out.insert(out.end(), data.begin(), data.end());
+  };
+  place(TEXT, m_Text, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 16);
+  place(RODATA, m_Rodata, SHT_PROGBITS, SHF_ALLOC, 16);
+  place(BSS, {}, SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 16);
+  headers[BSS].sh_size = m_BssSize;
+  place(RELA_TEXT, rela, SHT_RELA, SHF_INFO_LINK, 8);
+  headers[RELA_TEXT].sh_link = SYMTAB;
+  headers[RELA_TEXT].sh_info = TEXT;
+  headers[RELA_TEXT].sh_entsize = sizeof(Elf64_Rela);
+  place(SYMTAB, symtab, SHT_SYMTAB, 0, 8);
+  headers[SYMTAB].sh_link = STRTAB;
+  headers[SYMTAB].sh_info = firstGlobal;
+  headers[SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+  place(STRTAB, strtab, SHT_STRTAB, 0, 1);
+  // no executable stack
+  place(NOTE_STACK, {}, SHT_PROGBITS, 0, 1);
+  place(SHSTRTAB, shstrtab, SHT_STRTAB, 0, 1);
+
+  Align(out, 8);
+  Elf64_Ehdr ehdr;
+  std::memset(&ehdr, 0, sizeof(ehdr));
+  std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  ehdr.e_type = ET_REL;
+  ehdr.e_machine = EM_X86_64;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_shoff = out.size();
+  ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+  ehdr.e_shentsize = sizeof(Elf64_Shdr);
+  ehdr.e_shnum = COUNT;
+  ehdr.e_shstrndx = SHSTRTAB;
+  std::memcpy(out.data(), &ehdr, sizeof(ehdr));
+  for (auto &header : headers)
+  {
+    Append(out, header);
+  }
+  return out;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+  Writes relocatable x86-64 ELF objects: code in .text, string literals in
+  .rodata and zero initialized globals in .bss. Symbols are referenced by the
+  handle AddSymbol returns, locals are sorted first when writing
+*/
+class ElfWriter
+{
+public:
+  enum class Section : uint16_t
+  {
+    Undef,
+    Text,
+    Rodata,
+    Bss,
+  };
+
+  class Symbol
+  {
+  public:
+    std::string m_Name;
+    Section m_Section;
+    uint64_t m_Value;
+    uint64_t m_Size;
+    bool m_IsGlobal;
+    bool m_IsFunction;
+
+    Symbol(std::string name, Section section, uint64_t value, uint64_t size, bool isGlobal, bool isFunction) : m_Name(name), m_Section(section), m_Value(value), m_Size(size), m_IsGlobal(isGlobal), m_IsFunction(isFunction) {};
+  };
+
+  class Reloc
+  {
+  public:
+    uint64_t m_Offset; // in .text
+    size_t m_Symbol;
+    uint32_t m_Type; // R_X86_64_*
+    int64_t m_Addend;
+
+    Reloc(uint64_t offset, size_t symbol, uint32_t type, int64_t addend) : m_Offset(offset), m_Symbol(symbol), m_Type(type), m_Addend(addend) {};
+  };
+
+  std::vector<uint8_t> m_Text;
+  std::vector<uint8_t> m_Rodata;
+  uint64_t m_BssSize;
+  std::vector<Symbol> m_Symbols;
+  std::vector<Reloc> m_Relocs;
+
+  ElfWriter() : m_Text(), m_Rodata(), m_BssSize(0), m_Symbols(), m_Relocs() {};
+
+  size_t AddSymbol(std::string name, Section section, uint64_t value, uint64_t size, bool isGlobal, bool isFunction);
+  // symbol standing for the start of `section`, for references by offset
+  size_t SectionSymbol(Section section);
+  void AddReloc(uint64_t offset, size_t symbol, uint32_t type, int64_t addend);
+  std::vector<uint8_t> Write() const;
+};
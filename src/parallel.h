@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// one worker per hardware thread
+inline size_t DefaultJobs()
+{
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// calls `work(i)` for every i below `count` on up to `jobs` threads, the caller's included
+template <typename Work>
+void ParallelFor(size_t count, size_t jobs, Work work)
+{
+  std::atomic<size_t> next = 0;
+  auto worker = [&]()
+  {
+    for (size_t i = next++; i < count; i = next++)
+    {
+      work(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(count, jobs); ++i)
+  {
+    threads.push_back(std::thread(worker));
+  }
+  worker();
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+}
@@ -2,11 +2,14 @@
 #include <cstddef>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "ast.h"
 #include "diagnostic.h"
+#include "memstats.h"
 #include "parser.h"
 #include "pointer.h"
 #include "result.h"
@@ -15,23 +18,37 @@
 
 std::optional<Diagnostic> Parser::Parse()
 {
-  Next().unwrap();
-  Next().unwrap();
-  auto ast = MakePtr(Ast());
-  while (!IsEof())
+  MemScope memScope("parse", m_Module->m_Path);
+  try
   {
-    auto stmtRes = ParseStmt();
-    if (stmtRes.is_ok())
+    Next().unwrap();
+    Next().unwrap();
+    auto ast = MakePtr(Ast());
+    while (!IsEof())
     {
-      ast->m_Program.push_back(stmtRes.unwrap());
+      auto stmtRes = ParseStmt();
+      if (stmtRes.is_ok())
+      {
+        ast->m_Program.push_back(stmtRes.unwrap());
+      }
+      else
+      {
+        return stmtRes.unwrap_err();
+      }
     }
-    else
+    ast->m_NodesCount = m_NodesCount;
+    m_Module->m_AST = ast;
+    if (MemStats::IsEnabled())
     {
-      return stmtRes.unwrap_err();
+      MemStats::CountNodes(m_Module->m_Path, *ast);
     }
+    return std::nullopt;
+  }
+  catch (std::runtime_error &)
+  {
+    // an unexpected token or character reached an `unwrap`, editors send such sources all the time
+    return m_LexError.value_or(Diagnostic(DiagCode::UnexpectedToken, m_CurrToken.m_Position, m_ModuleID, {SourceSpan(m_ModuleID, m_CurrToken.m_Position)}));
   }
-  m_Module->m_AST = ast;
-  return std::nullopt;
 }
 
 Result<bool, Diagnostic> Parser::ParsePubAccMod()
@@ -41,7 +58,7 @@ Result<bool, Diagnostic> Parser::ParsePubAccMod()
     m_HasPubModifier = true;
     if (!AcceptsPubModifier(m_NextToken.m_Type))
     {
-      return Diagnostic(Errno::SYNTAX_ERROR, m_CurrToken.m_Position, m_ModuleID, DiagnosticSeverity::ERROR, "unexpected 'pub' modifier");
+      return Diagnostic(DiagCode::UnexpectedPub, m_CurrToken.m_Position, m_ModuleID);
     }
     Next().unwrap();
   }
@@ -110,13 +127,11 @@ Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtImport()
     path.push_back(identRes.unwrap());
     if (TokenType::Semi != m_CurrToken.m_Type)
     {
-      assert(TokenType::Assoc == m_CurrToken.m_Type);
-      Next().unwrap();
-      assert(TokenType::Ident == m_CurrToken.m_Type);
+      Expect(TokenType::Assoc).unwrap();
     }
   } while (!IsEof() && TokenType::Semi != m_CurrToken.m_Type);
   Expect(TokenType::Semi).unwrap();
-  return Result<Ptr<Stmt>, Diagnostic>(MakePtr<ImportStmt>(ImportStmt(pos, aliasRes.unwrap(), atToken, std::move(path))));
+  return Result<Ptr<Stmt>, Diagnostic>(MakeNode(ImportStmt(pos, aliasRes.unwrap(), atToken, std::move(path))));
 }
 
 Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtExpr()
@@ -135,9 +150,9 @@ Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtExpr()
   {
     if (TokenType::Rbrace != m_CurrToken.m_Type)
     {
-      return Diagnostic(Errno::SYNTAX_ERROR, expression->GetPos(), m_ModuleID, DiagnosticSeverity::ERROR, "implicity return expression must be the last in a block, insert ';' at end");
+      return Diagnostic(DiagCode::MisplacedImplicitRet, expression->GetPos(), m_ModuleID);
     }
-    return CastPtr<Stmt>(MakePtr<RetStmt>(RetStmt(expression)));
+    return CastPtr<Stmt>(MakeNode(RetStmt(expression)));
   }
   return CastPtr<Stmt>(expression);
 }
@@ -153,24 +168,28 @@ Result<FunParams, Diagnostic> Parser::ParseFunParams()
     if (TokenType::Ellipsis == m_CurrToken.m_Type)
     {
       varArgsNotation = Ellipsis(m_CurrToken);
+      // var args must be the last
       Next().unwrap();
-      assert(TokenType::Rparen == m_CurrToken.m_Type && "var args must be the last");
       break;
     }
-    assert(TokenType::Ident == m_CurrToken.m_Type);
     auto paramIdentifier = ParseExprIdent().unwrap();
-    Expect(TokenType::Colon).unwrap();
-    auto paramType = ParseTypeAnn().unwrap();
-    params.push_back(FunParam(paramIdentifier, paramType));
+    auto colonRes = Expect(TokenType::Colon);
+    if (colonRes.is_err())
+    {
+      return colonRes.unwrap_err();
+    }
+    auto paramTypeRes = ParseTypeAnn();
+    if (paramTypeRes.is_err())
+    {
+      return paramTypeRes.unwrap_err();
+    }
+    params.push_back(FunParam(paramIdentifier, paramTypeRes.unwrap()));
     if (TokenType::Rparen != m_CurrToken.m_Type)
     {
-      assert(TokenType::Comma == m_CurrToken.m_Type);
-      Next().unwrap();
-      assert(m_CurrToken.m_Type == TokenType::Ident);
+      Expect(TokenType::Comma).unwrap();
     }
   }
-  assert(TokenType::Rparen == m_CurrToken.m_Type);
-  position.m_End = Next().unwrap().m_End;
+  position.m_End = Expect(TokenType::Rparen).unwrap().m_End;
   return FunParams(position, std::move(params), varArgsNotation);
 }
 
@@ -180,25 +199,34 @@ Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtFunction()
   auto pos = Expect(TokenType::Fun).unwrap();
   auto ident = ParseExprIdent().unwrap();
   auto paramsRes = ParseFunParams();
+  if (paramsRes.is_err())
+  {
+    return paramsRes.unwrap_err();
+  }
   Ptr<AstType> returnType = nullptr;
   if (TokenType::Colon == m_CurrToken.m_Type)
   {
     Next().unwrap();
-    returnType = ParseTypeAnn().unwrap();
+    auto returnTypeRes = ParseTypeAnn();
+    if (returnTypeRes.is_err())
+    {
+      return returnTypeRes.unwrap_err();
+    }
+    returnType = returnTypeRes.unwrap();
   }
   auto params = paramsRes.unwrap();
   auto signature = FunSign(isPub, pos, ident, params, returnType);
   if (TokenType::Semi == m_CurrToken.m_Type)
   {
     Next().unwrap();
-    return CastPtr<Stmt>(MakePtr<FunStmt>(FunStmt(signature, nullptr)));
+    return CastPtr<Stmt>(MakeNode(FunStmt(signature, nullptr)));
   }
   auto bodyRes = ParseStmtBlock();
   if (bodyRes.is_err())
   {
     return bodyRes.unwrap_err();
   }
-  return CastPtr<Stmt>(MakePtr(FunStmt(signature, CastPtr<BlockStmt>(bodyRes.unwrap()))));
+  return CastPtr<Stmt>(MakeNode(FunStmt(signature, CastPtr<BlockStmt>(bodyRes.unwrap()))));
 }
 
 Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtBlock()
@@ -215,7 +243,7 @@ Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtBlock()
     statements.push_back(statementRes.unwrap());
   }
   position.m_End = Expect(TokenType::Rbrace).unwrap().m_End;
-  return CastPtr<Stmt>(MakePtr(BlockStmt(position, std::move(statements))));
+  return CastPtr<Stmt>(MakeNode(BlockStmt(position, std::move(statements))));
 }
 
 Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtLet()
@@ -248,7 +276,7 @@ Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtLet()
     init = initializerRes.unwrap();
   }
   Expect(TokenType::Semi).unwrap();
-  return CastPtr<Stmt>(MakePtr(LetStmt(isPub, pos, identRes.unwrap(), varType, init)));
+  return CastPtr<Stmt>(MakeNode(LetStmt(isPub, pos, identRes.unwrap(), varType, init)));
 }
 
 Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtReturn()
@@ -266,7 +294,7 @@ Result<Ptr<Stmt>, Diagnostic> Parser::ParseStmtReturn()
     value = valueRes.unwrap();
   }
   Expect(TokenType::Semi).unwrap();
-  return CastPtr<Stmt>(MakePtr(RetStmt(pos, value)));
+  return CastPtr<Stmt>(MakeNode(RetStmt(pos, value)));
 }
 
 Prec token2precedence(TokenType tokenType)
@@ -279,6 +307,12 @@ Prec token2precedence(TokenType tokenType)
     return Prec::Assign;
   case TokenType::Dot:
     return Prec::FieldAcc;
+  case TokenType::Plus:
+  case TokenType::Minus:
+    return Prec::Sum;
+  case TokenType::Asterisk:
+  case TokenType::Slash:
+    return Prec::Product;
   default:
     return Prec::Low;
   }
@@ -305,7 +339,7 @@ Result<Ptr<Expr>, Diagnostic> Parser::ParseExpr(Prec prec)
       auto callRes = ParseExprCall(lhsRes.unwrap());
       if (callRes.is_err())
       {
-        return lhsRes.unwrap_err();
+        return callRes.unwrap_err();
       }
       lhsRes.set_val(callRes.unwrap());
     }
@@ -315,7 +349,7 @@ Result<Ptr<Expr>, Diagnostic> Parser::ParseExpr(Prec prec)
       auto assignRes = ParseExprAssign(lhsRes.unwrap());
       if (assignRes.is_err())
       {
-        lhsRes.unwrap_err();
+        return assignRes.unwrap_err();
       }
       lhsRes.set_val(assignRes.unwrap());
     }
@@ -325,11 +359,24 @@ Result<Ptr<Expr>, Diagnostic> Parser::ParseExpr(Prec prec)
       auto assignRes = ParseExprFieldAcc(lhsRes.unwrap());
       if (assignRes.is_err())
       {
-        return lhsRes.unwrap_err();
+        return assignRes.unwrap_err();
       }
       lhsRes.set_val(assignRes.unwrap());
     }
     break;
+    case TokenType::Plus:
+    case TokenType::Minus:
+    case TokenType::Asterisk:
+    case TokenType::Slash:
+    {
+      auto binaryRes = ParseExprBinary(lhsRes.unwrap());
+      if (binaryRes.is_err())
+      {
+        return binaryRes.unwrap_err();
+      }
+      lhsRes.set_val(binaryRes.unwrap());
+    }
+    break;
     default:
       goto defer;
     }
@@ -343,20 +390,35 @@ Result<Ptr<Expr>, Diagnostic> Parser::ParseExprPrim()
   switch (m_CurrToken.m_Type)
   {
   case TokenType::StrLit:
-    return CastPtr<Expr>(MakePtr(StringExpr(m_CurrToken)));
+    return CastPtr<Expr>(MakeNode(StringExpr(m_CurrToken)));
   case TokenType::Ident:
-    return CastPtr<Expr>(MakePtr(IdentExpr(m_CurrToken)));
+    return CastPtr<Expr>(MakeNode(IdentExpr(m_CurrToken)));
   case TokenType::BinLit:
-    return CastPtr<Expr>(MakePtr(NumberExpr(m_CurrToken.m_Position, m_CurrToken.m_Lexeme, NumberBase::Bin)));
+    return CastPtr<Expr>(MakeNode(NumberExpr(m_CurrToken.m_Position, m_CurrToken.m_Lexeme, NumberBase::Bin)));
   case TokenType::DecLit:
-    return CastPtr<Expr>(MakePtr(NumberExpr(m_CurrToken.m_Position, m_CurrToken.m_Lexeme, NumberBase::Dec)));
+    return CastPtr<Expr>(MakeNode(NumberExpr(m_CurrToken.m_Position, m_CurrToken.m_Lexeme, NumberBase::Dec)));
   case TokenType::HexLit:
-    return CastPtr<Expr>(MakePtr(NumberExpr(m_CurrToken.m_Position, m_CurrToken.m_Lexeme, NumberBase::Hex)));
+    return CastPtr<Expr>(MakeNode(NumberExpr(m_CurrToken.m_Position, m_CurrToken.m_Lexeme, NumberBase::Hex)));
   case TokenType::FloatLit:
-    return CastPtr<Expr>(MakePtr(NumberExpr(m_CurrToken.m_Position, m_CurrToken.m_Lexeme, NumberBase::Dec, true)));
+    return CastPtr<Expr>(MakeNode(NumberExpr(m_CurrToken.m_Position, m_CurrToken.m_Lexeme, NumberBase::Dec, true)));
+  case TokenType::Lparen:
+  {
+    // grouping, the closing paren is left current like any other primary
+    Next().unwrap();
+    auto innerRes = ParseExpr(Prec::Low);
+    if (innerRes.is_err())
+    {
+      return innerRes.unwrap_err();
+    }
+    if (TokenType::Rparen != m_CurrToken.m_Type)
+    {
+      return Diagnostic(DiagCode::InvalidExpr, m_CurrToken.m_Position, m_ModuleID);
+    }
+    return innerRes.unwrap();
+  }
   default:
     // TODO: display expression
-    return Diagnostic(Errno::SYNTAX_ERROR, m_CurrToken.m_Position, m_ModuleID, DiagnosticSeverity::ERROR, "invalid left side expression");
+    return Diagnostic(DiagCode::InvalidExpr, m_CurrToken.m_Position, m_ModuleID);
   }
 }
 
@@ -382,22 +444,41 @@ Result<Ptr<CallExpr>, Diagnostic> Parser::ParseExprCall(Ptr<Expr> callee)
       }
     }
   }
-  assert(TokenType::Rparen == m_CurrToken.m_Type);
-  argsPosition.m_End = Next().unwrap().m_End;
-  return MakePtr(CallExpr(callee, CallExprArgs(argsPosition, std::move(args))));
+  argsPosition.m_End = Expect(TokenType::Rparen).unwrap().m_End;
+  return MakeNode(CallExpr(callee, CallExprArgs(argsPosition, std::move(args))));
 }
 
 Result<Ptr<AssignExpr>, Diagnostic> Parser::ParseExprAssign(Ptr<Expr> dest)
 {
   assert(TokenType::Equal == m_CurrToken.m_Type);
+  if (ExprT::Ident != dest->GetType())
+  {
+    return Diagnostic(DiagCode::InvalidExpr, dest->GetPos(), m_ModuleID);
+  }
   Next().unwrap();
-  assert(ExprT::Ident == dest->GetType());
   auto valueRes = ParseExpr(Prec::Low);
   if (valueRes.is_err())
   {
     return valueRes.unwrap_err();
   }
-  return MakePtr(AssignExpr(CastPtr<IdentExpr>(dest), valueRes.unwrap()));
+  return MakeNode(AssignExpr(CastPtr<IdentExpr>(dest), valueRes.unwrap()));
+}
+
+Result<Ptr<BinaryExpr>, Diagnostic> Parser::ParseExprBinary(Ptr<Expr> lhs)
+{
+  Token op = m_CurrToken;
+  auto nextRes = Next();
+  if (nextRes.is_err())
+  {
+    return nextRes.unwrap_err();
+  }
+  // parsing the rhs at the operator's own level keeps `a - b - c` left associative
+  auto rhsRes = ParseExpr(token2precedence(op.m_Type));
+  if (rhsRes.is_err())
+  {
+    return rhsRes.unwrap_err();
+  }
+  return MakeNode(BinaryExpr(op, lhs, rhsRes.unwrap()));
 }
 
 Result<Ptr<FieldAccExpr>, Diagnostic> Parser::ParseExprFieldAcc(Ptr<Expr> value)
@@ -408,16 +489,16 @@ Result<Ptr<FieldAccExpr>, Diagnostic> Parser::ParseExprFieldAcc(Ptr<Expr> value)
   {
     return fieldNameRes.unwrap_err();
   }
-  return MakePtr(FieldAccExpr(value, fieldNameRes.unwrap()));
+  return MakeNode(FieldAccExpr(value, fieldNameRes.unwrap()));
 }
 
 Result<Ptr<IdentExpr>, Diagnostic> Parser::ParseExprIdent()
 {
   if (TokenType::Ident != m_CurrToken.m_Type)
   {
-    return Diagnostic(Errno::SYNTAX_ERROR, m_CurrToken.m_Position, m_ModuleID, DiagnosticSeverity::ERROR, "expect an idetifier");
+    return Diagnostic(DiagCode::ExpectIdent, m_CurrToken.m_Position, m_ModuleID);
   }
-  auto identifierExpression = MakePtr(IdentExpr(m_CurrToken));
+  auto identifierExpression = MakeNode(IdentExpr(m_CurrToken));
   Next().unwrap();
   return identifierExpression;
 }
@@ -428,42 +509,42 @@ Result<Ptr<AstType>, Diagnostic> Parser::ParseTypeAnn()
   switch (m_CurrToken.m_Type)
   {
   case TokenType::I8:
-    type = MakePtr<type::Type>(type::Base::I8);
+    type = type::Type::Get(type::Base::I8);
     break;
   case TokenType::I16:
-    type = MakePtr<type::Type>(type::Base::I16);
+    type = type::Type::Get(type::Base::I16);
     break;
   case TokenType::I32:
-    type = MakePtr<type::Type>(type::Base::I32);
+    type = type::Type::Get(type::Base::I32);
     break;
   case TokenType::I64:
-    type = MakePtr<type::Type>(type::Base::I64);
+    type = type::Type::Get(type::Base::I64);
     break;
   case TokenType::U8:
-    type = MakePtr<type::Type>(type::Base::U8);
+    type = type::Type::Get(type::Base::U8);
     break;
   case TokenType::U16:
-    type = MakePtr<type::Type>(type::Base::U16);
+    type = type::Type::Get(type::Base::U16);
     break;
   case TokenType::U32:
-    type = MakePtr<type::Type>(type::Base::U32);
+    type = type::Type::Get(type::Base::U32);
     break;
   case TokenType::U64:
-    type = MakePtr<type::Type>(type::Base::U32);
+    type = type::Type::Get(type::Base::U64);
     break;
   case TokenType::Float:
-    type = MakePtr<type::Type>(type::Base::Float);
+    type = type::Type::Get(type::Base::Float);
     break;
   case TokenType::Void:
-    type = MakePtr<type::Type>(type::Base::VOID);
+    type = type::Type::Get(type::Base::VOID);
     break;
   case TokenType::String:
-    type = MakePtr<type::Type>(type::Base::STRING);
+    type = type::Type::Get(type::Base::STRING);
     break;
   case TokenType::Fun:
     return ParseFunTypeAnn();
   default:
-    return Diagnostic(Errno::SYNTAX_ERROR, m_CurrToken.m_Position, m_ModuleID, DiagnosticSeverity::ERROR, "expect type annotation, try 'i32', 'string', ...");
+    return Diagnostic(DiagCode::ExpectTypeAnn, m_CurrToken.m_Position, m_ModuleID);
   }
   return MakePtr(AstType(Next().unwrap(), type));
 }
@@ -481,10 +562,25 @@ Result<Ptr<AstType>, Diagnostic> Parser::ParseFunTypeAnn()
       return typeRes.unwrap_err();
     }
     argsTypes.push_back(typeRes.unwrap()->GetType());
+    if (TokenType::Comma == m_CurrToken.m_Type)
+    {
+      Next().unwrap();
+    }
+  }
+  for (auto tokenType : {TokenType::Rparen, TokenType::Arrow})
+  {
+    auto expectRes = Expect(tokenType);
+    if (expectRes.is_err())
+    {
+      return expectRes.unwrap_err();
+    }
+  }
+  auto returnTypeRes = ParseTypeAnn();
+  if (returnTypeRes.is_err())
+  {
+    return returnTypeRes.unwrap_err();
   }
-  Expect(TokenType::Rparen).unwrap();
-  Expect(TokenType::Arrow).unwrap();
-  auto returnType = ParseTypeAnn().unwrap();
+  auto returnType = returnTypeRes.unwrap();
   position.m_End = returnType->GetPos().m_End;
   size_t argsCount = argsTypes.size();
   auto functionType = MakePtr(type::Function(argsCount, std::move(argsTypes), returnType->GetType()));
@@ -497,10 +593,11 @@ Result<Position, Diagnostic> Parser::Next()
   auto res = m_Lexer.Next();
   if (res.is_err())
   {
+    m_LexError = res.unwrap_err();
     return Result<Position, Diagnostic>(res.unwrap_err());
   }
-  m_CurrToken = m_NextToken;
-  m_NextToken = res.unwrap();
+  m_CurrToken = std::move(m_NextToken);
+  m_NextToken = std::move(res.unwrap());
   return Result<Position, Diagnostic>(pos);
 }
 
@@ -508,8 +605,7 @@ Result<Position, Diagnostic> Parser::Expect(TokenType tokenType)
 {
   if (tokenType != m_CurrToken.m_Type)
   {
-    // TODO: display token, token_type
-    return Result<Position, Diagnostic>(Diagnostic(Errno::SYNTAX_ERROR, m_CurrToken.m_Position, m_ModuleID, DiagnosticSeverity::ERROR, "syntax error: expect {} but got {}."));
+    return Result<Position, Diagnostic>(Diagnostic(DiagCode::UnexpectedToken, m_CurrToken.m_Position, m_ModuleID, {SourceSpan(m_ModuleID, m_CurrToken.m_Position)}));
   }
   return Next();
 }
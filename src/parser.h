@@ -12,7 +12,7 @@
 class Parser
 {
 public:
-  Parser(Ptr<Module> module, ModuleManager &modManager) : m_Module(module), m_ModuleID(module->m_ID), m_Lexer(Lexer(module->m_ID, modManager)), m_CurrToken(), m_NextToken(), m_HasPubModifier(false) {};
+  Parser(Ptr<Module> module, ModuleManager &modManager) : m_Module(module), m_ModuleID(module->m_ID), m_Lexer(Lexer(module->m_ID, modManager)), m_CurrToken(), m_NextToken(), m_HasPubModifier(false), m_NodesCount(0), m_LexError() {};
 
   std::optional<Diagnostic> Parse();
 
@@ -23,6 +23,17 @@ private:
   Token m_CurrToken;
   Token m_NextToken;
   bool m_HasPubModifier;
+  NodeID m_NodesCount;
+  // last error of the lexer, callers of `Next` mostly unwrap its result
+  std::optional<Diagnostic> m_LexError;
+
+  template <typename T>
+  Ptr<T> MakeNode(T node)
+  {
+    auto ptr = MakePtr(std::move(node));
+    ptr->SetID(m_NodesCount++);
+    return ptr;
+  }
 
   bool IsEof();
   Result<Position, Diagnostic> Next();
@@ -43,6 +54,7 @@ private:
   Result<Ptr<CallExpr>, Diagnostic> ParseExprCall(Ptr<Expr>);
   Result<Ptr<AssignExpr>, Diagnostic> ParseExprAssign(Ptr<Expr>);
   Result<Ptr<FieldAccExpr>, Diagnostic> ParseExprFieldAcc(Ptr<Expr>);
+  Result<Ptr<BinaryExpr>, Diagnostic> ParseExprBinary(Ptr<Expr>);
 
   Result<bool, Diagnostic> ParsePubAccMod();
   Result<FunParams, Diagnostic> ParseFunParams();
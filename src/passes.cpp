@@ -0,0 +1,1197 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ir.h"
+#include "passes.h"
+
+namespace ir
+{
+// an arithmetic instruction that may trap has to stay even when unused
+static bool IsPure(const Instr *instr)
+{
+  switch (instr->m_Op)
+  {
+  case Op::Add:
+  case Op::Sub:
+  case Op::Mul:
+  case Op::Div:
+    return 0 == instr->m_Checks;
+  case Op::Const:
+  case Op::Param:
+  case Op::Copy:
+  case Op::Cast:
+  case Op::FuncRef:
+  case Op::Load:
+  case Op::Phi:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static std::vector<Instr *> Phis(Block *block)
+{
+  std::vector<Instr *> phis;
+  for (auto instr : block->m_Instrs)
+  {
+    if (Op::Phi != instr->m_Op)
+    {
+      break;
+    }
+    phis.push_back(instr);
+  }
+  return phis;
+}
+
+static void RetargetPhis(Block *block, Block *from, Block *to)
+{
+  for (auto succ : block->Successors())
+  {
+    for (auto phi : Phis(succ))
+    {
+      for (uint32_t i = 0; i < phi->m_ArgsCount; ++i)
+      {
+        if (phi->m_Incoming[i] == from)
+        {
+          phi->m_Incoming[i] = to;
+        }
+      }
+    }
+  }
+}
+
+static void MakeConst(Instr *instr, uint64_t bits, double value)
+{
+  instr->m_Op = Op::Const;
+  instr->m_Imm = bits;
+  instr->m_Float = value;
+  instr->m_ArgsCount = 0;
+}
+
+/*
+  SimplifyCFG
+*/
+bool SimplifyCFG::Run(Program &program)
+{
+  bool changed = false;
+  for (auto function : program.m_Functions)
+  {
+    if (function->IsExtern())
+    {
+      continue;
+    }
+    changed = RemoveUnreachable(function) || changed;
+    changed = MergeBlocks(function) || changed;
+  }
+  return changed;
+}
+
+bool SimplifyCFG::RemoveUnreachable(Function *function)
+{
+  std::unordered_set<Block *> reachable = {function->Entry()};
+  std::vector<Block *> worklist = {function->Entry()};
+  while (!worklist.empty())
+  {
+    auto block = worklist.back();
+    worklist.pop_back();
+    for (auto succ : block->Successors())
+    {
+      if (reachable.insert(succ).second)
+      {
+        worklist.push_back(succ);
+      }
+    }
+  }
+  if (reachable.size() == function->m_Blocks.size())
+  {
+    return false;
+  }
+  std::erase_if(function->m_Blocks, [&](Block *block)
+                { return reachable.count(block) == 0; });
+  // phis forget the edges coming from removed blocks
+  for (auto block : function->m_Blocks)
+  {
+    for (auto phi : Phis(block))
+    {
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < phi->m_ArgsCount; ++i)
+      {
+        if (reachable.count(phi->m_Incoming[i]))
+        {
+          phi->m_Args[kept] = phi->m_Args[i];
+          phi->m_Incoming[kept] = phi->m_Incoming[i];
+          kept++;
+        }
+      }
+      phi->m_ArgsCount = kept;
+    }
+  }
+  return true;
+}
+
+bool SimplifyCFG::MergeBlocks(Function *function)
+{
+  bool changed = false;
+  bool merged = true;
+  while (merged)
+  {
+    merged = false;
+    auto preds = function->Predecessors();
+    for (auto block : function->m_Blocks)
+    {
+      auto terminator = block->Terminator();
+      if (!terminator || Op::Jmp != terminator->m_Op)
+      {
+        continue;
+      }
+      auto succ = terminator->m_Target;
+      if (succ == block || succ == function->Entry() || preds.at(succ).size() != 1)
+      {
+        continue;
+      }
+      // a single predecessor leaves phis with a single operand
+      for (auto phi : Phis(succ))
+      {
+        function->ReplaceAllUses(phi, phi->Arg(0));
+      }
+      block->m_Instrs.pop_back();
+      for (auto instr : succ->m_Instrs)
+      {
+        if (Op::Phi != instr->m_Op)
+        {
+          instr->m_Block = block;
+          block->m_Instrs.push_back(instr);
+        }
+      }
+      RetargetPhis(block, succ, block);
+      std::erase(function->m_Blocks, succ);
+      merged = true;
+      changed = true;
+      break;
+    }
+  }
+  return changed;
+}
+
+/*
+  CopyProp
+*/
+bool CopyProp::Run(Program &program)
+{
+  bool changed = false;
+  for (auto function : program.m_Functions)
+  {
+    std::unordered_map<Instr *, Instr *> forward;
+    auto resolve = [&](Instr *value)
+    {
+      while (forward.count(value))
+      {
+        value = forward.at(value);
+      }
+      return value;
+    };
+    bool found = true;
+    while (found)
+    {
+      found = false;
+      for (auto block : function->m_Blocks)
+      {
+        for (auto instr : block->m_Instrs)
+        {
+          if (forward.count(instr))
+          {
+            continue;
+          }
+          if (Op::Copy == instr->m_Op)
+          {
+            forward[instr] = resolve(instr->Arg(0));
+            found = true;
+            continue;
+          }
+          if (Op::Phi != instr->m_Op || 0 == instr->m_ArgsCount)
+          {
+            continue;
+          }
+          Instr *same = nullptr;
+          bool isTrivial = true;
+          for (uint32_t i = 0; i < instr->m_ArgsCount && isTrivial; ++i)
+          {
+            auto arg = resolve(instr->Arg(i));
+            if (arg == instr || arg == same)
+            {
+              continue;
+            }
+            isTrivial = !same;
+            same = arg;
+          }
+          if (isTrivial && same)
+          {
+            forward[instr] = same;
+            found = true;
+          }
+        }
+      }
+    }
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+        {
+          auto arg = resolve(instr->m_Args[i]);
+          changed = changed || arg != instr->m_Args[i];
+          instr->m_Args[i] = arg;
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+/*
+  ConstFold
+*/
+static bool IsCallCompatible(const Instr *call, const Function *callee)
+{
+  auto argsCount = call->m_ArgsCount - 1;
+  if (callee->m_RetTy != call->m_Ty || argsCount < callee->m_Params.size() || (!callee->m_IsVarArgs && argsCount != callee->m_Params.size()))
+  {
+    return false;
+  }
+  for (size_t i = 0; i < callee->m_Params.size(); ++i)
+  {
+    if (call->Arg(i + 1)->m_Ty != callee->m_Params.at(i))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// false when the operation traps at runtime, the instruction then stays as is
+static bool FoldArith(const Instr *instr, uint64_t &bits, double &value)
+{
+  auto lhs = instr->Arg(0);
+  auto rhs = instr->Arg(1);
+  if (Ty::F64 == instr->m_Ty)
+  {
+    switch (instr->m_Op)
+    {
+    case Op::Add:
+      value = lhs->m_Float + rhs->m_Float;
+      break;
+    case Op::Sub:
+      value = lhs->m_Float - rhs->m_Float;
+      break;
+    case Op::Mul:
+      value = lhs->m_Float * rhs->m_Float;
+      break;
+    default:
+      value = lhs->m_Float / rhs->m_Float;
+      break;
+    }
+    bits = 0;
+    return true;
+  }
+  value = 0;
+  auto ty = instr->m_Ty;
+  uint64_t wrapped = 0;
+  bool overflow = false;
+  if (IsSigned(ty))
+  {
+    auto a = static_cast<int64_t>(lhs->m_Imm);
+    auto b = static_cast<int64_t>(rhs->m_Imm);
+    int64_t result = 0;
+    switch (instr->m_Op)
+    {
+    case Op::Add:
+      overflow = __builtin_add_overflow(a, b, &result);
+      break;
+    case Op::Sub:
+      overflow = __builtin_sub_overflow(a, b, &result);
+      break;
+    case Op::Mul:
+      overflow = __builtin_mul_overflow(a, b, &result);
+      break;
+    default:
+      if (0 == b)
+      {
+        return false;
+      }
+      // the only quotient out of range is MIN / -1, it wraps back to MIN
+      overflow = -1 == b && a == static_cast<int64_t>(NormalizeBits(ty, uint64_t(1) << (BitWidth(ty) - 1)));
+      result = overflow ? a : a / b;
+      break;
+    }
+    wrapped = static_cast<uint64_t>(result);
+  }
+  else
+  {
+    auto a = lhs->m_Imm;
+    auto b = rhs->m_Imm;
+    switch (instr->m_Op)
+    {
+    case Op::Add:
+      overflow = __builtin_add_overflow(a, b, &wrapped);
+      break;
+    case Op::Sub:
+      overflow = __builtin_sub_overflow(a, b, &wrapped);
+      break;
+    case Op::Mul:
+      overflow = __builtin_mul_overflow(a, b, &wrapped);
+      break;
+    default:
+      if (0 == b)
+      {
+        return false;
+      }
+      wrapped = a / b;
+      break;
+    }
+  }
+  bits = NormalizeBits(ty, wrapped);
+  overflow = overflow || bits != wrapped;
+  return !(overflow && (instr->m_Checks & CHECK_OVERFLOW));
+}
+
+bool ConstFold::Run(Program &program)
+{
+  bool changed = false;
+  for (auto function : program.m_Functions)
+  {
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        switch (instr->m_Op)
+        {
+        case Op::Copy:
+          if (Op::Const == instr->Arg(0)->m_Op)
+          {
+            MakeConst(instr, instr->Arg(0)->m_Imm, instr->Arg(0)->m_Float);
+            changed = true;
+          }
+          break;
+        case Op::Cast:
+          if (Op::Const == instr->Arg(0)->m_Op)
+          {
+            MakeConst(instr, NormalizeBits(instr->m_Ty, instr->Arg(0)->m_Imm), 0);
+            changed = true;
+          }
+          break;
+        case Op::Phi:
+        {
+          bool isSame = instr->m_ArgsCount > 0;
+          for (uint32_t i = 0; i < instr->m_ArgsCount && isSame; ++i)
+          {
+            auto arg = instr->Arg(i);
+            isSame = Op::Const == arg->m_Op && arg->m_Imm == instr->Arg(0)->m_Imm && arg->m_Float == instr->Arg(0)->m_Float;
+          }
+          if (isSame)
+          {
+            MakeConst(instr, instr->Arg(0)->m_Imm, instr->Arg(0)->m_Float);
+            changed = true;
+          }
+          break;
+        }
+        case Op::Add:
+        case Op::Sub:
+        case Op::Mul:
+        case Op::Div:
+        {
+          uint64_t bits = 0;
+          double value = 0;
+          if (Op::Const == instr->Arg(0)->m_Op && Op::Const == instr->Arg(1)->m_Op && FoldArith(instr, bits, value))
+          {
+            MakeConst(instr, bits, value);
+            instr->m_Checks = 0;
+            changed = true;
+          }
+          break;
+        }
+        case Op::CallIndirect:
+          // the address is known, call the function directly
+          if (Op::FuncRef == instr->Arg(0)->m_Op && IsCallCompatible(instr, instr->Arg(0)->m_Callee))
+          {
+            instr->m_Op = Op::Call;
+            instr->m_Callee = instr->Arg(0)->m_Callee;
+            instr->m_Args++;
+            instr->m_ArgsCount--;
+            changed = true;
+          }
+          break;
+        default:
+          break;
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+/*
+  DCE
+*/
+bool DCE::Run(Program &program)
+{
+  bool changed = false;
+  for (auto function : program.m_Functions)
+  {
+    std::unordered_map<Instr *, size_t> uses;
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+        {
+          uses[instr->Arg(i)]++;
+        }
+      }
+    }
+    std::unordered_set<Instr *> dead;
+    std::vector<Instr *> worklist;
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        if (IsPure(instr) && 0 == uses[instr])
+        {
+          worklist.push_back(instr);
+        }
+      }
+    }
+    while (!worklist.empty())
+    {
+      auto instr = worklist.back();
+      worklist.pop_back();
+      if (!dead.insert(instr).second)
+      {
+        continue;
+      }
+      for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+      {
+        auto arg = instr->Arg(i);
+        if (0 == --uses[arg] && IsPure(arg))
+        {
+          worklist.push_back(arg);
+        }
+      }
+    }
+    if (dead.empty())
+    {
+      continue;
+    }
+    for (auto block : function->m_Blocks)
+    {
+      std::erase_if(block->m_Instrs, [&](Instr *instr)
+                    { return dead.count(instr) > 0; });
+    }
+    changed = true;
+  }
+  return changed;
+}
+
+/*
+  Inline
+*/
+static bool CallsItself(const Function *function)
+{
+  for (auto block : function->m_Blocks)
+  {
+    for (auto instr : block->m_Instrs)
+    {
+      if (Op::Call == instr->m_Op && instr->m_Callee == function)
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool Inline::Run(Program &program)
+{
+  std::unordered_map<const Function *, bool> isEligible;
+  auto eligible = [&](const Function *callee)
+  {
+    if (!isEligible.count(callee))
+    {
+      isEligible[callee] = !callee->IsExtern() && callee->Size() <= m_Threshold && !CallsItself(callee);
+    }
+    return isEligible.at(callee);
+  };
+
+  bool changed = false;
+  for (auto function : program.m_Functions)
+  {
+    // only the calls present before this run, calls brought in by inlining wait for the next one
+    std::vector<Instr *> sites;
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        if (Op::Call == instr->m_Op && instr->m_Callee != function && eligible(instr->m_Callee))
+        {
+          sites.push_back(instr);
+        }
+      }
+    }
+    for (auto call : sites)
+    {
+      auto block = call->m_Block;
+      auto index = static_cast<size_t>(std::find(block->m_Instrs.begin(), block->m_Instrs.end(), call) - block->m_Instrs.begin());
+      InlineCall(program, function, block, index);
+      changed = true;
+    }
+    if (!sites.empty())
+    {
+      // callers of this function see its new size
+      isEligible.erase(function);
+    }
+  }
+  return changed;
+}
+
+void Inline::InlineCall(Program &program, Function *caller, Block *block, size_t index)
+{
+  auto call = block->m_Instrs.at(index);
+  auto callee = call->m_Callee;
+  auto calleeBlocks = callee->m_Blocks;
+
+  // 1. everything after the call moves to a continuation block
+  auto cont = program.NewBlock(caller);
+  cont->m_Instrs.assign(block->m_Instrs.begin() + static_cast<std::ptrdiff_t>(index) + 1, block->m_Instrs.end());
+  for (auto instr : cont->m_Instrs)
+  {
+    instr->m_Block = cont;
+  }
+  block->m_Instrs.resize(index);
+  RetargetPhis(cont, block, cont);
+
+  // 2. clone the callee body, params become the call arguments
+  std::unordered_map<const InlineSite *, const InlineSite *> sites;
+  std::function<const InlineSite *(const InlineSite *)> inlinedAt = [&](const InlineSite *site) -> const InlineSite *
+  {
+    // sites of instructions the callee got from inlining are rebased on the call
+    if (!site)
+    {
+      return program.m_Arena.Make<InlineSite>(callee, call->m_Pos, call->m_Inlined);
+    }
+    auto &rebased = sites[site];
+    if (!rebased)
+    {
+      rebased = program.m_Arena.Make<InlineSite>(site->m_Function, site->m_CallPos, inlinedAt(site->m_Parent));
+    }
+    return rebased;
+  };
+  std::unordered_map<const Block *, Block *> blocks;
+  std::unordered_map<const Instr *, Instr *> values;
+  std::vector<std::pair<const Instr *, Instr *>> clones;
+  std::vector<std::pair<Block *, const Instr *>> rets;
+  for (auto calleeBlock : calleeBlocks)
+  {
+    blocks[calleeBlock] = program.NewBlock(caller);
+  }
+  for (auto calleeBlock : calleeBlocks)
+  {
+    auto newBlock = blocks.at(calleeBlock);
+    for (auto instr : calleeBlock->m_Instrs)
+    {
+      if (Op::Param == instr->m_Op)
+      {
+        values[instr] = call->Arg(instr->m_Imm);
+        continue;
+      }
+      Instr *clone = nullptr;
+      if (Op::Ret == instr->m_Op)
+      {
+        rets.push_back({newBlock, instr->m_ArgsCount ? instr->Arg(0) : nullptr});
+        clone = program.NewInstr(Op::Jmp, Ty::Void);
+        clone->m_Target = cont;
+      }
+      else
+      {
+        clone = program.NewInstr(instr->m_Op, instr->m_Ty, std::vector<Instr *>(instr->m_ArgsCount, nullptr));
+        clone->m_Imm = instr->m_Imm;
+        clone->m_Checks = instr->m_Checks;
+        clone->m_Float = instr->m_Float;
+        clone->m_Callee = instr->m_Callee;
+        clone->m_Global = instr->m_Global;
+        clone->m_Target = instr->m_Target ? blocks.at(instr->m_Target) : nullptr;
+        clones.push_back({instr, clone});
+      }
+      clone->m_Block = newBlock;
+      clone->m_ID = caller->m_ValuesCount++;
+      // the position stays in the callee, the site records the call it was inlined at
+      clone->m_Pos = instr->m_Pos;
+      clone->m_Inlined = inlinedAt(instr->m_Inlined);
+      newBlock->m_Instrs.push_back(clone);
+      values[instr] = clone;
+    }
+  }
+  // operands may be defined in blocks cloned later, they are wired once all exist
+  for (auto &[instr, clone] : clones)
+  {
+    for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+    {
+      clone->m_Args[i] = values.at(instr->Arg(i));
+    }
+    if (Op::Phi == instr->m_Op)
+    {
+      clone->m_Incoming = program.m_Arena.MakeArray<Block *>(instr->m_ArgsCount);
+      for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+      {
+        clone->m_Incoming[i] = blocks.at(instr->m_Incoming[i]);
+      }
+    }
+  }
+
+  // 3. layout: the calling block, the callee body, then the continuation
+  std::erase(caller->m_Blocks, cont);
+  for (auto calleeBlock : calleeBlocks)
+  {
+    std::erase(caller->m_Blocks, blocks.at(calleeBlock));
+  }
+  auto at = std::find(caller->m_Blocks.begin(), caller->m_Blocks.end(), block) + 1;
+  at = caller->m_Blocks.insert(at, cont);
+  for (auto it = calleeBlocks.rbegin(); it != calleeBlocks.rend(); ++it)
+  {
+    at = caller->m_Blocks.insert(at, blocks.at(*it));
+  }
+  Builder builder(program);
+  builder.m_Block = block;
+  builder.m_Pos = call->m_Pos;
+  builder.Jmp(blocks.at(callee->Entry()))->m_Inlined = call->m_Inlined;
+
+  // 4. the call result is whatever the callee returned
+  if (Ty::Void == call->m_Ty || rets.empty())
+  {
+    return;
+  }
+  Instr *result = nullptr;
+  if (1 == rets.size())
+  {
+    result = values.at(rets.front().second);
+  }
+  else
+  {
+    std::vector<Instr *> args;
+    for (auto &ret : rets)
+    {
+      args.push_back(values.at(ret.second));
+    }
+    result = program.NewInstr(Op::Phi, call->m_Ty, args);
+    result->m_Incoming = program.m_Arena.MakeArray<Block *>(rets.size());
+    for (size_t i = 0; i < rets.size(); ++i)
+    {
+      result->m_Incoming[i] = rets.at(i).first;
+    }
+    result->m_Block = cont;
+    result->m_ID = caller->m_ValuesCount++;
+    result->m_Pos = call->m_Pos;
+    result->m_Inlined = call->m_Inlined;
+    cont->m_Instrs.insert(cont->m_Instrs.begin(), result);
+  }
+  caller->ReplaceAllUses(call, result);
+}
+
+/*
+  RangeProp
+*/
+// holds every i64 and u64 value and the sum of any two
+__extension__ typedef __int128 Wide;
+
+// products beyond this are clamped, they are out of every type's bounds anyway
+static const Wide WIDE_LIMIT = static_cast<Wide>(1) << 100;
+// instruction count up to which a callee is evaluated again for each call site
+static const size_t SMALL_CALLEE = 32;
+static const unsigned MAX_CALL_DEPTH = 2;
+// sweeps before a still growing phi is given up on
+static const size_t MAX_SWEEPS = 8;
+// rounds of call site propagation before giving up on facts crossing calls
+static const size_t MAX_ROUNDS = 8;
+
+// closed interval of integers, empty when nothing reaches the value
+class Range
+{
+public:
+  Wide m_Lo;
+  Wide m_Hi;
+
+  Range() : m_Lo(1), m_Hi(0) {};
+  Range(Wide lo, Wide hi) : m_Lo(lo), m_Hi(hi) {};
+
+  bool IsEmpty() const { return m_Lo > m_Hi; }
+  bool Contains(Wide value) const { return m_Lo <= value && value <= m_Hi; }
+  bool Within(const Range &other) const { return IsEmpty() || (other.m_Lo <= m_Lo && m_Hi <= other.m_Hi); }
+  bool operator==(const Range &other) const { return (IsEmpty() && other.IsEmpty()) || (m_Lo == other.m_Lo && m_Hi == other.m_Hi); }
+
+  Range Join(const Range &other) const
+  {
+    if (IsEmpty())
+    {
+      return other;
+    }
+    if (other.IsEmpty())
+    {
+      return *this;
+    }
+    return Range(std::min(m_Lo, other.m_Lo), std::max(m_Hi, other.m_Hi));
+  }
+
+  Range Meet(const Range &other) const { return Range(std::max(m_Lo, other.m_Lo), std::min(m_Hi, other.m_Hi)); }
+};
+
+static Range Bounds(Ty ty)
+{
+  auto width = BitWidth(ty);
+  if (IsSigned(ty))
+  {
+    return Range(-(static_cast<Wide>(1) << (width - 1)), (static_cast<Wide>(1) << (width - 1)) - 1);
+  }
+  return Range(0, (static_cast<Wide>(1) << width) - 1);
+}
+
+static std::string WideString(Wide value)
+{
+  return value < 0 ? std::to_string(static_cast<int64_t>(value)) : std::to_string(static_cast<uint64_t>(value));
+}
+
+static Wide ClampedMul(Wide a, Wide b)
+{
+  Wide product;
+  if (__builtin_mul_overflow(a, b, &product) || product > WIDE_LIMIT || product < -WIDE_LIMIT)
+  {
+    return (a < 0) != (b < 0) ? -WIDE_LIMIT : WIDE_LIMIT;
+  }
+  return product;
+}
+
+// mathematical result of `op` over all operand pairs, divisions by zero left out
+static Range Exact(Op op, const Range &lhs, const Range &rhs)
+{
+  if (lhs.IsEmpty() || rhs.IsEmpty())
+  {
+    return Range();
+  }
+  switch (op)
+  {
+  case Op::Add:
+    return Range(lhs.m_Lo + rhs.m_Lo, lhs.m_Hi + rhs.m_Hi);
+  case Op::Sub:
+    return Range(lhs.m_Lo - rhs.m_Hi, lhs.m_Hi - rhs.m_Lo);
+  case Op::Mul:
+  {
+    Range result;
+    for (auto a : {lhs.m_Lo, lhs.m_Hi})
+    {
+      for (auto b : {rhs.m_Lo, rhs.m_Hi})
+      {
+        auto product = ClampedMul(a, b);
+        result = result.Join(Range(product, product));
+      }
+    }
+    return result;
+  }
+  case Op::Div:
+  {
+    // truncating division is monotonic on each side of zero, the extremes sit at
+    // the ends of the divisor range or at -1 and 1
+    Range result;
+    for (auto b : {rhs.m_Lo, rhs.m_Hi, static_cast<Wide>(-1), static_cast<Wide>(1)})
+    {
+      if (0 == b || !rhs.Contains(b))
+      {
+        continue;
+      }
+      for (auto a : {lhs.m_Lo, lhs.m_Hi})
+      {
+        result = result.Join(Range(a / b, a / b));
+      }
+    }
+    return result;
+  }
+  default:
+    return Range();
+  }
+}
+
+class RangeAnalysis
+{
+public:
+  Program &m_Program;
+  // functions only called directly, their parameters span the arguments of their call sites
+  std::unordered_set<const Function *> m_Closed;
+  std::unordered_map<const Function *, std::vector<Range>> m_Params;
+  std::unordered_map<const Function *, Range> m_Returns;
+  // set when call site propagation did not settle, calls then yield full ranges
+  bool m_GaveUp;
+
+  RangeAnalysis(Program &program) : m_Program(program), m_Closed(), m_Params(), m_Returns(), m_GaveUp(false) {};
+
+  void Solve();
+  std::vector<Range> ParamsOf(const Function *function) const;
+  std::unordered_map<const Instr *, Range> Evaluate(const Function *function, const std::vector<Range> &params, Range &ret, unsigned depth) const;
+
+private:
+  Range Transfer(const Instr *instr, const std::vector<Range> &params, const std::unordered_map<const Instr *, Range> &ranges, unsigned depth) const;
+  Range CallRange(const Instr *call, const std::unordered_map<const Instr *, Range> &ranges, unsigned depth) const;
+};
+
+static Range RangeOf(const std::unordered_map<const Instr *, Range> &ranges, const Instr *value)
+{
+  auto found = ranges.find(value);
+  return found == ranges.end() ? Range() : found->second;
+}
+
+void RangeAnalysis::Solve()
+{
+  std::unordered_set<const Function *> open(m_Program.m_Inits.begin(), m_Program.m_Inits.end());
+  open.insert(m_Program.m_Main);
+  for (auto function : m_Program.m_Functions)
+  {
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        if (Op::FuncRef == instr->m_Op)
+        {
+          open.insert(instr->m_Callee);
+        }
+      }
+    }
+  }
+  for (auto function : m_Program.m_Functions)
+  {
+    if (!function->IsExtern() && !function->m_IsPub && !open.contains(function))
+    {
+      m_Closed.insert(function);
+    }
+  }
+  for (size_t round = 0; round < MAX_ROUNDS; ++round)
+  {
+    std::unordered_map<const Function *, std::vector<Range>> params;
+    std::unordered_map<const Function *, Range> returns;
+    for (auto function : m_Program.m_Functions)
+    {
+      if (function->IsExtern())
+      {
+        continue;
+      }
+      Range ret;
+      auto ranges = Evaluate(function, ParamsOf(function), ret, 0);
+      returns[function] = ret;
+      for (auto block : function->m_Blocks)
+      {
+        for (auto instr : block->m_Instrs)
+        {
+          if (Op::Call != instr->m_Op || !m_Closed.contains(instr->m_Callee))
+          {
+            continue;
+          }
+          auto &args = params[instr->m_Callee];
+          args.resize(instr->m_Callee->m_Params.size());
+          for (size_t i = 0; i < args.size() && i < instr->m_ArgsCount; ++i)
+          {
+            args[i] = args[i].Join(RangeOf(ranges, instr->Arg(i)));
+          }
+        }
+      }
+    }
+    if (params == m_Params && returns == m_Returns)
+    {
+      // never called, nothing is known about the parameters
+      for (auto function : m_Closed)
+      {
+        m_Params.try_emplace(function, std::vector<Range>());
+      }
+      for (auto &[function, args] : m_Params)
+      {
+        if (args.empty())
+        {
+          m_Closed.erase(function);
+        }
+      }
+      return;
+    }
+    m_Params = std::move(params);
+    m_Returns = std::move(returns);
+  }
+  m_GaveUp = true;
+  m_Closed.clear();
+  m_Params.clear();
+  m_Returns.clear();
+}
+
+std::vector<Range> RangeAnalysis::ParamsOf(const Function *function) const
+{
+  std::vector<Range> params;
+  auto found = m_Params.find(function);
+  if (m_Closed.contains(function))
+  {
+    // no call site seen yet, the parameters are unreached
+    return found == m_Params.end() ? std::vector<Range>(function->m_Params.size()) : found->second;
+  }
+  for (auto ty : function->m_Params)
+  {
+    params.push_back(IsInt(ty) ? Bounds(ty) : Range());
+  }
+  return params;
+}
+
+std::unordered_map<const Instr *, Range> RangeAnalysis::Evaluate(const Function *function, const std::vector<Range> &params, Range &ret, unsigned depth) const
+{
+  std::unordered_map<const Instr *, Range> ranges;
+  std::unordered_set<const Instr *> pinned;
+  for (size_t sweep = 0;; ++sweep)
+  {
+    bool changed = false;
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        if (!IsInt(instr->m_Ty))
+        {
+          continue;
+        }
+        auto range = pinned.contains(instr) ? Bounds(instr->m_Ty) : Transfer(instr, params, ranges, depth);
+        if (range == RangeOf(ranges, instr))
+        {
+          continue;
+        }
+        if (Op::Phi == instr->m_Op && sweep >= MAX_SWEEPS)
+        {
+          pinned.insert(instr);
+          range = Bounds(instr->m_Ty);
+        }
+        ranges[instr] = range;
+        changed = true;
+      }
+    }
+    if (!changed)
+    {
+      break;
+    }
+  }
+  ret = Range();
+  for (auto block : function->m_Blocks)
+  {
+    auto term = block->Terminator();
+    if (term && Op::Ret == term->m_Op && term->m_ArgsCount > 0)
+    {
+      ret = ret.Join(RangeOf(ranges, term->Arg(0)));
+    }
+  }
+  return ranges;
+}
+
+Range RangeAnalysis::Transfer(const Instr *instr, const std::vector<Range> &params, const std::unordered_map<const Instr *, Range> &ranges, unsigned depth) const
+{
+  auto bounds = Bounds(instr->m_Ty);
+  switch (instr->m_Op)
+  {
+  case Op::Const:
+  {
+    auto value = IsSigned(instr->m_Ty) ? static_cast<Wide>(static_cast<int64_t>(instr->m_Imm)) : static_cast<Wide>(instr->m_Imm);
+    return Range(value, value);
+  }
+  case Op::Param:
+    return instr->m_Imm < params.size() ? params[instr->m_Imm] : bounds;
+  case Op::Copy:
+    return RangeOf(ranges, instr->Arg(0));
+  case Op::Cast:
+  {
+    auto source = RangeOf(ranges, instr->Arg(0));
+    return IsInt(instr->Arg(0)->m_Ty) && source.Within(bounds) ? source : bounds;
+  }
+  case Op::Phi:
+  {
+    Range range;
+    for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+    {
+      range = range.Join(RangeOf(ranges, instr->Arg(i)));
+    }
+    return range;
+  }
+  case Op::Add:
+  case Op::Sub:
+  case Op::Mul:
+  case Op::Div:
+  {
+    auto exact = Exact(instr->m_Op, RangeOf(ranges, instr->Arg(0)), RangeOf(ranges, instr->Arg(1)));
+    if (exact.Within(bounds))
+    {
+      return exact;
+    }
+    // a checked result out of bounds traps instead of wrapping
+    return instr->m_Checks & CHECK_OVERFLOW ? exact.Meet(bounds) : bounds;
+  }
+  case Op::Call:
+    return CallRange(instr, ranges, depth);
+  default:
+    return bounds;
+  }
+}
+
+Range RangeAnalysis::CallRange(const Instr *call, const std::unordered_map<const Instr *, Range> &ranges, unsigned depth) const
+{
+  auto callee = call->m_Callee;
+  if (callee->IsExtern() || m_GaveUp)
+  {
+    return Bounds(call->m_Ty);
+  }
+  if (depth < MAX_CALL_DEPTH && callee->Size() <= SMALL_CALLEE)
+  {
+    std::vector<Range> args;
+    for (size_t i = 0; i < callee->m_Params.size(); ++i)
+    {
+      args.push_back(i < call->m_ArgsCount && IsInt(callee->m_Params[i]) ? RangeOf(ranges, call->Arg(i)) : Range());
+    }
+    Range ret;
+    Evaluate(callee, args, ret, depth + 1);
+    return ret;
+  }
+  auto found = m_Returns.find(callee);
+  return found == m_Returns.end() ? Range() : found->second;
+}
+
+bool RangeProp::Run(Program &program)
+{
+  RangeAnalysis analysis(program);
+  analysis.Solve();
+  bool changed = false;
+  for (auto function : program.m_Functions)
+  {
+    if (function->IsExtern())
+    {
+      continue;
+    }
+    Range ret;
+    auto ranges = analysis.Evaluate(function, analysis.ParamsOf(function), ret, 0);
+    for (auto block : function->m_Blocks)
+    {
+      for (auto instr : block->m_Instrs)
+      {
+        if (!IsArith(instr->m_Op) || 0 == instr->m_Checks)
+        {
+          continue;
+        }
+        auto lhs = RangeOf(ranges, instr->Arg(0));
+        auto rhs = RangeOf(ranges, instr->Arg(1));
+        // unreached
+        if (lhs.IsEmpty() || rhs.IsEmpty())
+        {
+          continue;
+        }
+        auto name = std::format("{}.{}", OpName(instr->m_Op), TyName(instr->m_Ty));
+        auto exact = Exact(instr->m_Op, lhs, rhs);
+        if ((instr->m_Checks & CHECK_OVERFLOW) && !exact.IsEmpty() && exact.Within(Bounds(instr->m_Ty)))
+        {
+          instr->m_Checks &= static_cast<uint8_t>(~CHECK_OVERFLOW);
+          m_Remarks.push_back(Remark(Name(), instr->Origin(function)->m_ModID, instr->m_Pos, instr->Origin(function)->m_Name, std::format("removed overflow check of '{}', result in [{}, {}]", name, WideString(exact.m_Lo), WideString(exact.m_Hi))));
+          changed = true;
+        }
+        if ((instr->m_Checks & CHECK_ZERO) && !rhs.Contains(0))
+        {
+          instr->m_Checks &= static_cast<uint8_t>(~CHECK_ZERO);
+          m_Remarks.push_back(Remark(Name(), instr->Origin(function)->m_ModID, instr->m_Pos, instr->Origin(function)->m_Name, std::format("removed division by zero check of '{}', divisor in [{}, {}]", name, WideString(rhs.m_Lo), WideString(rhs.m_Hi))));
+          changed = true;
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+/*
+  PassManager
+*/
+PassManager PassManager::ForLevel(unsigned level)
+{
+  PassManager manager;
+  auto cleanup = [&]()
+  {
+    manager.m_Passes.push_back(std::make_unique<CopyProp>());
+    manager.m_Passes.push_back(std::make_unique<ConstFold>());
+    manager.m_Passes.push_back(std::make_unique<CopyProp>());
+    manager.m_Passes.push_back(std::make_unique<DCE>());
+    manager.m_Passes.push_back(std::make_unique<SimplifyCFG>());
+  };
+  if (0 == level)
+  {
+    return manager;
+  }
+  manager.m_Passes.push_back(std::make_unique<SimplifyCFG>());
+  cleanup();
+  // folding turns calls through known addresses into direct calls, a second round inlines those
+  size_t rounds = level >= 2 ? 2 : 1;
+  for (size_t i = 0; i < rounds; ++i)
+  {
+    manager.m_Passes.push_back(std::make_unique<Inline>(level >= 2 ? 40 : 8));
+    manager.m_Passes.push_back(std::make_unique<SimplifyCFG>());
+    cleanup();
+  }
+  // checks dropped by the range pass make their instructions pure, DCE takes the unused ones
+  manager.m_Passes.push_back(std::make_unique<RangeProp>());
+  manager.m_Passes.push_back(std::make_unique<DCE>());
+  return manager;
+}
+
+bool PassManager::IsPassName(const std::string &name)
+{
+  auto passes = ForLevel(2);
+  return std::any_of(passes.m_Passes.begin(), passes.m_Passes.end(), [&](const std::unique_ptr<Pass> &pass)
+                     { return pass->Name() == name; });
+}
+
+void PassManager::Run(Program &program, std::ostream &out)
+{
+  for (auto &pass : m_Passes)
+  {
+    auto start = std::chrono::steady_clock::now();
+    bool changed = pass->Run(program);
+    m_Timings.push_back(PassTiming(pass->Name(), std::chrono::steady_clock::now() - start, changed));
+    if (m_PrintAfter == pass->Name())
+    {
+      out << "; IR after " << pass->Name() << (changed ? "" : " (unchanged)") << "\n"
+          << program.Dump() << "\n";
+    }
+  }
+  for (auto function : program.m_Functions)
+  {
+    function->Renumber();
+  }
+}
+
+void PassManager::ReportTimings(std::ostream &out) const
+{
+  std::chrono::nanoseconds total(0);
+  out << std::format("{:<16}{:>12}  {}\n", "pass", "time (ms)", "changed");
+  for (auto &timing : m_Timings)
+  {
+    total += timing.m_Elapsed;
+    out << std::format("{:<16}{:>12.3f}  {}\n", timing.m_Name, static_cast<double>(timing.m_Elapsed.count()) / 1e6, timing.m_Changed ? "yes" : "no");
+  }
+  out << std::format("{:<16}{:>12.3f}\n", "total", static_cast<double>(total.count()) / 1e6);
+}
+
+std::vector<Remark> PassManager::Remarks() const
+{
+  std::vector<Remark> remarks;
+  for (auto &pass : m_Passes)
+  {
+    remarks.insert(remarks.end(), pass->m_Remarks.begin(), pass->m_Remarks.end());
+  }
+  return remarks;
+}
+} // namespace ir
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+namespace ir
+{
+// an optimization a pass applied, reported with --remarks
+class Remark
+{
+public:
+  std::string m_Pass;
+  ModuleID m_ModID;
+  Position m_Pos;
+  std::string m_Function;
+  std::string m_Message;
+
+  Remark(std::string pass, ModuleID modID, Position pos, std::string function, std::string message) : m_Pass(pass), m_ModID(modID), m_Pos(pos), m_Function(function), m_Message(message) {};
+};
+
+class Pass
+{
+public:
+  std::vector<Remark> m_Remarks;
+
+  Pass() : m_Remarks() {};
+  virtual ~Pass() = default;
+
+  virtual std::string Name() const = 0;
+  // true if the program changed
+  virtual bool Run(Program &program) = 0;
+};
+
+// drops blocks unreachable from the entry and merges straight-line block chains
+class SimplifyCFG : public Pass
+{
+public:
+  std::string Name() const override { return "simplify-cfg"; }
+  bool Run(Program &program) override;
+
+private:
+  bool RemoveUnreachable(Function *function);
+  bool MergeBlocks(Function *function);
+};
+
+// forwards the operand of copies and of phis whose operands are all the same
+class CopyProp : public Pass
+{
+public:
+  std::string Name() const override { return "copy-prop"; }
+  bool Run(Program &program) override;
+};
+
+// evaluates instructions on constants and turns calls through known function addresses into direct calls
+class ConstFold : public Pass
+{
+public:
+  std::string Name() const override { return "const-fold"; }
+  bool Run(Program &program) override;
+};
+
+// removes side effect free instructions whose value is never used
+class DCE : public Pass
+{
+public:
+  std::string Name() const override { return "dce"; }
+  bool Run(Program &program) override;
+};
+
+// inlines direct calls to small non recursive functions, one level per run
+class Inline : public Pass
+{
+public:
+  size_t m_Threshold; // max callee size in instructions
+
+  Inline(size_t threshold) : m_Threshold(threshold) {};
+
+  std::string Name() const override { return "inline"; }
+  bool Run(Program &program) override;
+
+private:
+  void InlineCall(Program &program, Function *caller, Block *block, size_t index);
+};
+
+// bounds integer values by intervals followed through arithmetic, casts, phis and calls,
+// and drops the overflow and division by zero checks that can never trigger
+class RangeProp : public Pass
+{
+public:
+  std::string Name() const override { return "range-prop"; }
+  bool Run(Program &program) override;
+};
+
+class PassTiming
+{
+public:
+  std::string m_Name;
+  std::chrono::nanoseconds m_Elapsed;
+  bool m_Changed;
+
+  PassTiming(std::string name, std::chrono::nanoseconds elapsed, bool changed) : m_Name(name), m_Elapsed(elapsed), m_Changed(changed) {};
+};
+
+class PassManager
+{
+public:
+  std::vector<std::unique_ptr<Pass>> m_Passes;
+  // name of the pass after which the IR gets printed, empty for none
+  std::string m_PrintAfter;
+  std::vector<PassTiming> m_Timings;
+
+  PassManager() : m_Passes(), m_PrintAfter(), m_Timings() {};
+
+  // standard pipeline for -O0, -O1 and -O2
+  static PassManager ForLevel(unsigned level);
+  static bool IsPassName(const std::string &name);
+
+  void Run(Program &program, std::ostream &out);
+  void ReportTimings(std::ostream &out) const;
+  // remarks of every pass in pipeline order
+  std::vector<Remark> Remarks() const;
+};
+} // namespace ir
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <utility>
 
 template <typename T>
 using Ptr = std::shared_ptr<T>;
@@ -8,7 +9,7 @@ using Ptr = std::shared_ptr<T>;
 template <typename T>
 inline Ptr<T> MakePtr(T x)
 {
-  return std::make_shared<T>(x);
+  return std::make_shared<T>(std::move(x));
 }
 
 template <typename To, typename From>
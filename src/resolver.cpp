@@ -0,0 +1,154 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "resolver.h"
+#include "result.h"
+
+Result<SourceStamp, Error> SourceStamp::Of(std::string path)
+{
+  std::error_code errorCode;
+  auto size = std::filesystem::file_size(path, errorCode);
+  if (errorCode)
+  {
+    return Error(Errno::FS_ERROR, errorCode.message());
+  }
+  auto mtime = std::filesystem::last_write_time(path, errorCode);
+  if (errorCode)
+  {
+    return Error(Errno::FS_ERROR, errorCode.message());
+  }
+  return SourceStamp(path, size, static_cast<int64_t>(mtime.time_since_epoch().count()));
+}
+
+Resolver::Resolver() : m_Roots(), m_Home(), m_Mutex(), m_Dirs(), m_Canonical(), m_Stamps(), m_Resolved(), m_Names()
+{
+  auto home = std::getenv("ZEROLANG_HOME");
+  if (home && *home)
+  {
+    m_Home = home;
+  }
+}
+
+Result<std::string, Error> Resolver::Resolve(bool hasAtNotation, const std::vector<std::string> &segments)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+  std::string relative;
+  for (auto &segment : segments)
+  {
+    relative += relative.empty() ? segment : "/" + segment;
+  }
+  relative += ".zr";
+  auto key = hasAtNotation ? "@" + relative : relative;
+  if (auto found = m_Resolved.find(key); found != m_Resolved.end())
+  {
+    return found->second;
+  }
+
+  std::vector<std::string> roots;
+  if (hasAtNotation)
+  {
+    if (!m_Home.empty())
+    {
+      roots.push_back(m_Home);
+    }
+  }
+  else
+  {
+    roots = m_Roots;
+  }
+  roots.push_back(".");
+  for (auto &root : roots)
+  {
+    auto path = (std::filesystem::path(root) / relative).lexically_normal().string();
+    if (Exists(path))
+    {
+      m_Resolved.emplace(key, path);
+      // the least, so the name does not depend on which import a thread got to first
+      auto &name = m_Names[Canonical(path)];
+      if (name.empty() || key < name)
+      {
+        name = key;
+      }
+      return path;
+    }
+  }
+  return Error(Errno::FS_ERROR, "module '" + relative + "' not found in any search root");
+}
+
+bool Resolver::Exists(const std::string &path)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+  std::filesystem::path fsPath(path);
+  auto parent = fsPath.parent_path().string();
+  auto &index = IndexOf(parent.empty() ? "." : parent);
+  return index.count(fsPath.filename().string()) > 0;
+}
+
+std::string Resolver::Canonical(const std::string &path)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+  if (auto found = m_Canonical.find(path); found != m_Canonical.end())
+  {
+    return found->second;
+  }
+  std::error_code errorCode;
+  auto canonical = std::filesystem::weakly_canonical(path, errorCode);
+  auto result = errorCode ? std::filesystem::path(path).lexically_normal().string() : canonical.string();
+  m_Canonical.emplace(path, result);
+  return result;
+}
+
+std::string Resolver::ImportName(const std::string &path)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+  auto found = m_Names.find(Canonical(path));
+  return found == m_Names.end() ? "" : found->second;
+}
+
+Result<SourceStamp, Error> Resolver::Stamp(const std::string &path)
+{
+  std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+  if (auto found = m_Stamps.find(path); found != m_Stamps.end())
+  {
+    return found->second;
+  }
+  return m_Stamps.emplace(path, SourceStamp::Of(path)).first->second;
+}
+
+bool Resolver::IsFresh(const SourceStamp &stamp)
+{
+  auto current = Stamp(stamp.m_Path);
+  return current.is_ok() && current.unwrap().m_Size == stamp.m_Size && current.unwrap().m_MTime == stamp.m_MTime;
+}
+
+void Resolver::Forget()
+{
+  std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+  m_Dirs.clear();
+  m_Canonical.clear();
+  m_Stamps.clear();
+  m_Resolved.clear();
+  m_Names.clear();
+}
+
+const std::unordered_set<std::string> &Resolver::IndexOf(const std::string &dir)
+{
+  auto key = std::filesystem::path(dir).lexically_normal().string();
+  if (auto found = m_Dirs.find(key); found != m_Dirs.end())
+  {
+    return found->second;
+  }
+  // a missing or unreadable directory just gets an empty index
+  std::unordered_set<std::string> index;
+  std::error_code errorCode;
+  for (auto it = std::filesystem::directory_iterator(key, errorCode); !errorCode && it != std::filesystem::directory_iterator(); it.increment(errorCode))
+  {
+    index.insert(it->path().filename().string());
+  }
+  return m_Dirs.emplace(key, std::move(index)).first->second;
+}
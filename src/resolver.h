@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "error.h"
+#include "result.h"
+
+/*
+  Identifies a version of a source file on disk by its size and mtime, cheap to
+  obtain with a single `stat`
+*/
+class SourceStamp
+{
+public:
+  std::string m_Path;
+  uint64_t m_Size;
+  int64_t m_MTime;
+
+  SourceStamp() : m_Path(), m_Size(0), m_MTime(0) {};
+  SourceStamp(std::string path, uint64_t size, int64_t mtime) : m_Path(path), m_Size(size), m_MTime(mtime) {};
+
+  static Result<SourceStamp, Error> Of(std::string path);
+};
+
+/*
+  Maps import paths to source files. Directory listings, canonical paths and
+  stamps are cached for the whole run, so once a directory has been listed
+  resolving imports from it costs no syscalls. Safe to share between threads
+*/
+class Resolver
+{
+public:
+  // searched in order for plain imports, the working directory comes last
+  std::vector<std::string> m_Roots;
+  // searched for `@` imports before the working directory, from ZEROLANG_HOME
+  std::string m_Home;
+
+  Resolver();
+
+  // `a::b` resolves to `<root>/a/b.zr` of the first root holding it
+  Result<std::string, Error> Resolve(bool hasAtNotation, const std::vector<std::string> &segments);
+  bool Exists(const std::string &path);
+  std::string Canonical(const std::string &path);
+  // Import path a file was resolved from, eg. `@std/io.zr` for one found in ZEROLANG_HOME.
+  // The least of them when several lead to the file, empty if none did
+  std::string ImportName(const std::string &path);
+  Result<SourceStamp, Error> Stamp(const std::string &path);
+  bool IsFresh(const SourceStamp &stamp);
+  // drops every cached listing, path and stamp, for processes outliving a single run
+  void Forget();
+
+private:
+  // public methods call each other
+  std::recursive_mutex m_Mutex;
+  // directory → names of the entries it holds, listed on first use
+  std::unordered_map<std::string, std::unordered_set<std::string>> m_Dirs;
+  std::unordered_map<std::string, std::string> m_Canonical;
+  std::unordered_map<std::string, Result<SourceStamp, Error>> m_Stamps;
+  std::unordered_map<std::string, std::string> m_Resolved;
+  // canonical path → least import path resolved to it
+  std::unordered_map<std::string, std::string> m_Names;
+
+  const std::unordered_set<std::string> &IndexOf(const std::string &dir);
+};
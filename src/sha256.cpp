@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "sha256.h"
+
+static constexpr uint32_t ROUNDS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+Sha256::Sha256() : m_State{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}, m_Block(), m_BlockSize(0), m_Length(0) {};
+
+void Sha256::Compress(const uint8_t *block)
+{
+  uint32_t w[64];
+  for (size_t i = 0; i < 16; ++i)
+  {
+    w[i] = static_cast<uint32_t>(block[i * 4]) << 24 | static_cast<uint32_t>(block[i * 4 + 1]) << 16 | static_cast<uint32_t>(block[i * 4 + 2]) << 8 | block[i * 4 + 3];
+  }
+  for (size_t i = 16; i < 64; ++i)
+  {
+    uint32_t s0 = std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  auto [a, b, c, d, e, f, g, h] = m_State;
+  for (size_t i = 0; i < 64; ++i)
+  {
+    uint32_t t1 = h + (std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25)) + ((e & f) ^ (~e & g)) + ROUNDS[i] + w[i];
+    uint32_t t2 = (std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  m_State[0] += a;
+  m_State[1] += b;
+  m_State[2] += c;
+  m_State[3] += d;
+  m_State[4] += e;
+  m_State[5] += f;
+  m_State[6] += g;
+  m_State[7] += h;
+}
+
+void Sha256::Update(const void *data, size_t size)
+{
+  auto bytes = static_cast<const uint8_t *>(data);
+  m_Length += size;
+  if (m_BlockSize > 0)
+  {
+    size_t taken = std::min(size, m_Block.size() - m_BlockSize);
+    std::memcpy(m_Block.data() + m_BlockSize, bytes, taken);
+    m_BlockSize += taken;
+    bytes += taken;
+    size -= taken;
+    if (m_BlockSize < m_Block.size())
+    {
+      return;
+    }
+    Compress(m_Block.data());
+    m_BlockSize = 0;
+  }
+  for (; size >= m_Block.size(); bytes += m_Block.size(), size -= m_Block.size())
+  {
+    Compress(bytes);
+  }
+  std::memcpy(m_Block.data(), bytes, size);
+  m_BlockSize = size;
+}
+
+void Sha256::Field(const std::string &str)
+{
+  uint8_t size[8];
+  for (size_t i = 0; i < 8; ++i)
+  {
+    size[i] = static_cast<uint8_t>(static_cast<uint64_t>(str.size()) >> (i * 8));
+  }
+  Update(size, sizeof(size));
+  Update(str);
+}
+
+std::string Sha256::Hex()
+{
+  uint64_t bits = m_Length * 8;
+  uint8_t padding[72] = {0x80};
+  // the length goes in the last 8 bytes of a block
+  size_t padSize = (m_BlockSize < 56 ? 56 : 120) - m_BlockSize;
+  for (size_t i = 0; i < 8; ++i)
+  {
+    padding[padSize + i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+  }
+  Update(padding, padSize + 8);
+  static constexpr char DIGITS[] = "0123456789abcdef";
+  std::string hex;
+  for (auto word : m_State)
+  {
+    for (int shift = 28; shift >= 0; shift -= 4)
+    {
+      hex.push_back(DIGITS[(word >> shift) & 0xf]);
+    }
+  }
+  return hex;
+}
+
+std::string Sha256::Of(const std::string &str)
+{
+  Sha256 hash;
+  hash.Update(str);
+  return hash.Hex();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+  SHA-256 (FIPS 180-4), the digest build cache entries are named by. Fed in any
+  number of pieces, a piece is no different from the same bytes fed at once
+*/
+class Sha256
+{
+public:
+  Sha256();
+
+  void Update(const void *data, size_t size);
+  void Update(const std::string &str) { Update(str.data(), str.size()); }
+  // length prefixed, so consecutive fields cannot be confused with one another
+  void Field(const std::string &str);
+  // lowercase hexadecimal digest, the hash takes no more input after it
+  std::string Hex();
+
+  static std::string Of(const std::string &str);
+
+private:
+  std::array<uint32_t, 8> m_State;
+  std::array<uint8_t, 64> m_Block;
+  size_t m_BlockSize;
+  uint64_t m_Length;
+
+  void Compress(const uint8_t *block);
+};
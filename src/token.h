@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <utility>
 
 enum class TokenType
 {
@@ -77,7 +78,7 @@ public:
   std::string m_Lexeme;
 
   Token() = default;
-  Token(Position position, TokenType type, std::string lexeme) : m_Position(position), m_Type(type), m_Lexeme(lexeme) {};
+  Token(Position position, TokenType type, std::string lexeme) : m_Position(position), m_Type(type), m_Lexeme(std::move(lexeme)) {};
 
   std::string Inspect();
 };
@@ -1,13 +1,49 @@
+#include <cassert>
 #include <cstddef>
 #include <cstdio>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "pointer.h"
 #include "type.h"
 
 namespace type
 {
+Ptr<Type> Type::Get(Base base)
+{
+  static const auto primitives = []()
+  {
+    std::vector<Ptr<Type>> types;
+    for (size_t i = 0; i <= static_cast<size_t>(Base::UNKNOWN); ++i)
+    {
+      types.push_back(MakePtr(Type(static_cast<Base>(i))));
+    }
+    return types;
+  }();
+  assert(Base::FUNCTION != base && Base::OBJECT != base && Base::IntRange != base);
+  return primitives.at(static_cast<size_t>(base));
+}
+
+Ptr<Type> IntRange::Get(bool sign, unsigned long byteSize)
+{
+  static const auto ranges = []()
+  {
+    std::vector<Ptr<Type>> types;
+    for (unsigned long bytes = 0; bytes <= 8; ++bytes)
+    {
+      types.push_back(MakePtr(IntRange(false, bytes)));
+      types.push_back(MakePtr(IntRange(true, bytes)));
+    }
+    return types;
+  }();
+  if (byteSize > 8)
+  {
+    return MakePtr(IntRange(sign, byteSize));
+  }
+  return ranges.at(byteSize * 2 + (sign ? 1 : 0));
+}
+
 std::string Type::Inspect() const
 {
   switch (m_Base)
@@ -138,26 +174,26 @@ Ptr<Type> IntRange::GetDefault() const
 {
   if (m_BytesCout <= 4)
   {
-    return MakePtr(Type(Base::I32));
+    return Type::Get(Base::I32);
   }
-  return MakePtr(Type(Base::I64));
+  return Type::Get(Base::I64);
 }
 
 Ptr<Type> IntRange::GetSynthesized() const
 {
   if (m_BytesCout <= 1)
   {
-    return MakePtr(Type(Base::I8));
+    return Type::Get(Base::I8);
   }
   if (m_BytesCout <= 2)
   {
-    return MakePtr(Type(Base::I16));
+    return Type::Get(Base::I16);
   }
   if (m_BytesCout <= 4)
   {
-    return MakePtr(Type(Base::I32));
+    return Type::Get(Base::I32);
   }
-  return MakePtr(Type(Base::I64));
+  return Type::Get(Base::I64);
 }
 
 static inline unsigned long integerToSizeInBytes(Base base)
@@ -233,7 +269,7 @@ bool Function::IsCompatWith(Ptr<Type> other) const
   {
     return false;
   }
-  if (!m_RetType->IsCompatWith(otherFn))
+  if (!m_RetType->IsCompatWith(otherFn->m_RetType))
   {
     return false;
   }
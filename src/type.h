@@ -38,6 +38,9 @@ public:
   Type(Base base) : m_Base(base) {}
   virtual ~Type() = default;
 
+  // shared instance of a non composite type, no allocation
+  static Ptr<Type> Get(Base base);
+
   virtual std::string Inspect() const;
   virtual bool IsCompatWith(Ptr<Type>) const;
 
@@ -60,6 +63,8 @@ public:
 
   IntRange(bool sign, unsigned long byteSize) : Type(Base::IntRange), m_IsSigned(sign), m_BytesCout(byteSize) {}
 
+  static Ptr<Type> Get(bool sign, unsigned long byteSize);
+
   std::string Inspect() const override;
   Ptr<Type> GetDefault() const;
   Ptr<Type> GetSynthesized() const;
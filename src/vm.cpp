@@ -0,0 +1,937 @@
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.h"
+#include "jit.h"
+#include "vm.h"
+
+namespace vm
+{
+static void AppendValue(std::string &out, Value value, ir::Ty ty)
+{
+  switch (ty)
+  {
+  case ir::Ty::Void:
+    break;
+  case ir::Ty::Str:
+    if (value.s)
+    {
+      out.append(value.s->m_Ptr, value.s->m_Len);
+    }
+    break;
+  case ir::Ty::F64:
+    out += std::format("{}", value.f);
+    break;
+  case ir::Ty::Fn:
+    out += value.u ? "<fun>" : "<null fun>";
+    break;
+  default:
+    out += ir::IsSigned(ty) ? std::to_string(value.i) : std::to_string(value.u);
+    break;
+  }
+}
+
+// a leading string argument is a format, each `{}` in it takes the next argument
+static void NativePrintln(VM &vm, const Value *regs, const uint32_t *args, uint32_t argc)
+{
+  auto &out = vm.m_Out;
+  uint32_t next = 0;
+  if (argc > 0 && ir::Ty::Str == static_cast<ir::Ty>(args[1]))
+  {
+    auto format = regs[args[0]].s;
+    auto size = format ? format->m_Len : 0;
+    next = 1;
+    for (size_t i = 0; i < size; ++i)
+    {
+      if ('{' == format->m_Ptr[i] && i + 1 < size && '}' == format->m_Ptr[i + 1] && next < argc)
+      {
+        AppendValue(out, regs[args[next * 2]], static_cast<ir::Ty>(args[next * 2 + 1]));
+        next++;
+        i++;
+        continue;
+      }
+      out += format->m_Ptr[i];
+    }
+  }
+  for (; next < argc; ++next)
+  {
+    if (next > 0)
+    {
+      out += ' ';
+    }
+    AppendValue(out, regs[args[next * 2]], static_cast<ir::Ty>(args[next * 2 + 1]));
+  }
+  out += '\n';
+  if (out.size() >= 1 << 16)
+  {
+    vm.Flush();
+  }
+}
+
+// what println calls with a literal format lower to, one per value
+static void NativeWrite(VM &vm, const Value *regs, const uint32_t *args, uint32_t)
+{
+  AppendValue(vm.m_Out, regs[args[0]], static_cast<ir::Ty>(args[1]));
+  if (vm.m_Out.size() >= 1 << 16)
+  {
+    vm.Flush();
+  }
+}
+
+size_t OpLength(const uint32_t *pc)
+{
+  switch (static_cast<Opcode>(pc[0]))
+  {
+  case Opcode::RetVoid:
+    return 1;
+  case Opcode::Ret:
+  case Opcode::Jmp:
+  case Opcode::Trap:
+    return 2;
+  case Opcode::LoadK:
+  case Opcode::Mov:
+  case Opcode::LoadG:
+  case Opcode::StoreG:
+    return 3;
+  case Opcode::SExt:
+  case Opcode::ZExt:
+  case Opcode::Add:
+  case Opcode::Sub:
+  case Opcode::Mul:
+  case Opcode::FAdd:
+  case Opcode::FSub:
+  case Opcode::FMul:
+  case Opcode::FDiv:
+    return 4;
+  case Opcode::DivU:
+    return 5;
+  case Opcode::AddS:
+  case Opcode::AddU:
+  case Opcode::SubS:
+  case Opcode::SubU:
+  case Opcode::MulS:
+  case Opcode::MulU:
+    return 6;
+  case Opcode::DivS:
+    return 7;
+  case Opcode::Call:
+    return 4 + size_t(pc[3]);
+  case Opcode::CallNative:
+  case Opcode::CallInd:
+    return 4 + 2 * size_t(pc[3]);
+  }
+  return 1;
+}
+
+// the arithmetic that may trap, shared by the interpreter and the JIT slow path.
+// Yields NO_REG once the result is stored, the trap to raise otherwise
+template <Opcode OP>
+static inline uint32_t Arith(Value *regs, const uint32_t *pc)
+{
+  auto a = regs[pc[2]];
+  auto b = regs[pc[3]];
+  auto shift = pc[4];
+  Value result = {.u = 0};
+  if constexpr (Opcode::DivU == OP)
+  {
+    if (0 == b.u)
+    {
+      return pc[4];
+    }
+    regs[pc[1]].u = a.u / b.u;
+    return NO_REG;
+  }
+  else if constexpr (Opcode::DivS == OP)
+  {
+    if (0 == b.i)
+    {
+      return pc[5];
+    }
+    if (-1 == b.i && a.i == static_cast<int64_t>(uint64_t(1) << 63) >> shift)
+    {
+      if (NO_REG != pc[6])
+      {
+        return pc[6];
+      }
+      regs[pc[1]] = a;
+      return NO_REG;
+    }
+    regs[pc[1]].i = a.i / b.i;
+    return NO_REG;
+  }
+  else
+  {
+    bool overflow = false;
+    if constexpr (Opcode::AddS == OP)
+    {
+      overflow = __builtin_add_overflow(a.i, b.i, &result.i);
+    }
+    else if constexpr (Opcode::SubS == OP)
+    {
+      overflow = __builtin_sub_overflow(a.i, b.i, &result.i);
+    }
+    else if constexpr (Opcode::MulS == OP)
+    {
+      overflow = __builtin_mul_overflow(a.i, b.i, &result.i);
+    }
+    else if constexpr (Opcode::AddU == OP)
+    {
+      overflow = __builtin_add_overflow(a.u, b.u, &result.u);
+    }
+    else if constexpr (Opcode::SubU == OP)
+    {
+      overflow = __builtin_sub_overflow(a.u, b.u, &result.u);
+    }
+    else
+    {
+      overflow = __builtin_mul_overflow(a.u, b.u, &result.u);
+    }
+    if constexpr (Opcode::AddS == OP || Opcode::SubS == OP || Opcode::MulS == OP)
+    {
+      overflow = overflow || static_cast<int64_t>(result.u << shift) >> shift != result.i;
+    }
+    else
+    {
+      overflow = overflow || (result.u << shift) >> shift != result.u;
+    }
+    if (overflow)
+    {
+      return pc[5];
+    }
+    regs[pc[1]] = result;
+    return NO_REG;
+  }
+}
+
+static const std::unordered_map<std::string, NativeFn> NATIVES = {
+    {"println", NativePrintln},
+    {"zr_write_str", NativeWrite},
+    {"zr_write_i64", NativeWrite},
+    {"zr_write_u64", NativeWrite},
+    {"zr_write_f64", NativeWrite},
+    {"zr_write_fn", NativeWrite},
+};
+
+/*
+  Compiler
+*/
+class Compiler
+{
+public:
+  Compiler(const ir::Program &program, const ModuleManager &modManager) : m_IRProgram(program), m_ModManager(modManager), m_Program(std::make_shared<Program>()), m_Functions(), m_Globals() {};
+
+  Ptr<Program> Compile();
+
+private:
+  const ir::Program &m_IRProgram;
+  const ModuleManager &m_ModManager;
+  Ptr<Program> m_Program;
+  std::unordered_map<const ir::Function *, uint32_t> m_Functions;
+  std::unordered_map<const ir::Global *, uint32_t> m_Globals;
+
+  void CompileFunction(const ir::Function *irFunction, Function &function);
+  uint32_t Const(Function &function, Value value);
+};
+
+static uint32_t Reg(const ir::Function *function, const ir::Instr *instr)
+{
+  if (ir::Op::Param == instr->m_Op)
+  {
+    return static_cast<uint32_t>(instr->m_Imm);
+  }
+  return static_cast<uint32_t>(function->m_Params.size()) + instr->m_ID;
+}
+
+Ptr<Program> Program::Compile(const ir::Program &program, const ModuleManager &modManager)
+{
+  return Compiler(program, modManager).Compile();
+}
+
+Ptr<Program> Compiler::Compile()
+{
+  // literals are referenced by address, neither the pool nor the views may move after this
+  auto pool = ir::StringPool::Build(m_IRProgram.m_Strings);
+  m_Program->m_Pool = std::move(pool.m_Bytes);
+  for (size_t i = 0; i < m_IRProgram.m_Strings.size(); ++i)
+  {
+    m_Program->m_Strings.push_back({m_Program->m_Pool.data() + pool.m_Offsets.at(i), m_IRProgram.m_Strings.at(i).size()});
+  }
+  m_Program->m_GlobalsCount = m_IRProgram.m_Globals.size();
+  for (size_t i = 0; i < m_IRProgram.m_Globals.size(); ++i)
+  {
+    m_Globals[m_IRProgram.m_Globals.at(i)] = static_cast<uint32_t>(i);
+  }
+  m_Program->m_Functions.reserve(m_IRProgram.m_Functions.size());
+  for (auto irFunction : m_IRProgram.m_Functions)
+  {
+    m_Functions[irFunction] = static_cast<uint32_t>(m_Program->m_Functions.size());
+    auto &function = m_Program->m_Functions.emplace_back(irFunction->m_Name, static_cast<uint32_t>(irFunction->m_Params.size()), irFunction->m_RetTy);
+    if (irFunction->IsExtern())
+    {
+      function.m_IsExtern = true;
+      function.m_Native = NATIVES.count(irFunction->m_Symbol) ? NATIVES.at(irFunction->m_Symbol) : nullptr;
+    }
+  }
+  for (auto irFunction : m_IRProgram.m_Functions)
+  {
+    if (!irFunction->IsExtern())
+    {
+      CompileFunction(irFunction, m_Program->m_Functions.at(m_Functions.at(irFunction)));
+    }
+  }
+  for (auto init : m_IRProgram.m_Inits)
+  {
+    m_Program->m_Inits.push_back(m_Functions.at(init));
+  }
+  if (m_IRProgram.m_Main)
+  {
+    m_Program->m_Main = m_Functions.at(m_IRProgram.m_Main);
+  }
+  return m_Program;
+}
+
+uint32_t Compiler::Const(Function &function, Value value)
+{
+  function.m_Consts.push_back(value);
+  return static_cast<uint32_t>(function.m_Consts.size() - 1);
+}
+
+void Compiler::CompileFunction(const ir::Function *irFunction, Function &function)
+{
+  auto &code = function.m_Code;
+  auto emit = [&](Opcode opcode, std::initializer_list<uint32_t> operands)
+  {
+    code.push_back(static_cast<uint32_t>(opcode));
+    code.insert(code.end(), operands);
+  };
+  auto dstOf = [&](const ir::Instr *instr)
+  { return ir::Ty::Void == instr->m_Ty ? NO_REG : Reg(irFunction, instr); };
+  auto trapAt = [&](const ir::Instr *instr, const char *what)
+  {
+    m_Program->m_Traps.push_back(ir::TrapMessage(m_ModManager, irFunction, instr, what));
+    return static_cast<uint32_t>(m_Program->m_Traps.size() - 1);
+  };
+
+  // phi moves go through scratch registers placed after the values so they behave as a parallel copy
+  uint32_t scratch = static_cast<uint32_t>(irFunction->m_Params.size()) + irFunction->m_ValuesCount;
+  function.m_RegsCount = scratch;
+  std::unordered_map<const ir::Block *, size_t> starts;
+  std::vector<std::pair<size_t, const ir::Block *>> fixups;
+  auto &blocks = irFunction->m_Blocks;
+  for (size_t b = 0; b < blocks.size(); ++b)
+  {
+    auto block = blocks.at(b);
+    starts[block] = code.size();
+    for (auto instr : block->m_Instrs)
+    {
+      switch (instr->m_Op)
+      {
+      case ir::Op::Param:
+      case ir::Op::Phi:
+        break;
+      case ir::Op::Const:
+      {
+        Value value = {.u = instr->m_Imm};
+        if (ir::Ty::F64 == instr->m_Ty)
+        {
+          value.f = instr->m_Float;
+        }
+        else if (ir::Ty::Str == instr->m_Ty)
+        {
+          value.s = &m_Program->m_Strings.at(instr->m_Imm);
+        }
+        emit(Opcode::LoadK, {Reg(irFunction, instr), Const(function, value)});
+        break;
+      }
+      case ir::Op::FuncRef:
+        emit(Opcode::LoadK, {Reg(irFunction, instr), Const(function, {.u = m_Functions.at(instr->m_Callee) + uint64_t(1)})});
+        break;
+      case ir::Op::Copy:
+        emit(Opcode::Mov, {Reg(irFunction, instr), Reg(irFunction, instr->Arg(0))});
+        break;
+      case ir::Op::Cast:
+      {
+        auto shift = 64 - ir::BitWidth(instr->m_Ty);
+        if (0 == shift)
+        {
+          emit(Opcode::Mov, {Reg(irFunction, instr), Reg(irFunction, instr->Arg(0))});
+          break;
+        }
+        emit(ir::IsSigned(instr->m_Ty) ? Opcode::SExt : Opcode::ZExt, {Reg(irFunction, instr), Reg(irFunction, instr->Arg(0)), shift});
+        break;
+      }
+      case ir::Op::Load:
+        emit(Opcode::LoadG, {Reg(irFunction, instr), m_Globals.at(instr->m_Global)});
+        break;
+      case ir::Op::Store:
+        emit(Opcode::StoreG, {m_Globals.at(instr->m_Global), Reg(irFunction, instr->Arg(0))});
+        break;
+      case ir::Op::Call:
+      {
+        auto argc = instr->m_ArgsCount;
+        if (instr->m_Callee->IsExtern())
+        {
+          emit(Opcode::CallNative, {dstOf(instr), m_Functions.at(instr->m_Callee), argc});
+          for (uint32_t i = 0; i < argc; ++i)
+          {
+            code.push_back(Reg(irFunction, instr->Arg(i)));
+            code.push_back(static_cast<uint32_t>(instr->Arg(i)->m_Ty));
+          }
+          break;
+        }
+        emit(Opcode::Call, {dstOf(instr), m_Functions.at(instr->m_Callee), argc});
+        for (uint32_t i = 0; i < argc; ++i)
+        {
+          code.push_back(Reg(irFunction, instr->Arg(i)));
+        }
+        break;
+      }
+      case ir::Op::CallIndirect:
+      {
+        auto argc = instr->m_ArgsCount - 1;
+        emit(Opcode::CallInd, {dstOf(instr), Reg(irFunction, instr->Arg(0)), argc});
+        for (uint32_t i = 1; i <= argc; ++i)
+        {
+          code.push_back(Reg(irFunction, instr->Arg(i)));
+          code.push_back(static_cast<uint32_t>(instr->Arg(i)->m_Ty));
+        }
+        break;
+      }
+      case ir::Op::Ret:
+        if (instr->m_ArgsCount)
+        {
+          emit(Opcode::Ret, {Reg(irFunction, instr->Arg(0))});
+        }
+        else
+        {
+          emit(Opcode::RetVoid, {});
+        }
+        break;
+      case ir::Op::Jmp:
+      {
+        std::vector<std::pair<uint32_t, uint32_t>> moves;
+        for (auto phi : instr->m_Target->m_Instrs)
+        {
+          if (ir::Op::Phi != phi->m_Op)
+          {
+            break;
+          }
+          for (uint32_t i = 0; i < phi->m_ArgsCount; ++i)
+          {
+            if (phi->m_Incoming[i] == block)
+            {
+              moves.push_back({Reg(irFunction, phi), Reg(irFunction, phi->Arg(i))});
+            }
+          }
+        }
+        if (1 == moves.size())
+        {
+          emit(Opcode::Mov, {moves.front().first, moves.front().second});
+        }
+        else if (moves.size() > 1)
+        {
+          function.m_RegsCount = std::max(function.m_RegsCount, scratch + static_cast<uint32_t>(moves.size()));
+          for (uint32_t i = 0; i < moves.size(); ++i)
+          {
+            emit(Opcode::Mov, {scratch + i, moves.at(i).second});
+          }
+          for (uint32_t i = 0; i < moves.size(); ++i)
+          {
+            emit(Opcode::Mov, {moves.at(i).first, scratch + i});
+          }
+        }
+        // falls through to the next block
+        if (b + 1 < blocks.size() && blocks.at(b + 1) == instr->m_Target)
+        {
+          break;
+        }
+        emit(Opcode::Jmp, {0});
+        fixups.push_back({code.size() - 1, instr->m_Target});
+        break;
+      }
+      case ir::Op::Add:
+      case ir::Op::Sub:
+      case ir::Op::Mul:
+      case ir::Op::Div:
+      {
+        auto dst = Reg(irFunction, instr);
+        auto lhs = Reg(irFunction, instr->Arg(0));
+        auto rhs = Reg(irFunction, instr->Arg(1));
+        auto op = static_cast<size_t>(instr->m_Op) - static_cast<size_t>(ir::Op::Add);
+        if (ir::Ty::F64 == instr->m_Ty)
+        {
+          static const Opcode floats[] = {Opcode::FAdd, Opcode::FSub, Opcode::FMul, Opcode::FDiv};
+          emit(floats[op], {dst, lhs, rhs});
+          break;
+        }
+        auto shift = 64 - ir::BitWidth(instr->m_Ty);
+        bool isSigned = ir::IsSigned(instr->m_Ty);
+        bool isChecked = instr->m_Checks & ir::CHECK_OVERFLOW;
+        if (ir::Op::Div == instr->m_Op)
+        {
+          auto zero = trapAt(instr, "division by zero");
+          if (isSigned)
+          {
+            emit(Opcode::DivS, {dst, lhs, rhs, shift, zero, isChecked ? trapAt(instr, "integer overflow") : NO_REG});
+          }
+          else
+          {
+            emit(Opcode::DivU, {dst, lhs, rhs, zero});
+          }
+          break;
+        }
+        if (isChecked)
+        {
+          static const Opcode checked[][2] = {{Opcode::AddU, Opcode::AddS}, {Opcode::SubU, Opcode::SubS}, {Opcode::MulU, Opcode::MulS}};
+          emit(checked[op][isSigned], {dst, lhs, rhs, shift, trapAt(instr, "integer overflow")});
+          break;
+        }
+        static const Opcode wrapping[] = {Opcode::Add, Opcode::Sub, Opcode::Mul};
+        emit(wrapping[op], {dst, lhs, rhs});
+        if (0 != shift)
+        {
+          emit(isSigned ? Opcode::SExt : Opcode::ZExt, {dst, dst, shift});
+        }
+        break;
+      }
+      case ir::Op::Unreachable:
+        emit(Opcode::Trap, {trapAt(instr, "reached unreachable code")});
+        break;
+      }
+    }
+  }
+  for (auto &[at, target] : fixups)
+  {
+    code.at(at) = static_cast<uint32_t>(starts.at(target));
+  }
+}
+
+/*
+  VM
+*/
+// machine code and the interpreter recurse natively when they call each other
+constexpr size_t MAX_DEPTH = 4096;
+
+VM::VM(const Program &program, size_t stackSize) : m_Out(), m_JitThreshold(Jit::IsSupported() ? 1000 : 0), m_Program(program), m_Stack(new Value[stackSize]), m_StackSize(stackSize), m_Globals(program.m_GlobalsCount, Value{.u = 0}), m_Frames(), m_Jit(std::make_unique<Jit>()), m_Calls(program.m_Functions.size(), 0), m_Compiled(program.m_Functions.size(), nullptr), m_Error(), m_Depth(0)
+{
+  m_Frames.reserve(256);
+}
+
+VM::~VM()
+{
+  Flush();
+}
+
+void VM::Flush()
+{
+  if (!m_Out.empty())
+  {
+    std::fwrite(m_Out.data(), 1, m_Out.size(), stdout);
+    std::fflush(stdout);
+    m_Out.clear();
+  }
+}
+
+Result<int, Error> VM::Run()
+{
+  for (auto init : m_Program.m_Inits)
+  {
+    auto result = Invoke(init, m_Stack.get());
+    if (result.is_err())
+    {
+      Flush();
+      return result.unwrap_err();
+    }
+  }
+  int exitCode = 0;
+  if (m_Program.m_Main >= 0)
+  {
+    auto main = static_cast<uint32_t>(m_Program.m_Main);
+    auto result = Invoke(main, m_Stack.get());
+    if (result.is_err())
+    {
+      Flush();
+      return result.unwrap_err();
+    }
+    if (ir::IsInt(m_Program.m_Functions.at(main).m_RetTy))
+    {
+      exitCode = static_cast<int>(result.unwrap().i);
+    }
+  }
+  Flush();
+  return exitCode;
+}
+
+JitFn VM::TierUp(uint32_t function)
+{
+  if (m_Calls[function] < m_JitThreshold && ++m_Calls[function] == m_JitThreshold)
+  {
+    // stays null if the target has no JIT, the function is then interpreted for good
+    m_Compiled[function] = m_Jit->Compile(m_Program.m_Functions[function], m_Globals.data(), JitHelper);
+  }
+  return m_Compiled[function];
+}
+
+Result<Value, Error> VM::Invoke(uint32_t function, Value *regs)
+{
+  auto &callee = m_Program.m_Functions[function];
+  if (m_Depth >= MAX_DEPTH || regs + callee.m_RegsCount > m_Stack.get() + m_StackSize)
+  {
+    return Error(Errno::RUNTIME_ERROR, std::format("stack overflow in '{}'", callee.m_Name));
+  }
+  m_Depth++;
+  auto code = m_Compiled[function];
+  if (!code)
+  {
+    auto result = Execute(function, regs);
+    m_Depth--;
+    return result;
+  }
+  Value value = {.u = 0};
+  auto status = code(regs, this, &value);
+  m_Depth--;
+  if (0 != status)
+  {
+    auto error = std::move(m_Error.value());
+    m_Error.reset();
+    return error;
+  }
+  return value;
+}
+
+int VM::JitHelper(VM *vm, Value *regs, const uint32_t *pc, const Function *function)
+{
+  auto opcode = static_cast<Opcode>(pc[0]);
+  auto trap = NO_REG;
+  switch (opcode)
+  {
+  case Opcode::Trap:
+    trap = pc[1];
+    break;
+  case Opcode::AddS:
+    trap = Arith<Opcode::AddS>(regs, pc);
+    break;
+  case Opcode::AddU:
+    trap = Arith<Opcode::AddU>(regs, pc);
+    break;
+  case Opcode::SubS:
+    trap = Arith<Opcode::SubS>(regs, pc);
+    break;
+  case Opcode::SubU:
+    trap = Arith<Opcode::SubU>(regs, pc);
+    break;
+  case Opcode::MulS:
+    trap = Arith<Opcode::MulS>(regs, pc);
+    break;
+  case Opcode::MulU:
+    trap = Arith<Opcode::MulU>(regs, pc);
+    break;
+  case Opcode::DivS:
+    trap = Arith<Opcode::DivS>(regs, pc);
+    break;
+  case Opcode::DivU:
+    trap = Arith<Opcode::DivU>(regs, pc);
+    break;
+  default:
+    goto call;
+  }
+  if (NO_REG == trap)
+  {
+    return 0;
+  }
+  vm->m_Error = Error(Errno::RUNTIME_ERROR, vm->m_Program.m_Traps[trap]);
+  return 1;
+call:
+  auto index = pc[2];
+  if (Opcode::CallInd == opcode)
+  {
+    if (0 == regs[pc[2]].u)
+    {
+      vm->m_Error = Error(Errno::RUNTIME_ERROR, std::format("call of a null function in '{}'", function->m_Name));
+      return 1;
+    }
+    index = static_cast<uint32_t>(regs[pc[2]].u - 1);
+  }
+  auto &callee = vm->m_Program.m_Functions[index];
+  auto argc = pc[3];
+  if (callee.m_IsExtern)
+  {
+    if (!callee.m_Native)
+    {
+      vm->m_Error = Error(Errno::RUNTIME_ERROR, std::format("no native implementation of '{}'", callee.m_Name));
+      return 1;
+    }
+    callee.m_Native(*vm, regs, pc + 4, argc);
+    if (NO_REG != pc[1])
+    {
+      regs[pc[1]].u = 0;
+    }
+    return 0;
+  }
+  // direct calls list registers, the others (register, type) pairs
+  uint32_t stride = Opcode::Call == opcode ? 1 : 2;
+  auto calleeRegs = regs + function->m_RegsCount;
+  if (calleeRegs + callee.m_RegsCount <= vm->m_Stack.get() + vm->m_StackSize)
+  {
+    for (uint32_t i = 0; i < argc; ++i)
+    {
+      calleeRegs[i] = regs[pc[4 + stride * i]];
+    }
+  }
+  vm->TierUp(index);
+  auto result = vm->Invoke(index, calleeRegs);
+  if (result.is_err())
+  {
+    vm->m_Error = result.unwrap_err();
+    return 1;
+  }
+  if (NO_REG != pc[1])
+  {
+    regs[pc[1]] = result.unwrap();
+  }
+  return 0;
+}
+
+#if defined(__GNUC__)
+#define VM_THREADED
+// labels as values are a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+#ifdef VM_THREADED
+#define DISPATCH() goto *labels[*pc]
+#define CASE(name) L_##name:
+#else
+#define DISPATCH() goto dispatch
+#define CASE(name) case Opcode::name:
+#endif
+// unwinds the frames pushed by this Execute before reporting
+#define FAIL(...)                                                       \
+  do                                                                    \
+  {                                                                     \
+    m_Frames.resize(floor);                                             \
+    return Error(Errno::RUNTIME_ERROR, std::format(__VA_ARGS__));       \
+  } while (0)
+#define BINARY(name, field, expr) \
+  CASE(name)                      \
+  {                               \
+    auto a = regs[pc[2]].field;   \
+    auto b = regs[pc[3]].field;   \
+    regs[pc[1]].field = (expr);   \
+    pc += 4;                      \
+    DISPATCH();                   \
+  }
+#define ARITH(name, length)              \
+  CASE(name)                             \
+  {                                      \
+    trap = Arith<Opcode::name>(regs, pc); \
+    if (NO_REG != trap)                  \
+    {                                    \
+      goto raise;                        \
+    }                                    \
+    pc += length;                        \
+    DISPATCH();                          \
+  }
+
+Result<Value, Error> VM::Execute(uint32_t index, Value *regs)
+{
+#ifdef VM_THREADED
+  // same order as Opcode
+  static const void *labels[] = {&&L_LoadK, &&L_Mov, &&L_SExt, &&L_ZExt, &&L_LoadG, &&L_StoreG, &&L_Call, &&L_CallNative, &&L_CallInd, &&L_Ret, &&L_RetVoid, &&L_Jmp, &&L_Add, &&L_Sub, &&L_Mul, &&L_AddS, &&L_AddU, &&L_SubS, &&L_SubU, &&L_MulS, &&L_MulU, &&L_DivS, &&L_DivU, &&L_FAdd, &&L_FSub, &&L_FMul, &&L_FDiv, &&L_Trap};
+  static_assert(sizeof(labels) / sizeof(labels[0]) == static_cast<size_t>(Opcode::Trap) + 1);
+#endif
+  const auto functions = m_Program.m_Functions.data();
+  const Function *function = &functions[index];
+  const uint32_t *pc = function->m_Code.data();
+  Value *const stackEnd = m_Stack.get() + m_StackSize;
+  const size_t floor = m_Frames.size();
+  Value result = {.u = 0};
+  const Function *callee = nullptr;
+  Value *calleeRegs = nullptr;
+  uint32_t argc = 0;
+  uint32_t stride = 1;
+  uint32_t trap = NO_REG;
+  DISPATCH();
+
+#ifndef VM_THREADED
+dispatch:
+  switch (static_cast<Opcode>(*pc))
+  {
+#endif
+  CASE(LoadK)
+  {
+    regs[pc[1]] = function->m_Consts[pc[2]];
+    pc += 3;
+    DISPATCH();
+  }
+  CASE(Mov)
+  {
+    regs[pc[1]] = regs[pc[2]];
+    pc += 3;
+    DISPATCH();
+  }
+  CASE(SExt)
+  {
+    regs[pc[1]].i = static_cast<int64_t>(regs[pc[2]].u << pc[3]) >> pc[3];
+    pc += 4;
+    DISPATCH();
+  }
+  CASE(ZExt)
+  {
+    regs[pc[1]].u = (regs[pc[2]].u << pc[3]) >> pc[3];
+    pc += 4;
+    DISPATCH();
+  }
+  CASE(LoadG)
+  {
+    regs[pc[1]] = m_Globals[pc[2]];
+    pc += 3;
+    DISPATCH();
+  }
+  CASE(StoreG)
+  {
+    m_Globals[pc[1]] = regs[pc[2]];
+    pc += 3;
+    DISPATCH();
+  }
+  CASE(Call)
+  {
+    index = pc[2];
+    callee = &functions[index];
+    argc = pc[3];
+    stride = 1;
+  call:
+    calleeRegs = regs + function->m_RegsCount;
+    if (calleeRegs + callee->m_RegsCount > stackEnd)
+    {
+      FAIL("stack overflow in '{}'", callee->m_Name);
+    }
+    for (uint32_t i = 0; i < argc; ++i)
+    {
+      calleeRegs[i] = regs[pc[4 + stride * i]];
+    }
+    if (TierUp(index))
+    {
+      auto value = Invoke(index, calleeRegs);
+      if (value.is_err())
+      {
+        m_Frames.resize(floor);
+        return value.unwrap_err();
+      }
+      if (NO_REG != pc[1])
+      {
+        regs[pc[1]] = value.unwrap();
+      }
+      pc += 4 + stride * argc;
+      DISPATCH();
+    }
+    m_Frames.push_back(Frame{function, pc + 4 + stride * argc, regs, pc[1]});
+    function = callee;
+    regs = calleeRegs;
+    pc = function->m_Code.data();
+    DISPATCH();
+  }
+  CASE(CallNative)
+  {
+    callee = &functions[pc[2]];
+    argc = pc[3];
+  native:
+    if (!callee->m_Native)
+    {
+      FAIL("no native implementation of '{}'", callee->m_Name);
+    }
+    callee->m_Native(*this, regs, pc + 4, argc);
+    if (NO_REG != pc[1])
+    {
+      regs[pc[1]].u = 0;
+    }
+    pc += 4 + 2 * argc;
+    DISPATCH();
+  }
+  CASE(CallInd)
+  {
+    if (0 == regs[pc[2]].u)
+    {
+      FAIL("call of a null function in '{}'", function->m_Name);
+    }
+    index = static_cast<uint32_t>(regs[pc[2]].u - 1);
+    callee = &functions[index];
+    argc = pc[3];
+    if (callee->m_IsExtern)
+    {
+      goto native;
+    }
+    stride = 2;
+    goto call;
+  }
+  CASE(Ret)
+  {
+    result = regs[pc[1]];
+    goto ret;
+  }
+  CASE(RetVoid)
+  {
+    result.u = 0;
+  ret:
+    if (m_Frames.size() == floor)
+    {
+      return result;
+    }
+    function = m_Frames.back().m_Function;
+    pc = m_Frames.back().m_PC;
+    regs = m_Frames.back().m_Regs;
+    if (NO_REG != m_Frames.back().m_Dst)
+    {
+      regs[m_Frames.back().m_Dst] = result;
+    }
+    m_Frames.pop_back();
+    DISPATCH();
+  }
+  CASE(Jmp)
+  {
+    pc = function->m_Code.data() + pc[1];
+    DISPATCH();
+  }
+  BINARY(Add, u, a + b)
+  BINARY(Sub, u, a - b)
+  BINARY(Mul, u, a * b)
+  ARITH(AddS, 6)
+  ARITH(AddU, 6)
+  ARITH(SubS, 6)
+  ARITH(SubU, 6)
+  ARITH(MulS, 6)
+  ARITH(MulU, 6)
+  ARITH(DivS, 7)
+  ARITH(DivU, 5)
+  BINARY(FAdd, f, a + b)
+  BINARY(FSub, f, a - b)
+  BINARY(FMul, f, a * b)
+  BINARY(FDiv, f, a / b)
+  CASE(Trap)
+  {
+    trap = pc[1];
+  raise:
+    m_Frames.resize(floor);
+    return Error(Errno::RUNTIME_ERROR, m_Program.m_Traps[trap]);
+  }
+#ifndef VM_THREADED
+  }
+  FAIL("invalid opcode {}", *pc);
+#endif
+}
+
+#undef FAIL
+#undef BINARY
+#undef ARITH
+#undef DISPATCH
+#undef CASE
+#ifdef VM_THREADED
+#pragma GCC diagnostic pop
+#endif
+} // namespace vm
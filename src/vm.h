@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "ir.h"
+#include "module.h"
+#include "pointer.h"
+#include "result.h"
+
+/*
+  Register based bytecode. Every function gets a frame of registers, params
+  first, and its code is a stream of 32 bit words: an opcode followed by its
+  operands. Phis are lowered to moves on the incoming edges
+*/
+namespace vm
+{
+enum class Opcode : uint32_t
+{
+  LoadK,      // dst, const
+  Mov,        // dst, src
+  SExt,       // dst, src, shift: truncate to 64 - shift bits and sign extend
+  ZExt,       // dst, src, shift: truncate to 64 - shift bits and zero extend
+  LoadG,      // dst, global
+  StoreG,     // global, src
+  Call,       // dst, function, argc, args...
+  CallNative, // dst, native, argc, (arg, ty)...
+  CallInd,    // dst, register holding a function, argc, (arg, ty)...
+  Ret,        // src
+  RetVoid,    //
+  Jmp,        // target
+  // integers wrap at 64 bits, narrower results are extended again by the next instruction
+  Add,  // dst, a, b
+  Sub,  // dst, a, b
+  Mul,  // dst, a, b
+  AddS, // dst, a, b, shift, trap: checked at 64 - shift bits, signed
+  AddU, // dst, a, b, shift, trap: checked at 64 - shift bits, unsigned
+  SubS, // dst, a, b, shift, trap
+  SubU, // dst, a, b, shift, trap
+  MulS, // dst, a, b, shift, trap
+  MulU, // dst, a, b, shift, trap
+  DivS, // dst, a, b, shift, zero trap, overflow trap: MIN / -1 wraps when the latter is NO_REG
+  DivU, // dst, a, b, zero trap
+  FAdd, // dst, a, b
+  FSub, // dst, a, b
+  FMul, // dst, a, b
+  FDiv, // dst, a, b
+  Trap, // message
+};
+
+constexpr uint32_t NO_REG = UINT32_MAX;
+
+// number of words taken by the instruction at `pc`, operands included
+size_t OpLength(const uint32_t *pc);
+
+// string literal, a view into the pool of the program
+struct Str
+{
+  const char *m_Ptr;
+  uint64_t m_Len;
+};
+
+union Value
+{
+  int64_t i;
+  uint64_t u;
+  double f;
+  const Str *s; // null reads as the empty string
+};
+
+class VM;
+class Jit;
+
+// `args` holds (register, ir::Ty) pairs
+using NativeFn = void (*)(VM &vm, const Value *regs, const uint32_t *args, uint32_t argc);
+// machine code of a function, returns non zero when it failed, the error is in the VM
+using JitFn = int (*)(Value *regs, VM *vm, Value *result);
+
+class Function
+{
+public:
+  std::string m_Name;
+  uint32_t m_ParamsCount;
+  uint32_t m_RegsCount;
+  std::vector<uint32_t> m_Code;
+  std::vector<Value> m_Consts;
+  // external functions run natively, m_Native is null if there is no implementation
+  bool m_IsExtern;
+  NativeFn m_Native;
+  ir::Ty m_RetTy;
+
+  Function(std::string name, uint32_t paramsCount, ir::Ty retTy) : m_Name(name), m_ParamsCount(paramsCount), m_RegsCount(paramsCount), m_Code(), m_Consts(), m_IsExtern(false), m_Native(nullptr), m_RetTy(retTy) {};
+};
+
+class Program
+{
+public:
+  // function values are indexes in here plus one, zero is the null function
+  std::vector<Function> m_Functions;
+  std::string m_Pool;
+  std::vector<Str> m_Strings;
+  std::vector<std::string> m_Traps;
+  size_t m_GlobalsCount;
+  std::vector<uint32_t> m_Inits;
+  int64_t m_Main; // -1 when there is no main
+
+  Program() : m_Functions(), m_Pool(), m_Strings(), m_Traps(), m_GlobalsCount(0), m_Inits(), m_Main(-1) {};
+
+  static Ptr<Program> Compile(const ir::Program &program, const ModuleManager &modManager);
+};
+
+class VM
+{
+public:
+  // output of natives is buffered and flushed on exit
+  std::string m_Out;
+  // calls after which a function gets compiled to machine code, 0 never does
+  uint32_t m_JitThreshold;
+
+  VM(const Program &program, size_t stackSize = 1 << 18);
+  ~VM();
+
+  // runs the module initializers then main, yields the exit code
+  Result<int, Error> Run();
+  void Flush();
+
+private:
+  struct Frame
+  {
+    const Function *m_Function;
+    const uint32_t *m_PC;
+    Value *m_Regs;
+    uint32_t m_Dst;
+  };
+
+  const Program &m_Program;
+  std::unique_ptr<Value[]> m_Stack;
+  size_t m_StackSize;
+  std::vector<Value> m_Globals;
+  std::vector<Frame> m_Frames;
+  std::unique_ptr<Jit> m_Jit;
+  std::vector<uint32_t> m_Calls;
+  std::vector<JitFn> m_Compiled;
+  // set by the JIT helper when machine code fails
+  std::optional<Error> m_Error;
+  // nesting of Invoke, each level is a native stack frame
+  size_t m_Depth;
+
+  // counts a call of `function` and yields its machine code once it is hot
+  JitFn TierUp(uint32_t function);
+  // runs `function` with its frame at `regs`, as machine code when compiled
+  Result<Value, Error> Invoke(uint32_t function, Value *regs);
+  Result<Value, Error> Execute(uint32_t function, Value *regs);
+  static int JitHelper(VM *vm, Value *regs, const uint32_t *pc, const Function *function);
+};
+} // namespace vm
@@ -0,0 +1,117 @@
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <string>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "watch.h"
+
+// editor backups and other files next to the sources must not trigger a check
+static bool IsSource(const std::string &name)
+{
+  return name.ends_with(".zr");
+}
+
+FileWatcher::~FileWatcher()
+{
+  if (m_Fd >= 0)
+  {
+    close(m_Fd);
+  }
+}
+
+bool FileWatcher::Open()
+{
+  m_Fd = inotify_init1(IN_CLOEXEC);
+  return m_Fd >= 0;
+}
+
+void FileWatcher::Watch(const std::string &path)
+{
+  auto absolute = std::filesystem::absolute(path).lexically_normal();
+  if (!m_Files.insert(absolute.string()).second)
+  {
+    return;
+  }
+  auto dir = absolute.parent_path().string();
+  // the same directory yields the same descriptor, watching it again is harmless
+  int wd = inotify_add_watch(m_Fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+  if (wd >= 0)
+  {
+    m_Dirs[wd] = dir;
+  }
+}
+
+bool FileWatcher::Drain(bool &changed)
+{
+  alignas(inotify_event) char buffer[8192];
+  ssize_t size = read(m_Fd, buffer, sizeof(buffer));
+  if (size < 0)
+  {
+    return EINTR == errno || EAGAIN == errno;
+  }
+  for (ssize_t offset = 0; offset < size;)
+  {
+    auto event = reinterpret_cast<const inotify_event *>(buffer + offset);
+    offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+      changed = true;
+      continue;
+    }
+    if (event->mask & IN_IGNORED)
+    {
+      m_Dirs.erase(event->wd);
+      continue;
+    }
+    auto dir = m_Dirs.find(event->wd);
+    if (dir == m_Dirs.end() || 0 == event->len)
+    {
+      continue;
+    }
+    std::string name(event->name);
+    // a new file may be what a failed import was looking for
+    bool created = event->mask & (IN_CREATE | IN_MOVED_TO);
+    if (m_Files.contains(dir->second + '/' + name) || (created && IsSource(name)))
+    {
+      changed = true;
+    }
+  }
+  return true;
+}
+
+bool FileWatcher::Wait(int settleMs)
+{
+  bool changed = false;
+  pollfd pfd = {m_Fd, POLLIN, 0};
+  while (!changed)
+  {
+    if (poll(&pfd, 1, -1) < 0 && EINTR != errno)
+    {
+      return false;
+    }
+    if ((pfd.revents & POLLIN) && !Drain(changed))
+    {
+      return false;
+    }
+  }
+  // saving a file is often several events, and saving all of them several files
+  for (;;)
+  {
+    int ready = poll(&pfd, 1, settleMs);
+    if (ready < 0 && EINTR != errno)
+    {
+      return false;
+    }
+    if (ready <= 0)
+    {
+      return true;
+    }
+    if (!Drain(changed))
+    {
+      return false;
+    }
+  }
+}
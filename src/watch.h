@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/*
+  Waits on inotify for watched files to change. Their directories get watched rather
+  than the files themselves, editors often save by renaming a new file over the old one
+*/
+class FileWatcher
+{
+public:
+  FileWatcher() : m_Fd(-1), m_Dirs(), m_Files() {};
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+  // false when inotify can't be set up
+  bool Open();
+  // `path` from now on, along with the files watched already
+  void Watch(const std::string &path);
+  size_t Size() const { return m_Files.size(); }
+
+  // Blocks until a watched file changed or a source file appeared next to one, then
+  // until nothing changed for `settleMs`. Yields false when reading the events failed
+  bool Wait(int settleMs);
+
+private:
+  int m_Fd;
+  // watch descriptor to directory
+  std::unordered_map<int, std::string> m_Dirs;
+  // absolute paths
+  std::unordered_set<std::string> m_Files;
+
+  // false on error, `changed` set when an event concerns the checked sources
+  bool Drain(bool &changed);
+};
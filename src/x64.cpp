@@ -0,0 +1,1062 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <elf.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ir.h"
+#include "object.h"
+#include "x64.h"
+
+enum Reg : uint8_t
+{
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+};
+
+static const Reg ARG_REGS[] = {RDI, RSI, RDX, RCX, R8, R9};
+// rax is the scratch register, argument registers are never allocated so calls need no shuffling
+static const Reg CALLEE_SAVED[] = {RBX, R12, R13, R14, R15};
+static const Reg CALLER_SAVED[] = {R10, R11};
+constexpr unsigned XMM_ARGS = 8;
+
+enum ShiftOp : uint8_t
+{
+  SHL = 4,
+  SHR = 5,
+  SAR = 7,
+};
+
+// low nibble of the jcc opcodes
+enum Cond : uint8_t
+{
+  CC_O = 0,
+  CC_NO = 1,
+  CC_C = 2,
+  CC_NC = 3,
+  CC_E = 4,
+  CC_NE = 5,
+};
+
+class Assembler
+{
+public:
+  std::vector<uint8_t> &m_Code;
+
+  Assembler(std::vector<uint8_t> &code) : m_Code(code) {};
+
+  size_t Size() const { return m_Code.size(); }
+  void Byte(uint8_t byte) { m_Code.push_back(byte); }
+  void Imm32(int32_t imm) { Raw(imm); }
+  void Imm64(uint64_t imm) { Raw(imm); }
+  void Patch32(size_t at, int32_t value) { std::memcpy(m_Code.data() + at, &value, sizeof(value)); }
+
+  void Rex(unsigned reg, unsigned rm)
+  {
+    Byte(static_cast<uint8_t>(0x48 | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0)));
+  }
+  void ModRM(unsigned mod, unsigned reg, unsigned rm)
+  {
+    Byte(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+  }
+
+  // mov dst, src
+  void MovRR(Reg dst, Reg src)
+  {
+    if (dst != src)
+    {
+      Rex(src, dst);
+      Byte(0x89);
+      ModRM(3, src, dst);
+    }
+  }
+  // mov dst, [rbp + disp]
+  void MovRM(Reg dst, int32_t disp)
+  {
+    Rex(dst, RBP);
+    Byte(0x8B);
+    ModRM(2, dst, RBP);
+    Imm32(disp);
+  }
+  // mov [rbp + disp], src
+  void MovMR(int32_t disp, Reg src)
+  {
+    Rex(src, RBP);
+    Byte(0x89);
+    ModRM(2, src, RBP);
+    Imm32(disp);
+  }
+  void MovRI(Reg dst, uint64_t imm)
+  {
+    Rex(0, dst);
+    Byte(static_cast<uint8_t>(0xB8 + (dst & 7)));
+    Imm64(imm);
+  }
+  // rip relative forms, they return the offset of the displacement to relocate
+  size_t LeaRip(Reg dst) { return RipOp(0x8D, dst); }
+  size_t LoadRip(Reg dst) { return RipOp(0x8B, dst); }
+  size_t StoreRip(Reg src) { return RipOp(0x89, src); }
+  void Push(Reg reg)
+  {
+    if (reg & 8)
+    {
+      Byte(0x41);
+    }
+    Byte(static_cast<uint8_t>(0x50 + (reg & 7)));
+  }
+  void Pop(Reg reg)
+  {
+    if (reg & 8)
+    {
+      Byte(0x41);
+    }
+    Byte(static_cast<uint8_t>(0x58 + (reg & 7)));
+  }
+  // shift a register, rax by default, by an immediate
+  void Shift(ShiftOp op, uint8_t amount, Reg reg = RAX)
+  {
+    Rex(0, reg);
+    Byte(0xC1);
+    ModRM(3, op, reg);
+    Byte(amount);
+  }
+  // operand size prefix of a `bits` wide instruction, byte forms only use al and cl
+  void Width(unsigned bits, unsigned reg, unsigned rm)
+  {
+    if (16 == bits)
+    {
+      Byte(0x66);
+    }
+    else if (64 == bits)
+    {
+      Rex(reg, rm);
+    }
+  }
+  // add (0x01), sub (0x29), cmp (0x39) or test (0x85) dst, src at `bits` wide
+  void AluRR(uint8_t opcode, unsigned bits, Reg dst, Reg src)
+  {
+    Width(bits, src, dst);
+    Byte(8 == bits ? static_cast<uint8_t>(opcode - 1) : opcode);
+    ModRM(3, src, dst);
+  }
+  // imul dst, src; the byte form only exists as al = al * src
+  void ImulRR(unsigned bits, Reg dst, Reg src)
+  {
+    if (8 == bits)
+    {
+      Byte(0xF6);
+      ModRM(3, 5, src);
+      return;
+    }
+    Width(bits, dst, src);
+    Byte(0x0F);
+    Byte(0xAF);
+    ModRM(3, dst, src);
+  }
+  // unsigned group 3 op of rax by src: mul (4), div (6) or idiv (7), the high half goes to rdx
+  void Group3(unsigned ext, unsigned bits, Reg src)
+  {
+    Width(bits, 0, src);
+    Byte(8 == bits ? 0xF6 : 0xF7);
+    ModRM(3, ext, src);
+  }
+  void NegRax()
+  {
+    Rex(0, RAX);
+    Byte(0xF7);
+    ModRM(3, 3, RAX);
+  }
+  // cmp reg, imm8 sign extended
+  void CmpRI8(Reg reg, int8_t imm)
+  {
+    Rex(0, reg);
+    Byte(0x83);
+    ModRM(3, 7, reg);
+    Byte(static_cast<uint8_t>(imm));
+  }
+  void Cqo()
+  {
+    Byte(0x48);
+    Byte(0x99);
+  }
+  void XorEdxEdx()
+  {
+    Byte(0x31);
+    Byte(0xD2);
+  }
+  // {add,sub,mul,div}sd dst, src
+  void Sse(uint8_t opcode, unsigned dst, unsigned src)
+  {
+    Byte(0xF2);
+    Byte(0x0F);
+    Byte(opcode);
+    ModRM(3, dst, src);
+  }
+  // short jumps, they return the offset of the displacement to patch
+  size_t Jcc8(Cond cond)
+  {
+    Byte(static_cast<uint8_t>(0x70 | cond));
+    Byte(0);
+    return Size() - 1;
+  }
+  size_t Jmp8()
+  {
+    Byte(0xEB);
+    Byte(0);
+    return Size() - 1;
+  }
+  void Patch8(size_t at) { m_Code.at(at) = static_cast<uint8_t>(Size() - at - 1); }
+  // movq xmm, src
+  void MovqXR(unsigned xmm, Reg src)
+  {
+    Byte(0x66);
+    Rex(xmm, src);
+    Byte(0x0F);
+    Byte(0x6E);
+    ModRM(3, xmm, src);
+  }
+  // movq dst, xmm
+  void MovqRX(Reg dst, unsigned xmm)
+  {
+    Byte(0x66);
+    Rex(xmm, dst);
+    Byte(0x0F);
+    Byte(0x7E);
+    ModRM(3, xmm, dst);
+  }
+  size_t CallRel()
+  {
+    Byte(0xE8);
+    Imm32(0);
+    return Size() - 4;
+  }
+  size_t JmpRel()
+  {
+    Byte(0xE9);
+    Imm32(0);
+    return Size() - 4;
+  }
+  void CallR(Reg reg)
+  {
+    if (reg & 8)
+    {
+      Byte(0x41);
+    }
+    Byte(0xFF);
+    ModRM(3, 2, reg);
+  }
+  void MovEaxImm(uint32_t imm)
+  {
+    Byte(0xB8);
+    Raw(imm);
+  }
+  void XorEaxEax()
+  {
+    Byte(0x31);
+    Byte(0xC0);
+  }
+  void SubRsp(int32_t imm)
+  {
+    Rex(0, RSP);
+    Byte(0x81);
+    ModRM(3, 5, RSP);
+    Imm32(imm);
+  }
+  void AddRsp(int32_t imm)
+  {
+    Rex(0, RSP);
+    Byte(0x81);
+    ModRM(3, 0, RSP);
+    Imm32(imm);
+  }
+  // lea rsp, [rbp + disp]
+  void LeaRspRbp(int32_t disp)
+  {
+    Rex(RSP, RBP);
+    Byte(0x8D);
+    ModRM(2, RSP, RBP);
+    Imm32(disp);
+  }
+  void Ret() { Byte(0xC3); }
+  void Ud2()
+  {
+    Byte(0x0F);
+    Byte(0x0B);
+  }
+  // traps like Unreachable does when `cond` holds
+  void TrapIf(Cond cond)
+  {
+    auto skip = Jcc8(static_cast<Cond>(cond ^ 1));
+    Ud2();
+    Patch8(skip);
+  }
+
+private:
+  template <typename T>
+  void Raw(T value)
+  {
+    auto bytes = reinterpret_cast<const uint8_t *>(&value);
+    m_Code.insert(m_Code.end(), bytes, bytes + sizeof(T));
+  }
+
+  size_t RipOp(uint8_t opcode, Reg reg)
+  {
+    Rex(reg, 0);
+    Byte(opcode);
+    ModRM(0, reg, 5);
+    Imm32(0);
+    return Size() - 4;
+  }
+};
+
+/*
+  Linear scan
+*/
+class Interval
+{
+public:
+  const ir::Instr *m_Value;
+  int m_Start;
+  int m_End;
+  bool m_CrossesCall;
+  int m_Reg;  // -1 when spilled
+  int m_Slot; // spill slot, -1 when in a register
+
+  Interval(const ir::Instr *value, int pos) : m_Value(value), m_Start(pos), m_End(pos), m_CrossesCall(false), m_Reg(-1), m_Slot(-1) {};
+};
+
+class FunctionGen
+{
+public:
+  const ir::Function *m_Function;
+  ElfWriter &m_Elf;
+  Assembler m_Asm;
+  const std::unordered_map<const ir::Function *, size_t> &m_Functions;
+  const std::unordered_map<const ir::Global *, size_t> &m_Globals;
+  const std::vector<uint64_t> &m_Strings;
+
+  FunctionGen(const ir::Function *function, ElfWriter &elf, const std::unordered_map<const ir::Function *, size_t> &functions, const std::unordered_map<const ir::Global *, size_t> &globals, const std::vector<uint64_t> &strings) : m_Function(function), m_Elf(elf), m_Asm(elf.m_Text), m_Functions(functions), m_Globals(globals), m_Strings(strings), m_Pos(), m_BlockStart(), m_BlockEnd(), m_Intervals(), m_Saved(), m_SlotsCount(0), m_BlockOffsets(), m_Jumps() {};
+
+  void Generate();
+
+private:
+  std::unordered_map<const ir::Instr *, int> m_Pos;
+  std::unordered_map<const ir::Block *, int> m_BlockStart;
+  std::unordered_map<const ir::Block *, int> m_BlockEnd;
+  std::unordered_map<const ir::Instr *, Interval> m_Intervals;
+  std::vector<Reg> m_Saved; // callee saved registers in use
+  int m_SlotsCount;
+  std::unordered_map<const ir::Block *, size_t> m_BlockOffsets;
+  std::vector<std::pair<size_t, const ir::Block *>> m_Jumps;
+
+  void BuildIntervals();
+  void Allocate();
+  int32_t SlotDisp(int slot) const;
+  void Load(Reg dst, const ir::Instr *value);
+  void Store(const ir::Instr *value, Reg src);
+  void Reloc(size_t at, size_t symbol, uint32_t type, int64_t addend = 0);
+  void Epilogue();
+  void GenInstr(const ir::Instr *instr);
+  void GenCall(const ir::Instr *instr);
+  void GenArith(const ir::Instr *instr);
+  void GenPhiMoves(const ir::Instr *jmp);
+};
+
+static bool HasValue(const ir::Instr *instr)
+{
+  return ir::Ty::Void != instr->m_Ty;
+}
+
+void FunctionGen::BuildIntervals()
+{
+  // params are defined at 0, instructions at even positions after
+  int pos = 2;
+  for (auto block : m_Function->m_Blocks)
+  {
+    m_BlockStart[block] = pos;
+    for (auto instr : block->m_Instrs)
+    {
+      m_Pos[instr] = ir::Op::Param == instr->m_Op ? 0 : pos;
+      pos += 2;
+    }
+    m_BlockEnd[block] = pos - 2;
+  }
+
+  // liveness, phi operands are used at the end of the incoming block
+  std::unordered_map<const ir::Block *, std::unordered_set<const ir::Instr *>> uses, defs, phiUses, liveIn, liveOut;
+  for (auto block : m_Function->m_Blocks)
+  {
+    for (auto instr : block->m_Instrs)
+    {
+      if (ir::Op::Phi == instr->m_Op)
+      {
+        for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+        {
+          phiUses[instr->m_Incoming[i]].insert(instr->Arg(i));
+        }
+      }
+      else
+      {
+        for (uint32_t i = 0; i < instr->m_ArgsCount; ++i)
+        {
+          if (!defs[block].count(instr->Arg(i)))
+          {
+            uses[block].insert(instr->Arg(i));
+          }
+        }
+      }
+      defs[block].insert(instr);
+    }
+  }
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto it = m_Function->m_Blocks.rbegin(); it != m_Function->m_Blocks.rend(); ++it)
+    {
+      auto block = *it;
+      auto out = phiUses[block];
+      for (auto succ : block->Successors())
+      {
+        for (auto value : liveIn[succ])
+        {
+          out.insert(value);
+        }
+      }
+      auto in = uses[block];
+      for (auto value : out)
+      {
+        if (!defs[block].count(value))
+        {
+          in.insert(value);
+        }
+      }
+      if (out.size() != liveOut[block].size() || in.size() != liveIn[block].size())
+      {
+        liveOut[block] = std::move(out);
+        liveIn[block] = std::move(in);
+        changed = true;
+      }
+    }
+  }
+
+  auto extend = [&](const ir::Instr *value, int at)
+  {
+    auto &interval = m_Intervals.at(value);
+    interval.m_Start = std::min(interval.m_Start, at);
+    interval.m_End = std::max(interval.m_End, at);
+  };
+  std::vector<int> calls;
+  for (auto block : m_Function->m_Blocks)
+  {
+    for (auto instr : block->m_Instrs)
+    {
+      if (HasValue(instr))
+      {
+        m_Intervals.emplace(instr, Interval(instr, ir::Op::Phi == instr->m_Op ? m_BlockStart.at(block) : m_Pos.at(instr)));
+      }
+      if (ir::Op::Call == instr->m_Op || ir::Op::CallIndirect == instr->m_Op)
+      {
+        calls.push_back(m_Pos.at(instr));
+      }
+    }
+  }
+  for (auto block : m_Function->m_Blocks)
+  {
+    for (auto instr : block->m_Instrs)
+    {
+      for (uint32_t i = 0; ir::Op::Phi != instr->m_Op && i < instr->m_ArgsCount; ++i)
+      {
+        extend(instr->Arg(i), m_Pos.at(instr));
+      }
+    }
+    for (auto value : liveIn[block])
+    {
+      extend(value, m_BlockStart.at(block));
+    }
+    for (auto value : liveOut[block])
+    {
+      extend(value, m_BlockEnd.at(block));
+    }
+  }
+  for (auto &[value, interval] : m_Intervals)
+  {
+    interval.m_CrossesCall = std::any_of(calls.begin(), calls.end(), [&](int call)
+                                         { return interval.m_Start < call && call < interval.m_End; });
+  }
+}
+
+void FunctionGen::Allocate()
+{
+  std::vector<Interval *> order;
+  for (auto &[value, interval] : m_Intervals)
+  {
+    order.push_back(&interval);
+  }
+  std::sort(order.begin(), order.end(), [](const Interval *a, const Interval *b)
+            { return a->m_Start != b->m_Start ? a->m_Start < b->m_Start : a->m_Value->m_ID < b->m_Value->m_ID; });
+  std::vector<Interval *> active;
+  std::unordered_set<int> used;
+  auto isFree = [&](Reg reg)
+  {
+    return std::none_of(active.begin(), active.end(), [&](const Interval *other)
+                        { return other->m_Reg == reg; });
+  };
+  for (auto current : order)
+  {
+    std::erase_if(active, [&](const Interval *other)
+                  { return other->m_End < current->m_Start; });
+    int reg = -1;
+    if (!current->m_CrossesCall)
+    {
+      for (auto candidate : CALLER_SAVED)
+      {
+        if (reg < 0 && isFree(candidate))
+        {
+          reg = candidate;
+        }
+      }
+    }
+    for (auto candidate : CALLEE_SAVED)
+    {
+      if (reg < 0 && isFree(candidate))
+      {
+        reg = candidate;
+      }
+    }
+    if (reg < 0)
+    {
+      // spill whichever lives longest, the current interval or one holding a register it can use
+      Interval *victim = current;
+      for (auto other : active)
+      {
+        bool isUsable = !current->m_CrossesCall || std::find(std::begin(CALLEE_SAVED), std::end(CALLEE_SAVED), other->m_Reg) != std::end(CALLEE_SAVED);
+        if (isUsable && other->m_End > victim->m_End)
+        {
+          victim = other;
+        }
+      }
+      if (victim != current)
+      {
+        reg = victim->m_Reg;
+        victim->m_Reg = -1;
+        victim->m_Slot = m_SlotsCount++;
+        std::erase(active, victim);
+      }
+      else
+      {
+        current->m_Slot = m_SlotsCount++;
+        continue;
+      }
+    }
+    current->m_Reg = reg;
+    active.push_back(current);
+    used.insert(reg);
+  }
+  for (auto reg : CALLEE_SAVED)
+  {
+    if (used.count(reg))
+    {
+      m_Saved.push_back(reg);
+    }
+  }
+}
+
+int32_t FunctionGen::SlotDisp(int slot) const
+{
+  return -8 * static_cast<int32_t>(m_Saved.size()) - 8 * (slot + 1);
+}
+
+void FunctionGen::Load(Reg dst, const ir::Instr *value)
+{
+  auto &interval = m_Intervals.at(value);
+  if (interval.m_Reg >= 0)
+  {
+    m_Asm.MovRR(dst, static_cast<Reg>(interval.m_Reg));
+    return;
+  }
+  m_Asm.MovRM(dst, SlotDisp(interval.m_Slot));
+}
+
+void FunctionGen::Store(const ir::Instr *value, Reg src)
+{
+  auto &interval = m_Intervals.at(value);
+  if (interval.m_Reg >= 0)
+  {
+    m_Asm.MovRR(static_cast<Reg>(interval.m_Reg), src);
+    return;
+  }
+  m_Asm.MovMR(SlotDisp(interval.m_Slot), src);
+}
+
+void FunctionGen::Reloc(size_t at, size_t symbol, uint32_t type, int64_t addend)
+{
+  // displacements are relative to the end of the 4 byte field
+  m_Elf.AddReloc(at, symbol, type, addend - 4);
+}
+
+void FunctionGen::Epilogue()
+{
+  m_Asm.LeaRspRbp(-8 * static_cast<int32_t>(m_Saved.size()));
+  for (auto it = m_Saved.rbegin(); it != m_Saved.rend(); ++it)
+  {
+    m_Asm.Pop(*it);
+  }
+  m_Asm.Pop(RBP);
+  m_Asm.Ret();
+}
+
+void FunctionGen::Generate()
+{
+  BuildIntervals();
+  Allocate();
+
+  m_Asm.Push(RBP);
+  m_Asm.MovRR(RBP, RSP);
+  for (auto reg : m_Saved)
+  {
+    m_Asm.Push(reg);
+  }
+  // keep rsp 16 byte aligned at calls
+  auto frame = 8 * (m_Saved.size() + static_cast<size_t>(m_SlotsCount));
+  auto spills = 8 * m_SlotsCount + (frame % 16 ? 8 : 0);
+  if (spills)
+  {
+    m_Asm.SubRsp(spills);
+  }
+
+  // params move from the ABI locations to their homes
+  unsigned gprs = 0, xmms = 0, stack = 0;
+  std::unordered_map<uint64_t, const ir::Instr *> params;
+  for (auto instr : m_Function->Entry()->m_Instrs)
+  {
+    if (ir::Op::Param == instr->m_Op)
+    {
+      params[instr->m_Imm] = instr;
+    }
+  }
+  for (size_t i = 0; i < m_Function->m_Params.size(); ++i)
+  {
+    auto isFloat = ir::Ty::F64 == m_Function->m_Params.at(i);
+    auto param = params.count(i) ? params.at(i) : nullptr;
+    if (isFloat && xmms < XMM_ARGS)
+    {
+      auto xmm = xmms++;
+      if (param)
+      {
+        m_Asm.MovqRX(RAX, xmm);
+        Store(param, RAX);
+      }
+    }
+    else if (!isFloat && gprs < std::size(ARG_REGS))
+    {
+      auto reg = ARG_REGS[gprs++];
+      if (param)
+      {
+        Store(param, reg);
+      }
+    }
+    else
+    {
+      auto disp = static_cast<int32_t>(16 + 8 * stack++);
+      if (param)
+      {
+        m_Asm.MovRM(RAX, disp);
+        Store(param, RAX);
+      }
+    }
+  }
+
+  auto &blocks = m_Function->m_Blocks;
+  for (size_t b = 0; b < blocks.size(); ++b)
+  {
+    auto block = blocks.at(b);
+    m_BlockOffsets[block] = m_Asm.Size();
+    for (auto instr : block->m_Instrs)
+    {
+      if (ir::Op::Jmp == instr->m_Op)
+      {
+        GenPhiMoves(instr);
+        if (b + 1 < blocks.size() && blocks.at(b + 1) == instr->m_Target)
+        {
+          continue;
+        }
+        m_Jumps.push_back({m_Asm.JmpRel(), instr->m_Target});
+        continue;
+      }
+      GenInstr(instr);
+    }
+  }
+  for (auto &[at, target] : m_Jumps)
+  {
+    m_Asm.Patch32(at, static_cast<int32_t>(m_BlockOffsets.at(target)) - static_cast<int32_t>(at + 4));
+  }
+}
+
+void FunctionGen::GenInstr(const ir::Instr *instr)
+{
+  switch (instr->m_Op)
+  {
+  case ir::Op::Param:
+  case ir::Op::Phi:
+  case ir::Op::Jmp:
+    break;
+  case ir::Op::Const:
+    if (ir::Ty::Str == instr->m_Ty)
+    {
+      Reloc(m_Asm.LeaRip(RAX), m_Elf.SectionSymbol(ElfWriter::Section::Rodata), R_X86_64_PC32, static_cast<int64_t>(m_Strings.at(instr->m_Imm)));
+    }
+    else if (ir::Ty::F64 == instr->m_Ty)
+    {
+      uint64_t bits;
+      std::memcpy(&bits, &instr->m_Float, sizeof(bits));
+      m_Asm.MovRI(RAX, bits);
+    }
+    else
+    {
+      m_Asm.MovRI(RAX, instr->m_Imm);
+    }
+    Store(instr, RAX);
+    break;
+  case ir::Op::Copy:
+    Load(RAX, instr->Arg(0));
+    Store(instr, RAX);
+    break;
+  case ir::Op::Cast:
+  {
+    Load(RAX, instr->Arg(0));
+    auto shift = static_cast<uint8_t>(64 - ir::BitWidth(instr->m_Ty));
+    if (shift)
+    {
+      m_Asm.Shift(SHL, shift);
+      m_Asm.Shift(ir::IsSigned(instr->m_Ty) ? SAR : SHR, shift);
+    }
+    Store(instr, RAX);
+    break;
+  }
+  case ir::Op::FuncRef:
+    if (instr->m_Callee->IsExtern())
+    {
+      // undefined functions may live in a shared object, their address comes from the GOT
+      Reloc(m_Asm.LoadRip(RAX), m_Functions.at(instr->m_Callee), R_X86_64_GOTPCREL);
+    }
+    else
+    {
+      Reloc(m_Asm.LeaRip(RAX), m_Functions.at(instr->m_Callee), R_X86_64_PC32);
+    }
+    Store(instr, RAX);
+    break;
+  case ir::Op::Load:
+    Reloc(m_Asm.LoadRip(RAX), m_Globals.at(instr->m_Global), R_X86_64_PC32);
+    Store(instr, RAX);
+    break;
+  case ir::Op::Store:
+    Load(RAX, instr->Arg(0));
+    Reloc(m_Asm.StoreRip(RAX), m_Globals.at(instr->m_Global), R_X86_64_PC32);
+    break;
+  case ir::Op::Call:
+  case ir::Op::CallIndirect:
+    GenCall(instr);
+    break;
+  case ir::Op::Ret:
+    if (instr->m_ArgsCount)
+    {
+      Load(RAX, instr->Arg(0));
+      if (ir::Ty::F64 == instr->Arg(0)->m_Ty)
+      {
+        m_Asm.MovqXR(0, RAX);
+      }
+    }
+    Epilogue();
+    break;
+  case ir::Op::Add:
+  case ir::Op::Sub:
+  case ir::Op::Mul:
+  case ir::Op::Div:
+    GenArith(instr);
+    break;
+  case ir::Op::Unreachable:
+    m_Asm.Ud2();
+    break;
+  }
+}
+
+void FunctionGen::GenArith(const ir::Instr *instr)
+{
+  // rcx and rdx are never allocated, they hold the rhs and the high half of products and quotients
+  Load(RAX, instr->Arg(0));
+  Load(RCX, instr->Arg(1));
+  if (ir::Ty::F64 == instr->m_Ty)
+  {
+    static const uint8_t opcodes[] = {0x58, 0x5C, 0x59, 0x5E};
+    m_Asm.MovqXR(0, RAX);
+    m_Asm.MovqXR(1, RCX);
+    m_Asm.Sse(opcodes[static_cast<size_t>(instr->m_Op) - static_cast<size_t>(ir::Op::Add)], 0, 1);
+    m_Asm.MovqRX(RAX, 0);
+    Store(instr, RAX);
+    return;
+  }
+  auto bits = ir::BitWidth(instr->m_Ty);
+  auto shift = static_cast<uint8_t>(64 - bits);
+  bool isSigned = ir::IsSigned(instr->m_Ty);
+  bool isChecked = instr->m_Checks & ir::CHECK_OVERFLOW;
+  switch (instr->m_Op)
+  {
+  case ir::Op::Add:
+    m_Asm.AluRR(0x01, bits, RAX, RCX);
+    break;
+  case ir::Op::Sub:
+    m_Asm.AluRR(0x29, bits, RAX, RCX);
+    break;
+  case ir::Op::Mul:
+    // both give the same low half, only the flags differ
+    if (isSigned || !isChecked)
+    {
+      m_Asm.ImulRR(bits, RAX, RCX);
+    }
+    else
+    {
+      m_Asm.Group3(4, bits, RCX);
+    }
+    break;
+  default:
+  {
+    // operands are extended to 64 bits already so the division is done there
+    m_Asm.AluRR(0x85, 64, RCX, RCX);
+    m_Asm.TrapIf(CC_E);
+    if (!isSigned)
+    {
+      m_Asm.XorEdxEdx();
+      m_Asm.Group3(6, 64, RCX);
+      Store(instr, RAX);
+      return;
+    }
+    // idiv faults on MIN / -1, dividing by -1 is a negation that wraps instead
+    m_Asm.CmpRI8(RCX, -1);
+    auto divide = m_Asm.Jcc8(CC_NE);
+    m_Asm.NegRax();
+    if (isChecked && !shift)
+    {
+      m_Asm.TrapIf(CC_O);
+    }
+    auto done = m_Asm.Jmp8();
+    m_Asm.Patch8(divide);
+    m_Asm.Cqo();
+    m_Asm.Group3(7, 64, RCX);
+    m_Asm.Patch8(done);
+    if (isChecked && shift)
+    {
+      // -MIN is the only quotient out of range, it does not survive a round trip through the width
+      m_Asm.MovRR(RDX, RAX);
+      m_Asm.Shift(SHL, shift, RDX);
+      m_Asm.Shift(SAR, shift, RDX);
+      m_Asm.AluRR(0x39, 64, RAX, RDX);
+      m_Asm.TrapIf(CC_NE);
+    }
+    isChecked = false;
+    break;
+  }
+  }
+  if (isChecked)
+  {
+    m_Asm.TrapIf(isSigned ? CC_O : CC_C);
+  }
+  if (shift)
+  {
+    m_Asm.Shift(SHL, shift);
+    m_Asm.Shift(isSigned ? SAR : SHR, shift);
+  }
+  Store(instr, RAX);
+}
+
+void FunctionGen::GenCall(const ir::Instr *instr)
+{
+  uint32_t first = ir::Op::CallIndirect == instr->m_Op ? 1 : 0;
+  std::vector<std::pair<const ir::Instr *, int>> regArgs; // register index, negative for xmm
+  std::vector<const ir::Instr *> stackArgs;
+  unsigned gprs = 0, xmms = 0;
+  for (uint32_t i = first; i < instr->m_ArgsCount; ++i)
+  {
+    auto arg = instr->Arg(i);
+    if (ir::Ty::F64 == arg->m_Ty && xmms < XMM_ARGS)
+    {
+      regArgs.push_back({arg, -1 - static_cast<int>(xmms++)});
+    }
+    else if (ir::Ty::F64 != arg->m_Ty && gprs < std::size(ARG_REGS))
+    {
+      regArgs.push_back({arg, static_cast<int>(gprs++)});
+    }
+    else
+    {
+      stackArgs.push_back(arg);
+    }
+  }
+  int32_t pad = stackArgs.size() % 2 ? 8 : 0;
+  if (pad)
+  {
+    m_Asm.SubRsp(pad);
+  }
+  for (auto it = stackArgs.rbegin(); it != stackArgs.rend(); ++it)
+  {
+    Load(RAX, *it);
+    m_Asm.Push(RAX);
+  }
+  for (auto &[arg, index] : regArgs)
+  {
+    if (index < 0)
+    {
+      Load(RAX, arg);
+      m_Asm.MovqXR(static_cast<unsigned>(-1 - index), RAX);
+    }
+    else
+    {
+      Load(ARG_REGS[index], arg);
+    }
+  }
+  if (first)
+  {
+    Load(R11, instr->Arg(0));
+  }
+  // variadic callees read the number of vector registers used from al
+  m_Asm.MovEaxImm(xmms);
+  if (first)
+  {
+    m_Asm.CallR(R11);
+  }
+  else
+  {
+    Reloc(m_Asm.CallRel(), m_Functions.at(instr->m_Callee), R_X86_64_PLT32);
+  }
+  if (!stackArgs.empty() || pad)
+  {
+    m_Asm.AddRsp(static_cast<int32_t>(8 * stackArgs.size()) + pad);
+  }
+  if (!HasValue(instr))
+  {
+    return;
+  }
+  if (ir::Ty::F64 == instr->m_Ty)
+  {
+    m_Asm.MovqRX(RAX, 0);
+  }
+  else if (ir::IsInt(instr->m_Ty) && ir::BitWidth(instr->m_Ty) < 64 && (first || instr->m_Callee->IsExtern()))
+  {
+    // foreign code leaves the upper bits of narrow results undefined
+    auto shift = static_cast<uint8_t>(64 - ir::BitWidth(instr->m_Ty));
+    m_Asm.Shift(SHL, shift);
+    m_Asm.Shift(ir::IsSigned(instr->m_Ty) ? SAR : SHR, shift);
+  }
+  Store(instr, RAX);
+}
+
+void FunctionGen::GenPhiMoves(const ir::Instr *jmp)
+{
+  // through the stack so every source is read before any phi is written
+  std::vector<const ir::Instr *> phis;
+  for (auto phi : jmp->m_Target->m_Instrs)
+  {
+    if (ir::Op::Phi != phi->m_Op)
+    {
+      break;
+    }
+    for (uint32_t i = 0; i < phi->m_ArgsCount; ++i)
+    {
+      if (phi->m_Incoming[i] == jmp->m_Block)
+      {
+        Load(RAX, phi->Arg(i));
+        m_Asm.Push(RAX);
+        phis.push_back(phi);
+      }
+    }
+  }
+  for (auto it = phis.rbegin(); it != phis.rend(); ++it)
+  {
+    m_Asm.Pop(RAX);
+    Store(*it, RAX);
+  }
+}
+
+/*
+  X64Generator
+*/
+std::vector<uint8_t> X64Generator::Generate()
+{
+  auto pool = ir::StringPool::Build(m_Program.m_Strings);
+  m_Elf.m_Rodata.assign(pool.m_Bytes.begin(), pool.m_Bytes.end());
+  m_Strings = std::move(pool.m_Offsets);
+  for (auto global : m_Program.m_Globals)
+  {
+    m_Globals[global] = m_Elf.AddSymbol(global->m_Symbol, ElfWriter::Section::Bss, m_Elf.m_BssSize, 8, global->m_IsPub, false);
+    m_Elf.m_BssSize += 8;
+  }
+  for (auto function : m_Program.m_Functions)
+  {
+    auto section = function->IsExtern() ? ElfWriter::Section::Undef : ElfWriter::Section::Text;
+    m_Functions[function] = m_Elf.AddSymbol(function->m_Symbol, section, 0, 0, function->IsExtern() || function->m_IsPub, true);
+  }
+  for (auto function : m_Program.m_Functions)
+  {
+    if (!function->IsExtern())
+    {
+      GenFunction(function);
+    }
+  }
+  GenEntry();
+  return m_Elf.Write();
+}
+
+void X64Generator::GenFunction(const ir::Function *function)
+{
+  while (m_Elf.m_Text.size() % 16)
+  {
+    m_Elf.m_Text.push_back(0x90);
+  }
+  auto &symbol = m_Elf.m_Symbols.at(m_Functions.at(function));
+  symbol.m_Value = m_Elf.m_Text.size();
+  FunctionGen(function, m_Elf, m_Functions, m_Globals, m_Strings).Generate();
+  m_Elf.m_Symbols.at(m_Functions.at(function)).m_Size = m_Elf.m_Text.size() - m_Elf.m_Symbols.at(m_Functions.at(function)).m_Value;
+}
+
+void X64Generator::GenEntry()
+{
+  while (m_Elf.m_Text.size() % 16)
+  {
+    m_Elf.m_Text.push_back(0x90);
+  }
+  auto start = m_Elf.m_Text.size();
+  Assembler as(m_Elf.m_Text);
+  as.Push(RBP);
+  as.MovRR(RBP, RSP);
+  for (auto init : m_Program.m_Inits)
+  {
+    m_Elf.AddReloc(as.CallRel(), m_Functions.at(init), R_X86_64_PLT32, -4);
+  }
+  as.XorEaxEax();
+  if (m_Program.m_Main)
+  {
+    m_Elf.AddReloc(as.CallRel(), m_Functions.at(m_Program.m_Main), R_X86_64_PLT32, -4);
+    if (!ir::IsInt(m_Program.m_Main->m_RetTy))
+    {
+      as.XorEaxEax();
+    }
+  }
+  as.Pop(RBP);
+  as.Ret();
+  m_Elf.AddSymbol("main", ElfWriter::Section::Text, start, m_Elf.m_Text.size() - start, true, true);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.h"
+#include "object.h"
+
+/*
+  Native x86-64 code generator. Values get registers from a linear scan over
+  the function in layout order, the ones living across a call only get
+  callee saved registers, the rest spill to the frame. Calls follow the
+  System V ABI and external functions are left as undefined symbols for the
+  linker. The result is a relocatable ELF object with a `main` running the
+  module initializers and then the entry module main
+*/
+class X64Generator
+{
+public:
+  X64Generator(const ir::Program &program) : m_Program(program), m_Elf(), m_Functions(), m_Globals(), m_Strings() {};
+
+  // bytes of the object file
+  std::vector<uint8_t> Generate();
+
+private:
+  const ir::Program &m_Program;
+  ElfWriter m_Elf;
+  std::unordered_map<const ir::Function *, size_t> m_Functions;
+  std::unordered_map<const ir::Global *, size_t> m_Globals;
+  // offset in .rodata of each string literal
+  std::vector<uint64_t> m_Strings;
+
+  void GenFunction(const ir::Function *function);
+  void GenEntry();
+};